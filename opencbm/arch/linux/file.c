@@ -10,6 +10,8 @@
 #include "arch.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 
 /*! \brief Obtain the size of a given file
@@ -44,3 +46,58 @@ int arch_filesize(const char *Filename, off_t *Filesize)
 
     return ret;
 }
+
+/*! \brief Map a file into memory for reading
+
+ \param Filename
+   Name of the file to map.
+
+ \param Filesize
+   Pointer to a location which will be set to the size of the
+   file on successfull termination.
+
+ \return
+   Pointer to the contents of the file, NULL if an error occurred.
+   The mapping has to be released with arch_unmap_file().
+*/
+
+const void *arch_map_file(const char *Filename, size_t *Filesize)
+{
+    struct stat statrec;
+    void *data = NULL;
+    int fd;
+
+    fd = open(Filename, O_RDONLY);
+
+    if (fd >= 0)
+    {
+        if (fstat(fd, &statrec) == 0 && statrec.st_size > 0)
+        {
+            data = mmap(NULL, statrec.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (data == MAP_FAILED)
+                data = NULL;
+            else
+                *Filesize = statrec.st_size;
+        }
+
+        /* the mapping stays valid after closing the file */
+        close(fd);
+    }
+
+    return data;
+}
+
+/*! \brief Release a file mapping
+
+ \param Data
+   Pointer to the contents of the file, as returned by arch_map_file().
+
+ \param Filesize
+   The size of the file, as returned by arch_map_file().
+*/
+
+void arch_unmap_file(const void *Data, size_t Filesize)
+{
+    munmap((void *) Data, Filesize);
+}
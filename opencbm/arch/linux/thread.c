@@ -0,0 +1,107 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 2026 OpenCBM team
+ *
+*/
+
+/*! **************************************************************
+** \file arch/linux/thread.c \n
+** \author OpenCBM team \n
+** \n
+** \brief Helper functions for running worker threads
+**
+****************************************************************/
+
+#include "arch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*! \internal \brief The data of a worker thread */
+struct arch_thread_s
+{
+    pthread_t thread;              /*!< the pthread of this worker */
+    ARCH_THREAD_FUNCTION function; /*!< the function the thread executes */
+    void *context;                 /*!< the parameter of the function */
+};
+
+static void *
+thread_entry(void *Parameter)
+{
+    struct arch_thread_s *thread = Parameter;
+
+    thread->function(thread->context);
+
+    return NULL;
+}
+
+/*! \brief Start a worker thread
+
+ \param Thread
+   Pointer to a location which will get the handle of the thread.
+
+ \param Function
+   The function the thread executes.
+
+ \param Context
+   The parameter which is given to Function.
+
+ \return
+   0 on success, everything else denotes an error.
+
+ The thread has to be waited for with arch_thread_join().
+*/
+
+int
+arch_thread_start(ARCH_THREAD *Thread, ARCH_THREAD_FUNCTION Function, void *Context)
+{
+    struct arch_thread_s *thread;
+
+    thread = malloc(sizeof(*thread));
+    if (thread == NULL)
+        return 1;
+
+    thread->function = Function;
+    thread->context = Context;
+
+    if (pthread_create(&thread->thread, NULL, thread_entry, thread) != 0)
+    {
+        free(thread);
+        return 1;
+    }
+
+    *Thread = thread;
+    return 0;
+}
+
+/*! \brief Wait for a worker thread to finish
+
+ \param Thread
+   The handle of the thread, as returned by arch_thread_start().
+   It is invalid afterwards.
+*/
+
+void
+arch_thread_join(ARCH_THREAD Thread)
+{
+    pthread_join(Thread->thread, NULL);
+    free(Thread);
+}
+
+/*! \brief Get the number of processors
+
+ \return
+   The number of processors which are online, at least 1.
+*/
+
+unsigned int
+arch_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (count > 0) ? (unsigned int) count : 1;
+}
@@ -50,3 +50,67 @@ int arch_filesize(const char *Filename, off_t *Filesize)
 
     return ret;
 }
+
+/*! \brief Map a file into memory for reading
+
+ \param Filename
+   Name of the file to map.
+
+ \param Filesize
+   Pointer to a location which will be set to the size of the
+   file on successfull termination.
+
+ \return
+   Pointer to the contents of the file, NULL if an error occurred.
+   The mapping has to be released with arch_unmap_file().
+*/
+
+const void *arch_map_file(const char *Filename, size_t *Filesize)
+{
+    HANDLE hFile, hMapping;
+    DWORD sizeLow, sizeHigh;
+    const void *data = NULL;
+
+    hFile = CreateFile(Filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        sizeLow = GetFileSize(hFile, &sizeHigh);
+
+        /* empty files cannot be mapped, and we only map what fits into the address space */
+        if (sizeLow != INVALID_FILE_SIZE && sizeLow > 0 && (sizeof(size_t) > 4 || sizeHigh == 0))
+        {
+            hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+            if (hMapping != NULL)
+            {
+                data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+                if (data != NULL)
+                    *Filesize = (size_t) (((ULONGLONG) sizeHigh << 32) | sizeLow);
+
+                /* the view stays valid after closing the handles */
+                CloseHandle(hMapping);
+            }
+        }
+
+        CloseHandle(hFile);
+    }
+
+    return data;
+}
+
+/*! \brief Release a file mapping
+
+ \param Data
+   Pointer to the contents of the file, as returned by arch_map_file().
+
+ \param Filesize
+   The size of the file, as returned by arch_map_file().
+*/
+
+void arch_unmap_file(const void *Data, size_t Filesize)
+{
+    UnmapViewOfFile(Data);
+}
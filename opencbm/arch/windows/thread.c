@@ -0,0 +1,113 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 2026 OpenCBM team
+ *
+*/
+
+/*! **************************************************************
+** \file arch/windows/thread.c \n
+** \author OpenCBM team \n
+** \n
+** \brief Helper functions for running worker threads
+**
+****************************************************************/
+
+#include <windows.h>
+
+#include <stdlib.h>
+
+#include "arch.h"
+
+/*! \internal \brief The data of a worker thread */
+struct arch_thread_s
+{
+    HANDLE thread;                 /*!< the handle of this worker */
+    ARCH_THREAD_FUNCTION function; /*!< the function the thread executes */
+    void *context;                 /*!< the parameter of the function */
+};
+
+static DWORD WINAPI
+thread_entry(LPVOID Parameter)
+{
+    struct arch_thread_s *thread = Parameter;
+
+    thread->function(thread->context);
+
+    return 0;
+}
+
+/*! \brief Start a worker thread
+
+ \param Thread
+   Pointer to a location which will get the handle of the thread.
+
+ \param Function
+   The function the thread executes.
+
+ \param Context
+   The parameter which is given to Function.
+
+ \return
+   0 on success, everything else denotes an error.
+
+ The thread has to be waited for with arch_thread_join().
+*/
+
+int
+arch_thread_start(ARCH_THREAD *Thread, ARCH_THREAD_FUNCTION Function, void *Context)
+{
+    struct arch_thread_s *thread;
+    DWORD threadId;
+
+    thread = malloc(sizeof(*thread));
+    if (thread == NULL)
+        return 1;
+
+    thread->function = Function;
+    thread->context = Context;
+
+    thread->thread = CreateThread(NULL, 0, thread_entry, thread, 0, &threadId);
+    if (thread->thread == NULL)
+    {
+        free(thread);
+        return 1;
+    }
+
+    *Thread = thread;
+    return 0;
+}
+
+/*! \brief Wait for a worker thread to finish
+
+ \param Thread
+   The handle of the thread, as returned by arch_thread_start().
+   It is invalid afterwards.
+*/
+
+void
+arch_thread_join(ARCH_THREAD Thread)
+{
+    WaitForSingleObject(Thread->thread, INFINITE);
+    CloseHandle(Thread->thread);
+    free(Thread);
+}
+
+/*! \brief Get the number of processors
+
+ \return
+   The number of processors of the machine, at least 1.
+*/
+
+unsigned int
+arch_cpu_count(void)
+{
+    SYSTEM_INFO systemInfo;
+
+    GetSystemInfo(&systemInfo);
+
+    return (systemInfo.dwNumberOfProcessors > 0) ? systemInfo.dwNumberOfProcessors : 1;
+}
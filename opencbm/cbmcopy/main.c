@@ -112,7 +112,9 @@ static void help(const char *prog)
 "                             connected to the IEC bus;\n"
 "                             `parallel' needs a XP1541/XP1571 cable in addition\n"
 "                             to the serial one.\n"
-"                             `auto' tries to determine the best option.\n"
+"                             `auto' tries to determine the best option;\n"
+"                             it reads from 1571/1581 drives with their\n"
+"                             burst fastload if the adapter can do that.\n"
 "  -d, --drive-type=TYPE      specify drive type, one of:\n"
 "                               1541, 1570, 1571, 1581\n"
 "  -a, --address=ADDRESS      override file start address\n"
@@ -187,6 +189,7 @@ int ARCH_MAINDECL main(int argc, char **argv)
     int i;
     int write;
     cbmcopy_settings *settings;
+    cbmcopy_session *session;
     char auto_name[17];
     char auto_type = '\0';
     char output_type = '\0';
@@ -442,16 +445,20 @@ int ARCH_MAINDECL main(int argc, char **argv)
     {
         fd_cbm = fd;
 
+        arch_set_ctrlbreak_handler(reset);
+
         /*
-         * If the user specified auto transfer mode, find out
-         * which transfer mode to use.
+         * keep the turbo resident in the drive for all files. If the
+         * user specified auto transfer mode, this finds out which
+         * transfer mode to use.
          */
-        settings->transfer_mode = 
-            cbmcopy_check_auto_transfer_mode(fd_cbm,
-                settings->transfer_mode,
-                drive);
-
-        arch_set_ctrlbreak_handler(reset);
+        session = cbmcopy_session_open(fd, settings, drive);
+        if(NULL == session)
+        {
+            cbm_driver_close( fd );
+            my_message_cb(sev_fatal, "Out of memory");
+            exit(1);
+        }
 
         while(++optind < argc)
         {
@@ -515,7 +522,7 @@ int ARCH_MAINDECL main(int argc, char **argv)
                                                filedata[1], filedata[0] );
 
                             }
-                            if(cbmcopy_write_file(fd, settings, drive,
+                            if(cbmcopy_session_write_file(session,
                                                   buf, strlen(buf),
                                                   filedata, filesize,
                                                   my_message_cb,
@@ -590,6 +597,7 @@ int ARCH_MAINDECL main(int argc, char **argv)
                 else
                 {
                     /* should not happen... */
+                    cbmcopy_session_close( session );
                     cbm_driver_close( fd );
                     my_message_cb(sev_fatal, "Out of memory");
                     exit(1);
@@ -597,7 +605,7 @@ int ARCH_MAINDECL main(int argc, char **argv)
 
                 my_message_cb( sev_info, "reading %s -> %s", buf, fs_name );
 
-                if(cbmcopy_read_file(fd, settings, drive, buf, strlen(buf),
+                if(cbmcopy_session_read_file(session, buf, strlen(buf),
                                      &filedata, &filesize,
                                      my_message_cb, my_status_cb) == 0)
                 {
@@ -649,6 +657,7 @@ int ARCH_MAINDECL main(int argc, char **argv)
                 }
             }
         }
+        cbmcopy_session_close( session );
         cbm_driver_close( fd );
 
         if(rv)
@@ -13,6 +13,7 @@
 #include "opencbm.h"
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
@@ -20,6 +21,7 @@
 
 #include "arch.h"
 #include "libmisc.h"
+#include "d64copy.h"
 
 typedef
 enum {
@@ -908,7 +910,99 @@ static int do_command(CBM_FILE fd, OPTIONS * const options)
 }
 
 /*
- * display directory
+ * output the directory, as read by cbm_read_dir()
+ */
+static void print_dir(cbm_dir *dir, PETSCII_RAW petsciiraw)
+{
+    static const char *types[8] =
+    {
+        "DEL", "SEQ", "PRG", "USR", "REL", "CBM", "???", "???"
+    };
+    unsigned int i;
+
+    if (petsciiraw == PA_PETSCII)
+    {
+        cbm_petscii2ascii(dir->name);
+        cbm_petscii2ascii(dir->id);
+    }
+    printf("0 \"%-16s\" %s\n", dir->name, dir->id);
+
+    for (i = 0; i < dir->count; i++)
+    {
+        cbm_dirent *entry = &dir->entries[i];
+
+        if (petsciiraw == PA_PETSCII)
+            cbm_petscii2ascii(entry->name);
+
+        printf("%-5u\"%s\"%*s%c%s%c\n",
+            entry->blocks, entry->name, 17 - (int) strlen(entry->name), "",
+            (entry->type & 0x80) ? ' ' : '*',
+            types[entry->type & 0x07],
+            (entry->type & 0x40) ? '<' : ' ');
+    }
+    printf("%u blocks free.\n", dir->blocks_free);
+}
+
+/*
+ * report the messages of the d64copy fast loaders
+ */
+static void dir_message_cb(int severity, const char *format, ...)
+{
+    va_list args;
+
+    if (severity > 1)
+        return;
+
+    va_start(args, format);
+    fprintf(stderr, "%s: ", severity ? "warning" : "error");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/*
+ * read the directory by accessing the directory blocks directly,
+ * through the fast loader of the given d64copy transfer mode
+ */
+static int do_dir_fast(CBM_FILE fd, unsigned char unit, const char *transfer, PETSCII_RAW petsciiraw)
+{
+    d64copy_settings *settings;
+    char buf[40];
+    cbm_dir *dir;
+    int rv;
+
+    settings = d64copy_get_default_settings();
+    if (settings == NULL)
+        return 1;
+
+    settings->transfer_mode = d64copy_get_transfer_mode_index(transfer);
+    if (settings->transfer_mode < 0)
+    {
+        fprintf(stderr, "unknown transfer mode: %s\n", transfer);
+        free(settings);
+        return 1;
+    }
+    settings->transfer_mode =
+        d64copy_check_auto_transfer_mode(fd, settings->transfer_mode, unit);
+
+    rv = d64copy_read_dir(fd, settings, unit, &dir, dir_message_cb);
+    free(settings);
+
+    if (rv == 0)
+    {
+        print_dir(dir, petsciiraw);
+        cbm_free_dir(dir);
+    }
+    if (rv >= 0)
+    {
+        cbm_device_status(fd, unit, buf, sizeof(buf));
+        printf("%s", cbm_petscii2ascii(buf));
+    }
+    return rv;
+}
+
+/*
+ * read the directory and output it
  */
 static int do_dir(CBM_FILE fd, OPTIONS * const options)
 {
@@ -917,9 +1011,38 @@ static int do_dir(CBM_FILE fd, OPTIONS * const options)
     int rv;
     unsigned char unit;
 
-    rv = skip_options(options);
-    
-    rv = rv || get_argument_char(options, &unit);
+    int fast = 0;
+    const char *transfer = NULL;
+    int opt;
+    static const char short_options[] = "+ft:";
+    static struct option long_options[] =
+    {
+        {"fast",     no_argument,       NULL, 'f'},
+        {"transfer", required_argument, NULL, 't'},
+        {NULL,       no_argument,       NULL, 0  }
+    };
+
+    // first of all, process the options given
+
+    while ((opt = process_individual_option(options, short_options, long_options)) != EOF)
+    {
+        switch (opt)
+        {
+        case 'f':
+            fast = 1;
+            break;
+
+        case 't':
+            fast = 1;
+            transfer = optarg;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    rv = get_argument_char(options, &unit);
     /* default is drive '0' */
     if (options->argc > 0)
     {
@@ -929,6 +1052,21 @@ static int do_dir(CBM_FILE fd, OPTIONS * const options)
     if (rv || check_if_parameters_ok(options))
         return 1;
 
+    if (fast && command[1] == '0')
+    {
+        rv = do_dir_fast(fd, unit, transfer, options->petsciiraw);
+
+        if (rv >= 0)
+            return rv;
+
+        /* the drive is not supported: read the directory the usual way */
+        fprintf(stderr, "fast directory not supported for this drive, using \"$\".\n");
+    }
+    else if (fast)
+    {
+        fprintf(stderr, "fast directory only supports drive 0, using \"$\".\n");
+    }
+
     rv = cbm_open(fd, unit, 0, command, sizeof(command));
     if(rv == 0)
     {
@@ -1337,6 +1475,69 @@ static int do_change(CBM_FILE fd, OPTIONS * const options)
     return rv;
 }
 
+/*
+ * set the IEC timing of a drive, from a profile or by calibration
+ */
+static int do_timing(CBM_FILE fd, OPTIONS * const options)
+{
+    static const struct
+    {
+        const char *name;
+        enum cbm_iec_timing_e profile;
+    } profiles[] =
+    {
+        { "1541",      cbm_it_1541 },
+        { "1571",      cbm_it_1571 },
+        { "1581",      cbm_it_1581 },
+        { "fast",      cbm_it_fast },
+        { "calibrate", cbm_it_calibrate },
+        { NULL,        cbm_it_1541 }
+    };
+    unsigned char unit;
+    char *name;
+    int i;
+    int rv;
+
+    rv = skip_options(options);
+    
+    rv = rv || get_argument_char(options, &unit);
+    rv = rv || get_argument_string(options, &name, NULL);
+
+    if (rv || check_if_parameters_ok(options))
+        return 1;
+
+    for (i = 0; profiles[i].name; i++)
+    {
+        if (strcmp(name, profiles[i].name) == 0)
+            break;
+    }
+    if (profiles[i].name == NULL)
+    {
+        fprintf(stderr, "Unknown timing profile '%s', aborting!\n", name);
+        return 1;
+    }
+
+    rv = cbm_iec_timing(fd, unit, profiles[i].profile);
+    if (rv < 0)
+    {
+        fprintf(stderr, "The adapter does not support IEC timing profiles.\n");
+        return 1;
+    }
+    if (rv == 0)
+    {
+        if (profiles[i].profile == cbm_it_calibrate)
+        {
+            fprintf(stderr, "Calibration of drive %u failed.\n", unit);
+            return 1;
+        }
+        printf("%2d: no timing to set\n", unit);
+        return 0;
+    }
+
+    printf("%2d: setup %d us, acknowledge %d us\n", unit, rv & 0xff, (rv >> 8) & 0xff);
+    return 0;
+}
+
 struct prog
 {
     int      need_driver;
@@ -1487,9 +1688,18 @@ static struct prog prog_table[] =
         "NOTE: You have to give the commands in lower-case letters.\n"
         "      Upper case will NOT work!\n" },
 
-    {1, "dir"     , PA_PETSCII, do_dir     , "<device> [<drive>]",
+    {1, "dir"     , PA_PETSCII, do_dir     , "[-f|--fast] [-t|--transfer=<mode>] <device> [<drive>]",
         "output the directory of the disk in the specified drive",
         "This command gets the directory of a disk in the drive.\n\n"
+        "-f, --fast: read the header, BAM and directory blocks directly\n"
+        "            and build the listing on the PC. This is much faster\n"
+        "            than reading \"$\". Only 1541, 1570, 1571 and 1581 are\n"
+        "            supported, on other drives \"$\" is read instead.\n"
+        "-t, --transfer=<mode>: implies -f. Read the blocks with the fast\n"
+        "            loader of this d64copy transfer mode: auto (default),\n"
+        "            original, serial1, serial2 or parallel. The fast\n"
+        "            loaders only work on 1541, 1570 and 1571; on a 1581,\n"
+        "            the blocks are read through the DOS.\n\n"
         "<device> is the device number of the drive (bus ID).\n" 
         "<drive> is the drive number of a dual drive (LUN), default is 0." },
 
@@ -1554,6 +1764,19 @@ static struct prog prog_table[] =
         "Because of this, just opening the drive and closing it again (without\n"
         "actually removing the disk) will not work in most cases." },
 
+    {1, "timing"  , PA_UNSPEC,  do_timing  , "<device> 1541|1571|1581|fast|calibrate",
+        "set the IEC timing the adapter uses with a drive",
+        "This command sets the delays of the standard IEC protocol the adapter\n"
+        "uses with the specified drive. They are sized for a stock 1541 by\n"
+        "default, faster drives get by with less.\n\n"
+        "<device> is the device number of the drive.\n\n"
+        "1541, 1571, 1581 and fast (SD2IEC and the like) select a profile.\n"
+        "calibrate has the adapter find the shortest timing with which it can\n"
+        "read the drive's memory several times without errors. The drive has\n"
+        "to understand \"M-R\".\n\n"
+        "The setting lasts until the adapter is unplugged. Currently, only\n"
+        "the xum1541 supports it." },
+
     {0, NULL, PA_UNSPEC, NULL, NULL, NULL}
 };
 
@@ -47,10 +47,97 @@
 #define CBMCTRL_PARBURST_WRITE_TRACK _IO(CBMCTRL_BASE, 20)
 #define CBMCTRL_PARBURST_READ_TRACK_VAR    _IO(CBMCTRL_BASE, 21)
 
-/* all values needed by PARBURST_READ_TRACK and PARBURST_WRITE_TRACK */
+/* block transfers with the d64copy turbo protocols and parallel burst */
+#define CBMCTRL_S1_READ_N        _IO(CBMCTRL_BASE, 22)
+#define CBMCTRL_S1_WRITE_N       _IO(CBMCTRL_BASE, 23)
+#define CBMCTRL_S2_READ_N        _IO(CBMCTRL_BASE, 24)
+#define CBMCTRL_S2_WRITE_N       _IO(CBMCTRL_BASE, 25)
+#define CBMCTRL_PP_DC_READ_N     _IO(CBMCTRL_BASE, 26)
+#define CBMCTRL_PP_DC_WRITE_N    _IO(CBMCTRL_BASE, 27)
+#define CBMCTRL_PARBURST_READ_N  _IO(CBMCTRL_BASE, 28)
+#define CBMCTRL_PARBURST_WRITE_N _IO(CBMCTRL_BASE, 29)
+
+/* execute a list of the commands above, see CBM_BATCH */
+#define CBMCTRL_BATCH            _IO(CBMCTRL_BASE, 30)
+
+/* pseudo commands which are only valid inside of a CBMCTRL_BATCH */
+#define CBMCTRL_BATCH_READ       _IO(CBMCTRL_BASE, 0x80)
+#define CBMCTRL_BATCH_WRITE      _IO(CBMCTRL_BASE, 0x81)
+
+/* read parallel burst tracks into the mmap-able ring, see CBM_RING_HEADER */
+#define CBMCTRL_RING_READ_TRACK  _IO(CBMCTRL_BASE, 31)
+#define CBMCTRL_RING_RELEASE     _IO(CBMCTRL_BASE, 32)
+
+/* all values needed by PARBURST_READ_TRACK and PARBURST_WRITE_TRACK,
+   and by the *_READ_N and *_WRITE_N block transfers */
 typedef struct PARBURST_RW_VALUE {
 	unsigned char *buffer;
 	int length;
 } PARBURST_RW_VALUE;
 
+/* run this operation even if an earlier one of the batch failed */
+#define CBM_BATCH_ALWAYS 1
+
+/* one operation of a CBMCTRL_BATCH */
+typedef struct CBM_BATCH_OP {
+	unsigned int cmd;	/* CBMCTRL_xxx, or CBMCTRL_BATCH_READ/WRITE */
+	unsigned long arg;	/* ioctl argument */
+	unsigned char *buffer;	/* data for CBMCTRL_BATCH_READ/WRITE */
+	int length;
+	int flags;		/* CBM_BATCH_xxx */
+	int result;		/* filled in by the driver */
+} CBM_BATCH_OP;
+
+/* all values needed by CBMCTRL_BATCH */
+typedef struct CBM_BATCH {
+	CBM_BATCH_OP *ops;
+	int count;
+} CBM_BATCH;
+
+/*
+ * The ring of track buffers: mmap() CBM_RING_SIZE bytes of /dev/cbm at
+ * offset 0. The mapping starts with a CBM_RING_HEADER, slot n starts at
+ * CBM_RING_DATA_OFFSET + n * CBM_RING_SLOT_SIZE.
+ *
+ * Before queueing a read into the free slot n, put the parallel burst
+ * command bytes which make the drive send the track (e.g. step to the
+ * track, then read it) into cmd and cmd_length of the slot. They are
+ * taken when the read is queued.
+ *
+ * CBMCTRL_RING_READ_TRACK with arg = n (| CBM_RING_VAR) queues the read
+ * and returns at once. The driver writes the command bytes and reads
+ * the track directly into the slot; poll() signals POLLIN as soon as a
+ * slot is full. After consuming it, CBMCTRL_RING_RELEASE with arg = n
+ * marks the slot free again. While reads are queued, all other requests
+ * fail with EBUSY, and CBMCTRL_RING_READ_TRACK is not allowed inside of
+ * a CBMCTRL_BATCH.
+ */
+#define CBM_RING_SLOTS       8
+#define CBM_RING_SLOT_SIZE   0x2000
+#define CBM_RING_DATA_OFFSET CBM_RING_SLOT_SIZE
+#define CBM_RING_SIZE        (CBM_RING_DATA_OFFSET + CBM_RING_SLOTS * CBM_RING_SLOT_SIZE)
+
+/* maximum number of command bytes sent before a track is read */
+#define CBM_RING_CMD_SIZE    16
+
+/* read until the 0x55 end marker, like PARBURST_READ_TRACK_VAR */
+#define CBM_RING_VAR         0x100
+
+/* slot states */
+#define CBM_RING_FREE        0
+#define CBM_RING_QUEUED      1
+#define CBM_RING_FULL        2
+
+typedef struct CBM_RING_SLOT {
+	int state;		/* CBM_RING_xxx */
+	int length;		/* number of bytes read */
+	int result;		/* != 0 on success, like PARBURST_READ_TRACK */
+	int cmd_length;		/* number of bytes in cmd */
+	unsigned char cmd[CBM_RING_CMD_SIZE];	/* sent to the drive first */
+} CBM_RING_SLOT;
+
+typedef struct CBM_RING_HEADER {
+	CBM_RING_SLOT slot[CBM_RING_SLOTS];
+} CBM_RING_HEADER;
+
 #endif
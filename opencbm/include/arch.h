@@ -111,6 +111,16 @@ typedef bool BOOL;
 
 int arch_filesize(const char *Filename, off_t *Filesize);
 
+const void *arch_map_file(const char *Filename, size_t *Filesize);
+void arch_unmap_file(const void *Data, size_t Filesize);
+
+typedef struct arch_thread_s *ARCH_THREAD;
+typedef void (*ARCH_THREAD_FUNCTION)(void *Context);
+
+int arch_thread_start(ARCH_THREAD *Thread, ARCH_THREAD_FUNCTION Function, void *Context);
+void arch_thread_join(ARCH_THREAD Thread);
+unsigned int arch_cpu_count(void);
+
 #define arch_strdup(_x) ARCH_CBM_LINUX_WIN(strdup(_x), _strdup(_x))
 
 #define arch_fileno(_x) ARCH_CBM_LINUX_WIN(fileno(_x), _fileno(_x))
@@ -20,8 +20,18 @@ typedef struct
 {
     int transfer_mode;
     enum cbm_device_type_e drive_type;
+    int burst_load;     /* with "auto", read from 1571/1581 with their burst fastload, if possible */
 } cbmcopy_settings;
 
+/*
+ * a copy session keeps the turbo code resident in the drive across
+ * several files. It holds the drive buffers of the turbo with two
+ * direct access channels (secondary addresses 2 and 3), so the files
+ * opened through DOS cannot overwrite it. The turbo is only uploaded
+ * again after an error, or if the DOS has no buffer to spare.
+ */
+typedef struct cbmcopy_session_s cbmcopy_session;
+
 typedef enum
 {
     sev_fatal,
@@ -97,6 +107,35 @@ extern int cbmcopy_read_file_ts(CBM_FILE cbm_fd,
                                 cbmcopy_message_cb msg_cb,
                                 cbmcopy_status_cb status_cb);
 
+/*
+ * returns malloc()'d session for copying several files to or from
+ * the given drive. settings must stay valid as long as the session
+ * is open. Must be closed with cbmcopy_session_close() after use.
+ * An "auto" transfer mode in settings is replaced by the one
+ * cbmcopy_check_auto_transfer_mode() picks.
+ */
+extern cbmcopy_session *cbmcopy_session_open(CBM_FILE cbm_fd,
+                                             cbmcopy_settings *settings,
+                                             int drive);
+
+extern void cbmcopy_session_close(cbmcopy_session *session);
+
+extern int cbmcopy_session_write_file(cbmcopy_session *session,
+                                      const char *cbmname,
+                                      int cbmname_size,
+                                      const unsigned char *filedata,
+                                      int filedata_size,
+                                      cbmcopy_message_cb msg_cb,
+                                      cbmcopy_status_cb status_cb);
+
+extern int cbmcopy_session_read_file(cbmcopy_session *session,
+                                     const char *cbmname,
+                                     int cbmname_size,
+                                     unsigned char **filedata,
+                                     size_t *filedata_size,
+                                     cbmcopy_message_cb msg_cb,
+                                     cbmcopy_status_cb status_cb);
+
 #ifdef __cplusplus
 }
 #endif
@@ -135,6 +135,18 @@ extern int d64copy_write_image(CBM_FILE cbm_fd,
                                d64copy_message_cb msg_cb,
                                d64copy_status_cb status_cb);
 
+/*
+ * read the directory of a 1541/1570/1571 disk with the fast loader of
+ * the given transfer mode, which must not be "auto". Other drives and
+ * the "original" transfer mode read it through the DOS instead.
+ * The directory must be free()'d with cbm_free_dir() after use.
+ */
+extern int d64copy_read_dir(CBM_FILE cbm_fd,
+                            d64copy_settings *settings,
+                            int src_drive,
+                            cbm_dir **dir,
+                            d64copy_message_cb msg_cb);
+
 extern void d64copy_cleanup(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,101 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+#ifndef NIBCOPY_H
+#define NIBCOPY_H
+
+/* last track a 1541 head reaches safely */
+#define NIB_MAX_TRACKS      42
+/* halftrack numbers are track * 2, from 2 (track 1) */
+#define NIB_MAX_HALFTRACKS  (NIB_MAX_TRACKS * 2)
+
+/* bytes read per track, a bit more than one revolution */
+#define NIB_TRACK_LENGTH    0x2000
+
+/* largest track in a .g64 image */
+#define G64_TRACK_MAXLEN    7928
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  image file formats
+ */
+typedef enum
+{
+    nf_g64 = 0,     /* one revolution per track  */
+    nf_nib = 1      /* raw reads, nibtools style */
+} nibcopy_format;
+
+typedef struct
+{
+    int start_track;
+    int end_track;
+    int half_tracks;
+    int retries;
+    int density_scan;   /* find the density of each track */
+    nibcopy_format format;
+    enum cbm_device_type_e drive_type;
+} nibcopy_settings;
+
+typedef struct
+{
+    int halftrack;      /* 0: start of transfer */
+    int density;
+    int length;         /* one revolution in bytes, 0 if none found */
+    int formatted;
+    int tracks_processed;
+    int total_tracks;
+    nibcopy_settings *settings;
+} nibcopy_status;
+
+typedef enum
+{
+    sev_fatal,
+    sev_warning,
+    sev_info,
+    sev_debug
+} nibcopy_severity_e;
+
+typedef void (*nibcopy_message_cb)(int nibcopy_severity_e, const char *format, ...);
+typedef int (*nibcopy_status_cb)(nibcopy_status status);
+
+/*
+ * returns malloc()'d pointer to default settings.
+ * must be free()'d after use.
+ */
+extern nibcopy_settings *nibcopy_get_default_settings(void);
+
+/*
+ * parse format name ("g64", "nib"), abbreviations are possible.
+ * returns -1 if unknown.
+ */
+extern int nibcopy_get_format_index(const char *name);
+
+/*
+ * read all (half) tracks of the disk in src_drive into a .g64 or .nib
+ * image. Needs a 1541, 1570 or 1571 with a parallel cable, or a 1570
+ * or 1571 and an adapter with SRQ. Returns the number of tracks read,
+ * or -1 on error.
+ */
+extern int nibcopy_read_image(CBM_FILE cbm_fd,
+                              nibcopy_settings *settings,
+                              int src_drive,
+                              const char *dst_image,
+                              nibcopy_message_cb msg_cb,
+                              nibcopy_status_cb status_cb);
+
+extern void nibcopy_cleanup(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* NIBCOPY_H */
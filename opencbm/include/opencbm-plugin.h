@@ -336,12 +336,164 @@ typedef int CBMAPIDECL opencbm_plugin_tap_wait_for_play_sense_t(CBM_FILE HandleD
 typedef int CBMAPIDECL opencbm_plugin_tap_motor_on_t(CBM_FILE HandleDevice, int *Status);
 typedef int CBMAPIDECL opencbm_plugin_tap_motor_off_t(CBM_FILE HandleDevice, int *Status);
 typedef int CBMAPIDECL opencbm_plugin_tap_start_capture_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead);
+typedef int CBMAPIDECL opencbm_plugin_tap_start_capture_stream_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_cb Callback, void *Context, int *Status, int *BytesRead);
 typedef int CBMAPIDECL opencbm_plugin_tap_start_write_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten);
+typedef int CBMAPIDECL opencbm_plugin_tap_start_write_stream_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_write_cb Callback, void *Context, int *Status, int *BytesWritten);
 typedef int CBMAPIDECL opencbm_plugin_tap_get_ver_t(CBM_FILE HandleDevice, int *Status);
 typedef int CBMAPIDECL opencbm_plugin_tap_download_config_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead);
 typedef int CBMAPIDECL opencbm_plugin_tap_upload_config_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten);
 typedef int CBMAPIDECL opencbm_plugin_tap_break_t(CBM_FILE HandleDevice);
 
+/*! \brief Execute a command in the floppy drive with one call into the backend
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Command
+   Pointer to the command to be executed.
+
+ \param Size
+   The length of the command in bytes.
+
+ \return
+   0 on success.
+
+ \remark
+   This function is optional. If it is not available,
+   cbm_exec_command() uses listen, raw_write and unlisten.
+*/
+typedef int CBMAPIDECL opencbm_plugin_exec_command_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, const void *Command, size_t Size);
+
+/*! \brief Read the error channel of a floppy drive with one call into the backend
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Buffer
+   Pointer to a buffer which will hold the status string.
+
+ \param BufferLength
+   The length of the Buffer in bytes.
+
+ \return
+   The number of bytes read, or -1 if the device did not talk.
+
+ \remark
+   This function is optional. If it is not available,
+   cbm_device_status() uses talk, raw_read and untalk.
+*/
+typedef int CBMAPIDECL opencbm_plugin_device_status_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, void *Buffer, size_t BufferLength);
+
+/*! \brief Start a burst fastload on a 1571 or 1581 floppy drive
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Command
+   Pointer to the burst command ("U0", 0x1f and the file name).
+
+ \param Size
+   The length of the command in bytes.
+
+ \return
+   0 on success, -1 if the adapter cannot do fast serial
+   transfers. In this case, nothing was sent on the bus.
+
+ \remark
+   This function is optional. The backend must announce itself as a
+   fast serial host while it sends the command.
+*/
+typedef int CBMAPIDECL opencbm_plugin_burst_load_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, const void *Command, size_t Size);
+
+/*! \brief Read one block of a burst fastload
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which will hold the block as it was sent
+   by the drive, starting with the status byte.
+
+ \param Length
+   The length of the Buffer in bytes, at least 256.
+
+ \return
+   The number of bytes read, or -1 on error.
+
+ \remark
+   This function is optional. It must be available if
+   opencbm_plugin_burst_load() is.
+*/
+typedef int CBMAPIDECL opencbm_plugin_burst_load_block_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length);
+
+/*! \brief Read disk blocks through the DOS of a floppy drive
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Channel
+   The channel of an open "#" buffer on the drive.
+
+ \param TrackSector
+   Pointer to Count pairs of track and sector.
+
+ \param Count
+   The number of blocks to read.
+
+ \param Buffer
+   Pointer to a buffer of Count * 256 bytes for the data.
+
+ \param Status
+   Pointer to Count bytes for the DOS error number of each
+   block, 0xff if the drive did not answer.
+
+ \return
+   0 on success, -1 if the adapter cannot read the blocks
+   itself. In this case, nothing was sent on the bus.
+
+ \remark
+   This function is optional. The backend runs "U1", reads the
+   error channel, runs "B-P" and reads the data for each block,
+   as the caller would do otherwise.
+*/
+typedef int CBMAPIDECL opencbm_plugin_read_blocks_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Channel, const unsigned char *TrackSector, unsigned int Count, unsigned char *Buffer, unsigned char *Status);
+
+/*! \brief Set the IEC timing the adapter uses with a device
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Profile
+   One of the XUM_IEC_PROFILE_* values: a timing profile for a
+   drive type, or XUM_IEC_PROFILE_CALIBRATE to have the adapter
+   find the shortest timing the device takes without errors.
+
+ \return
+   The timing in use: the bit setup time in the low byte, the
+   acknowledge time in the high byte (us). 0 if there is nothing
+   to set (IEEE-488) or calibration failed, -1 if the adapter
+   does not support it.
+
+ \remark
+   This function is optional.
+*/
+typedef int CBMAPIDECL opencbm_plugin_iec_timing_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, int Profile);
+
 /*! \brief read a block of data from the OpenCBM backend with protocol serial-1
 
  \param HandleDevice  
@@ -599,6 +751,18 @@ struct opencbm_plugin_s {
     opencbm_plugin_tap_upload_config_t          * opencbm_plugin_tap_upload_config;       /*!< pointer to a opencbm_plugin_tap_upload_config_t() function */
     opencbm_plugin_tap_break_t                  * opencbm_plugin_tap_break;               /*!< pointer to a opencbm_plugin_tap_break_t() function */
 
+    opencbm_plugin_tap_start_capture_stream_t   * opencbm_plugin_tap_start_capture_stream; /*!< pointer to a opencbm_plugin_tap_start_capture_stream_t() function */
+    opencbm_plugin_tap_start_write_stream_t     * opencbm_plugin_tap_start_write_stream;   /*!< pointer to a opencbm_plugin_tap_start_write_stream_t() function */
+
+    opencbm_plugin_exec_command_t               * opencbm_plugin_exec_command;            /*!< pointer to a opencbm_plugin_exec_command_t() function */
+    opencbm_plugin_device_status_t              * opencbm_plugin_device_status;           /*!< pointer to a opencbm_plugin_device_status_t() function */
+
+    opencbm_plugin_burst_load_t                 * opencbm_plugin_burst_load;              /*!< pointer to a opencbm_plugin_burst_load_t() function */
+    opencbm_plugin_burst_load_block_t           * opencbm_plugin_burst_load_block;        /*!< pointer to a opencbm_plugin_burst_load_block_t() function */
+
+    opencbm_plugin_read_blocks_t                * opencbm_plugin_read_blocks;             /*!< pointer to a opencbm_plugin_read_blocks_t() function */
+    opencbm_plugin_iec_timing_t                 * opencbm_plugin_iec_timing;              /*!< pointer to a opencbm_plugin_iec_timing_t() function */
+
 } opencbm_plugin_t;
 
 #endif // #ifndef OPENCBM_PLUGIN_H
@@ -136,6 +136,36 @@ enum cbm_cable_type_e
     cbm_ct_xp1541        /*!< The device does have a parallel cable */
 };
 
+/*! Specifies the IEC timing for cbm_iec_timing() */
+enum cbm_iec_timing_e
+{
+    cbm_it_1541 = 0,     /*!< Timing of a stock 1541, safe for all drives */
+    cbm_it_1571,         /*!< Timing for a 1571 */
+    cbm_it_1581,         /*!< Timing for a 1581 */
+    cbm_it_fast,         /*!< Timing for SD2IEC and other modern drives */
+    cbm_it_calibrate = 0xff /*!< Find the shortest timing that works */
+};
+
+/*! One entry of a disk directory, as returned by cbm_read_dir() */
+typedef struct cbm_dirent_s
+{
+    unsigned char type;       /*!< The file type byte as stored on disk: bit 7 = closed, bit 6 = locked, bits 0-2 = DEL, SEQ, PRG, USR, REL, CBM */
+    unsigned char track;      /*!< The track of the first block of the file */
+    unsigned char sector;     /*!< The sector of the first block of the file */
+    unsigned short blocks;    /*!< The size of the file in blocks */
+    char name[17];            /*!< The file name (PETSCII), without padding, '\0'-terminated */
+} cbm_dirent;
+
+/*! A disk directory, as returned by cbm_read_dir() */
+typedef struct cbm_dir_s
+{
+    char name[17];            /*!< The disk name (PETSCII), without padding, '\0'-terminated */
+    char id[6];               /*!< The disk ID and the DOS type (PETSCII), '\0'-terminated */
+    unsigned int blocks_free; /*!< The number of free blocks, as DOS reports them */
+    unsigned int count;       /*!< The number of entries in the directory */
+    cbm_dirent *entries;      /*!< The entries of the directory */
+} cbm_dir;
+
 /*! \todo FIXME: port isn't used yet */
 EXTERN int CBMAPIDECL cbm_driver_open(CBM_FILE *f, int port);
 EXTERN int CBMAPIDECL cbm_driver_open_ex(CBM_FILE *f, char * adapter);
@@ -173,6 +203,7 @@ EXTERN void CBMAPIDECL cbm_iec_set(CBM_FILE f, int line);
 EXTERN void CBMAPIDECL cbm_iec_release(CBM_FILE f, int line);
 EXTERN void CBMAPIDECL cbm_iec_setrelease(CBM_FILE f, int set, int release);
 EXTERN int CBMAPIDECL cbm_iec_wait(CBM_FILE f, int line, int state);
+EXTERN int CBMAPIDECL cbm_iec_timing(CBM_FILE f, unsigned char dev, enum cbm_iec_timing_e profile);
 
 EXTERN int CBMAPIDECL cbm_upload(CBM_FILE f, unsigned char dev, int adr, const void *prog, size_t size);
 EXTERN int CBMAPIDECL cbm_download(CBM_FILE f, unsigned char dev, int adr, void *dbuf, size_t size);
@@ -180,6 +211,12 @@ EXTERN int CBMAPIDECL cbm_download(CBM_FILE f, unsigned char dev, int adr, void
 EXTERN int CBMAPIDECL cbm_device_status(CBM_FILE f, unsigned char dev, void *buf, size_t bufsize);
 EXTERN int CBMAPIDECL cbm_exec_command(CBM_FILE f, unsigned char dev, const void *cmd, size_t len);
 
+EXTERN int CBMAPIDECL cbm_burst_load(CBM_FILE f, unsigned char dev, const void *name, size_t len);
+EXTERN int CBMAPIDECL cbm_burst_load_block(CBM_FILE f, unsigned char *buf);
+EXTERN int CBMAPIDECL cbm_read_blocks(CBM_FILE f, unsigned char dev, unsigned char channel,
+                                     const unsigned char *ts, unsigned int count,
+                                     unsigned char *buf, unsigned char *status);
+
 EXTERN int CBMAPIDECL cbm_identify(CBM_FILE f, unsigned char drv,
                                    enum cbm_device_type_e *t,
                                    const char **type_str);
@@ -189,6 +226,19 @@ EXTERN int CBMAPIDECL cbm_identify_xp1541(CBM_FILE HandleDevice,
                                           enum cbm_device_type_e *CbmDeviceType,
                                           enum cbm_cable_type_e *CableType);
 
+EXTERN int CBMAPIDECL cbm_read_dir(CBM_FILE HandleDevice,
+                                   unsigned char DeviceAddress,
+                                   cbm_dir **Directory);
+
+/*! \brief callback for cbm_read_dir_ex(): reads the 256 bytes of a block into Buffer; returns 0 on success */
+typedef int (*cbm_dir_read_block_cb)(void *Context, unsigned char Track, unsigned char Sector, unsigned char *Buffer);
+
+EXTERN int CBMAPIDECL cbm_read_dir_ex(enum cbm_device_type_e DeviceType,
+                                      cbm_dir_read_block_cb ReadBlock,
+                                      void *Context,
+                                      cbm_dir **Directory);
+EXTERN void CBMAPIDECL cbm_free_dir(cbm_dir *Directory);
+
 
 EXTERN char CBMAPIDECL cbm_petscii2ascii_c(char character);
 EXTERN char CBMAPIDECL cbm_ascii2petscii_c(char character);
@@ -239,7 +289,17 @@ EXTERN int CBMAPIDECL cbm_tap_get_sense(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_wait_for_stop_sense(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_wait_for_play_sense(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_start_capture(CBM_FILE f, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead);
+
+/*! \brief callback for cbm_tap_start_capture_stream(): gets the capture data as it arrives; return non-zero to abort the capture */
+typedef int (*cbm_tap_capture_cb)(void *Context, const unsigned char *Data, unsigned int Length);
+
+EXTERN int CBMAPIDECL cbm_tap_start_capture_stream(CBM_FILE f, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_cb Callback, void *Context, int *Status, int *BytesRead);
 EXTERN int CBMAPIDECL cbm_tap_start_write(CBM_FILE f, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten);
+
+/*! \brief callback for cbm_tap_start_write_stream(): fills the buffer with the next write data; returns the number of bytes, 0 at the end, or < 0 to abort the write */
+typedef int (*cbm_tap_write_cb)(void *Context, unsigned char *Data, unsigned int Length);
+
+EXTERN int CBMAPIDECL cbm_tap_start_write_stream(CBM_FILE f, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_write_cb Callback, void *Context, int *Status, int *BytesWritten);
 EXTERN int CBMAPIDECL cbm_tap_motor_on(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_motor_off(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_get_ver(CBM_FILE f, int *Status);
@@ -111,6 +111,10 @@ SOURCE=..\detectxp1541.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\dir.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\gcr_4b5b.c
 # End Source File
 # Begin Source File
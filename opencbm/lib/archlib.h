@@ -67,6 +67,10 @@ EXTERN opencbm_plugin_parallel_burst_read_n_t      opencbm_plugin_srq_burst_read
 EXTERN opencbm_plugin_parallel_burst_write_n_t     opencbm_plugin_srq_burst_write_n;
 EXTERN opencbm_plugin_parallel_burst_read_track_t  opencbm_plugin_srq_burst_read_track;
 EXTERN opencbm_plugin_parallel_burst_write_track_t opencbm_plugin_srq_burst_write_track;
+EXTERN opencbm_plugin_burst_load_t                opencbm_plugin_burst_load;
+EXTERN opencbm_plugin_burst_load_block_t          opencbm_plugin_burst_load_block;
+EXTERN opencbm_plugin_read_blocks_t               opencbm_plugin_read_blocks;
+EXTERN opencbm_plugin_iec_timing_t                opencbm_plugin_iec_timing;
 
 EXTERN opencbm_plugin_tap_prepare_capture_t        opencbm_plugin_tap_prepare_capture;
 EXTERN opencbm_plugin_tap_prepare_write_t          opencbm_plugin_tap_prepare_write;
@@ -81,6 +85,8 @@ EXTERN opencbm_plugin_tap_get_ver_t                opencbm_plugin_tap_get_ver;
 EXTERN opencbm_plugin_tap_download_config_t        opencbm_plugin_tap_download_config;
 EXTERN opencbm_plugin_tap_upload_config_t          opencbm_plugin_tap_upload_config;
 EXTERN opencbm_plugin_tap_break_t                  opencbm_plugin_tap_break;
+EXTERN opencbm_plugin_tap_start_capture_stream_t   opencbm_plugin_tap_start_capture_stream;
+EXTERN opencbm_plugin_tap_start_write_stream_t     opencbm_plugin_tap_start_write_stream;
 
 EXTERN opencbm_plugin_s1_read_n_t                  opencbm_plugin_s1_read_n;
 EXTERN opencbm_plugin_s1_write_n_t                 opencbm_plugin_s1_write_n;
@@ -26,6 +26,7 @@
 
 #include "debug.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -227,6 +228,39 @@ static struct plugin_read_pointer plugin_pointer_to_read_tape[] =
     PLUGIN_POINTER_END()
 };
 
+static struct plugin_read_pointer plugin_pointer_to_read_tape_stream[] =
+{
+	PLUGIN_POINTER_DEF(opencbm_plugin_tap_start_capture_stream),
+	PLUGIN_POINTER_DEF(opencbm_plugin_tap_start_write_stream),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_batch[] =
+{
+	PLUGIN_POINTER_DEF(opencbm_plugin_exec_command),
+	PLUGIN_POINTER_DEF(opencbm_plugin_device_status),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_burst_load[] =
+{
+	PLUGIN_POINTER_DEF(opencbm_plugin_burst_load),
+	PLUGIN_POINTER_DEF(opencbm_plugin_burst_load_block),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_blocks[] =
+{
+	PLUGIN_POINTER_DEF(opencbm_plugin_read_blocks),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_iec_timing[] =
+{
+	PLUGIN_POINTER_DEF(opencbm_plugin_iec_timing),
+    PLUGIN_POINTER_END()
+};
+
 
 struct plugin_read_pointer_group
 {
@@ -246,6 +280,11 @@ static struct plugin_read_pointer_group read_pointer_group[] =
     { plugin_pointer_to_read_pp_readwrite, PRP_OPTIONAL_ALL_OR_NOTHING },
     { plugin_pointer_to_read_srq_burst, PRP_OPTIONAL_ALL_OR_NOTHING },
     { plugin_pointer_to_read_tape, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_tape_stream, PRP_OPTIONAL },
+    { plugin_pointer_to_read_batch, PRP_OPTIONAL },
+    { plugin_pointer_to_read_burst_load, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_blocks, PRP_OPTIONAL },
+    { plugin_pointer_to_iec_timing, PRP_OPTIONAL },
     { NULL, PRP_OPTIONAL }
 };
 
@@ -1452,6 +1491,47 @@ cbm_iec_wait(CBM_FILE HandleDevice, int Line, int State)
     FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_iec_wait(HandleDevice, Line, State));
 }
 
+/*! \brief Set the IEC timing the adapter uses with a device
+
+ The delays of the standard IEC protocol are sized for a stock
+ 1541. This function lets an adapter that supports it use shorter
+ ones with a faster device, from a profile or by calibration.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Profile
+   The timing profile for the drive type, or cbm_it_calibrate
+   to find the shortest timing the device takes without errors.
+   cbm_it_1541 goes back to the default.
+
+ \return
+   The timing in use: the bit setup time in the low byte, the
+   acknowledge time in the high byte (us). 0 if there is
+   nothing to set or calibration failed, -1 if the adapter
+   does not support it.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_iec_timing(CBM_FILE HandleDevice, unsigned char DeviceAddress, enum cbm_iec_timing_e Profile)
+{
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    if (Plugin_information.Plugin.opencbm_plugin_iec_timing)
+        rv = Plugin_information.Plugin.opencbm_plugin_iec_timing(HandleDevice, DeviceAddress, Profile);
+
+    FUNC_LEAVE_INT(rv);
+}
+
 /*! \brief Get the (logical) state of a line on the IEC serial bus
 
  This function gets the (logical) state of a line on the IEC serial bus.
@@ -1549,7 +1629,21 @@ cbm_device_status(CBM_FILE HandleDevice, unsigned char DeviceAddress,
 
         // Now, ask the drive for its error status:
 
-        if (cbm_talk(HandleDevice, DeviceAddress, 15) == 0)
+        if (Plugin_information.Plugin.opencbm_plugin_device_status)
+        {
+            int bytesRead;
+
+            bytesRead = Plugin_information.Plugin.opencbm_plugin_device_status(
+                HandleDevice, DeviceAddress, bufferToWrite, BufferLength - 1);
+
+            DBG_ASSERT(bytesRead < (int) BufferLength);
+
+            if (bytesRead >= 0)
+            {
+                bufferToWrite[bytesRead] = '\0';
+            }
+        }
+        else if (cbm_talk(HandleDevice, DeviceAddress, 15) == 0)
         {
             unsigned int bytesRead;
             
@@ -1602,13 +1696,211 @@ cbm_exec_command(CBM_FILE HandleDevice, unsigned char DeviceAddress,
     int rv;
 
     FUNC_ENTER();
-    rv = cbm_listen(HandleDevice, DeviceAddress, 15);
-    if(rv == 0) {
-        if(Size == 0) {
-            Size = (size_t) strlen(Command);
+    if(Size == 0) {
+        Size = (size_t) strlen(Command);
+    }
+    if(Plugin_information.Plugin.opencbm_plugin_exec_command) {
+        rv = Plugin_information.Plugin.opencbm_plugin_exec_command(HandleDevice, DeviceAddress, Command, Size);
+    }
+    else {
+        rv = cbm_listen(HandleDevice, DeviceAddress, 15);
+        if(rv == 0) {
+            rv = (size_t) cbm_raw_write(HandleDevice, Command, Size) != Size;
+            cbm_unlisten(HandleDevice);
+        }
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Start a burst fastload of a file
+
+ This function asks a 1571 or 1581 floppy drive to send a file
+ with its burst fastload ("U0" command). This needs no drive code,
+ but the adapter must be able to do fast serial transfers. The
+ blocks of the file are read with cbm_burst_load_block().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Filename
+   Pointer to the name of the file to load.
+
+ \param Size
+   The length of the file name in bytes. If zero, the Filename
+   has to be a null-terminated string.
+
+ \return
+   0 on success, -1 if the burst fastload is not available. In
+   this case, nothing was sent to the drive, and the caller can
+   load the file the usual way. Other values are bus errors.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_burst_load(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+               const void *Filename, size_t Size)
+{
+    unsigned char command[3 + 64];
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    if(Size == 0) {
+        Size = (size_t) strlen(Filename);
+    }
+    if(Plugin_information.Plugin.opencbm_plugin_burst_load && Size <= sizeof(command) - 3) {
+        // "U0", then the fastload command: bits 0 - 4 all set
+        command[0] = 'U';
+        command[1] = '0';
+        command[2] = 0x1f;
+        memcpy(command + 3, Filename, Size);
+        rv = Plugin_information.Plugin.opencbm_plugin_burst_load(HandleDevice, DeviceAddress, command, Size + 3);
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Read a block of a burst fastload
+
+ This function reads the next block of a file after
+ cbm_burst_load() has started the fastload.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer of at least 254 bytes which will hold
+   the data of the block.
+
+ \return
+   255 if Buffer holds 254 bytes and more blocks follow,
+   0 - 254 for the number of bytes in the last block,
+   <0 on error. Then, the drive has its reason in the
+   error channel.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_burst_load_block(CBM_FILE HandleDevice, unsigned char *Buffer)
+{
+    unsigned char block[256];
+    int rv = -1;
+    int len;
+
+    FUNC_ENTER();
+
+    if(Plugin_information.Plugin.opencbm_plugin_burst_load_block) {
+        len = Plugin_information.Plugin.opencbm_plugin_burst_load_block(HandleDevice, block, sizeof(block));
+
+        /*
+         * Status 0 and 1 mean 254 bytes follow, 0x1f that this is the
+         * last block, with the count of bytes in it.
+         */
+        if(len == 1 + 254 && block[0] < 2) {
+            memcpy(Buffer, block + 1, 254);
+            rv = 255;
+        }
+        else if(len >= 2 && block[0] == 0x1f && len == 2 + block[1] && block[1] < 255) {
+            memcpy(Buffer, block + 2, block[1]);
+            rv = block[1];
+        }
+        else {
+            DBG_WARN((DBG_PREFIX "burst load status %02x, %d bytes", len > 0 ? block[0] : 0, len));
+        }
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Read disk blocks through the DOS of a floppy drive
+
+ This function reads blocks into memory the way the "original"
+ transfer mode of d64copy does: For each block, it sends "U1" to
+ the command channel, reads the error channel, sends "B-P" and
+ reads the 256 bytes from the buffer. If the plugin can do these
+ steps in the adapter, it saves the round trips to the host.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Channel
+   The channel of a buffer the caller opened with "#".
+
+ \param TrackSector
+   Pointer to Count pairs of track and sector.
+
+ \param Count
+   The number of blocks to read.
+
+ \param Buffer
+   Pointer to a buffer of Count * 256 bytes for the data.
+
+ \param Status
+   Pointer to Count bytes which will hold the DOS error number
+   of each block. The data of a block is only valid if its
+   error number is 0.
+
+ \return
+   0 on success, else failure. A block the drive could
+   not read is not a failure, see Status.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_read_blocks(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                unsigned char Channel, const unsigned char *TrackSector,
+                unsigned int Count, unsigned char *Buffer,
+                unsigned char *Status)
+{
+    char cmd[48];
+    unsigned int i;
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    if(Plugin_information.Plugin.opencbm_plugin_read_blocks) {
+        rv = Plugin_information.Plugin.opencbm_plugin_read_blocks(HandleDevice, DeviceAddress, Channel, TrackSector, Count, Buffer, Status);
+    }
+
+    // Otherwise, do the steps one by one.
+    for(i = 0; rv == -1 && i < Count; i++) {
+        unsigned char *data = Buffer + 256 * i;
+
+        memset(data, 0, 256);
+        sprintf(cmd, "U1:%d 0 %d %d", Channel, TrackSector[2 * i], TrackSector[2 * i + 1]);
+        cbm_exec_command(HandleDevice, DeviceAddress, cmd, 0);
+        Status[i] = (unsigned char) cbm_device_status(HandleDevice, DeviceAddress, cmd, sizeof(cmd));
+        if(Status[i] == 0) {
+            sprintf(cmd, "B-P:%d 0", Channel);
+            cbm_exec_command(HandleDevice, DeviceAddress, cmd, 0);
+            if(cbm_talk(HandleDevice, DeviceAddress, Channel) != 0 ||
+               cbm_raw_read(HandleDevice, data, 256) != 256) {
+                Status[i] = 0xff;
+            }
+            cbm_untalk(HandleDevice);
         }
-        rv = (size_t) cbm_raw_write(HandleDevice, Command, Size) != Size;
-        cbm_unlisten(HandleDevice);
+    }
+    if(rv == -1) {
+        rv = 0;
     }
 
     FUNC_LEAVE_INT(rv);
@@ -2256,6 +2548,56 @@ cbm_tap_start_capture(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int
     FUNC_LEAVE_INT(ret);
 }
 
+/*! \brief TAPE: Start streaming capture
+
+ This function is a helper function for tape:
+ It starts the actual tape capture, but unlike cbm_tap_start_capture(),
+ it does not need a buffer for the whole tape. Instead, the capture
+ data is given to a callback function as soon as it arrives.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which is used for the single chunks.
+
+ \param Buffer_Length
+   The length of the Buffer. The plugin might require a minimum size.
+
+ \param Callback
+   The function which gets the chunks of capture data.
+
+ \param Context
+   A pointer which is given to the Callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_tap_start_capture_stream(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_cb Callback, void *Context, int *Status, int *BytesRead)
+{
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    if (Plugin_information.Plugin.opencbm_plugin_tap_start_capture_stream)
+        ret = Plugin_information.Plugin.opencbm_plugin_tap_start_capture_stream(HandleDevice, Buffer, Buffer_Length, Callback, Context, Status, BytesRead);
+
+    FUNC_LEAVE_INT(ret);
+}
+
 /*! \brief TAPE: Start write
 
  This function is a helper function for tape:
@@ -2298,6 +2640,56 @@ cbm_tap_start_write(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int L
     FUNC_LEAVE_INT(ret);
 }
 
+/*! \brief TAPE: Start streaming write
+
+ This function is a helper function for tape:
+ It starts the actual tape write, but unlike cbm_tap_start_write(),
+ it does not need the whole tape image in memory. Instead, the write
+ data is requested from a callback function while the tape is running.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which is used for the single chunks.
+
+ \param Buffer_Length
+   The length of the Buffer. The plugin might require a minimum size.
+
+ \param Callback
+   The function which fills the chunks of write data.
+
+ \param Context
+   A pointer which is given to the Callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_tap_start_write_stream(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_write_cb Callback, void *Context, int *Status, int *BytesWritten)
+{
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    if (Plugin_information.Plugin.opencbm_plugin_tap_start_write_stream)
+        ret = Plugin_information.Plugin.opencbm_plugin_tap_start_write_stream(HandleDevice, Buffer, Buffer_Length, Callback, Context, Status, BytesWritten);
+
+    FUNC_LEAVE_INT(ret);
+}
+
 
 /*! \brief TAPE: Return tape firmware version
 
@@ -0,0 +1,449 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 2026 OpenCBM team
+ *
+*/
+
+/*! **************************************************************
+** \file lib/dir.c \n
+** \author OpenCBM team \n
+** \n
+** \brief Shared library / DLL for accessing the driver:
+**        Read the directory by accessing the directory sectors
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! mark: We are building the DLL */
+#define DLL
+#include "opencbm.h"
+#include "archlib.h"
+
+/*! the channel (secondary address) used for reading the sectors */
+#define DIR_CHANNEL 2
+
+/*! the maximum number of directory sectors we follow, to catch loops */
+#define DIR_MAX_SECTORS 64
+
+/*! the padding character used in names on disk (shifted space) */
+#define SHIFTED_SPACE 0xA0
+
+/*! \internal \brief Description of the directory layout of a drive */
+typedef struct dir_layout_s
+{
+    unsigned char header_track;  /*!< track which contains the header and the directory */
+    unsigned char dir_sector;    /*!< sector of the first directory block */
+    unsigned char name_offset;   /*!< offset of the disk name in the header block */
+    unsigned char id_offset;     /*!< offset of disk ID and DOS type in the header block */
+} dir_layout;
+
+static const dir_layout layout15x1 = { 18, 1, 0x90, 0xA2 };
+static const dir_layout layout1581 = { 40, 3, 0x04, 0x16 };
+
+/*! \internal \brief The context of dos_read_block() */
+typedef struct dos_reader_s
+{
+    CBM_FILE HandleDevice;        /*!< the file handle of the driver */
+    unsigned char DeviceAddress;  /*!< the address of the device on the IEC serial bus */
+} dos_reader;
+
+/*! \internal \brief Read a block from the disk through the DOS
+
+ This function reads a block with cbm_read_blocks() into the buffer
+ opened on DIR_CHANNEL. It is the block reader of cbm_read_dir().
+
+ \param Context
+   Pointer to the dos_reader of the drive.
+
+ \param Track
+   The track of the block to read.
+
+ \param Sector
+   The sector of the block to read.
+
+ \param Buffer
+   Pointer to a buffer of 256 byte which will contain the block.
+
+ \return
+   0 on success, else an error occurred.
+*/
+static int
+dos_read_block(void *Context, unsigned char Track, unsigned char Sector, unsigned char *Buffer)
+{
+    dos_reader *reader = Context;
+    unsigned char ts[2];
+    unsigned char status;
+    int rv;
+
+    FUNC_ENTER();
+
+    ts[0] = Track;
+    ts[1] = Sector;
+
+    rv = cbm_read_blocks(reader->HandleDevice, reader->DeviceAddress, DIR_CHANNEL,
+                         ts, 1, Buffer, &status);
+
+    DBG_PRINT((DBG_PREFIX "reading %u/%u: %u", Track, Sector, status));
+
+    FUNC_LEAVE_INT(rv || status != 0);
+}
+
+/*! \internal \brief Copy a name from a disk block
+
+ \param Destination
+   Pointer to the buffer which gets the name; it must be
+   able to hold Length + 1 characters.
+
+ \param Source
+   Pointer to the name in the disk block.
+
+ \param Length
+   The maximum length of the name.
+
+ The shifted space padding is removed, the result is '\0'-terminated.
+*/
+static void
+copy_name(char *Destination, const unsigned char *Source, unsigned int Length)
+{
+    while (Length > 0 && Source[Length - 1] == SHIFTED_SPACE)
+    {
+        --Length;
+    }
+    memcpy(Destination, Source, Length);
+    Destination[Length] = '\0';
+}
+
+/*! \internal \brief Count the free blocks of a 1541 or 1571 disk
+
+ \param Bam
+   The header block (18/0), which contains the BAM.
+
+ \return
+   The number of free blocks, excluding the directory track(s).
+*/
+static unsigned int
+blocks_free_15x1(const unsigned char *Bam)
+{
+    unsigned int blocks = 0;
+    unsigned int track;
+
+    for (track = 1; track <= 35; track++)
+    {
+        if (track != 18)
+            blocks += Bam[4 * track];
+    }
+
+    /* double sided 1571 disk: the free counts of side 2 are stored at $DD */
+    if (Bam[3] & 0x80)
+    {
+        for (track = 36; track <= 70; track++)
+        {
+            if (track != 53)
+                blocks += Bam[0xDD + track - 36];
+        }
+    }
+
+    return blocks;
+}
+
+/*! \internal \brief Count the free blocks of a 1581 disk
+
+ \param Bam
+   The two BAM blocks (40/1 and 40/2), one after the other.
+
+ \return
+   The number of free blocks, excluding the directory track.
+*/
+static unsigned int
+blocks_free_1581(const unsigned char *Bam)
+{
+    unsigned int blocks = 0;
+    unsigned int track;
+
+    for (track = 1; track <= 80; track++)
+    {
+        if (track != 40)
+        {
+            const unsigned char *bam = Bam + (track > 40 ? 256 : 0);
+            blocks += bam[0x10 + 6 * ((track - 1) % 40)];
+        }
+    }
+
+    return blocks;
+}
+
+/*! \internal \brief Append the entries of a directory block
+
+ \param Directory
+   The directory to append to.
+
+ \param Block
+   The directory block.
+
+ \return
+   0 on success, else we ran out of memory.
+*/
+static int
+append_entries(cbm_dir *Directory, const unsigned char *Block)
+{
+    const unsigned char *entry;
+    cbm_dirent *entries;
+
+    entries = realloc(Directory->entries, (Directory->count + 8) * sizeof(cbm_dirent));
+    if (entries == NULL)
+        return 1;
+
+    Directory->entries = entries;
+
+    for (entry = Block; entry < Block + 256; entry += 32)
+    {
+        cbm_dirent *dirent;
+
+        /* scratched or never used entry */
+        if (entry[2] == 0)
+            continue;
+
+        dirent = &Directory->entries[Directory->count++];
+
+        dirent->type   = entry[2];
+        dirent->track  = entry[3];
+        dirent->sector = entry[4];
+        dirent->blocks = entry[30] | (entry[31] << 8);
+        copy_name(dirent->name, entry + 5, 16);
+    }
+    return 0;
+}
+
+/*! \brief Read the directory of a disk with a given block reader
+
+ This function reads the header, the BAM and the directory
+ blocks of a disk with the given block reader, and parses them
+ on the host. It allows to read the blocks with a fast loader
+ which is already running in the drive.
+
+ \param DeviceType
+   The type of the drive, as returned by cbm_identify().
+
+ \param ReadBlock
+   The function which reads a block from the disk.
+
+ \param Context
+   The context which is given to ReadBlock.
+
+ \param Directory
+   Pointer to a pointer which will point to the directory.
+   It has to be freed with cbm_free_dir() after use.
+
+ \return
+   0 on success. -1 if the drive type is not supported.
+   Any other value means that ReadBlock failed.
+
+ Currently, 1541, 1570, 1571 and 1581 drives are supported.
+*/
+
+int CBMAPIDECL
+cbm_read_dir_ex(enum cbm_device_type_e DeviceType, cbm_dir_read_block_cb ReadBlock,
+                void *Context, cbm_dir **Directory)
+{
+    const dir_layout *layout;
+    unsigned char block[2 * 256];
+    unsigned char track, sector;
+    cbm_dir *dir;
+    int count;
+    int rv;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(ReadBlock != NULL);
+    DBG_ASSERT(Directory != NULL);
+
+    *Directory = NULL;
+
+    switch (DeviceType)
+    {
+    case cbm_dt_cbm1541:
+    case cbm_dt_cbm1570:
+    case cbm_dt_cbm1571:
+        layout = &layout15x1;
+        break;
+
+    case cbm_dt_cbm1581:
+        layout = &layout1581;
+        break;
+
+    default:
+        FUNC_LEAVE_INT(-1);
+    }
+
+    dir = calloc(1, sizeof(cbm_dir));
+    if (dir == NULL)
+        FUNC_LEAVE_INT(1);
+
+    /* the header block */
+    rv = ReadBlock(Context, layout->header_track, 0, block) != 0;
+
+    if (rv == 0)
+    {
+        unsigned int i;
+
+        copy_name(dir->name, block + layout->name_offset, 16);
+
+        /* ID and DOS type, separated by a shifted space */
+        for (i = 0; i < 5; i++)
+        {
+            unsigned char c = block[layout->id_offset + i];
+            dir->id[i] = (c == SHIFTED_SPACE) ? ' ' : c;
+        }
+        dir->id[5] = '\0';
+
+        if (layout == &layout1581)
+        {
+            rv = ReadBlock(Context, 40, 1, block)
+                || ReadBlock(Context, 40, 2, block + 256);
+
+            if (rv == 0)
+                dir->blocks_free = blocks_free_1581(block);
+        }
+        else
+        {
+            dir->blocks_free = blocks_free_15x1(block);
+        }
+    }
+
+    /* follow the directory chain */
+    track = layout->header_track;
+    sector = layout->dir_sector;
+
+    for (count = 0; rv == 0 && track != 0 && count < DIR_MAX_SECTORS; count++)
+    {
+        rv = ReadBlock(Context, track, sector, block)
+            || append_entries(dir, block);
+
+        track = block[0];
+        sector = block[1];
+    }
+
+    if (rv == 0)
+        *Directory = dir;
+    else
+        cbm_free_dir(dir);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Read the directory of a disk
+
+ This function reads the directory of the disk in the given drive.
+ Unlike loading "$", it reads the header, the BAM and the directory
+ blocks directly, and parses them on the host. This needs far less
+ bus transactions, as every block is transferred in one go.
+
+ The blocks are read through the DOS, with cbm_read_blocks(). To
+ read them with a fast loader, use cbm_read_dir_ex().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Directory
+   Pointer to a pointer which will point to the directory.
+   It has to be freed with cbm_free_dir() after use.
+
+ \return
+   0 on success. -1 if the drive type is not supported; in this
+   case, the caller should fall back to loading "$". Any other
+   value means that there was an error accessing the disk.
+
+ Currently, 1541, 1570, 1571 and 1581 drives are supported.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_read_dir(CBM_FILE HandleDevice, unsigned char DeviceAddress, cbm_dir **Directory)
+{
+    enum cbm_device_type_e deviceType;
+    dos_reader reader;
+    char status[40];
+    int rv;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(Directory != NULL);
+
+    *Directory = NULL;
+
+    if (cbm_identify(HandleDevice, DeviceAddress, &deviceType, NULL) != 0)
+        FUNC_LEAVE_INT(1);
+
+    switch (deviceType)
+    {
+    case cbm_dt_cbm1541:
+    case cbm_dt_cbm1570:
+    case cbm_dt_cbm1571:
+    case cbm_dt_cbm1581:
+        break;
+
+    default:
+        FUNC_LEAVE_INT(-1);
+    }
+
+    reader.HandleDevice = HandleDevice;
+    reader.DeviceAddress = DeviceAddress;
+
+    rv = cbm_open(HandleDevice, DeviceAddress, DIR_CHANNEL, "#", 1);
+
+    if (rv == 0)
+    {
+        rv = cbm_device_status(HandleDevice, DeviceAddress, status, sizeof(status));
+
+        if (rv == 0)
+            rv = cbm_read_dir_ex(deviceType, dos_read_block, &reader, Directory);
+
+        cbm_close(HandleDevice, DeviceAddress, DIR_CHANNEL);
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Free a directory
+
+ This function frees a directory which was read with cbm_read_dir()
+ or cbm_read_dir_ex().
+
+ \param Directory
+   Pointer to the directory. It is allowed to give NULL.
+*/
+
+void CBMAPIDECL
+cbm_free_dir(cbm_dir *Directory)
+{
+    FUNC_ENTER();
+
+    if (Directory)
+    {
+        free(Directory->entries);
+        free(Directory);
+    }
+
+    FUNC_LEAVE();
+}
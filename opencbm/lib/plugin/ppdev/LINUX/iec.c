@@ -0,0 +1,605 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999-2005 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+*/
+
+/*! **************************************************************
+** \file lib/plugin/ppdev/LINUX/iec.c \n
+** \n
+** \brief IEC bus routines of the ppdev plugin
+**
+** These are the routines of sys/linux/cbm_module.c, running in
+** user space on a parallel port claimed exclusively through
+** /dev/parportN. No kernel module is needed.
+**
+** Unlike in the kernel module, the timing critical parts cannot
+** disable interrupts or preemption. If the process is descheduled
+** within a bit, the drive sees a timeout, and the transfer fails.
+** Thus, cbm_driver_open() asks for SCHED_FIFO and locks the memory
+** of the process. This needs CAP_SYS_NICE and CAP_IPC_LOCK, or
+** RLIMIT_RTPRIO and RLIMIT_MEMLOCK high enough; without them, the
+** plugin runs at normal priority, which mostly works on an idle
+** machine only.
+**
+****************************************************************/
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "opencbm.h"
+#include "ppdev.h"
+
+/* the timeout of ppdev_wait(), in seconds */
+#define PPDEV_WAIT_TIMEOUT 10
+
+unsigned char ppdev_out_bits, ppdev_out_eor;
+int ppdev_data_reverse;
+
+static int eoi;
+
+/* the scheduling of the process before cbm_driver_open() */
+static int sched_changed;
+static int sched_old_policy;
+static struct sched_param sched_old_param;
+static int memory_locked;
+
+static unsigned long long now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*! \brief Busy wait
+
+ Sleeping is far too coarse for the bus timing, thus,
+ this spins on the monotonic clock.
+
+ \param us
+   The time to wait, in microseconds.
+*/
+void
+ppdev_udelay(unsigned int us)
+{
+    unsigned long long end = now_us() + us;
+
+    while (now_us() < end)
+        ;
+}
+
+/*! \brief Wait for an input line to reach a state
+
+ The drive usually answers within some microseconds, thus,
+ this spins first, and only sleeps if the drive is busy.
+
+ \param line
+   The input line (ATN_IN, CLK_IN, DATA_IN).
+
+ \param state
+   1 to wait until the line is set, 0 until it is released.
+
+ \return
+   0 on success, -1 on timeout.
+*/
+int
+ppdev_wait(unsigned char line, int state)
+{
+    unsigned long long end = 0;
+    int i = 0;
+
+    while (GET(line) != state) {
+        if (i < 100) {
+            i++;
+            continue;
+        }
+        if (end == 0) {
+            end = now_us() + PPDEV_WAIT_TIMEOUT * 1000000ULL;
+        } else if (now_us() > end) {
+            return -1;
+        }
+        usleep(100);
+    }
+    return 0;
+}
+
+static int check_if_bus_free(void)
+{
+    int ret = 0;
+
+    do {
+        RELEASE(ATN_OUT | CLK_OUT | DATA_OUT | RESET);
+
+        /* wait for the drive to have time to react */
+        usleep(100);
+
+        /* assert ATN */
+        SET(ATN_OUT);
+
+        /* now, wait for the drive to have time to react */
+        usleep(100);
+
+        /* if DATA is still unset, we have a problem. */
+        if (!GET(DATA_IN))
+            break;
+
+        /* ok, at least one drive reacted. Now, test releasing ATN: */
+
+        RELEASE(ATN_OUT);
+        usleep(100);
+
+        if (!GET(DATA_IN))
+            ret = 1;
+
+    } while (0);
+
+    RELEASE(ATN_OUT | CLK_OUT | DATA_OUT | RESET);
+
+    return ret;
+}
+
+static void wait_for_free_bus(void)
+{
+    int i;
+
+    for (i = 1; i < 1000; i++) {
+        if (check_if_bus_free())
+            break;
+        usleep(1000);
+    }
+}
+
+/*
+ *  send byte
+ */
+static int send_byte(int b)
+{
+    int i, ack = 0;
+
+    for (i = 0; i < 8; i++) {
+        ppdev_udelay(70);
+        if (!((b >> i) & 1))
+            SET(DATA_OUT);
+        RELEASE(CLK_OUT);
+        ppdev_udelay(20);
+        SET_RELEASE(CLK_OUT, DATA_OUT);
+    }
+
+    for (i = 0; (i < 20) && !(ack = GET(DATA_IN)); i++)
+        ppdev_udelay(100);
+
+    return ack;
+}
+
+/*
+ *  wait until the listener is ready to receive. For the last byte,
+ *  the listener acknowledges the EOI by pulsing DATA, too.
+ */
+static int wait_for_listener(int eoi_byte)
+{
+    RELEASE(CLK_OUT);
+    if (ppdev_wait(DATA_IN, 0))
+        return -1;
+    if (eoi_byte) {
+        if (ppdev_wait(DATA_IN, 1) || ppdev_wait(DATA_IN, 0))
+            return -1;
+    }
+    SET(CLK_OUT);
+    return 0;
+}
+
+static int iec_raw_write(const unsigned char *buf, size_t cnt, int atn, int talk)
+{
+    int i;
+    int rv = 0;
+    size_t sent = 0;
+
+    eoi = 0;
+
+    RELEASE(DATA_OUT);
+    SET(CLK_OUT | (atn ? ATN_OUT : 0));
+
+    for (i = 0; (i < 100) && !GET(DATA_IN); i++)
+        ppdev_udelay(10);
+
+    if (!GET(DATA_IN)) {
+        /* no devices found */
+        RELEASE(CLK_OUT | ATN_OUT);
+        return -1;
+    }
+
+    usleep(20000);
+
+    while (cnt > sent && rv == 0) {
+        ppdev_udelay(50);
+        if (GET(DATA_IN)) {
+            if (wait_for_listener((sent == (cnt - 1)) && (atn == 0))) {
+                rv = -1;
+            } else if (send_byte(*buf++)) {
+                sent++;
+                ppdev_udelay(100);
+            } else {
+                /* I/O error */
+                rv = -1;
+            }
+        } else {
+            /* device not present */
+            rv = -1;
+        }
+    }
+
+    if (talk && (rv == 0)) {
+        SET(DATA_OUT);
+        RELEASE(ATN_OUT);
+
+        RELEASE(CLK_OUT);
+        for (i = 0; (i < 100) && !GET(CLK_IN); i++)
+            ppdev_udelay(10);
+        if (!GET(CLK_IN)) {
+            /* device not present */
+            rv = -1;
+        }
+    } else {
+        RELEASE(ATN_OUT);
+    }
+    ppdev_udelay(100);
+
+    return (rv < 0) ? rv : (int)sent;
+}
+
+/*! \brief Ask for real-time scheduling
+
+ Everything is best effort: if the process is not allowed to
+ use SCHED_FIFO or to lock its memory, it keeps running as it is.
+*/
+static void ppdev_realtime_enter(void)
+{
+    struct sched_param param;
+
+    sched_old_policy = sched_getscheduler(0);
+    if (sched_old_policy >= 0 && sched_old_policy != SCHED_FIFO
+        && sched_getparam(0, &sched_old_param) == 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        sched_changed = (sched_setscheduler(0, SCHED_FIFO, &param) == 0);
+    }
+
+    memory_locked = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+}
+
+/*! \brief Undo ppdev_realtime_enter() */
+static void ppdev_realtime_leave(void)
+{
+    if (sched_changed) {
+        sched_setscheduler(0, sched_old_policy, &sched_old_param);
+        sched_changed = 0;
+    }
+    if (memory_locked) {
+        munlockall();
+        memory_locked = 0;
+    }
+}
+
+const char *
+opencbm_plugin_get_driver_name(const char * const Port)
+{
+    return ppdev_port_name(Port);
+}
+
+int
+opencbm_plugin_driver_open(CBM_FILE *f, const char * const Port)
+{
+    int cable;
+
+    *f = ppdev_port_open(Port);
+    if (*f < 0) {
+        return -1;
+    }
+
+    /* autodetect the cable like the kernel module does */
+    cable = (GET(ATN_IN) != ((ppdev_read_control() & ATN_OUT) ? 1 : 0));
+    ppdev_out_eor = cable ? 0xcb : 0xc4;
+    ppdev_out_bits = (ppdev_read_control() ^ ppdev_out_eor) &
+        (DATA_OUT | CLK_OUT | ATN_OUT | RESET);
+
+    RELEASE(DATA_OUT | ATN_OUT | RESET);
+    set_data_forward();
+
+    /* strict C64 behaviour: hold CLK while idle */
+    SET(CLK_OUT);
+
+    ppdev_realtime_enter();
+
+    eoi = 0;
+    return 0;
+}
+
+void
+opencbm_plugin_driver_close(CBM_FILE f)
+{
+    ppdev_port_close();
+    ppdev_realtime_leave();
+}
+
+/*! \brief Lock the parallel port for the driver
+
+ The port is claimed exclusively in cbm_driver_open()
+ already, thus, there is nothing to do.
+*/
+void
+opencbm_plugin_lock(CBM_FILE f)
+{
+}
+
+/*! \brief Unlock the parallel port for the driver
+
+ Look at opencbm_plugin_lock().
+*/
+void
+opencbm_plugin_unlock(CBM_FILE f)
+{
+}
+
+int
+opencbm_plugin_raw_write(CBM_FILE f, const void *buf, size_t size)
+{
+    return iec_raw_write(buf, size, 0, 0);
+}
+
+int
+opencbm_plugin_raw_read(CBM_FILE f, void *buf, size_t count)
+{
+    unsigned char *p = buf;
+    size_t received = 0;
+    int i, b, bit;
+    int ok = 0;
+
+    if (eoi)
+        return 0;
+
+    do {
+        if (ppdev_wait(CLK_IN, 0))
+            return -1;
+
+        RELEASE(DATA_OUT);
+        for (i = 0; (i < 40) && !(ok = GET(CLK_IN)); i++)
+            ppdev_udelay(10);
+        if (!ok) {
+            /* device signals eoi */
+            eoi = 1;
+            SET(DATA_OUT);
+            ppdev_udelay(70);
+            RELEASE(DATA_OUT);
+        }
+        for (i = 0; i < 100 && !(ok = GET(CLK_IN)); i++)
+            ppdev_udelay(20);
+        for (bit = b = 0; (bit < 8) && ok; bit++) {
+            for (i = 0; (i < 200) && !(ok = (GET(CLK_IN) == 0)); i++)
+                ppdev_udelay(10);
+            if (ok) {
+                b >>= 1;
+                if (GET(DATA_IN) == 0)
+                    b |= 0x80;
+                for (i = 0; i < 100 && !(ok = GET(CLK_IN)); i++)
+                    ppdev_udelay(20);
+            }
+        }
+        if (ok) {
+            SET(DATA_OUT);
+            p[received++] = (unsigned char) b;
+            ppdev_udelay(50);
+        }
+
+    } while (received < count && ok && !eoi);
+
+    return ok ? (int)received : -1;
+}
+
+int
+opencbm_plugin_listen(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    unsigned char buf[2];
+
+    buf[0] = 0x20 | (dev & 0x1f);
+    buf[1] = 0x60 | (secadr & 0x0f);
+    return iec_raw_write(buf, 2, 1, 0) > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_talk(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    unsigned char buf[2];
+
+    buf[0] = 0x40 | (dev & 0x1f);
+    buf[1] = 0x60 | (secadr & 0x0f);
+    return iec_raw_write(buf, 2, 1, 1) > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_open(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    unsigned char buf[2];
+
+    buf[0] = 0x20 | (dev & 0x1f);
+    buf[1] = 0xf0 | (secadr & 0x0f);
+    return iec_raw_write(buf, 2, 1, 0) > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_close(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    unsigned char buf[2];
+    int rv;
+
+    buf[0] = 0x20 | (dev & 0x1f);
+    buf[1] = 0xe0 | (secadr & 0x0f);
+    rv = iec_raw_write(buf, 2, 1, 0);
+    if (rv > 0) {
+        /* issue an unlisten */
+        buf[0] = 0x3f;
+        iec_raw_write(buf, 1, 1, 0);
+    }
+    return rv > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_unlisten(CBM_FILE f)
+{
+    unsigned char c = 0x3f;
+
+    return iec_raw_write(&c, 1, 1, 0) > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_untalk(CBM_FILE f)
+{
+    unsigned char c = 0x5f;
+
+    return iec_raw_write(&c, 1, 1, 0) > 0 ? 0 : -1;
+}
+
+int
+opencbm_plugin_get_eoi(CBM_FILE f)
+{
+    return eoi ? 1 : 0;
+}
+
+int
+opencbm_plugin_clear_eoi(CBM_FILE f)
+{
+    eoi = 0;
+    return 0;
+}
+
+int
+opencbm_plugin_reset(CBM_FILE f)
+{
+    RELEASE(DATA_OUT | ATN_OUT | CLK_OUT);
+    set_data_forward();
+    SET(RESET);
+    usleep(100000); /* 100ms */
+    RELEASE(RESET);
+
+    wait_for_free_bus();
+    return 0;
+}
+
+unsigned char
+opencbm_plugin_pp_read(CBM_FILE f)
+{
+    if (!ppdev_data_reverse) {
+        XP_WRITE(0xff);
+        set_data_reverse();
+    }
+    return XP_READ();
+}
+
+void
+opencbm_plugin_pp_write(CBM_FILE f, unsigned char c)
+{
+    if (ppdev_data_reverse)
+        set_data_forward();
+    XP_WRITE(c);
+}
+
+int
+opencbm_plugin_iec_poll(CBM_FILE f)
+{
+    unsigned char c = ppdev_read_status();
+    int rv = 0;
+
+    if ((c & DATA_IN) == 0)
+        rv |= IEC_DATA;
+    if ((c & CLK_IN) == 0)
+        rv |= IEC_CLOCK;
+    if ((c & ATN_IN) == 0)
+        rv |= IEC_ATN;
+    return rv;
+}
+
+int
+opencbm_plugin_iec_get(CBM_FILE f, int line)
+{
+    return (opencbm_plugin_iec_poll(f) & line) != 0;
+}
+
+static unsigned char iec_to_out(int line)
+{
+    unsigned char mask = 0;
+
+    if (line & IEC_DATA)
+        mask |= DATA_OUT;
+    if (line & IEC_CLOCK)
+        mask |= CLK_OUT;
+    if (line & IEC_ATN)
+        mask |= ATN_OUT;
+    if (line & IEC_RESET)
+        mask |= RESET;
+    return mask;
+}
+
+void
+opencbm_plugin_iec_set(CBM_FILE f, int line)
+{
+    SET(iec_to_out(line));
+}
+
+void
+opencbm_plugin_iec_release(CBM_FILE f, int line)
+{
+    RELEASE(iec_to_out(line));
+}
+
+void
+opencbm_plugin_iec_setrelease(CBM_FILE f, int set, int release)
+{
+    SET_RELEASE(iec_to_out(set), iec_to_out(release));
+}
+
+int
+opencbm_plugin_iec_wait(CBM_FILE f, int line, int state)
+{
+    struct timespec ts;
+    unsigned char mask;
+    int i;
+
+    switch (line) {
+    case IEC_DATA:
+        mask = DATA_IN;
+        break;
+    case IEC_CLOCK:
+        mask = CLK_IN;
+        break;
+    case IEC_ATN:
+        mask = ATN_IN;
+        break;
+    default:
+        return -1;
+    }
+
+    /*
+     * Like the kernel module, this waits as long as it takes, but
+     * sleeps after a short while, and returns if a signal arrives.
+     */
+    for (i = 0; GET(mask) != (state ? 1 : 0); i++) {
+        if (i < 20) {
+            ppdev_udelay(10);
+        } else {
+            ts.tv_sec = 0;
+            ts.tv_nsec = 20000000; /* 20 ms */
+            if (nanosleep(&ts, NULL) < 0 && errno == EINTR)
+                return -1;
+        }
+    }
+
+    return opencbm_plugin_iec_poll(f);
+}
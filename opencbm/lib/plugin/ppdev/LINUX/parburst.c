@@ -0,0 +1,176 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 2000-2005 Markus Brenner
+ *  Copyright 2000-2005 Pete Rittwage
+ *  Copyright 2005      Tim Schrmann
+ *  Copyright 2005-2006,2009 Spiro Trikaliotis
+ *  Copyright 2009      Arnd Menge <arnd(at)jonnz(dot)de>
+*/
+
+/*! **************************************************************
+** \file lib/plugin/ppdev/LINUX/parburst.c \n
+** \n
+** \brief Parallel burst routines of the ppdev plugin
+**
+** These are the routines of sys/linux/cbm_module.c, running in
+** user space.
+**
+****************************************************************/
+
+#include <stdio.h>
+
+#include "opencbm.h"
+#include "ppdev.h"
+
+static int handshaked_read(int toggle)
+{
+    int returnvalue, returnvalue2, returnvalue3, timeoutcount;
+
+    if (ppdev_wait(DATA_IN, toggle ? 1 : 0))
+        return -1;
+
+    timeoutcount = 0;
+
+    returnvalue = returnvalue3 = XP_READ();
+    returnvalue2 = ~returnvalue3;    /* ensure to read once more */
+
+    do {
+        if (++timeoutcount >= 8) {
+            fprintf(stderr, "Triple-Debounce TIMEOUT: 0x%02x, 0x%02x, 0x%02x (%d)\n",
+                returnvalue, returnvalue2, returnvalue3, timeoutcount);
+            break;
+        }
+        returnvalue = returnvalue2;
+        returnvalue2 = returnvalue3;
+        returnvalue3 = XP_READ();
+    } while ((returnvalue != returnvalue2) || (returnvalue != returnvalue3));
+
+    return returnvalue;
+}
+
+static int handshaked_write(unsigned char data, int toggle)
+{
+    if (ppdev_wait(DATA_IN, toggle ? 1 : 0))
+        return 1;
+
+    if (ppdev_data_reverse)
+        set_data_forward();
+    XP_WRITE(data);
+    return 0;
+}
+
+unsigned char
+opencbm_plugin_parallel_burst_read(CBM_FILE f)
+{
+    int rv;
+
+    RELEASE(DATA_OUT | CLK_OUT);
+    SET(ATN_OUT);
+    ppdev_udelay(20);
+    ppdev_wait(DATA_IN, 0);
+    if (!ppdev_data_reverse) {
+        XP_WRITE(0xff);
+        set_data_reverse();
+    }
+    rv = XP_READ();
+    ppdev_udelay(5);
+    RELEASE(ATN_OUT);
+    ppdev_udelay(10);
+    ppdev_wait(DATA_IN, 1);
+    return rv;
+}
+
+void
+opencbm_plugin_parallel_burst_write(CBM_FILE f, unsigned char c)
+{
+    RELEASE(DATA_OUT | CLK_OUT);
+    SET(ATN_OUT);
+    ppdev_udelay(20);
+    ppdev_wait(DATA_IN, 0);
+    if (ppdev_data_reverse)
+        set_data_forward();
+    XP_WRITE(c);
+    ppdev_udelay(5);
+    RELEASE(ATN_OUT);
+    ppdev_udelay(20);
+    ppdev_wait(DATA_IN, 1);
+    if (!ppdev_data_reverse) {
+        XP_WRITE(0xff);
+        set_data_reverse();
+    }
+    XP_READ();
+}
+
+int
+opencbm_plugin_parallel_burst_read_n(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+        buffer[i] = opencbm_plugin_parallel_burst_read(f);
+    return length;
+}
+
+int
+opencbm_plugin_parallel_burst_write_n(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+        opencbm_plugin_parallel_burst_write(f, buffer[i]);
+    return length;
+}
+
+int
+opencbm_plugin_parallel_burst_read_track(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    int i, byte;
+
+    for (i = 0; i < 0x2000; i += 1) {
+        byte = handshaked_read(i & 1);
+        if (byte == -1)
+            return 0;
+        buffer[i] = byte;
+    }
+
+    opencbm_plugin_parallel_burst_read(f);
+    return 1;
+}
+
+int
+opencbm_plugin_parallel_burst_read_track_var(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    int i, byte;
+
+    for (i = 0; i < 0x2000; i += 1) {
+        byte = handshaked_read(i & 1);
+        if (byte == -1)
+            return 0;
+        buffer[i] = byte;
+        if (byte == 0x55)
+            break;
+    }
+
+    opencbm_plugin_parallel_burst_read(f);
+    return 1;
+}
+
+int
+opencbm_plugin_parallel_burst_write_track(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    unsigned int i;
+
+    for (i = 0; i < length; i++) {
+        if (handshaked_write(buffer[i], i & 1)) {
+            /* timeout */
+            return 0;
+        }
+    }
+    handshaked_write(0, i & 1);
+    opencbm_plugin_parallel_burst_read(f);
+    return 1;
+}
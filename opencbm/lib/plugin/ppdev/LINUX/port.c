@@ -0,0 +1,178 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999-2005 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+*/
+
+/*! **************************************************************
+** \file lib/plugin/ppdev/LINUX/port.c \n
+** \n
+** \brief Parallel port access through ppdev, and a stub port
+**
+** The port is given as the number N of /dev/parportN, or as
+** the path of the device. The port "stub" does not access any
+** hardware: it behaves like an XA1541 cable with nothing connected,
+** that is, every line driven by the PC can be read back, and the
+** data port returns whatever was written to it. This allows
+** to test the plugin and the programs without a cable.
+**
+****************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/parport.h>
+#include <linux/ppdev.h>
+
+#include "ppdev.h"
+
+static int port_fd = -1;
+static int port_stub = 0;
+
+/* the control register is write only for us, so keep a copy of it */
+static unsigned char port_control;
+
+static unsigned char stub_data;
+static int stub_reverse;
+
+static char port_name[64];
+
+/* returns the device name which belongs to the given port */
+const char *
+ppdev_port_name(const char *Port)
+{
+    if (Port == NULL || *Port == '\0') {
+        Port = "0";
+    }
+
+    if (strcmp(Port, "stub") == 0 || *Port == '/') {
+        snprintf(port_name, sizeof(port_name), "%s", Port);
+    } else {
+        snprintf(port_name, sizeof(port_name), "/dev/parport%lu", strtoul(Port, NULL, 10));
+    }
+    return port_name;
+}
+
+/* returns the file descriptor of the port, or -1 on error */
+int
+ppdev_port_open(const char *Port)
+{
+    int mode = IEEE1284_MODE_COMPAT;
+
+    ppdev_port_name(Port);
+
+    if (strcmp(port_name, "stub") == 0) {
+        port_stub = 1;
+        port_control = 0xcb & 0x0f;
+        stub_data = 0xff;
+        stub_reverse = 0;
+        /* hand out a real file descriptor for the stub, too */
+        port_fd = open("/dev/null", O_RDWR);
+        return port_fd;
+    }
+
+    port_stub = 0;
+    port_fd = open(port_name, O_RDWR);
+    if (port_fd < 0) {
+        return -1;
+    }
+
+    /* nobody else may use the port while we own it */
+    if (ioctl(port_fd, PPEXCL) != 0 || ioctl(port_fd, PPCLAIM) != 0) {
+        close(port_fd);
+        port_fd = -1;
+        return -1;
+    }
+    ioctl(port_fd, PPSETMODE, &mode);
+
+    ioctl(port_fd, PPRCONTROL, &port_control);
+
+    return port_fd;
+}
+
+void
+ppdev_port_close(void)
+{
+    if (port_fd >= 0) {
+        if (!port_stub) {
+            ioctl(port_fd, PPRELEASE);
+        }
+        close(port_fd);
+        port_fd = -1;
+    }
+    port_stub = 0;
+}
+
+unsigned char
+ppdev_read_status(void)
+{
+    unsigned char status = 0xff;
+
+    if (port_stub) {
+        unsigned char lines = (port_control ^ 0xcb) & 0x0f;
+
+        if (lines & ATN_OUT)  status &= ~ATN_IN;
+        if (lines & CLK_OUT)  status &= ~CLK_IN;
+        if (lines & DATA_OUT) status &= ~DATA_IN;
+    } else {
+        ioctl(port_fd, PPRSTATUS, &status);
+    }
+    return status;
+}
+
+unsigned char
+ppdev_read_control(void)
+{
+    return port_control;
+}
+
+void
+ppdev_write_control(unsigned char c)
+{
+    c &= 0x0f;
+    if (c != port_control) {
+        port_control = c;
+        if (!port_stub) {
+            ioctl(port_fd, PPWCONTROL, &port_control);
+        }
+    }
+}
+
+unsigned char
+ppdev_read_data(void)
+{
+    unsigned char c;
+
+    if (port_stub) {
+        return stub_reverse ? 0xff : stub_data;
+    }
+    ioctl(port_fd, PPRDATA, &c);
+    return c;
+}
+
+void
+ppdev_write_data(unsigned char c)
+{
+    if (port_stub) {
+        stub_data = c;
+    } else {
+        ioctl(port_fd, PPWDATA, &c);
+    }
+}
+
+void
+ppdev_data_dir(int reverse)
+{
+    if (port_stub) {
+        stub_reverse = reverse;
+    } else {
+        ioctl(port_fd, PPDATADIR, &reverse);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999-2005 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+*/
+
+/*! **************************************************************
+** \file lib/plugin/ppdev/LINUX/ppdev.h \n
+** \n
+** \brief Shared definitions of the ppdev plugin
+**
+****************************************************************/
+
+#ifndef OPENCBM_PPDEV_H
+#define OPENCBM_PPDEV_H
+
+/* lpt output lines, these are the same as in sys/linux/cbm_module.c */
+#define ATN_OUT    0x01
+#define CLK_OUT    0x02
+#define DATA_OUT   0x04
+#define RESET      0x08
+
+/* lpt input lines */
+#define ATN_IN     0x10
+#define CLK_IN     0x20
+#define DATA_IN    0x40
+
+/* port.c: access to the parallel port, or to the stub */
+extern const char *ppdev_port_name(const char *Port);
+extern int  ppdev_port_open(const char *Port);
+extern void ppdev_port_close(void);
+extern unsigned char ppdev_read_status(void);
+extern unsigned char ppdev_read_control(void);
+extern void ppdev_write_control(unsigned char c);
+extern unsigned char ppdev_read_data(void);
+extern void ppdev_write_data(unsigned char c);
+extern void ppdev_data_dir(int reverse);
+
+/* iec.c: line handling shared by all protocols */
+extern unsigned char ppdev_out_bits, ppdev_out_eor;
+extern int ppdev_data_reverse;
+
+extern void ppdev_udelay(unsigned int us);
+extern int  ppdev_wait(unsigned char line, int state);
+
+#define GET(line)        ((ppdev_read_status() & (line)) == 0 ? 1 : 0)
+#define SET(line)        (ppdev_write_control(ppdev_out_eor ^ (ppdev_out_bits |= (line))))
+#define RELEASE(line)    (ppdev_write_control(ppdev_out_eor ^ (ppdev_out_bits &= ~(line))))
+#define SET_RELEASE(s,r) (ppdev_write_control(ppdev_out_eor ^ \
+                            (ppdev_out_bits = (ppdev_out_bits | (s)) & ~(r))))
+
+#define XP_READ()        (ppdev_read_data())
+#define XP_WRITE(c)      (ppdev_write_data(c))
+
+#define set_data_forward() do { ppdev_data_dir(0); ppdev_data_reverse = 0; } while (0)
+#define set_data_reverse() do { ppdev_data_dir(1); ppdev_data_reverse = 1; } while (0)
+
+#endif /* #ifndef OPENCBM_PPDEV_H */
@@ -0,0 +1,210 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999-2005 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+*/
+
+/*! **************************************************************
+** \file lib/plugin/ppdev/LINUX/s1_s2_pp.c \n
+** \n
+** \brief Block transfers with the d64copy protocols serial1,
+**        serial2 and parallel
+**
+** These are the same loops as in libd64copy, but they run
+** directly on the port instead of one plugin call per line change.
+**
+****************************************************************/
+
+#include "opencbm.h"
+#include "ppdev.h"
+
+/*! \brief Read data with serial1 protocol
+
+  \return
+    The number of bytes actually read.
+*/
+int
+opencbm_plugin_s1_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+    int i, b;
+
+    for (n = 0; n < size; n++) {
+        data[n] = 0;
+        for (i = 7; i >= 0; i--) {
+            if (ppdev_wait(DATA_IN, 0))
+                return n;
+            RELEASE(CLK_OUT);
+            b = GET(CLK_IN);
+            data[n] = (data[n] >> 1) | (b ? 0x80 : 0);
+            SET(DATA_OUT);
+            if (ppdev_wait(CLK_IN, !b))
+                return n;
+            RELEASE(DATA_OUT);
+            if (ppdev_wait(DATA_IN, 1))
+                return n;
+            SET(CLK_OUT);
+        }
+    }
+    return n;
+}
+
+/*! \brief Write data with serial1 protocol
+
+  \return
+    The number of bytes actually written.
+*/
+int
+opencbm_plugin_s1_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+    int i, b;
+
+    for (n = 0; n < size; n++) {
+        for (i = 7; i >= 0; i--) {
+            b = (data[n] >> i) & 1;
+            if (b)
+                SET(DATA_OUT);
+            else
+                RELEASE(DATA_OUT);
+            RELEASE(CLK_OUT);
+            if (ppdev_wait(CLK_IN, 1))
+                return n;
+            if (b)
+                RELEASE(DATA_OUT);
+            else
+                SET(DATA_OUT);
+            if (ppdev_wait(CLK_IN, 0))
+                return n;
+            RELEASE(DATA_OUT);
+            SET(CLK_OUT);
+            if (ppdev_wait(DATA_IN, 1))
+                return n;
+        }
+    }
+    return n;
+}
+
+/*! \brief Read data with serial2 protocol
+
+  \return
+    The number of bytes actually read.
+*/
+int
+opencbm_plugin_s2_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+    int i;
+
+    for (n = 0; n < size; n++) {
+        data[n] = 0;
+        for (i = 4; i > 0; i--) {
+            if (ppdev_wait(CLK_IN, 0))
+                return n;
+            data[n] = (data[n] >> 1) | (GET(DATA_IN) ? 0x80 : 0);
+            RELEASE(ATN_OUT);
+            if (ppdev_wait(CLK_IN, 1))
+                return n;
+            data[n] = (data[n] >> 1) | (GET(DATA_IN) ? 0x80 : 0);
+            SET(ATN_OUT);
+        }
+    }
+    return n;
+}
+
+/*! \brief Write data with serial2 protocol
+
+  \return
+    The number of bytes actually written.
+*/
+int
+opencbm_plugin_s2_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+    unsigned char c;
+    int i;
+
+    for (n = 0; n < size; n++) {
+        c = data[n];
+        for (i = 4; i > 0; i--) {
+            if (c & 1)
+                SET(DATA_OUT);
+            else
+                RELEASE(DATA_OUT);
+            c >>= 1;
+            RELEASE(ATN_OUT);
+            if (ppdev_wait(CLK_IN, 0))
+                return n;
+            if (c & 1)
+                SET(DATA_OUT);
+            else
+                RELEASE(DATA_OUT);
+            c >>= 1;
+            SET(ATN_OUT);
+            if (ppdev_wait(CLK_IN, 1))
+                return n;
+        }
+        RELEASE(DATA_OUT);
+    }
+    return n;
+}
+
+/*! \brief Read data with parallel protocol (d64copy)
+
+  \return
+    The number of bytes actually read. The bytes
+    are always transferred in pairs.
+*/
+int
+opencbm_plugin_pp_dc_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+
+    if (!ppdev_data_reverse) {
+        XP_WRITE(0xff);
+        set_data_reverse();
+        ppdev_udelay(100);
+    }
+    for (n = 0; n + 1 < size; n += 2) {
+        if (ppdev_wait(DATA_IN, 1))
+            return n;
+        data[n] = XP_READ();
+        RELEASE(CLK_OUT);
+        if (ppdev_wait(DATA_IN, 0))
+            return n;
+        data[n + 1] = XP_READ();
+        SET(CLK_OUT);
+    }
+    return n;
+}
+
+/*! \brief Write data with parallel protocol (d64copy)
+
+  \return
+    The number of bytes actually written. The bytes
+    are always transferred in pairs.
+*/
+int
+opencbm_plugin_pp_dc_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    unsigned int n;
+
+    if (ppdev_data_reverse) {
+        set_data_forward();
+        ppdev_udelay(100);
+    }
+    for (n = 0; n + 1 < size; n += 2) {
+        if (ppdev_wait(DATA_IN, 1))
+            return n;
+        XP_WRITE(data[n]);
+        RELEASE(CLK_OUT);
+        if (ppdev_wait(DATA_IN, 0))
+            return n;
+        XP_WRITE(data[n + 1]);
+        SET(CLK_OUT);
+    }
+    return n;
+}
@@ -18,6 +18,9 @@
 
 static char *cbm_dev_name = "/dev/cbm";
 
+/* does the kernel module know CBMCTRL_BATCH? */
+static int batch_supported = 0;
+
 const char *opencbm_plugin_get_driver_name(int port)
 {
     return cbm_dev_name;
@@ -25,8 +28,26 @@ const char *opencbm_plugin_get_driver_name(int port)
 
 int opencbm_plugin_driver_open(CBM_FILE *f, int port)
 {
+    CBM_BATCH batch;
+    char *val;
+
     *f = open(cbm_dev_name, O_RDWR);
-    return (*f < 0) ? -1 : 0; /* FIXME */
+    if (*f < 0) {
+        return -1; /* FIXME */
+    }
+
+    /* an empty batch fails on older kernel modules */
+    batch.ops = NULL;
+    batch.count = 0;
+    batch_supported = (ioctl(*f, CBMCTRL_BATCH, &batch) == 0);
+
+    /* XA1541_NO_BATCH=1 uses one ioctl per step, for comparison */
+    val = getenv("XA1541_NO_BATCH");
+    if (val != NULL && atoi(val) != 0) {
+        batch_supported = 0;
+    }
+
+    return 0;
 }
 
 void opencbm_plugin_driver_close(CBM_FILE f)
@@ -184,3 +205,82 @@ void opencbm_plugin_iec_setrelease(CBM_FILE f, int set, int release)
 {
     ioctl(f, CBMCTRL_IEC_SETRELEASE, (set<<8) | release);
 }
+
+static void batch_op(CBM_BATCH_OP *op, unsigned int cmd, unsigned long arg,
+                     unsigned char *buffer, int length, int flags)
+{
+    op->cmd = cmd;
+    op->arg = arg;
+    op->buffer = buffer;
+    op->length = length;
+    op->flags = flags;
+    op->result = -1;
+}
+
+/*! \brief Execute a command in the floppy drive
+
+ Listen, command and unlisten are sent to the kernel module
+ with a single CBMCTRL_BATCH ioctl.
+*/
+int opencbm_plugin_exec_command(CBM_FILE f, unsigned char dev, const void *cmd, size_t size)
+{
+    CBM_BATCH_OP op[3];
+    CBM_BATCH batch;
+    int rv;
+
+    if (!batch_supported) {
+        rv = opencbm_plugin_listen(f, dev, 15);
+        if (rv == 0) {
+            rv = opencbm_plugin_raw_write(f, cmd, size) != (int) size;
+            opencbm_plugin_unlisten(f);
+        }
+        return rv;
+    }
+
+    batch_op(&op[0], CBMCTRL_LISTEN, (dev<<8) | 15, NULL, 0, 0);
+    batch_op(&op[1], CBMCTRL_BATCH_WRITE, 0, (unsigned char *) cmd, size, 0);
+    batch_op(&op[2], CBMCTRL_UNLISTEN, 0, NULL, 0, CBM_BATCH_ALWAYS);
+    batch.ops = op;
+    batch.count = 3;
+
+    ioctl(f, CBMCTRL_BATCH, &batch);
+
+    if (op[0].result < 0) {
+        return -1;
+    }
+    return op[1].result != (int) size;
+}
+
+/*! \brief Read the error channel of the floppy drive
+
+ Talk, read and untalk are sent to the kernel module
+ with a single CBMCTRL_BATCH ioctl.
+*/
+int opencbm_plugin_device_status(CBM_FILE f, unsigned char dev, void *buf, size_t size)
+{
+    CBM_BATCH_OP op[3];
+    CBM_BATCH batch;
+    int rv;
+
+    if (!batch_supported) {
+        if (opencbm_plugin_talk(f, dev, 15) != 0) {
+            return -1;
+        }
+        rv = opencbm_plugin_raw_read(f, buf, size);
+        opencbm_plugin_untalk(f);
+        return (rv < 0) ? -1 : rv;
+    }
+
+    batch_op(&op[0], CBMCTRL_TALK, (dev<<8) | 15, NULL, 0, 0);
+    batch_op(&op[1], CBMCTRL_BATCH_READ, 0, buf, size, 0);
+    batch_op(&op[2], CBMCTRL_UNTALK, 0, NULL, 0, CBM_BATCH_ALWAYS);
+    batch.ops = op;
+    batch.count = 3;
+
+    ioctl(f, CBMCTRL_BATCH, &batch);
+
+    if (op[0].result < 0 || op[1].result < 0) {
+        return -1;
+    }
+    return op[1].result;
+}
@@ -38,6 +38,22 @@ void opencbm_plugin_parallel_burst_write(CBM_FILE f, unsigned char c)
     ioctl(f, CBMCTRL_PARBURST_WRITE, c);
 }
 
+int opencbm_plugin_parallel_burst_read_n(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    PARBURST_RW_VALUE mv;
+    mv.buffer=buffer;
+    mv.length=length;
+    return ioctl(f, CBMCTRL_PARBURST_READ_N, &mv);
+}
+
+int opencbm_plugin_parallel_burst_write_n(CBM_FILE f, unsigned char *buffer, unsigned int length)
+{
+    PARBURST_RW_VALUE mv;
+    mv.buffer=buffer;
+    mv.length=length;
+    return ioctl(f, CBMCTRL_PARBURST_WRITE_N, &mv);
+}
+
 int opencbm_plugin_parallel_burst_read_track(CBM_FILE f, unsigned char *buffer, unsigned int length)
 {
     int retval;
@@ -0,0 +1,53 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999-2005 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+*/
+
+#include <sys/ioctl.h>
+
+#include "opencbm.h"
+#include "cbm_module.h"
+
+/* all block transfers are done by the kernel module in one ioctl */
+static int xfer_n(CBM_FILE f, unsigned int cmd, const unsigned char *data, unsigned int size)
+{
+    PARBURST_RW_VALUE mv;
+
+    mv.buffer = (unsigned char *) data;
+    mv.length = size;
+    return ioctl(f, cmd, &mv);
+}
+
+int opencbm_plugin_s1_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_S1_READ_N, data, size);
+}
+
+int opencbm_plugin_s1_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_S1_WRITE_N, data, size);
+}
+
+int opencbm_plugin_s2_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_S2_READ_N, data, size);
+}
+
+int opencbm_plugin_s2_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_S2_WRITE_N, data, size);
+}
+
+int opencbm_plugin_pp_dc_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_PP_DC_READ_N, data, size);
+}
+
+int opencbm_plugin_pp_dc_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return xfer_n(f, CBMCTRL_PP_DC_WRITE_N, data, size);
+}
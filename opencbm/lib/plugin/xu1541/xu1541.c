@@ -32,10 +32,14 @@
 
 static int debug_level = -10000; /*!< \internal \brief the debugging level for debugging output */
 static usb_dev_handle *xu1541_handle = NULL; /*!< \internal \brief handle to the xu1541 device */
+static int xu1541_pipeline = 0; /*!< \internal \brief the firmware supports pipelined read/write */
 
 /*! \brief timeout value, used mainly after errors \todo What is the exact purpose of this? */
 #define TIMEOUT_DELAY  25000   // 25ms
 
+/*! \brief delay before asking again if a pipelined read is not ready yet */
+#define PIPE_DELAY      1000   // 1ms
+
 /*! \internal \brief Output debugging information for the xu1541
 
  \param level
@@ -232,6 +236,11 @@ int xu1541_init(void) {
     return -1;
   }
 
+  /* firmware x.19 and up can queue the next chunk of a read or write */
+  xu1541_pipeline = ((ret[2] | (ret[3] << 8)) & XU1541_CAP_PIPELINE) != 0;
+  if(xu1541_pipeline)
+    xu1541_dbg(0, "using pipelined read/write");
+
   return 0;
 }
 
@@ -365,6 +374,92 @@ int xu1541_ioctl(unsigned int cmd, unsigned int addr, unsigned int secaddr)
   return ret[0];
 }
 
+/*! \internal \brief write data to the xu1541 device, pipelined
+
+ Each chunk is sent right after the previous one. The device writes
+ the previous chunk to the IEC bus before it takes the next one, so
+ only the result of the last chunk has to be asked for. If a chunk
+ fails, the device drops the following ones and tells how many bytes
+ it has written.
+
+ \param data
+    Pointer to buffer which contains the data to be written to the xu1541
+
+ \param len
+    The length of the data buffer to be written to the xu1541
+
+ \return
+    The number of bytes written
+*/
+static int xu1541_pipe_write(const unsigned char *data, size_t len)
+{
+    int bytesWritten = 0;
+    int wr, bytes2write;
+    int flags = XU1541_PIPE_FIRST;
+    unsigned char rv[4];
+
+    while(len)
+    {
+	bytes2write = (len > XU1541_IO_BUFFER_SIZE)?XU1541_IO_BUFFER_SIZE:len;
+
+	/* the device writes the previous chunk to IEC before it answers */
+	if((wr = usb.control_msg(xu1541_handle, 
+				 USB_TYPE_CLASS | USB_ENDPOINT_OUT, 
+				 XU1541_PIPE_WRITE, bytes2write, flags, 
+				 (char*)data, bytes2write, 
+				 USB_TIMEOUT)) < 0) 
+	{
+	    /* a slow bus is not an error, send the same chunk again */
+	    if(wr == -ETIMEDOUT)
+	    {
+		xu1541_dbg(3, "usb timeout");
+		arch_usleep(PIPE_DELAY);
+		continue;
+	    }
+
+	    fprintf(stderr, "USB error xu1541_write(): %s\n", usb.strerror());
+	    exit(-1);
+	    return -1;
+	}
+
+	flags = 0;
+	len -= wr;
+	data += wr;
+	bytesWritten += wr;
+
+	xu1541_dbg(2, "queued chunk of %d bytes, total %d, left %d", 
+		   wr, bytesWritten, len);
+    }
+
+    /* wait for the last chunk to be written */
+    for(;;)
+    {
+	if(usb.control_msg(xu1541_handle, 
+			   USB_TYPE_CLASS | USB_ENDPOINT_IN, 
+			   XU1541_GET_RESULT, 0, 0, 
+			   (char*)rv, sizeof(rv), 
+			   1000) == sizeof(rv)) 
+	{
+	    if(rv[0] == XU1541_IO_RESULT)
+		break;
+
+	    xu1541_dbg(3, "unexpected result (%d/%d)", rv[0], rv[1]);
+	    arch_usleep(PIPE_DELAY);
+	}
+	else
+	{
+	    xu1541_dbg(3, "usb timeout");
+	}
+    }
+    errno = 0;
+
+    /* a chunk failed, the device counted what made it to the bus */
+    if(!rv[1])
+	bytesWritten = rv[2] | (rv[3] << 8);
+
+    return bytesWritten;
+}
+
 /*! \brief write data to the xu1541 device
 
  \param data
@@ -382,6 +477,9 @@ int xu1541_write(const unsigned char *data, size_t len)
 
     xu1541_dbg(1, "write %d bytes from address %p", len, data);
 
+    if(xu1541_pipeline)
+	return xu1541_pipe_write(data, len);
+
     while(len) 
     {
         int link_ok = 0, err = 0;
@@ -447,6 +545,106 @@ int xu1541_write(const unsigned char *data, size_t len)
     return bytesWritten;
 }
 
+/*! \internal \brief read data from the xu1541 device, pipelined
+
+ Each XU1541_PIPE_READ fetches a chunk and has the device start
+ reading the next one from the IEC bus right away, so there is no
+ separate request and result for each chunk. The state and the number
+ of the chunk come in front of the data; if the chunk is not there
+ yet, only they are returned.
+
+ \param data
+    Pointer to a buffer which will contain the data read from the xu1541
+
+ \param len
+    The number of bytes to read from the xu1541
+
+ \return
+    The number of bytes read
+*/
+static int xu1541_pipe_read(unsigned char *data, size_t len)
+{
+    unsigned char buf[2 + XU1541_IO_BUFFER_SIZE];
+    unsigned char seq = 0;
+    int bytesRead = 0;
+    int rd, bytes2read, next;
+
+    bytes2read = (len > XU1541_IO_BUFFER_SIZE)?XU1541_IO_BUFFER_SIZE:len;
+
+    /* start the first chunk */
+    if(usb.control_msg(xu1541_handle, 
+		       USB_TYPE_CLASS | USB_ENDPOINT_IN, 
+		       XU1541_REQUEST_READ, bytes2read, 0, 
+		       NULL, 0,
+		       1000) < 0)
+    {
+	fprintf(stderr, "USB error in xu1541_request_read(): %s\n", 
+		usb.strerror());
+	exit(-1);
+	return -1;
+    }
+
+    while(len > 0) 
+    {
+	bytes2read = (len > XU1541_IO_BUFFER_SIZE)?XU1541_IO_BUFFER_SIZE:len;
+	next = len - bytes2read;
+	if(next > XU1541_IO_BUFFER_SIZE)
+	    next = XU1541_IO_BUFFER_SIZE;
+
+	for(;;)
+	{
+	    /* the USB link may be down while the device reads from IEC */
+	    rd = usb.control_msg(xu1541_handle, 
+				 USB_TYPE_CLASS | USB_ENDPOINT_IN, 
+				 XU1541_PIPE_READ, bytes2read, next, 
+				 (char*)buf, 2 + bytes2read, 1000);
+	    if(rd < 2)
+	    {
+		xu1541_dbg(3, "usb timeout");
+		continue;
+	    }
+
+	    xu1541_dbg(2, "got result %d/%d", buf[0], buf[1]);
+
+	    if(buf[0] == XU1541_IO_READ_DONE)
+		break;
+
+	    /* anything else than a read in progress means it's gone */
+	    if(buf[0] != XU1541_IO_READ)
+	    {
+		fprintf(stderr, "xu1541_read(): device is not reading (%d)\n", 
+			buf[0]);
+		return bytesRead;
+	    }
+	    arch_usleep(PIPE_DELAY);
+	}
+	errno = 0;
+
+	/* a reply that got lost on the way would shift the data */
+	if(buf[1] != seq)
+	{
+	    fprintf(stderr, "xu1541_read(): got chunk %d, expected %d\n", 
+		    buf[1], seq);
+	    return bytesRead;
+	}
+	seq++;
+
+	rd -= 2;
+	memcpy(data, buf + 2, rd);
+	len -= rd;
+	data += rd;
+	bytesRead += rd;
+
+	xu1541_dbg(2, "received chunk of %d bytes, total %d, left %d", 
+		   rd, bytesRead, len);
+
+	/* force end of read, the device did not start the next chunk */
+	if(rd < bytes2read) 
+	    len = 0;
+    }
+    return bytesRead;
+}
+
 /*! \brief read data from the xu1541 device
 
  \param data
@@ -463,6 +661,9 @@ int xu1541_read(unsigned char *data, size_t len)
     int bytesRead = 0;
     
     xu1541_dbg(1, "read %d bytes to address %p", len, data);
+
+    if(xu1541_pipeline)
+	return xu1541_pipe_read(data, len);
     
     while(len > 0) 
     {
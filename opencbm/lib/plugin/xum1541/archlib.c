@@ -251,6 +251,10 @@ opencbm_plugin_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
  This prepares a LISTENer, so that it will wait for our
  bytes we will write in the future.
 
+ If JiffyDOS is enabled (see xum1541_jiffy()), the xum1541
+ also probes the device for it. If it answers, the following
+ cbm_raw_write() calls use JiffyDOS.
+
  \param HandleDevice  
    A CBM_FILE which contains the file handle of the driver.
 
@@ -273,7 +277,7 @@ opencbm_plugin_listen(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsign
 {
     unsigned char proto, dataBuf[2];
 
-    proto = XUM1541_CBM | XUM_WRITE_ATN;
+    proto = XUM1541_CBM | XUM_WRITE_ATN | xum1541_jiffy();
     dataBuf[0] = 0x20 | DeviceAddress;
     dataBuf[1] = 0x60 | SecondaryAddress;
     return !xum1541_write((usb_dev_handle *)HandleDevice, proto, dataBuf, sizeof(dataBuf));
@@ -285,6 +289,10 @@ opencbm_plugin_listen(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsign
  This prepares a TALKer, so that it will prepare to send
  us some bytes in the future.
 
+ If JiffyDOS is enabled (see xum1541_jiffy()), the xum1541
+ also probes the device for it. If it answers, the following
+ cbm_raw_read() calls use JiffyDOS.
+
  \param HandleDevice  
    A CBM_FILE which contains the file handle of the driver.
 
@@ -307,7 +315,7 @@ opencbm_plugin_talk(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned
 {
     unsigned char proto, dataBuf[2];
 
-    proto = XUM1541_CBM | XUM_WRITE_ATN | XUM_WRITE_TALK;
+    proto = XUM1541_CBM | XUM_WRITE_ATN | XUM_WRITE_TALK | xum1541_jiffy();
     dataBuf[0] = 0x40 | DeviceAddress;
     dataBuf[1] = 0x60 | SecondaryAddress;
     return !xum1541_write((usb_dev_handle *)HandleDevice, proto, dataBuf, sizeof(dataBuf));
@@ -339,7 +347,7 @@ opencbm_plugin_open(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned
 {
     unsigned char proto, dataBuf[2];
 
-    proto = XUM1541_CBM | XUM_WRITE_ATN;
+    proto = XUM1541_CBM | XUM_WRITE_ATN | xum1541_jiffy();
     dataBuf[0] = 0x20 | DeviceAddress;
     dataBuf[1] = 0xf0 | SecondaryAddress;
     return !xum1541_write((usb_dev_handle *)HandleDevice, proto, dataBuf, sizeof(dataBuf));
@@ -713,6 +721,35 @@ opencbm_plugin_iec_wait(CBM_FILE HandleDevice, int Line, int State)
     return xum1541_ioctl((usb_dev_handle *)HandleDevice, XUM1541_IEC_WAIT, Line, State);
 }
 
+/*! \brief Set the IEC timing the firmware uses with a device
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Profile
+   One of the XUM_IEC_PROFILE_* values.
+
+ \return
+   The timing in use, setup time in the low byte and acknowledge
+   time in the high byte (us), or 0 if calibration failed. -1 if
+   the firmware does not know timing profiles.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_iec_timing(CBM_FILE HandleDevice, unsigned char DeviceAddress, int Profile)
+{
+    if ((DeviceCapabilities & XUM1541_CAP_TIMING) == 0)
+        return -1;
+
+    return xum1541_ioctl((usb_dev_handle *)HandleDevice, XUM1541_IEC_TIMING, DeviceAddress, Profile);
+}
+
 /*! \brief Sends a command to the xum1541 device
 
  This function sends a control message respectively a command to the xum1541 device.
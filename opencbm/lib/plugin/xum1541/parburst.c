@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define DBG_USERMODE
 #define DBG_PROGNAME "OPENCBM-XUM1541.DLL"
@@ -354,6 +355,159 @@ opencbm_plugin_srq_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffe
     return result;
 }
 
+/*! \brief SRQ: Start a burst fastload
+
+ This function sends the burst fastload command to a 1571 or
+ 1581 drive. The LISTEN and UNLISTEN tell the drive that we are
+ a fast serial host.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Command
+   Pointer to the burst command.
+
+ \param Size
+   The length of the command in bytes.
+
+ \return
+   0 on success, -1 if the firmware cannot do the burst fastload.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_burst_load(CBM_FILE HandleDevice, unsigned char DeviceAddress, const void *Command, size_t Size)
+{
+    unsigned char proto, dataBuf[2];
+    int result;
+
+    if ((DeviceCapabilities & XUM1541_CAP_NIB_SRQ) == 0)
+        return -1;
+
+    proto = XUM1541_CBM | XUM_WRITE_ATN | XUM_WRITE_FAST;
+    dataBuf[0] = 0x20 | DeviceAddress;
+    dataBuf[1] = 0x6f;
+    if (xum1541_write((usb_dev_handle *)HandleDevice, proto, dataBuf, 2) != 2)
+        return 1;
+
+    result = xum1541_write((usb_dev_handle *)HandleDevice, XUM1541_CBM, Command, Size);
+
+    // The drive starts sending once it sees the UNLISTEN.
+    dataBuf[0] = 0x3f;
+    if (xum1541_write((usb_dev_handle *)HandleDevice, proto, dataBuf, 1) != 1 ||
+        result != (int)Size) {
+        DBG_WARN((DBG_PREFIX "burst_load: returned with error %d", result));
+        return 1;
+    }
+
+    return 0;
+}
+
+/*! \brief SRQ: Read a block of a burst fastload
+
+ This function is a helper function for fast serial burst:
+ It reads one block with its status byte.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param Length
+   The length of the Buffer.
+
+ \return
+   The number of bytes read, or -1 on error.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_burst_load_block(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
+{
+    return xum1541_read((usb_dev_handle *)HandleDevice, XUM1541_BURST_LOAD, Buffer, Length);
+}
+
+/*! \brief Read disk blocks with the DOS block reader of the firmware
+
+ This function has the adapter run "U1", the error channel, "B-P"
+ and the data read for each block, up to XUM_DOS_MAX_BLOCKS blocks
+ per request.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param Channel
+   The channel of the open buffer on the drive.
+
+ \param TrackSector
+   Pointer to Count pairs of track and sector.
+
+ \param Count
+   The number of blocks to read.
+
+ \param Buffer
+   Pointer to a buffer of Count * 256 bytes for the data.
+
+ \param Status
+   Pointer to Count bytes for the DOS error number of each block.
+
+ \return
+   0 on success, -1 if the firmware has no DOS block reader,
+   1 on a USB error.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_read_blocks(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Channel, const unsigned char *TrackSector, unsigned int Count, unsigned char *Buffer, unsigned char *Status)
+{
+    unsigned char request[2 + 2 * XUM_DOS_MAX_BLOCKS];
+    unsigned char reply[XUM_DOS_MAX_BLOCKS * XUM_DOS_BLOCK_SIZE];
+    unsigned int i, n;
+    int len;
+
+    if ((DeviceCapabilities & XUM1541_CAP_DOS) == 0)
+        return -1;
+
+    request[0] = DeviceAddress;
+    request[1] = Channel;
+    for (; Count > 0; Count -= n) {
+        n = Count;
+        if (n > XUM_DOS_MAX_BLOCKS)
+            n = XUM_DOS_MAX_BLOCKS;
+        memcpy(request + 2, TrackSector, 2 * n);
+        if (xum1541_write((usb_dev_handle *)HandleDevice, XUM1541_DOS_READ, request, 2 + 2 * n) != (int)(2 + 2 * n))
+            return 1;
+
+        // Each block comes as its 256 data bytes, then the error number.
+        len = xum1541_read((usb_dev_handle *)HandleDevice, XUM1541_DOS_READ, reply, n * XUM_DOS_BLOCK_SIZE);
+        if (len != (int)(n * XUM_DOS_BLOCK_SIZE)) {
+            DBG_WARN((DBG_PREFIX "read_blocks: got %d bytes", len));
+            return 1;
+        }
+        for (i = 0; i < n; i++) {
+            memcpy(Buffer, reply + i * XUM_DOS_BLOCK_SIZE, 256);
+            *Status++ = reply[i * XUM_DOS_BLOCK_SIZE + 256];
+            Buffer += 256;
+        }
+        TrackSector += 2 * n;
+    }
+
+    return 0;
+}
+
 /**************** Tape routines below ****************/
 
 /*! \brief TAPE: Prepare capture
@@ -570,6 +724,226 @@ opencbm_plugin_tap_start_capture(CBM_FILE HandleDevice, unsigned char *Buffer, u
     return result;
 }
 
+/*! first tape firmware version which supports the packed capture format */
+#define XUM1541_TAP_PACKED_VERSION 0x0002
+
+/*! number of recent deltas the packed capture format refers to */
+#define TAP_PACKED_TABLE_SIZE 4
+
+/*! \internal \brief State of the decoder for the packed capture format
+
+ The firmware usually sends a delta as the difference to one of the
+ last four different deltas of the same signal level (see tape_153x.c). The decoder turns this
+ back into the unpacked format (2 or 5 byte timestamps), so the
+ callers do not see a difference.
+*/
+typedef struct tap_unpack_s
+{
+    cbm_tap_capture_cb callback;  /*!< the callback of the caller */
+    void *context;                /*!< the context of the caller */
+    unsigned char *out;           /*!< buffer for the unpacked data (the buffer of the caller) */
+    unsigned int outSize;         /*!< the size of out */
+    unsigned int outLen;          /*!< number of bytes in out */
+    int bytes;                    /*!< number of unpacked bytes in total */
+    int aborted;                  /*!< the callback requested to abort */
+    unsigned char code[6];        /*!< the code being collected, it can span two chunks */
+    unsigned int codeLen;         /*!< number of bytes in code */
+    unsigned int table[2][TAP_PACKED_TABLE_SIZE]; /*!< recent deltas per signal level, most recently used first */
+    unsigned int level;           /*!< signal level of the next delta */
+} tap_unpack;
+
+/*! \internal \brief Give the unpacked data to the callback of the caller */
+static int
+tap_unpack_flush(tap_unpack *Unpack)
+{
+    if (Unpack->outLen > 0 && !Unpack->aborted)
+    {
+        if (Unpack->callback(Unpack->context, Unpack->out, Unpack->outLen) != 0)
+            Unpack->aborted = 1;
+    }
+    Unpack->outLen = 0;
+    return Unpack->aborted;
+}
+
+/*! \internal \brief Append data in unpacked format */
+static void
+tap_unpack_put(tap_unpack *Unpack, const unsigned char *Data, unsigned int Length)
+{
+    if (Unpack->outLen + Length > Unpack->outSize)
+        tap_unpack_flush(Unpack);
+
+    memcpy(Unpack->out + Unpack->outLen, Data, Length);
+    Unpack->outLen += Length;
+    Unpack->bytes += Length;
+}
+
+/*! \internal \brief Append a delta in unpacked format, update the table
+
+ \param Unpack
+   The decoder state.
+
+ \param Entry
+   The table entry the delta refers to; TAP_PACKED_TABLE_SIZE - 1
+   for a new entry.
+
+ \param Delta
+   The delta.
+*/
+static void
+tap_unpack_delta(tap_unpack *Unpack, unsigned int Entry, unsigned int Delta)
+{
+    unsigned int *table = Unpack->table[Unpack->level];
+    unsigned char buf[5];
+
+    Unpack->level ^= 1;
+
+    /* long signal: HiDelta (23 bit, MSB set) and LoDelta; Delta < 2^32 */
+    buf[0] = 0x80;
+    buf[1] = (unsigned char)(Delta >> 24);
+    buf[2] = (unsigned char)(Delta >> 16);
+    buf[3] = (unsigned char)(Delta >> 8);
+    buf[4] = (unsigned char)Delta;
+
+    if (Delta >= 0x8000)
+        tap_unpack_put(Unpack, buf, 5);
+    else
+        tap_unpack_put(Unpack, buf + 3, 2);
+
+    for (; Entry > 0; Entry--)
+        table[Entry] = table[Entry - 1];
+    table[0] = Delta;
+}
+
+/*! \internal \brief Callback for xum1541_read_stream(): decode a chunk of packed data */
+static int
+tap_unpack_chunk(void *Context, const unsigned char *Data, unsigned int Length)
+{
+    tap_unpack *Unpack = Context;
+    unsigned char *code = Unpack->code;
+    unsigned int *table, needed, entry;
+    int diff;
+
+    for (; Length > 0; Length--)
+    {
+        code[Unpack->codeLen++] = *Data++;
+
+        if ((code[0] & 0x80) == 0)
+            needed = 1;
+        else if ((code[0] & 0xc0) == 0x80)
+            needed = 2;
+        else if ((code[0] & 0xe0) == 0xc0)
+            needed = 3;
+        else
+            needed = 6;
+
+        if (Unpack->codeLen < needed)
+            continue;
+        Unpack->codeLen = 0;
+        table = Unpack->table[Unpack->level];
+
+        switch (needed)
+        {
+        case 1:
+            entry = code[0] >> 5;
+            diff = (code[0] & 0x1f) - ((code[0] & 0x10) ? 32 : 0);
+            tap_unpack_delta(Unpack, entry, table[entry] + diff);
+            break;
+
+        case 2:
+            diff = (((code[0] & 0x3f) << 8) | code[1]) - ((code[0] & 0x20) ? 16384 : 0);
+            tap_unpack_delta(Unpack, TAP_PACKED_TABLE_SIZE - 1, table[0] + diff);
+            break;
+
+        case 3:
+            tap_unpack_delta(Unpack, TAP_PACKED_TABLE_SIZE - 1, ((code[0] & 0x1f) << 16) | (code[1] << 8) | code[2]);
+            break;
+
+        default:
+            /* very long signal, already in unpacked format */
+            tap_unpack_put(Unpack, code + 1, 5);
+            Unpack->level ^= 1;
+            break;
+        }
+    }
+
+    return tap_unpack_flush(Unpack);
+}
+
+/*! \brief TAPE: Start streaming capture
+
+ This function is a helper function for tape:
+ It starts the actual tape capture, giving the data to a callback
+ in chunks as it arrives.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which is used for the chunks. It must be able to
+   hold at least XUM_MAX_XFER_SIZE bytes.
+
+ \param Buffer_Length
+   The length of the Buffer.
+
+ \param Callback
+   The function which gets the chunks.
+
+ \param Context
+   A pointer which is given to the Callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_tap_start_capture_stream(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_cb Callback, void *Context, int *Status, int *BytesRead)
+{
+    usb_dev_handle *HandleXum1541 = (usb_dev_handle *)HandleDevice;
+    unsigned char *packed = NULL;
+    tap_unpack unpack;
+    int result;
+
+    /*
+     * If the firmware supports it, let it send the packed format, which
+     * needs far less USB bandwidth. It is unpacked into the Buffer, so
+     * the caller gets the same data as without packing.
+     */
+    if (xum1541_ioctl(HandleXum1541, XUM1541_TAP_GET_VER, 0, 0) >= XUM1541_TAP_PACKED_VERSION)
+        packed = malloc(XUM_MAX_XFER_SIZE);
+
+    if (packed == NULL) {
+        result = xum1541_read_stream(HandleXum1541, XUM1541_TAP, Buffer, Buffer_Length, Callback, Context, Status, BytesRead);
+    } else {
+        memset(&unpack, 0, sizeof(unpack));
+        unpack.callback = Callback;
+        unpack.context = Context;
+        unpack.out = Buffer;
+        unpack.outSize = Buffer_Length;
+
+        result = xum1541_read_stream(HandleXum1541, XUM1541_TAP | XUM_TAP_PACKED, packed, XUM_MAX_XFER_SIZE, tap_unpack_chunk, &unpack, Status, BytesRead);
+        DBG_PRINT((DBG_PREFIX "opencbm_plugin_tap_start_capture_stream: %d packed bytes, %d unpacked", *BytesRead, unpack.bytes));
+
+        *BytesRead = unpack.bytes;
+        free(packed);
+    }
+
+    if (result <= 0) {
+        DBG_WARN((DBG_PREFIX "opencbm_plugin_tap_start_capture_stream: returned with error %d", result));
+    }
+    return result;
+}
+
 /*! \brief TAPE: Start write
 
  This function is a helper function for tape:
@@ -609,6 +983,52 @@ opencbm_plugin_tap_start_write(CBM_FILE HandleDevice, unsigned char *Buffer, uns
     return result;
 }
 
+/*! \brief TAPE: Start streaming write
+
+ This function is a helper function for tape:
+ It starts the actual tape write, requesting the data from a callback
+ in chunks while the tape is written.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer which is used for the chunks.
+
+ \param Buffer_Length
+   The length of the Buffer.
+
+ \param Callback
+   The function which fills the chunks.
+
+ \param Context
+   A pointer which is given to the Callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to 
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_tap_start_write_stream(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_write_cb Callback, void *Context, int *Status, int *BytesWritten)
+{
+    int result = xum1541_write_stream((usb_dev_handle *)HandleDevice, XUM1541_TAP, Buffer, Buffer_Length, Callback, Context, Status, BytesWritten);
+    if (result <= 0) {
+        DBG_WARN((DBG_PREFIX "opencbm_plugin_tap_start_write_stream: returned with error %d", result));
+    }
+    return result;
+}
+
 /*! \brief TAPE: Return tape firmware version
 
  This function is a helper function for tape:
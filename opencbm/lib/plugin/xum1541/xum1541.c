@@ -44,6 +44,7 @@
 static int debug_level = -1; /*!< \internal \brief the debugging level for debugging output */
 
 unsigned char DeviceDriveMode; // Temporary disk/tape mode hack until usb device handle context is there.
+unsigned char DeviceCapabilities; // XUM1541_CAP_* as reported by the device, same hack as above
 
 /*! \internal \brief Output debugging information for the xum1541
 
@@ -247,6 +248,29 @@ xum1541_enumerate(usb_dev_handle **HandleXum1541, int PortNumber)
     }
 }
 
+/*! \brief Check if the CBM protocol should probe for JiffyDOS
+
+ The JiffyDOS transfers have only been tested against the simulator,
+ not with real JiffyDOS drives. Thus, they are only used if the
+ environment variable XUM1541_JIFFY is set to a value other than 0,
+ and if the firmware supports them.
+
+ \return
+   XUM_WRITE_JIFFY if JiffyDOS is to be used, else 0.
+*/
+unsigned char
+xum1541_jiffy(void)
+{
+    static int jiffy = -1;
+
+    if (jiffy == -1) {
+        char *val = getenv("XUM1541_JIFFY");
+        jiffy = (val != NULL && atoi(val) != 0);
+    }
+
+    return (jiffy && (DeviceCapabilities & XUM1541_CAP_JIFFY)) ? XUM_WRITE_JIFFY : 0;
+}
+
 // Check for a firmware version compatible with this plugin
 static int
 xum1541_check_version(int version)
@@ -378,6 +402,7 @@ xum1541_init(usb_dev_handle **HandleXum1541, int PortNumber)
 
     // Place after "xum1541_usb_handle" allocation:
     /*uh->*/DeviceDriveMode = DeviceDriveMode_Uninit;
+    DeviceCapabilities = 0;
 
     xum1541_enumerate(HandleXum1541, PortNumber);
 
@@ -419,6 +444,16 @@ xum1541_init(usb_dev_handle **HandleXum1541, int PortNumber)
     if (len >= 4) {
         xum1541_dbg(0, "device capabilities %02x status %02x",
             devInfo[1], devInfo[2]);
+        DeviceCapabilities = devInfo[1];
+        if (devInfo[1] & XUM1541_CAP_JIFFY)
+            xum1541_dbg(1, "JiffyDOS %s", xum1541_jiffy() ?
+                "used for devices that answer it" : "available, set XUM1541_JIFFY=1 to use it");
+        if (devInfo[1] & XUM1541_CAP_NIB_SRQ)
+            xum1541_dbg(1, "burst fastload available for 1571/1581");
+        if (devInfo[1] & XUM1541_CAP_DOS)
+            xum1541_dbg(1, "DOS block reader available");
+        if (devInfo[1] & XUM1541_CAP_TIMING)
+            xum1541_dbg(1, "IEC timing profiles available");
     }
 
     // Check for the xum1541's current status. (Not the drive.)
@@ -758,6 +793,116 @@ xum1541_write(usb_dev_handle *HandleXum1541, unsigned char modeFlags, const unsi
     return bytesWritten;
 }
 
+/*! \brief Write data of unknown length to the xum1541 device, chunk by chunk
+
+ The data is requested from the callback chunk by chunk, and every
+ chunk is written to the device before the next one is requested.
+ This way, the memory needed does not depend on the length of the
+ transfer. It is used for tape write, where the device takes the data
+ as it writes it to tape.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param modeFlags
+    Drive protocol to use to write the data to the device.
+
+ \param data
+    Pointer to a buffer which is used for the chunks.
+
+ \param size
+    The size of the buffer.
+
+ \param callback
+    The function which fills the chunks. It returns the number of bytes
+    in the chunk, 0 at the end of the data, or < 0 to abort the transfer.
+
+ \param context
+    A pointer which is given to the callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+int
+xum1541_write_stream(usb_dev_handle *HandleXum1541, unsigned char modeFlags,
+    unsigned char *data, size_t size, cbm_tap_write_cb callback,
+    void *context, int *Status, int *BytesWritten)
+{
+    int wr, len, pos, bytes2write;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = ((modeFlags == XUM1541_TAP) || (modeFlags == XUM1541_TAP_CONFIG));
+
+    xum1541_dbg(1, "[xum1541_write_stream] %d, buffer of %d bytes", modeFlags, size);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    // Send the write command; the length is not known in advance
+    cmdBuf[0] = XUM1541_WRITE;
+    cmdBuf[1] = modeFlags;
+    cmdBuf[2] = 0xff;
+    cmdBuf[3] = 0xff;
+    wr = usb.bulk_write(HandleXum1541,
+        XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+        (char *)cmdBuf, sizeof(cmdBuf), LIBUSB_NO_TIMEOUT);
+    if (wr < 0) {
+        fprintf(stderr, "USB error in write cmd: %s\n",
+            usb.strerror());
+        return -1;
+    }
+
+    *BytesWritten = 0;
+    while ((len = callback(context, data, (unsigned int)size)) > 0) {
+        for (pos = 0; pos < len; pos += wr) {
+            bytes2write = len - pos;
+            if (bytes2write > XUM_MAX_XFER_SIZE)
+                bytes2write = XUM_MAX_XFER_SIZE;
+            wr = usb.bulk_write(HandleXum1541,
+                XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+                (char *)data + pos, bytes2write, LIBUSB_NO_TIMEOUT);
+            if (wr < 0) {
+                if (isTapeCmd)
+                {
+                    // The device stopped early (e.g., <STOP> pressed).
+                    if (usb.resetep(HandleXum1541, XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT) < 0)
+                        fprintf(stderr, "USB reset ep request failed for out ep (tape stall): %s\n", usb.strerror());
+                    if (usb.control_msg(HandleXum1541, USB_RECIP_ENDPOINT, USB_REQ_CLEAR_FEATURE, 0, XUM_BULK_OUT_ENDPOINT, NULL, 0, USB_TIMEOUT) < 0)
+                        fprintf(stderr, "USB error in xum1541_control_msg (tape stall): %s\n", usb.strerror());
+                    goto done;
+                }
+                fprintf(stderr, "USB error in write data: %s\n",
+                    usb.strerror());
+                return -1;
+            }
+
+            xum1541_dbg(2, "wrote %d bytes", wr);
+            *BytesWritten += wr;
+
+            // A short write means the device does not take more data.
+            if (wr < bytes2write)
+                goto done;
+        }
+    }
+
+    if (len < 0) {
+        // Stop the write, the device does not get the rest of the data
+        xum1541_dbg(1, "[xum1541_write_stream] aborted by callback");
+        xum1541_tap_break(HandleXum1541);
+    }
+
+done:
+    xum1541_dbg(2, "[xum1541_write_stream] BytesWritten = %d", *BytesWritten);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_write_stream] Status = %d", *Status);
+    return 1;
+}
+
 /*! \brief Wrapper for xum1541_write() forcing xum1541_wait_status(), with additional parameters:
 
  \param Status
@@ -886,3 +1031,110 @@ xum1541_read(usb_dev_handle *HandleXum1541, unsigned char mode, unsigned char *d
     xum1541_dbg(2, "read done, got %d bytes", bytesRead);
     return bytesRead;
 }
+
+/*! \brief Read data of unknown length from the xum1541 device, chunk by chunk
+
+ The data is read into the buffer; every time the buffer is full (or
+ the transfer ends), the data is given to the callback. This way, the
+ memory needed does not depend on the length of the transfer. It is
+ used for tape capture, which ends when the tape is stopped.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param mode
+    Drive protocol to use to read the data from the device.
+
+ \param data
+    Pointer to a buffer which is used for the chunks.
+
+ \param size
+    The size of the buffer. It must be at least XUM_MAX_XFER_SIZE.
+
+ \param callback
+    The function which gets the chunks. If it returns non-zero, the
+    transfer is aborted.
+
+ \param context
+    A pointer which is given to the callback unchanged.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+int
+xum1541_read_stream(usb_dev_handle *HandleXum1541, unsigned char mode,
+    unsigned char *data, size_t size, cbm_tap_capture_cb callback,
+    void *context, int *Status, int *BytesRead)
+{
+    int rd, aborted = 0;
+    size_t bytesInBuffer;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = ((XUM_RW_PROTO(mode) == XUM1541_TAP) || (mode == XUM1541_TAP_CONFIG));
+
+    xum1541_dbg(1, "[xum1541_read_stream] %d, buffer of %d bytes", mode, size);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if (size < XUM_MAX_XFER_SIZE) {
+        fprintf(stderr, "xum1541_read_stream: buffer too small (%d)\n", (int)size);
+        return -1;
+    }
+
+    // Send the read command; the length is not known in advance
+    cmdBuf[0] = XUM1541_READ;
+    cmdBuf[1] = mode;
+    cmdBuf[2] = 0xff;
+    cmdBuf[3] = 0xff;
+    rd = usb.bulk_write(HandleXum1541,
+        XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+        (char *)cmdBuf, sizeof(cmdBuf), LIBUSB_NO_TIMEOUT);
+    if (rd < 0) {
+        fprintf(stderr, "USB error in read cmd: %s\n",
+            usb.strerror());
+        return -1;
+    }
+
+    *BytesRead = 0;
+    bytesInBuffer = 0;
+    do {
+        rd = usb.bulk_read(HandleXum1541,
+            XUM_BULK_IN_ENDPOINT | USB_ENDPOINT_IN,
+            (char *)data + bytesInBuffer, XUM_MAX_XFER_SIZE, LIBUSB_NO_TIMEOUT);
+        if (rd < 0) {
+            fprintf(stderr, "USB error in read data(%p, %d): %s\n",
+               data, (int)size, usb.strerror());
+            return -1;
+        }
+
+        xum1541_dbg(2, "read %d bytes", rd);
+        bytesInBuffer += rd;
+        *BytesRead += rd;
+
+        /*
+         * Hand the data over if there is no room left for another
+         * transfer, or if the transfer is done (short read).
+         */
+        if (bytesInBuffer + XUM_MAX_XFER_SIZE > size || rd < XUM_MAX_XFER_SIZE) {
+            if (!aborted && bytesInBuffer > 0
+                && callback(context, data, (unsigned int)bytesInBuffer) != 0) {
+                // Stop the capture, but drain the data still pending
+                xum1541_dbg(1, "[xum1541_read_stream] aborted by callback");
+                xum1541_tap_break(HandleXum1541);
+                aborted = 1;
+            }
+            bytesInBuffer = 0;
+        }
+    } while (rd == XUM_MAX_XFER_SIZE);
+
+    xum1541_dbg(2, "[xum1541_read_stream] BytesRead = %d", *BytesRead);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_read_stream] Status = %d", *Status);
+    return 1;
+}
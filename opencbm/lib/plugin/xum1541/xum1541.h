@@ -46,12 +46,16 @@ CTASSERT(sizeof(CBM_FILE) >= sizeof(usb_dev_handle *));
 #define DeviceDriveMode_Disk            1 // Disk drive mode (only communication to disk drives allowed)
 #define DeviceDriveMode_Tape            2 // Tape drive mode (only communication to tape drive allowed)
 
+// XUM1541_CAP_* of the device, set by xum1541_init()
+extern unsigned char DeviceCapabilities;
+
 const char *xum1541_device_path(int PortNumber);
 int xum1541_init(usb_dev_handle **HandleXum1541, int PortNumber);
 void xum1541_close(usb_dev_handle *HandleXum1541);
 int xum1541_control_msg(usb_dev_handle *HandleXum1541, unsigned int cmd);
 int xum1541_ioctl(usb_dev_handle *HandleXum1541, unsigned int cmd,
     unsigned int addr, unsigned int secaddr);
+unsigned char xum1541_jiffy(void);
 
 // Read/write data in normal CBM and speeder protocol modes
 int xum1541_write(usb_dev_handle *HandleXum1541, unsigned char mode,
@@ -62,6 +66,12 @@ int xum1541_read(usb_dev_handle *HandleXum1541, unsigned char mode,
     unsigned char *data, size_t size);
 int xum1541_read_ext(usb_dev_handle *HandleXum1541, unsigned char mode,
     unsigned char *data, size_t size, int *Status, int *BytesRead);
+int xum1541_read_stream(usb_dev_handle *HandleXum1541, unsigned char mode,
+    unsigned char *data, size_t size, cbm_tap_capture_cb callback,
+    void *context, int *Status, int *BytesRead);
+int xum1541_write_stream(usb_dev_handle *HandleXum1541, unsigned char mode,
+    unsigned char *data, size_t size, cbm_tap_write_cb callback,
+    void *context, int *Status, int *BytesWritten);
 
 int xum1541_tap_break(usb_dev_handle *HandleXum1541);
 
@@ -82,13 +82,126 @@ static int check_drive_type(CBM_FILE fd, unsigned char drive,
 }
 
 
-static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
-                      const cbmcopy_settings *settings,
+/*
+ * a copy session keeps track of the turbo code which has been uploaded
+ * into the drive, so that it can be reused for the next file
+ */
+struct cbmcopy_session_s
+{
+    CBM_FILE fd;
+    cbmcopy_settings *settings;
+    unsigned char drive;
+    const unsigned char *resident;  /* turbo code resident in the drive, or NULL */
+    int auto_mode;                  /* the transfer mode was "auto" */
+    int keep;                       /* hold the turbo buffers: 1 yes, 0 one file only, -1 DOS refused */
+    int reserved;                   /* the turbo buffers are held */
+};
+
+/*
+ * The turbo code lives at $0500 (main part) and $0680 (I/O part), in
+ * the drive buffers 2 and 3. A session holds them with two direct
+ * access channels, so that the DOS never loads a block of another file
+ * there, and the code can be reused without reading it back.
+ */
+static int reserve_buffers(cbmcopy_session *session,
+                           cbmcopy_message_cb msg_cb)
+{
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+    char buf[48];
+
+    if(session->keep <= 0)
+    {
+        return -1;
+    }
+    if(session->reserved)
+    {
+        return 0;
+    }
+
+    /* anything uploaded before may have been overwritten */
+    session->resident = NULL;
+
+    cbm_open( fd, drive, SA_BUF2, "#2", 2 );
+    if(cbm_device_status( fd, drive, buf, sizeof(buf) ) == 0)
+    {
+        cbm_open( fd, drive, SA_BUF3, "#3", 2 );
+        if(cbm_device_status( fd, drive, buf, sizeof(buf) ) == 0)
+        {
+            msg_cb( sev_debug, "holding the turbo buffers" );
+            session->reserved = 1;
+            return 0;
+        }
+        cbm_close( fd, drive, SA_BUF3 );
+    }
+    cbm_close( fd, drive, SA_BUF2 );
+
+    msg_cb( sev_debug, "could not reserve the turbo buffers: %s", buf );
+    session->keep = -1;
+    return -1;
+}
+
+static void release_buffers(cbmcopy_session *session)
+{
+    if(session->reserved)
+    {
+        cbm_close( session->fd, session->drive, SA_BUF3 );
+        cbm_close( session->fd, session->drive, SA_BUF2 );
+        session->reserved = 0;
+    }
+    session->resident = NULL;
+}
+
+/*
+ * Open a file by name, or a direct access channel if cbmname is NULL.
+ * If the DOS has no buffer left for it ("70, NO CHANNEL") while the
+ * turbo buffers are held, these are given up for the session.
+ */
+static int open_file(cbmcopy_session *session, unsigned char sa,
+                     const char *cbmname, int cbmname_len,
+                     char *buf, size_t buf_size,
+                     cbmcopy_message_cb msg_cb)
+{
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+    int rv;
+
+    for(;;)
+    {
+        if(cbmname)
+        {
+            cbm_open( fd, drive, sa, NULL, 0 );
+            cbm_raw_write( fd, cbmname, cbmname_len );
+            cbm_unlisten( fd );
+        }
+        else
+        {
+            cbm_open( fd, drive, sa, "#", 1 );
+        }
+        rv = cbm_device_status( fd, drive, buf, buf_size );
+
+        if(rv != 70 || !session->reserved)
+        {
+            return rv;
+        }
+
+        msg_cb( sev_debug, "no buffer left, giving up the turbo buffers" );
+        cbm_close( fd, drive, sa );
+        release_buffers(session);
+        session->keep = -1;
+    }
+}
+
+static int send_turbo(cbmcopy_session *session, int write,
                       const unsigned char *turbo, size_t turbo_size,
                       const unsigned char *start_cmd, size_t cmd_len,
                       cbmcopy_message_cb msg_cb)
 {
     const transfer_funcs *trf;
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+    const cbmcopy_settings *settings = session->settings;
+    int rv;
 
     trf = transfers[settings->transfer_mode].trf;
     /*
@@ -99,15 +212,31 @@ static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
     {
         if(turbo_size)
         {
-            cbm_upload( fd, drive, 0x500, turbo, turbo_size );
-            msg_cb( sev_debug, "uploading %d bytes turbo code", turbo_size );
-            if(trf->upload_turbo(fd, drive, settings->drive_type, write) == 0)
+            rv = -1;
+            if(session->resident == turbo && session->reserved)
+            {
+                /* re-attaches to the I/O part of the transfer mode */
+                rv = trf->reuse_turbo(fd, drive, settings->drive_type, write);
+                if(rv == 0)
+                {
+                    msg_cb( sev_debug, "reusing resident turbo code" );
+                }
+            }
+            if(rv != 0)
+            {
+                session->resident = NULL;
+                cbm_upload( fd, drive, 0x500, turbo, turbo_size );
+                msg_cb( sev_debug, "uploading %d bytes turbo code", turbo_size );
+                rv = trf->upload_turbo(fd, drive, settings->drive_type, write);
+            }
+            if(rv == 0)
             {
                 cbm_exec_command( fd, drive, start_cmd, cmd_len );
                 msg_cb( sev_debug, "initializing transfer code" );
                 if(trf->start_turbo(fd, write) == 0)
                 {
                     msg_cb( sev_debug, "done" );
+                    session->resident = turbo;
                     return 0;
                 }
                 else
@@ -115,6 +244,8 @@ static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
                     msg_cb( sev_fatal, "could not start turbo" );
                 }
             }
+            /* do not trust the drive memory contents anymore */
+            session->resident = NULL;
         }
         else
         {
@@ -133,9 +264,86 @@ static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
 }
 
 
-static int cbmcopy_read(CBM_FILE fd,
-                        cbmcopy_settings *settings,
-                        unsigned char drive,
+/*
+ * Load a file with the burst fastload of the 1571/1581 ROM. No drive
+ * code is needed, but the adapter must be able to do fast serial.
+ * Returns -1 without touching the drive if that is not the case.
+ */
+static int cbmcopy_burst_read(cbmcopy_session *session,
+                              const char *cbmname,
+                              int cbmname_len,
+                              unsigned char **filedata,
+                              size_t *filedata_size,
+                              cbmcopy_message_cb msg_cb,
+                              cbmcopy_status_cb status_cb)
+{
+    int rv;
+    int i;
+    int blocks_read;
+    unsigned char buf[48];
+    unsigned char *data;
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+
+    rv = cbm_burst_load( fd, drive, cbmname, cbmname_len );
+    if(rv == -1)
+    {
+        msg_cb( sev_debug, "burst fastload not supported by the adapter" );
+        return -1;
+    }
+
+    /* the drive reads the file through its buffers */
+    session->resident = NULL;
+
+    if(rv == 0)
+    {
+        msg_cb( sev_debug, "using burst fastload" );
+        status_cb( 0 );
+
+        for(blocks_read = 0; ; blocks_read++)
+        {
+            data = realloc(*filedata, *filedata_size + 254);
+            if(data == NULL)
+            {
+                msg_cb( sev_fatal, "Out of memory" );
+                rv = 1;
+                break;
+            }
+            *filedata = data;
+
+            i = cbm_burst_load_block( fd, data + *filedata_size );
+            msg_cb( sev_debug, "number of bytes read for block %d: %d", blocks_read, i );
+            if(i < 0)
+            {
+                rv = 1;
+                break;
+            }
+            if(i < 255)
+            {
+                *filedata_size += i;
+                status_cb( blocks_read + 1 );
+                break;
+            }
+            *filedata_size += 254;
+            status_cb( blocks_read + 1 );
+        }
+    }
+
+    if(rv)
+    {
+        if(cbm_device_status( fd, drive, (char*)buf, sizeof(buf) ) != 0)
+        {
+            msg_cb( sev_fatal, "could not read file: %s", buf );
+        }
+        else
+        {
+            msg_cb( sev_fatal, "burst fastload failed" );
+        }
+    }
+    return rv;
+}
+
+static int cbmcopy_read(cbmcopy_session *session,
                         int track, int sector,
                         const char *cbmname,
                         int cbmname_len,
@@ -152,6 +360,10 @@ static int cbmcopy_read(CBM_FILE fd,
     const unsigned char *turbo;
     const transfer_funcs *trf;
     int blocks_read;
+    int block_delay;
+    CBM_FILE fd = session->fd;
+    cbmcopy_settings *settings = session->settings;
+    unsigned char drive = session->drive;
 
     *filedata = NULL;
     *filedata_size = 0;
@@ -165,6 +377,8 @@ static int cbmcopy_read(CBM_FILE fd,
         return -1;
     }
 
+    block_delay = 0;
+
     switch(settings->drive_type)
     {
         case cbm_dt_cbm1541:
@@ -190,6 +404,8 @@ static int cbmcopy_read(CBM_FILE fd,
         case cbm_dt_sfd1001:
             turbo = NULL;
             turbo_size = 0;
+            /* not measured on IEEE-488 drives, keep their block delays */
+            block_delay = 1;
             break;
     }
 
@@ -200,22 +416,42 @@ static int cbmcopy_read(CBM_FILE fd,
         turbo_size = 0;
     }
 
+    if(turbo)
+    {
+        /* the delays are for the drive code, see below */
+        block_delay = 1;
+    }
+
+    if(cbmname && turbo && settings->burst_load && session->auto_mode &&
+       settings->drive_type != cbm_dt_cbm1541)
+    {
+        /* 1570/1571/1581: try the fastload in the ROM first */
+        if(cbmname_len == 0) cbmname_len = strlen( cbmname );
+        rv = cbmcopy_burst_read(session, cbmname, cbmname_len,
+                                filedata, filedata_size,
+                                msg_cb, status_cb);
+        if(rv != -1)
+        {
+            return rv;
+        }
+    }
+
+    if(turbo)
+    {
+        /* if this fails, the turbo is just uploaded for each file */
+        reserve_buffers(session, msg_cb);
+    }
+
     if(cbmname)
     {
         /* start by file name */
         track = 0;
         sector = 0;
-        cbm_open( fd, drive, SA_READ, NULL, 0 );
         if(cbmname_len == 0) cbmname_len = strlen( cbmname );
-        cbm_raw_write( fd, cbmname, cbmname_len );
-        cbm_unlisten( fd );
     }
-    else
-    {
-        /* start by track/sector */
-        cbm_open( fd, drive, SA_READ, "#", 1 );
-    }
-    rv = cbm_device_status( fd, drive, (char*)buf, sizeof(buf) );
+    /* else start by track/sector */
+    rv = open_file(session, SA_READ, cbmname, cbmname_len,
+                   (char*)buf, sizeof(buf), msg_cb);
 
     if(rv)
     {
@@ -233,7 +469,7 @@ static int cbmcopy_read(CBM_FILE fd,
     sprintf( (char*)buf, "U4:%c%c", (unsigned char)track, (unsigned char)sector );
 
     SETSTATEDEBUG((void)0);    // pre send_turbo condition
-    if(send_turbo(fd, drive, 0, settings,
+    if(send_turbo(session, 0,
                   turbo, turbo_size, buf, 5, msg_cb) == 0)
     {
         msg_cb( sev_debug, "start of copy" );
@@ -254,7 +490,10 @@ static int cbmcopy_read(CBM_FILE fd,
         while( (error = trf->check_error(fd, 0)) == 0 )
         {
             SETSTATEDEBUG((void)0); // after check_error condition
-            arch_usleep(1000);      // fix for Tim's environment
+            if(block_delay)
+            {
+                arch_usleep(1000);      // fix for Tim's environment
+            }
 
             SETSTATEDEBUG(DebugBlockCount++);    // preset condition
 
@@ -285,7 +524,10 @@ static int cbmcopy_read(CBM_FILE fd,
                  *        now, shouldn't we wait for it then?"
                  *    add a little delay after the turbo start
                  */
-                arch_usleep(1000);
+                if(block_delay)
+                {
+                    arch_usleep(1000);
+                }
 
                 if( i < 255)
                 {
@@ -299,6 +541,7 @@ static int cbmcopy_read(CBM_FILE fd,
                     else
                     {
                         rv = -1;
+                        session->resident = NULL;
                     }
                     break;
                 }
@@ -339,6 +582,7 @@ static int cbmcopy_read(CBM_FILE fd,
         if(rv)
         {
             msg_cb( sev_warning, "file copy ended with error status: %s", buf );
+            session->resident = NULL;
         }
     }
 
@@ -508,15 +752,14 @@ cbmcopy_settings *cbmcopy_get_default_settings(void)
     {
         settings->drive_type    = cbm_dt_unknown; /* auto detect later on */
         settings->transfer_mode = 0;
+        settings->burst_load    = 1;
     }
     return settings;
 }
 
 
 
-int cbmcopy_write_file(CBM_FILE fd,
-                       cbmcopy_settings *settings,
-                       int drivei,
+static int cbmcopy_write(cbmcopy_session *session,
                        const char *cbmname,
                        int cbmname_len,
                        const unsigned char *filedata,
@@ -527,12 +770,14 @@ int cbmcopy_write_file(CBM_FILE fd,
     int rv;
     int i;
     int turbo_size;
-    unsigned char drive = (unsigned char) drivei; //! \todo Find better solution
     int error;
     unsigned char buf[48];
     const unsigned char *turbo;
     const transfer_funcs *trf;
     int blocks_written;
+    CBM_FILE fd = session->fd;
+    cbmcopy_settings *settings = session->settings;
+    unsigned char drive = session->drive;
 
     msg_cb( sev_debug, "using transfer mode `%s'",
             transfers[settings->transfer_mode].name);
@@ -578,11 +823,15 @@ int cbmcopy_write_file(CBM_FILE fd,
         turbo_size = 0;
     }
 
-    cbm_open( fd, drive, SA_WRITE, NULL, 0 );
+    if(turbo)
+    {
+        /* if this fails, the turbo is just uploaded for each file */
+        reserve_buffers(session, msg_cb);
+    }
+
     if(cbmname_len == 0) cbmname_len = strlen( cbmname );
-    cbm_raw_write( fd, cbmname, cbmname_len );
-    cbm_unlisten( fd );
-    rv = cbm_device_status( fd, drive, buf, sizeof(buf) );
+    rv = open_file(session, SA_WRITE, cbmname, cbmname_len,
+                   (char*)buf, sizeof(buf), msg_cb);
 
     if(rv)
     {
@@ -594,7 +843,7 @@ int cbmcopy_write_file(CBM_FILE fd,
     error = 0;
 
     SETSTATEDEBUG((void)0);    // pre send_turbo condition
-    if(send_turbo(fd, drive, 1, settings,
+    if(send_turbo(session, 1,
                   turbo, turbo_size, (unsigned char*)"U4:", 3, msg_cb) == 0)
     {
         msg_cb( sev_debug, "start of copy" );
@@ -626,6 +875,7 @@ int cbmcopy_write_file(CBM_FILE fd,
                 /* normally blocks of 254 bytes are written, even if the count byte is at value 255 */
                 /* for the last block of a file, only filedata_size bytes need to be transferred    */
                 rv = -1;
+                session->resident = NULL;
                 break;
             }
 
@@ -633,6 +883,7 @@ int cbmcopy_write_file(CBM_FILE fd,
             if ( trf->check_error( fd, 1 ) != 0 )
             {
                 rv = -1;
+                session->resident = NULL;
                 break;
             }
 
@@ -646,8 +897,15 @@ int cbmcopy_write_file(CBM_FILE fd,
              *       "hmmmm, if we know that the drive is busy
              *        now, shouldn't we wait for it then?"
              *    add a little delay after the turbo start
+             *
+             * The other drives do not need it, and on some systems
+             * the delay is much longer than requested, so it is
+             * only done where the race has been observed.
              */
-            arch_usleep(1000);
+            if(settings->drive_type == cbm_dt_cbm1581)
+            {
+                arch_usleep(1000);
+            }
 
             status_cb( ++blocks_written );
             SETSTATEDEBUG((void)0);
@@ -665,6 +923,7 @@ int cbmcopy_write_file(CBM_FILE fd,
         if(rv)
         {
             msg_cb( sev_warning, "file copy ended with error status: %s", buf );
+            session->resident = NULL;
         }
     }
     cbm_close( fd, drive, SA_WRITE );
@@ -672,7 +931,98 @@ int cbmcopy_write_file(CBM_FILE fd,
 }
 
 
+cbmcopy_session *cbmcopy_session_open(CBM_FILE fd,
+                                      cbmcopy_settings *settings,
+                                      int drive)
+{
+    cbmcopy_session *session;
+
+    session = malloc(sizeof(cbmcopy_session));
+
+    if(NULL != session)
+    {
+        session->fd       = fd;
+        session->settings = settings;
+        session->drive    = (unsigned char) drive;
+        session->resident = NULL; /* nothing uploaded yet */
+        session->keep     = 1;
+        session->reserved = 0;
+
+        /* only "auto" may use the burst fastload instead of the turbo */
+        session->auto_mode = (settings->transfer_mode == 0);
+        if(session->auto_mode)
+        {
+            settings->transfer_mode =
+                cbmcopy_check_auto_transfer_mode(fd, 0, drive);
+        }
+    }
+    return session;
+}
+
+
+void cbmcopy_session_close(cbmcopy_session *session)
+{
+    /* the turbo code is left in the drive memory, it is inactive anyway */
+    release_buffers(session);
+    free(session);
+}
+
+
 /* just a wrapper */
+int cbmcopy_session_write_file(cbmcopy_session *session,
+                               const char *cbmname,
+                               int cbmname_len,
+                               const unsigned char *filedata,
+                               int filedata_size,
+                               cbmcopy_message_cb msg_cb,
+                               cbmcopy_status_cb status_cb)
+{
+    return cbmcopy_write(session,
+                         cbmname, cbmname_len,
+                         filedata, filedata_size,
+                         msg_cb, status_cb);
+}
+
+
+/* just a wrapper */
+int cbmcopy_session_read_file(cbmcopy_session *session,
+                              const char *cbmname,
+                              int cbmname_len,
+                              unsigned char **filedata,
+                              size_t *filedata_size,
+                              cbmcopy_message_cb msg_cb,
+                              cbmcopy_status_cb status_cb)
+{
+    return cbmcopy_read(session,
+                        0, 0,
+                        cbmname, cbmname_len,
+                        filedata, filedata_size,
+                        msg_cb, status_cb);
+}
+
+
+/* just a wrapper, using a session which lasts for one file only */
+int cbmcopy_write_file(CBM_FILE fd,
+                       cbmcopy_settings *settings,
+                       int drive,
+                       const char *cbmname,
+                       int cbmname_len,
+                       const unsigned char *filedata,
+                       int filedata_size,
+                       cbmcopy_message_cb msg_cb,
+                       cbmcopy_status_cb status_cb)
+{
+    cbmcopy_session session = { fd, settings, (unsigned char) drive, NULL,
+                                settings->transfer_mode == 0, 0, 0 };
+
+    return cbmcopy_write(&session,
+                         cbmname, cbmname_len,
+                         filedata, filedata_size,
+                         msg_cb, status_cb);
+}
+
+
+/* just a wrapper, using a session which lasts for one file only */
 int cbmcopy_read_file_ts(CBM_FILE fd,
                          cbmcopy_settings *settings,
                          int drive,
@@ -682,7 +1032,10 @@ int cbmcopy_read_file_ts(CBM_FILE fd,
                          cbmcopy_message_cb msg_cb,
                          cbmcopy_status_cb status_cb)
 {
-    return cbmcopy_read(fd, settings, (unsigned char) drive,
+    cbmcopy_session session = { fd, settings, (unsigned char) drive, NULL,
+                                settings->transfer_mode == 0, 0, 0 };
+
+    return cbmcopy_read(&session,
                         track, sector,
                         NULL, 0,
                         filedata, filedata_size,
@@ -690,7 +1043,7 @@ int cbmcopy_read_file_ts(CBM_FILE fd,
 }
 
 
-/* just a wrapper */
+/* just a wrapper, using a session which lasts for one file only */
 int cbmcopy_read_file(CBM_FILE fd,
                       cbmcopy_settings *settings,
                       int drive,
@@ -701,7 +1054,10 @@ int cbmcopy_read_file(CBM_FILE fd,
                       cbmcopy_message_cb msg_cb,
                       cbmcopy_status_cb status_cb)
 {
-    return cbmcopy_read(fd, settings, (unsigned char) drive,
+    cbmcopy_session session = { fd, settings, (unsigned char) drive, NULL,
+                                settings->transfer_mode == 0, 0, 0 };
+
+    return cbmcopy_read(&session,
                         0, 0,
                         cbmname, cbmname_len,
                         filedata, filedata_size,
@@ -771,6 +1127,64 @@ int write_block_generic(CBM_FILE HandleDevice, const void *data, unsigned char s
     return rv;
 }
 
+/*! \brief write a data block of a file with a single block transfer
+
+ \param HandleDevice  
+   Pointer to a CBM_FILE which will contain the file handle of the OpenCBM backend
+
+ \param data
+    Pointer to buffer which contains the data to be written to the OpenCBM backend
+
+ \param size
+    The number of bytes to be transferred from the buffer to the OpenCBM backend,
+    or 255, to transfer 254 bytes from the buffer and tell the turbo write routine
+    that more blocks are following
+
+ \param wn_func
+    Callback to the plugin's block write function
+
+ \param msg_cb
+    Handle to cbmcopy's log message handler
+
+ \return
+    The number of bytes actually written, 0 on OpenCBM backend error.
+    If there is a fatal error, returns -1.
+
+ The byte count is prepended to the block data, so that the plugin can
+ stream both in one go instead of doing two round trips to the adapter.
+*/
+int write_block_n(CBM_FILE HandleDevice, const void *data, unsigned char size, write_n_t *wn_func, cbmcopy_message_cb msg_cb)
+{
+    unsigned char frame[255];
+    unsigned int len;
+    int rv;
+
+    SETSTATEDEBUG((void)0);
+#ifdef LIBCBMCOPY_DEBUG
+    msg_cb( sev_debug, "send byte count: %d", size );
+#endif
+    if( data == NULL )
+    {
+        return -1;
+    }
+
+    len = (size == 0xff) ? 254 : size;
+    frame[0] = size;
+    memcpy(frame + 1, data, len);
+
+#ifdef LIBCBMCOPY_DEBUG
+    msg_cb( sev_debug, "send block data" );
+#endif 
+    SETSTATEDEBUG((void)0);
+    rv = wn_func( HandleDevice, frame, len + 1 );
+
+    /* (drive is busy now) */
+    SETSTATEDEBUG((void)0);
+
+    /* the byte count itself is not part of the data written */
+    return (rv < 1) ? -1 : rv - 1;
+}
+
 /*! \brief read a data block of a file with a sequence of byte transfers
 
  \param HandleDevice  
@@ -22,6 +22,8 @@
 
 #define SA_READ     0
 #define SA_WRITE    1
+#define SA_BUF2     2   /* holds drive buffer 2 ($0500) */
+#define SA_BUF3     3   /* holds drive buffer 3 ($0600) */
 
 /* mandatory functions for the transfer function modules */
 typedef struct {
@@ -29,6 +31,7 @@ typedef struct {
     int  (*read_blk)(CBM_FILE,void *,size_t,cbmcopy_message_cb);
     int  (*check_error)(CBM_FILE,int);
     int  (*upload_turbo)(CBM_FILE, unsigned char, enum cbm_device_type_e,int);
+    int  (*reuse_turbo)(CBM_FILE, unsigned char, enum cbm_device_type_e,int);
     int  (*start_turbo)(CBM_FILE,int);
     void (*exit_turbo)(CBM_FILE,int);
 } transfer_funcs;
@@ -37,12 +40,18 @@ typedef struct {
 typedef int           (*write_byte_t)(CBM_FILE,unsigned char);
 typedef unsigned char (*read_byte_t)(CBM_FILE);
 
+/* callback from the block handler to the plugin's block write function */
+typedef int CBMAPIDECL write_n_t(CBM_FILE,const unsigned char *,unsigned int);
+
 /* generic block handlers to the transfer data with single byte transfers */
 int write_block_generic(CBM_FILE,const void *,unsigned char,write_byte_t,cbmcopy_message_cb);
 int read_block_generic(CBM_FILE,void *,size_t,read_byte_t,cbmcopy_message_cb);
 
+/* block handler to transfer the byte count and the data with one plugin call */
+int write_block_n(CBM_FILE,const void *,unsigned char,write_n_t *,cbmcopy_message_cb);
+
 #define DECLARE_TRANSFER_FUNCS(x) \
     transfer_funcs cbmcopy_ ## x = {write_blk, read_blk, check_error, \
-                        upload_turbo, start_turbo, exit_turbo}
+                        upload_turbo, reuse_turbo, start_turbo, exit_turbo}
 
 #endif
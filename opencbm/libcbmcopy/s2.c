@@ -77,25 +77,9 @@ static int write_blk(CBM_FILE HandleDevice, const void *Buffer, unsigned char Co
 {
     if (opencbm_plugin_s2_write_n)
     {
-#ifdef LIBCBMCOPY_DEBUG
-        msg_cb( sev_debug, "send byte count: %d", Count );
-#endif
-        SETSTATEDEBUG((void)0);
-        if ( (Buffer == NULL) || (opencbm_plugin_s2_write_n( HandleDevice, &Count, 1 ) != 1) )
-        {
-            return -1;
-        }
         SETSTATEDEBUG((void)0);
-
-        if( Count == 0xff )
-        {
-            Count--;
-        }
-
-#ifdef LIBCBMCOPY_DEBUG
-        msg_cb( sev_debug, "send block data" );
-#endif 
-        return opencbm_plugin_s2_write_n( HandleDevice, Buffer, Count );
+        /* send byte count and block data with one block transfer */
+        return write_block_n(HandleDevice, Buffer, Count, opencbm_plugin_s2_write_n, msg_cb);
     }
     else
     {
@@ -263,18 +247,39 @@ static int check_error(CBM_FILE fd, int write)
     return error;
 }
 
-static int upload_turbo(CBM_FILE fd, unsigned char drive,
-                        enum cbm_device_type_e drive_type, int write)
+static void get_plugin_funcs(void)
 {
-    const struct drive_prog *p;
-    int dt;
-
     opencbm_plugin_s2_read_n = cbm_get_plugin_function_address("opencbm_plugin_s2_read_n");
 
     opencbm_plugin_s2_write_n = cbm_get_plugin_function_address("opencbm_plugin_s2_write_n");
+}
+
+static const struct drive_prog *select_prog(enum cbm_device_type_e drive_type, int write)
+{
+    int dt = (drive_type == cbm_dt_cbm1581);
+
+    return &drive_progs[dt * 2 + (write != 0)];
+}
+
+/*
+ * re-attach to transfer code which is still resident in the drive:
+ * the session holds the drive buffers it lives in, so only the plugin
+ * block transfer helpers need to be looked up again
+ */
+static int reuse_turbo(CBM_FILE fd, unsigned char drive,
+                       enum cbm_device_type_e drive_type, int write)
+{
+    get_plugin_funcs();
+
+    return 0;
+}
+
+static int upload_turbo(CBM_FILE fd, unsigned char drive,
+                        enum cbm_device_type_e drive_type, int write)
+{
+    const struct drive_prog *p = select_prog(drive_type, write);
 
-    dt = (drive_type == cbm_dt_cbm1581);
-    p = &drive_progs[dt * 2 + (write != 0)];
+    get_plugin_funcs();
 
                                                                         SETSTATEDEBUG((void)0);
     cbm_upload(fd, drive, 0x680, p->prog, p->size);
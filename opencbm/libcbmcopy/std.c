@@ -13,9 +13,22 @@
 #include "cbmcopy_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "arch.h"
 
+/*
+ * Without drive code, the file is just read from the talking drive, and
+ * there is no block structure on the bus. So read ahead several blocks
+ * in one cbm_raw_read() and hand them out one at a time; each call costs
+ * a round trip to the adapter, which matters most with the IEEE-488
+ * drives, where "original" is the only transfer mode.
+ */
+#define READ_AHEAD  (16 * 254)
+
+static unsigned char ahead_buf[READ_AHEAD];
+static int ahead_pos, ahead_len, ahead_eof;
+
 /*! \brief write a data block of a file to the OpenCBM backend
 
  \param HandleDevice  
@@ -66,8 +79,27 @@ static int read_blk(CBM_FILE HandleDevice, void *Buffer, size_t Count, cbmcopy_m
 {
     int rv;
 
-    /* non-turbo methods don't send a header byte specifying the block length */
-    rv = cbm_raw_read(HandleDevice, Buffer, Count);
+    if( ahead_pos == ahead_len && !ahead_eof )
+    {
+        /* non-turbo methods don't send a header byte specifying the block length */
+        rv = cbm_raw_read(HandleDevice, ahead_buf, sizeof(ahead_buf));
+        if( rv < 0 )
+        {
+            return rv;
+        }
+        ahead_pos = 0;
+        ahead_len = rv;
+        ahead_eof = rv < (int) sizeof(ahead_buf);
+    }
+
+    rv = ahead_len - ahead_pos;
+    if( rv > (int) Count )
+    {
+        rv = (int) Count;
+    }
+    memcpy(Buffer, ahead_buf + ahead_pos, rv);
+    ahead_pos += rv;
+
     if( rv == 254 )
     {
         /* when a full block was read, return that more blocks are following (255) */
@@ -94,12 +126,21 @@ static int upload_turbo(CBM_FILE fd, unsigned char drive,
     }
     else
     {
+        ahead_pos = ahead_len = ahead_eof = 0;
         cbm_talk(fd, drive, SA_READ);
     }
     return 0;
 }
 
 
+static int reuse_turbo(CBM_FILE fd, unsigned char drive,
+                       enum cbm_device_type_e drive_type, int write)
+{
+    /* there is no drive code, so there is nothing which could be reused */
+    return upload_turbo(fd, drive, drive_type, write);
+}
+
+
 static int start_turbo(CBM_FILE fd, int write)
 {
     /* no special handshake signalisation needed */
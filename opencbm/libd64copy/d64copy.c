@@ -475,6 +475,12 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
                 }
                 else
                 {
+                    if(scnt && !src->needs_turbo && src->send_track_map)
+                    {
+                        /* no turbo: just tells which blocks we will read */
+                        SETSTATEDEBUG((void)0);
+                        src->send_track_map(tr, trackmap, scnt);
+                    }
                     se = 0;
                 }
                 while(scnt && !resend_trackmap)
@@ -831,6 +837,81 @@ int d64copy_write_image(CBM_FILE cbm_fd,
             src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, (unsigned char) dst_drive);
 }
 
+static int read_dir_block(void *context, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    const transfer_funcs *trf = context;
+
+    SETSTATEDEBUG((void)0);
+    return trf->read_block(tr, se, block);
+}
+
+int d64copy_read_dir(CBM_FILE cbm_fd,
+                     d64copy_settings *settings,
+                     int src_drive,
+                     cbm_dir **dir,
+                     d64copy_message_cb msg_cb)
+{
+    const transfer_funcs *src;
+    char buf[40];
+    int ret;
+
+    message_cb = msg_cb;
+
+    *dir = NULL;
+
+    src = transfers[settings->transfer_mode].trf;
+
+    if(settings->drive_type == cbm_dt_unknown)
+    {
+        SETSTATEDEBUG((void)0);
+        if(cbm_identify(cbm_fd, (unsigned char)src_drive, &settings->drive_type, NULL))
+        {
+            message_cb(0, "could not identify device");
+            return 1;
+        }
+    }
+
+    /* the fast loaders only know the 1541 and the 1571 */
+    if(!src->needs_turbo ||
+       (settings->drive_type != cbm_dt_cbm1541 &&
+        settings->drive_type != cbm_dt_cbm1570 &&
+        settings->drive_type != cbm_dt_cbm1571))
+    {
+        SETSTATEDEBUG((void)0);
+        return cbm_read_dir(cbm_fd, (unsigned char)src_drive, dir);
+    }
+
+    SETSTATEDEBUG((void)0);
+    cbm_exec_command(cbm_fd, (unsigned char)src_drive, "I0:", 0);
+    if(cbm_device_status(cbm_fd, (unsigned char)src_drive, buf, sizeof(buf)))
+    {
+        message_cb(0, "drive %02d: %s", src_drive, buf);
+        return 1;
+    }
+
+    settings->two_sided = 0;
+
+    SETSTATEDEBUG((void)0);
+    send_turbo(cbm_fd, (unsigned char)src_drive, 0, 0,
+               settings->drive_type == cbm_dt_cbm1541 ? 0 : 1);
+
+    SETSTATEDEBUG((void)0);
+    if(src->open_disk(cbm_fd, settings, (void*)(ULONG_PTR)src_drive, 0,
+                      start_turbo, message_cb) != 0)
+    {
+        message_cb(0, "can't open source");
+        return 1;
+    }
+
+    SETSTATEDEBUG((void)0);
+    ret = cbm_read_dir_ex(settings->drive_type, read_dir_block, (void*)src, dir);
+
+    SETSTATEDEBUG((void)0);
+    src->close_disk();
+
+    return ret;
+}
+
 void d64copy_cleanup(void)
 {
     /* if we were interrupted writing to the fs, make sure to
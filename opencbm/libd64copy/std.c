@@ -12,30 +12,89 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static unsigned char drive = 0;
 static CBM_FILE fd_cbm = (CBM_FILE) -1;
 
+/*
+ * The blocks of a track the engine is going to ask for, read ahead by
+ * send_track_map() in one cbm_read_blocks() call. This lets an adapter
+ * which reads the blocks itself do so without a round trip to the
+ * host for each step. Each block is handed out once, so a retry reads
+ * it again.
+ */
+static int two_sided;
+static unsigned char cache_track;
+static unsigned char cache_valid[MAX_SECTORS];
+static unsigned char cache_status[MAX_SECTORS];
+static unsigned char cache_block[MAX_SECTORS][BLOCKSIZE];
+
 static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
 {
-    char cmd[48];
-    int rv = 1;
-
-    sprintf(cmd, "U1:2 0 %d %d", tr, se);
-    if(cbm_exec_command(fd_cbm, drive, cmd, 0) == 0) {
-        rv = cbm_device_status(fd_cbm, drive, cmd, sizeof(cmd));
-        if(rv == 0) {
-            if(cbm_exec_command(fd_cbm, drive, "B-P2 0", 0) == 0) {
-                if(cbm_talk(fd_cbm, drive, 2) == 0) {
+    unsigned char ts[2];
+    unsigned char status;
+
+    if(tr == cache_track && se < MAX_SECTORS && cache_valid[se])
+    {
+        cache_valid[se] = 0;
+        memcpy(block, cache_block[se], BLOCKSIZE);
+        return cache_status[se];
+    }
+
+    ts[0] = tr;
+    ts[1] = se;
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-                    rv = cbm_raw_read(fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
+    if(cbm_read_blocks(fd_cbm, drive, 2, ts, 1, block, &status) != 0)
+    {
+        status = 1;
+    }
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
-                    cbm_untalk(fd_cbm);
-                }
-            }
+    return status;
+}
+
+static int send_track_map(unsigned char tr, const char *trackmap, unsigned char count)
+{
+    unsigned char ts[2 * MAX_SECTORS];
+    unsigned char status[MAX_SECTORS];
+    unsigned char data[MAX_SECTORS * BLOCKSIZE];
+    int se, sectors, n, rv;
+
+    memset(cache_valid, 0, sizeof(cache_valid));
+    cache_track = tr;
+
+    sectors = d64copy_sector_count(two_sided, tr);
+    for(se = n = 0; se < sectors && se < MAX_SECTORS && n < count; se++)
+    {
+        if(NEED_SECTOR(trackmap[se]))
+        {
+            ts[2 * n] = tr;
+            ts[2 * n + 1] = (unsigned char) se;
+            n++;
         }
     }
-    return rv;
+
+    if(n == 0)
+    {
+        return 0;
+    }
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+    rv = cbm_read_blocks(fd_cbm, drive, 2, ts, n, data, status);
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+    if(rv != 0)
+    {
+        /* read_block() does each block by itself, then */
+        return 0;
+    }
+
+    while(n-- > 0)
+    {
+        se = ts[2 * n + 1];
+        memcpy(cache_block[se], data + n * BLOCKSIZE, BLOCKSIZE);
+        cache_status[se] = status[n];
+        cache_valid[se] = 1;
+    }
+    return 0;
 }
 
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
@@ -79,6 +138,8 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
     drive = (unsigned char)(ULONG_PTR)arg;
 
     fd_cbm = fd;
+    two_sided = settings->two_sided;
+    cache_track = 0;
 
     cbm_open(fd_cbm, drive, 2, "#", 1);
 
@@ -95,4 +156,12 @@ static void close_disk(void)
     cbm_close(fd_cbm, drive, 2);
 }
 
-DECLARE_TRANSFER_FUNCS(std_transfer, 1, 0);
+/* no read_gcr_block(), send_track_map() only fills the cache */
+transfer_funcs d64copy_std_transfer = {open_disk,
+                    read_block,
+                    write_block,
+                    close_disk,
+                    1,
+                    0,
+                    send_track_map,
+                    NULL};
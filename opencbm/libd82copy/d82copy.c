@@ -518,6 +518,12 @@ static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
                 }
                 else
                 {
+                    if(scnt && !src->needs_turbo && src->send_track_map)
+                    {
+                        /* no turbo: just tells which blocks we will read */
+                        SETSTATEDEBUG((void)0);
+                        src->send_track_map(tr, trackmap, scnt);
+                    }
                     se = 0;
                 }
                 while(scnt && !resend_trackmap)
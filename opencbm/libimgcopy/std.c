@@ -19,24 +19,19 @@ static CBM_FILE fd_cbm = (CBM_FILE) -1;
 
 static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
 {
-    char cmd[48];
-    int rv = 1;
+    unsigned char ts[2];
+    unsigned char status;
 
-    sprintf(cmd, "U1:2 0 %d %d", tr, se);
-    if(cbm_exec_command(fd_cbm, drive, cmd, 0) == 0) {
-        rv = cbm_device_status(fd_cbm, drive, cmd, sizeof(cmd));
-        if(rv == 0) {
-            if(cbm_exec_command(fd_cbm, drive, "B-P2 0", 0) == 0) {
-                if(cbm_talk(fd_cbm, drive, 2) == 0) {
+    /* U1, error channel, B-P and the data, in the adapter if it can */
+    ts[0] = tr;
+    ts[1] = se;
                                                                         SETSTATEDEBUG(debugLibImgByteCount=0);
-                    rv = cbm_raw_read(fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
-                                                                        SETSTATEDEBUG(debugLibImgByteCount=-1);
-                    cbm_untalk(fd_cbm);
-                }
-            }
-        }
+    if(cbm_read_blocks(fd_cbm, drive, 2, ts, 1, block, &status) != 0)
+    {
+        status = 1;
     }
-    return rv;
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=-1);
+    return status;
 }
 
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
@@ -0,0 +1,622 @@
+/*
+ *    This program is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU General Public License
+ *    as published by the Free Software Foundation; either version
+ *    2 of the License, or (at your option) any later version.
+*/
+
+/*
+ * Read raw GCR tracks with a drive program over the parallel cable and
+ * write them to a .g64 or .nib image.
+ *
+ * The drive program (nibread*.a65) takes nibtools style burst commands,
+ * so the tracks come in through cbm_parallel_burst_read_track() of any
+ * plugin that has it. Without a parallel cable, a 1571 can send them
+ * over the fast serial bus (nibsrq1571.a65) to a plugin with
+ * cbm_srq_burst_read_track(). The head step to the next track is
+ * started before the current track is written out, so both run at the
+ * same time.
+ */
+
+#include "opencbm.h"
+#include "nibcopy.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+
+static const unsigned char nibread1541[] =
+{
+#include "nibread1541.inc"
+};
+
+static const unsigned char nibread1571[] =
+{
+#include "nibread1571.inc"
+};
+
+static const unsigned char nibsrq1571[] =
+{
+#include "nibsrq1571.inc"
+};
+
+/* drive program commands, see nibread1571.a65 */
+#define NIB_CMD_SEEK    0x01
+#define NIB_CMD_READ    0x03
+#define NIB_CMD_QUIT    0x0f
+
+/* first byte of a track read */
+#define NIB_ST_OK       0x00
+#define NIB_ST_NOSYNC   0x01
+#define NIB_ST_KILLER   0x02
+
+/* bytes compared to find the start of the next revolution */
+#define SIG_LEN         32
+
+#define G64_TRACKS      84
+#define G64_HEADER_LEN  (0x0c + 2 * 4 * G64_TRACKS)
+
+#define NIB_HEADER_LEN  0x100
+
+/* bytes per revolution at 300 rpm, by density */
+static const int track_capacity[4] = { 6250, 6666, 7142, 7692 };
+
+/* image being written, kept to finish it in nibcopy_cleanup() */
+static FILE *image_file;
+static nibcopy_format image_format;
+static unsigned char image_header[G64_HEADER_LEN];
+static int image_tracks;
+
+static CBM_FILE fd_cbm;
+
+/* the tracks come over the fast serial bus instead of the parallel cable */
+static int use_srq;
+
+
+static int default_density(int halftrack)
+{
+    int track = halftrack / 2;
+
+    if(track < 18) return 3;
+    if(track < 25) return 2;
+    if(track < 31) return 1;
+    return 0;
+}
+
+static void put_le32(unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+
+static int image_open(const char *name, nibcopy_format format)
+{
+    image_file = fopen(name, "wb");
+    if(image_file == NULL)
+    {
+        return -1;
+    }
+
+    image_format = format;
+    image_tracks = 0;
+    memset(image_header, 0, sizeof(image_header));
+
+    if(format == nf_g64)
+    {
+        memcpy(image_header, "GCR-1541", 8);
+        image_header[0x08] = 0;
+        image_header[0x09] = G64_TRACKS;
+        image_header[0x0a] = G64_TRACK_MAXLEN & 0xff;
+        image_header[0x0b] = G64_TRACK_MAXLEN >> 8;
+        return fwrite(image_header, G64_HEADER_LEN, 1, image_file) == 1 ? 0 : -1;
+    }
+    else
+    {
+        memcpy(image_header, "MNIB-1541-RAW", 13);
+        image_header[0x0d] = 3;
+        return fwrite(image_header, NIB_HEADER_LEN, 1, image_file) == 1 ? 0 : -1;
+    }
+}
+
+/*
+ * Append a track. gcr holds the bytes read after a sync, length is one
+ * revolution of it, or 0 if the track had no data.
+ */
+static int image_add_track(int halftrack, int density,
+                           const unsigned char *gcr, int length)
+{
+    unsigned char buf[NIB_TRACK_LENGTH];
+    int ok;
+
+    if(image_format == nf_g64)
+    {
+        int idx = halftrack - 2;
+
+        if(length == 0 || idx < 0 || idx >= G64_TRACKS)
+        {
+            return 0;
+        }
+        if(length > G64_TRACK_MAXLEN)
+        {
+            length = G64_TRACK_MAXLEN;
+        }
+
+        put_le32(image_header + 0x0c + 4 * idx, ftell(image_file));
+        put_le32(image_header + 0x0c + 4 * (G64_TRACKS + idx), density);
+
+        buf[0] = (unsigned char)length;
+        buf[1] = (unsigned char)(length >> 8);
+        memcpy(buf + 2, gcr, length);
+        memset(buf + 2 + length, 0x55, G64_TRACK_MAXLEN - length);
+        ok = fwrite(buf, 2 + G64_TRACK_MAXLEN, 1, image_file) == 1;
+    }
+    else
+    {
+        if(image_tracks >= (NIB_HEADER_LEN - 0x10) / 2)
+        {
+            return 0;
+        }
+
+        image_header[0x10 + 2 * image_tracks] = (unsigned char)halftrack;
+        image_header[0x11 + 2 * image_tracks] = (unsigned char)density;
+
+        /* the raw read, the last byte continues the revolution */
+        memcpy(buf, gcr, NIB_TRACK_LENGTH - 1);
+        buf[NIB_TRACK_LENGTH - 1] = length ?
+            gcr[NIB_TRACK_LENGTH - 1 - length] : 0;
+        ok = fwrite(buf, NIB_TRACK_LENGTH, 1, image_file) == 1;
+    }
+
+    image_tracks++;
+    return ok ? 0 : -1;
+}
+
+static int image_close(void)
+{
+    int ok;
+
+    if(image_file == NULL)
+    {
+        return 0;
+    }
+
+    ok = fseek(image_file, 0, SEEK_SET) == 0 &&
+         fwrite(image_header, image_format == nf_g64 ?
+                G64_HEADER_LEN : NIB_HEADER_LEN, 1, image_file) == 1;
+    ok = (fclose(image_file) == 0) && ok;
+    image_file = NULL;
+
+    return ok ? 0 : -1;
+}
+
+
+static void send_command(unsigned char cmd, const unsigned char *args, int len)
+{
+    unsigned char buf[8] = { 0x00, 0x55, 0xaa, 0xff };
+
+    buf[4] = cmd;
+    if(len > 0)
+    {
+        memcpy(buf + 5, args, len);
+    }
+    if(use_srq)
+    {
+        cbm_srq_burst_write_n(fd_cbm, buf, 5 + len);
+    }
+    else
+    {
+        cbm_parallel_burst_write_n(fd_cbm, buf, 5 + len);
+    }
+}
+
+/*
+ * Start the head moving. The drive does not answer, it takes the next
+ * command once the head has settled.
+ */
+static void seek_track(int halftrack, int density)
+{
+    unsigned char args[2];
+
+    args[0] = (unsigned char)halftrack;
+    args[1] = (unsigned char)density;
+    send_command(NIB_CMD_SEEK, args, sizeof(args));
+}
+
+static int read_track(unsigned char *buf)
+{
+    send_command(NIB_CMD_READ, NULL, 0);
+
+    if(use_srq)
+    {
+        cbm_srq_burst_read(fd_cbm);
+        return cbm_srq_burst_read_track(fd_cbm, buf, NIB_TRACK_LENGTH) > 0 ? 0 : -1;
+    }
+
+    cbm_parallel_burst_read(fd_cbm);
+
+    /* the plugins disagree on the return value, but all fail with <= 0 */
+    return cbm_parallel_burst_read_track(fd_cbm, buf, NIB_TRACK_LENGTH) > 0 ? 0 : -1;
+}
+
+/*
+ * Find the length of one revolution: the first bytes of the read come
+ * again there. Of all matches near the nominal capacity, the closest
+ * one wins. Returns 0 if there is none.
+ */
+static int find_cycle(const unsigned char *gcr, int len, int density)
+{
+    int capacity = track_capacity[density];
+    int lo = capacity - capacity / 10;
+    int hi = capacity + capacity / 10;
+    int best = 0;
+    int pos;
+
+    if(hi > len - SIG_LEN)
+    {
+        hi = len - SIG_LEN;
+    }
+
+    for(pos = lo; pos <= hi; pos++)
+    {
+        if(gcr[pos] == gcr[0] && memcmp(gcr, gcr + pos, SIG_LEN) == 0 &&
+           (best == 0 || abs(pos - capacity) < abs(best - capacity)))
+        {
+            best = pos;
+        }
+    }
+    return best;
+}
+
+/*
+ * Read a track until a revolution is found. An unformatted track
+ * won't have one, so don't retry that. Returns -1 if the transfer
+ * failed, else the length of the revolution in *length.
+ */
+static int read_revolution(unsigned char *buf, int density, int retries,
+                           int *length)
+{
+    do
+    {
+        if(read_track(buf))
+        {
+            return -1;
+        }
+        *length = buf[0] == NIB_ST_OK ?
+            find_cycle(buf + 1, NIB_TRACK_LENGTH - 1, density) : 0;
+    } while(buf[0] == NIB_ST_OK && *length == 0 && retries-- > 0);
+
+    return 0;
+}
+
+/*
+ * Count the bits in a GCR stream which no GCR code can produce: the
+ * third 0 in a row. A read with the wrong density has plenty of them.
+ */
+static int count_bad_gcr(const unsigned char *gcr, int len)
+{
+    unsigned int bits = 0xff;
+    int bad = 0;
+    int i, b;
+
+    for(i = 0; i < len; i++)
+    {
+        for(b = 7; b >= 0; b--)
+        {
+            bits = (bits << 1) | ((gcr[i] >> b) & 1);
+            if((bits & 7) == 0)
+            {
+                bad++;
+            }
+        }
+    }
+    return bad;
+}
+
+/*
+ * Read a track with each of the four densities and keep the read with
+ * the fewest bad GCR bits in one revolution. A read without a
+ * revolution only wins if no other has one. scan is a second track
+ * buffer.
+ */
+static int scan_density(int halftrack, unsigned char *buf, unsigned char *scan,
+                        int *density, int *length)
+{
+    int d, len, bad;
+    int best = INT_MAX;
+
+    for(d = 0; d < 4; d++)
+    {
+        seek_track(halftrack, d);
+        if(read_revolution(scan, d, 0, &len))
+        {
+            return -1;
+        }
+
+        if(scan[0] != NIB_ST_OK)
+        {
+            bad = INT_MAX;
+        }
+        else if(len == 0)
+        {
+            bad = INT_MAX / 2 + count_bad_gcr(scan + 1, NIB_TRACK_LENGTH - 1);
+        }
+        else
+        {
+            bad = count_bad_gcr(scan + 1, len);
+        }
+
+        if(d == 0 || bad < best)
+        {
+            best = bad;
+            *density = d;
+            *length = len;
+            memcpy(buf, scan, NIB_TRACK_LENGTH);
+        }
+    }
+    return 0;
+}
+
+
+nibcopy_settings *nibcopy_get_default_settings(void)
+{
+    nibcopy_settings *settings;
+
+    settings = malloc(sizeof(nibcopy_settings));
+
+    if(NULL != settings)
+    {
+        settings->start_track = 1;
+        settings->end_track   = 41;
+        settings->half_tracks = 0;
+        settings->retries     = 3;
+        settings->density_scan = 0;
+        settings->format      = nf_g64;
+        settings->drive_type  = cbm_dt_unknown; /* auto detect later on */
+    }
+    return settings;
+}
+
+int nibcopy_get_format_index(const char *name)
+{
+    size_t len;
+
+    if(name == NULL)
+    {
+        return nf_g64;
+    }
+
+    len = strlen(name);
+    if(len > 0 && arch_strncasecmp(name, "g64", len) == 0)
+    {
+        return nf_g64;
+    }
+    if(len > 0 && arch_strncasecmp(name, "nib", len) == 0)
+    {
+        return nf_nib;
+    }
+    return -1;
+}
+
+int nibcopy_read_image(CBM_FILE cbm_fd,
+                       nibcopy_settings *settings,
+                       int src_drive,
+                       const char *dst_image,
+                       nibcopy_message_cb msg_cb,
+                       nibcopy_status_cb status_cb)
+{
+    unsigned char *buf;
+    unsigned char *scan = NULL;
+    unsigned char drive = (unsigned char)src_drive;
+    enum cbm_cable_type_e cable_type;
+    nibcopy_status status;
+    char drive_status[40];
+    const unsigned char *prog;
+    size_t prog_size;
+    int step, halftrack, next, density;
+    int st, length, formatted;
+    int rv = -1;
+
+    fd_cbm = cbm_fd;
+
+    if(settings->start_track < 1 || settings->start_track > NIB_MAX_TRACKS)
+    {
+        msg_cb(sev_fatal, "invalid value (%d) for start track",
+               settings->start_track);
+        return -1;
+    }
+    if(settings->end_track < settings->start_track ||
+       settings->end_track > NIB_MAX_TRACKS)
+    {
+        msg_cb(sev_fatal, "invalid value (%d) for end track",
+               settings->end_track);
+        return -1;
+    }
+
+    if(settings->drive_type == cbm_dt_unknown)
+    {
+        msg_cb(sev_info, "Trying to identify drive type");
+        if(cbm_identify(fd_cbm, drive, &settings->drive_type, NULL))
+        {
+            msg_cb(sev_fatal, "could not identify device");
+        }
+    }
+
+    switch(settings->drive_type)
+    {
+        case cbm_dt_cbm1541:
+            prog = nibread1541;
+            prog_size = sizeof(nibread1541);
+            break;
+        case cbm_dt_cbm1570:
+        case cbm_dt_cbm1571:
+            prog = nibread1571;
+            prog_size = sizeof(nibread1571);
+            break;
+        case cbm_dt_cbm1581:
+            msg_cb(sev_fatal, "1581 drives are not supported");
+            return -1;
+        default:
+            msg_cb(sev_warning, "Unknown drive, assuming 1541");
+            settings->drive_type = cbm_dt_cbm1541;
+            prog = nibread1541;
+            prog_size = sizeof(nibread1541);
+            break;
+    }
+
+    use_srq = 0;
+    if(cbm_identify_xp1541(fd_cbm, drive, NULL, &cable_type) ||
+       cable_type != cbm_ct_xp1541)
+    {
+        if(settings->drive_type == cbm_dt_cbm1541 ||
+           cbm_get_plugin_function_address("opencbm_plugin_srq_burst_read_track") == NULL)
+        {
+            msg_cb(sev_fatal, "track reads need a parallel cable, "
+                   "or a 1571 and an adapter with SRQ");
+            return -1;
+        }
+        msg_cb(sev_info, "no parallel cable, using the fast serial bus");
+        use_srq = 1;
+        prog = nibsrq1571;
+        prog_size = sizeof(nibsrq1571);
+    }
+
+    /* also puts the head on a known track */
+    cbm_exec_command(fd_cbm, drive, "I0:", 0);
+    if(cbm_device_status(fd_cbm, drive, drive_status, sizeof(drive_status)))
+    {
+        msg_cb(sev_fatal, "drive %02d: %s", src_drive, drive_status);
+        return -1;
+    }
+
+    buf = malloc(NIB_TRACK_LENGTH);
+    if(settings->density_scan && buf != NULL)
+    {
+        scan = malloc(NIB_TRACK_LENGTH);
+        if(scan == NULL)
+        {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    if(buf == NULL)
+    {
+        msg_cb(sev_fatal, "no memory");
+        return -1;
+    }
+
+    if(image_open(dst_image, settings->format))
+    {
+        msg_cb(sev_fatal, "could not create %s", dst_image);
+        if(image_file != NULL)
+        {
+            fclose(image_file);
+            image_file = NULL;
+        }
+        free(scan);
+        free(buf);
+        return -1;
+    }
+
+    cbm_upload(fd_cbm, drive, 0x500, prog, prog_size);
+    cbm_exec_command(fd_cbm, drive, "U3:", 0);
+    /* let DOS run the program before ATN is taken for the handshake */
+    arch_usleep(100000);
+
+    step = settings->half_tracks ? 1 : 2;
+    memset(&status, 0, sizeof(status));
+    status.settings = settings;
+    status.total_tracks = (settings->end_track - settings->start_track) *
+                          2 / step + 1;
+    status_cb(status);
+
+    halftrack = settings->start_track * 2;
+    density = default_density(halftrack);
+    seek_track(halftrack, density);
+
+    for(;;)
+    {
+        if(settings->density_scan)
+        {
+            st = scan_density(halftrack, buf, scan, &density, &length);
+        }
+        else
+        {
+            st = read_revolution(buf, density, settings->retries, &length);
+        }
+        if(st)
+        {
+            msg_cb(sev_fatal, "track read failed on track %d%s",
+                   halftrack / 2, (halftrack & 1) ? ".5" : "");
+            goto done;
+        }
+        formatted = buf[0] == NIB_ST_OK;
+
+        /* the drive steps on while we write this one */
+        next = halftrack + step;
+        if(next <= settings->end_track * 2)
+        {
+            seek_track(next, default_density(next));
+        }
+
+        if(formatted && length == 0)
+        {
+            msg_cb(sev_warning, "track %d%s: no revolution found",
+                   halftrack / 2, (halftrack & 1) ? ".5" : "");
+            length = track_capacity[density];
+        }
+        else if(buf[0] == NIB_ST_KILLER)
+        {
+            msg_cb(sev_info, "track %d%s: killer track",
+                   halftrack / 2, (halftrack & 1) ? ".5" : "");
+            memset(buf + 1, 0xff, NIB_TRACK_LENGTH - 1);
+            length = track_capacity[density];
+        }
+
+        if(image_add_track(halftrack, density, buf + 1, length))
+        {
+            msg_cb(sev_fatal, "could not write %s", dst_image);
+            goto done;
+        }
+
+        status.halftrack = halftrack;
+        status.density = density;
+        status.length = length;
+        status.formatted = formatted;
+        status.tracks_processed++;
+        status_cb(status);
+
+        if(next > settings->end_track * 2)
+        {
+            break;
+        }
+        halftrack = next;
+        density = default_density(halftrack);
+    }
+    rv = status.tracks_processed;
+
+done:
+    send_command(NIB_CMD_QUIT, NULL, 0);
+
+    if(image_close())
+    {
+        msg_cb(sev_fatal, "could not write %s", dst_image);
+        rv = -1;
+    }
+    free(scan);
+    free(buf);
+
+    return rv;
+}
+
+void nibcopy_cleanup(void)
+{
+    /* keep the tracks read so far if we were interrupted */
+    image_close();
+}
@@ -15,6 +15,10 @@
 
 #include "debug.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "arch.h"
 
 #include "o65.h"
@@ -123,148 +127,215 @@ linkedlist_removeafter(linkedlist_node_t * const Previous)
 /*-----------------------------------------------------------*/
 /* functions for implementing the symbol table of the loader */
 
+/* The symbol table is indexed by a hash of the symbol name, so
+   resolving a reference does not depend on the number of symbols
+   loaded. Additionally, every symbol is linked into the list of
+   the module which defined it, so unloading a module only visits
+   the symbols of that module. The hash table grows with the number
+   of symbols, so the buckets remain short. */
+
 typedef
 struct o65_symboltable_entry
 {
-    unsigned char *module;  /* name of the module which contains this symbol */
-    unsigned char *name;    /* name of the symbol */
+    struct o65_symboltable_entry *hash_next;   /* next symbol in the same hash bucket */
+    struct o65_symboltable_entry *module_next; /* next symbol of the same module */
     uint16         address; /* address to where this symbol is located */
+    char           name[1]; /* name of the symbol; allocated with the entry */
 } o65_symbol;
 
-#define O65_SYMBOLTABLE_MAX 1000
+#define O65_SYMBOLTABLE_HASH_SIZE_MIN 256
 
-static o65_symbol o65_symboltable[O65_SYMBOLTABLE_MAX];
-static int        o65_symboltable_count = 0;
+static o65_symbol  **o65_symboltable = NULL;
+static unsigned int  o65_symboltable_size = 0;
+static unsigned int  o65_symboltable_count = 0;
 
+static unsigned int
+o65_symbol_hash(const char * const Name)
+{
+    const unsigned char *p;
+    unsigned int hash = 2166136261u;
 
-static char *
-stralloc(const char * const String)
+    /* FNV-1a */
+    for (p = (const unsigned char *) Name; *p; p++)
+    {
+        hash = (hash ^ *p) * 16777619u;
+    }
+
+    return hash & (o65_symboltable_size - 1);
+}
+
+static int
+o65_symbol_table_resize(unsigned int Size)
 {
-    char *p;
+    o65_symbol **oldtable = o65_symboltable;
+    unsigned int oldsize = o65_symboltable_size;
+    unsigned int i;
 
     FUNC_ENTER();
 
-    p = malloc(strlen(String)+1);
+    DBG_ASSERT((Size & (Size - 1)) == 0);
+
+    o65_symboltable = calloc(Size, sizeof(*o65_symboltable));
+
+    if (!o65_symboltable)
+    {
+        o65_symboltable = oldtable;
+        FUNC_LEAVE_INT(O65ERR_OUT_OF_MEMORY);
+    }
 
-    DBG_ASSERT(p != NULL);
+    o65_symboltable_size = Size;
 
-    if (p)
+    /* move all symbols over to the new table */
+
+    for (i = 0; i < oldsize; i++)
     {
-        strcpy(p, String);
+        while (oldtable[i])
+        {
+            o65_symbol *symbol = oldtable[i];
+            unsigned int hash = o65_symbol_hash(symbol->name);
+
+            oldtable[i] = symbol->hash_next;
+
+            symbol->hash_next = o65_symboltable[hash];
+            o65_symboltable[hash] = symbol;
+        }
     }
 
-    FUNC_LEAVE_STRING(p);
+    free(oldtable);
+
+    FUNC_LEAVE_INT(O65ERR_NO_ERROR);
 }
 
-static int
+static o65_symbol *
 o65_symbol_search(const char * const Name)
 {
-    int i;
-    int found = -1;
+    o65_symbol *symbol;
 
     FUNC_ENTER();
 
-    for (i = 0; i < o65_symboltable_count; i++)
+    DBG_ASSERT(Name != NULL);
+
+    symbol = o65_symboltable_size ? o65_symboltable[o65_symbol_hash(Name)] : NULL;
+
+    for (; symbol; symbol = symbol->hash_next)
     {
-        if (strcmp(o65_symboltable[i].name, Name) == 0)
+        if (strcmp(symbol->name, Name) == 0)
         {
-            found = i;
             break;
         }
     }
 
-    FUNC_LEAVE_INT(found);
+    FUNC_LEAVE_PTR(symbol, o65_symbol *);
 }
 
 static int
-o65_symbol_add(const char * const Name, uint16 Address, const char * const Module)
+o65_symbol_add(const char * const Name, uint16 Address, o65_symbol ** const Module)
 {
-    int entry;
+    o65_symbol *symbol;
+    unsigned int hash;
+    int error = O65ERR_NO_ERROR;
 
     FUNC_ENTER();
 
-    DBG_O65_SHOW((DBG_PREFIX "Adding symbol '%s' at $%04X, module '%s'.",
-        Name, Address, Module));
+    DBG_ASSERT(Module != NULL);
 
-    /* check if the symbol already exists */
+    DBG_O65_SHOW((DBG_PREFIX "Adding symbol '%s' at $%04X.", Name, Address));
 
-    entry = o65_symbol_search(Name);
+    /* check if the symbol already exists */
 
-    if (entry >= 0)
+    if (o65_symbol_search(Name))
     {
         DBG_ERROR((DBG_PREFIX "Trying to add symbol %s which already exists!",
             Name));
 
-        entry = -1;
+        error = O65ERR_DUPLICATE_SYMBOL;
+    }
+    else if (o65_symboltable_count >= o65_symboltable_size
+             && (error = o65_symbol_table_resize(o65_symboltable_size
+                    ? 2 * o65_symboltable_size : O65_SYMBOLTABLE_HASH_SIZE_MIN)) != 0)
+    {
+        DBG_ERROR((DBG_PREFIX "Not enough memory for growing the symbol table."));
     }
     else
     {
-        /* advance the number of symbols in the table */
-        o65_symboltable[o65_symboltable_count].module = stralloc(Module);
-        o65_symboltable[o65_symboltable_count].name = stralloc(Name);
-        o65_symboltable[o65_symboltable_count].address = Address;
+        symbol = malloc(sizeof(*symbol) + strlen(Name));
+
+        if (!symbol)
+        {
+            DBG_ERROR((DBG_PREFIX "Not enough memory for adding symbol %s.",
+                Name));
+
+            error = O65ERR_OUT_OF_MEMORY;
+        }
+        else
+        {
+            strcpy(symbol->name, Name);
+            symbol->address = Address;
+
+            hash = o65_symbol_hash(Name);
+            symbol->hash_next = o65_symboltable[hash];
+            o65_symboltable[hash] = symbol;
 
-        o65_symboltable_count++;
+            symbol->module_next = *Module;
+            *Module = symbol;
 
-        DBG_ASSERT(o65_symboltable_count < O65_SYMBOLTABLE_MAX);
+            o65_symboltable_count++;
+        }
     }
 
-    FUNC_LEAVE_INT(entry);
+    FUNC_LEAVE_INT(error);
 }
 
-static int
-o65_symbol_delete(int Entry)
+static void
+o65_symbol_delete(o65_symbol *Symbol)
 {
+    o65_symbol **p;
+
     FUNC_ENTER();
 
     DBG_ASSERT(o65_symboltable_count > 0);
-    DBG_ASSERT(Entry < o65_symboltable_count);
-    DBG_ASSERT(Entry >= 0);
+    DBG_ASSERT(Symbol != NULL);
 
-    DBG_ASSERT(o65_symboltable[Entry].module != NULL);
-    DBG_ASSERT(o65_symboltable[Entry].name   != NULL);
+    DBG_O65_SHOW((DBG_PREFIX "Deleting symbol '%s'.", Symbol->name));
 
-    DBG_O65_SHOW((DBG_PREFIX "Deleting symbol '%s'.",
-        o65_symboltable[Entry].name));
+    /* unlink the symbol from its hash bucket */
 
-    /* free the allocated memory */
-    free(o65_symboltable[Entry].module);
-    free(o65_symboltable[Entry].name);
+    for (p = &o65_symboltable[o65_symbol_hash(Symbol->name)]; *p != Symbol; p = &(*p)->hash_next)
+    {
+        DBG_ASSERT(*p != NULL);
+    }
 
-    --o65_symboltable_count;
+    *p = Symbol->hash_next;
 
-    /* now, copy the last item over the just removed item */
-    o65_symboltable[Entry].module  = o65_symboltable[o65_symboltable_count].module;
-    o65_symboltable[Entry].name    = o65_symboltable[o65_symboltable_count].name;
-    o65_symboltable[Entry].address = o65_symboltable[o65_symboltable_count].address;
+    free(Symbol);
 
-    /* clear the last entry */
-    DBGDO(o65_symboltable[o65_symboltable_count].module  = NULL);
-    DBGDO(o65_symboltable[o65_symboltable_count].name    = NULL);
-    DBGDO(o65_symboltable[o65_symboltable_count].address = 0);
+    /* release the table after the last symbol is gone */
 
-    FUNC_LEAVE_INT(0);
+    if (--o65_symboltable_count == 0)
+    {
+        free(o65_symboltable);
+        o65_symboltable = NULL;
+        o65_symboltable_size = 0;
+    }
+
+    FUNC_LEAVE();
 }
 
 static int
-o65_symbol_delete_module(const char * const ModuleName)
+o65_symbol_delete_module(o65_symbol ** const Module)
 {
-    int i;
+    o65_symbol *symbol;
 
     FUNC_ENTER();
 
-    DBG_O65_SHOW((DBG_PREFIX "Deleting symbols for module '%s'.", ModuleName));
+    DBG_ASSERT(Module != NULL);
 
-    for (i=0; i < o65_symboltable_count; i++)
-    {
-        if (strcmp(o65_symboltable[i].module, ModuleName) == 0)
-        {
-            DBG_O65_SHOW((DBG_PREFIX "Deleting symbol '%s'.",
-                o65_symboltable[i].module));
+    DBG_O65_SHOW((DBG_PREFIX "Deleting symbols of module."));
 
-            o65_symbol_delete(i);
-            --i;
-        }
+    while ((symbol = *Module) != NULL)
+    {
+        *Module = symbol->module_next;
+        o65_symbol_delete(symbol);
     }
 
     FUNC_LEAVE_INT(0);
@@ -288,7 +359,8 @@ typedef int o65version_type;
 typedef
 struct o65_file_references_s
 {
-    char *name;
+    char   *name;
+    uint16  address; /* the address of the symbol, after resolving it */
 } o65_file_references_t;
 
 typedef
@@ -303,7 +375,7 @@ typedef
 struct o65_file_relocation_entry_s
 {
     uint32 relocAddress;
-    uint8  reference;
+    uint32 reference;
     uint8  segment;
     uint8  type;
     uint8  additional;
@@ -314,6 +386,8 @@ typedef
 struct o65_file_s
 {
     char                       *raw_buffer;
+    size_t                      mapped_size;  /* != 0: raw_buffer is a file mapping */
+    unsigned char              *segments;     /* copy of text and data of a mapped file */
     o65version_type             o65version;
     o65_file_header_common_t    header;
     o65_file_header_32_t        header_32;
@@ -326,6 +400,7 @@ struct o65_file_s
     unsigned char              *pdata;
     linkedlist_node_t           text_relocation_list;
     linkedlist_node_t           data_relocation_list;
+    o65_symbol                 *symbols;
 
 } o65_file_t;
 
@@ -360,46 +435,30 @@ o65_read_byte(uint8 *InBuffer, unsigned Length, unsigned *Ptr,
 static char *
 o65_read_string_zt(uint8 *InBuffer, unsigned Length, unsigned *Ptr)
 {
-    unsigned int i;
     char *result = NULL;
-    char *p;
-    int error = O65ERR_NO_ERROR;
+    unsigned start = *Ptr;
 
     FUNC_ENTER();
 
     DBG_ASSERT(InBuffer != NULL);
     DBG_ASSERT(Length > 0);
 
+    /* determine the end of the string. The string is not copied,
+       the result points into the buffer itself. */
 
-    /* determine the length of the string */
-
-    for (i = 0, p = &InBuffer[*Ptr]; (*p != 0) && (*Ptr < Length); p++, i++, (*Ptr)++)
+    while ((*Ptr < Length) && (InBuffer[*Ptr] != 0))
     {
+        ++(*Ptr);
     }
 
-    if (*p != 0)
+    if (*Ptr == Length)
     {
-        if ((*Ptr) == Length)
-        {
-            DBG_ERROR((DBG_PREFIX
-                "End of file while searching for end of string."));
-            error = O65ERR_UNEXPECTED_END_OF_FILE;
-        }
-        else
-        {
-            DBG_ERROR((DBG_PREFIX "String is too long, aborting..."));
-            error = O65ERR_STRING_TOO_LONG;
-        }
+        DBG_ERROR((DBG_PREFIX
+            "End of file while searching for end of string."));
     }
-
-    if (!error)
+    else
     {
-        result = malloc(i+1);
-
-        if (result)
-        {
-            strcpy(result, p - i);
-        }
+        result = (char *) &InBuffer[start];
 
         ++(*Ptr);
     }
@@ -851,20 +910,23 @@ o65_file_load_readtext(uint8 *InBuffer, unsigned Length, unsigned *Ptr,
     DBG_ASSERT(OutBuffer != NULL);
     DBG_ASSERT(*OutBuffer == NULL);
 
+    /* the segment is not copied, but used in place in the buffer */
+
     if (Count != 0)
     {
-        *OutBuffer = malloc(Count);
-
-        if (!*OutBuffer)
+        if (*Ptr + Count <= Length)
         {
-            error = O65ERR_OUT_OF_MEMORY;
-            DBG_ERROR((DBG_PREFIX "Error while malloc()ing %u byte for %s.",
-                Count, What));
+            *OutBuffer = &InBuffer[*Ptr];
+            *Ptr += Count;
+
+            DBG_O65_MEMDUMP(What, *OutBuffer, Count);
         }
         else
         {
-            error = o65_read_byte(InBuffer, Length, Ptr, What, *OutBuffer, Count);
-            DBG_O65_MEMDUMP(What, *OutBuffer, Count);
+            error = O65ERR_UNEXPECTED_END_OF_FILE;
+
+            DBG_ERROR((DBG_PREFIX "%s has size %u, but I could "
+                "not read more than %u byte", What, Count, Length - *Ptr));
         }
     }
 
@@ -886,7 +948,7 @@ o65_file_read_size(uint8 *Buffer, unsigned Length, unsigned *Ptr,
     }
     else
     {
-        uint16 result16;
+        uint16 result16 = 0;
 
         error = o65_read_byte(Buffer, Length, Ptr, What,
             &result16, sizeof(result16));
@@ -1054,18 +1116,21 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
         }
         memset(po65_relocation_entry, 0, sizeof(*po65_relocation_entry));
 
-        while (*p == 0xFF)
+        while (!error && *p == 0xFF)
         {
             relocAddress += 0xFE;
-            p++;
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "byte from reloc table, 2", p, 1)) != 0)
-            {
-                break;
-            }
+            error = o65_read_byte(Buffer, Length, Ptr, "byte from reloc table, 2", p, 1);
         }
-        relocAddress += *p++;
-        if ((error = o65_read_byte(Buffer, Length, Ptr, "byte from reloc table, 3", p, 1)) != 0)
+
+        if (!error)
         {
+            relocAddress += *p;
+            error = o65_read_byte(Buffer, Length, Ptr, "byte from reloc table, 3", p, 1);
+        }
+
+        if (error)
+        {
+            free(po65_relocation_entry);
             break;
         }
 
@@ -1117,45 +1182,42 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
 
         po65_relocation_entry->type = *p & O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_MASK;
 
+        /* an undefined reference is followed by the index into
+           the references table */
+
+        if (!error && po65_relocation_entry->segment == O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_UNDEF)
+        {
+            error = o65_file_read_size(Buffer, Length, Ptr, "reference from reloc table",
+                O65file, &po65_relocation_entry->reference);
+        }
+
+        if (error)
+        {
+            free(po65_relocation_entry);
+            break;
+        }
+
         switch (po65_relocation_entry->type)
         {
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 1", p+1, 2)) == 0)
-            {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
-
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type WORD, %s(%u), additional data: $%04X",
-                    O65file->references[p[1]], p[1], p[2]));
-                p += 2;
-            }
+            DBG_O65_SHOW((DBG_PREFIX "    - Type WORD"));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_HIGH:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 2", p+1, 2)) == 0)
+            /* with bytewise relocation, the low byte is needed, too */
+            if ((O65file->header.mode & O65_FILE_HEADER_MODE_PAGERELOC) == 0)
             {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
-
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type HIGH, %s, additional data: $%04X",
-                    O65file->references[p[1]], p[2]));
-                p += 2;
+                error = o65_read_byte(Buffer, Length, Ptr, "low byte from reloc table",
+                    &po65_relocation_entry->additional, 1);
             }
+
+            DBG_O65_SHOW((DBG_PREFIX
+                "    - Type HIGH, additional data: $%02X",
+                po65_relocation_entry->additional));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_LOW:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 3", p+1, 2)) == 0)
-            {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
-
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type LOW, %s, additional data: $%04X",
-                    O65file->references[p[1]], p[2]));
-                p += 2;
-            }
+            DBG_O65_SHOW((DBG_PREFIX "    - Type LOW"));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_SEGADR:
@@ -1180,7 +1242,8 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
 
         if (po65_relocation_entry)
         {
-            if (po65_relocation_entry->reference >= O65file->references_count)
+            if (po65_relocation_entry->segment == O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_UNDEF
+                && po65_relocation_entry->reference >= O65file->references_count)
             {
                 DBG_ERROR((DBG_PREFIX "references illegal reference %u",
                     po65_relocation_entry->reference));
@@ -1201,8 +1264,19 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
     FUNC_LEAVE_INT(error);
 }
 
+/* Release the buffer an o65 file has been parsed from */
+
+static void
+o65_file_release_buffer(char *Buffer, size_t MappedSize)
+{
+    if (MappedSize != 0)
+        arch_unmap_file(Buffer, MappedSize);
+    else
+        free(Buffer);
+}
+
 static o65_file_t *
-o65_file_alloc(char *Buffer)
+o65_file_alloc(char *Buffer, size_t MappedSize)
 {
     o65_file_t *o65file = NULL;
 
@@ -1224,6 +1298,7 @@ o65_file_alloc(char *Buffer)
         linkedlist_list_init(&o65file->data_relocation_list);
 
         o65file->raw_buffer = Buffer;
+        o65file->mapped_size = MappedSize;
 
         o65file->o65version = O65VERSION_CALC(1, 2); /* assume: version 1.2 of o65 file */
     }
@@ -1232,16 +1307,24 @@ o65_file_alloc(char *Buffer)
 }
 
 void
-o65_file_delete(o65_file_t *O65file)
+o65_file_delete(void *O65File)
 {
+    o65_file_t *O65file = O65File;
+
     FUNC_ENTER();
 
     DBG_ASSERT(O65file != NULL);
 
     if (O65file)
     {
-        free(O65file->ptext);
-        free(O65file->pdata);
+        o65_symbol_delete_module(&O65file->symbols);
+
+        /* the names of references and globals as well as the text
+           and data segment point into the raw buffer, they are not
+           freed separately */
+
+        free(O65file->references);
+        free(O65file->globals);
 
         while (!linkedlist_is_last(O65file->options_list.next))
             free(linkedlist_removeafter(&O65file->options_list));
@@ -1252,16 +1335,62 @@ o65_file_delete(o65_file_t *O65file)
         while (!linkedlist_is_last(O65file->data_relocation_list.next))
             free(linkedlist_removeafter(&O65file->data_relocation_list));
 
-        free(O65file->raw_buffer);
+        free(O65file->segments);
+        o65_file_release_buffer(O65file->raw_buffer, O65file->mapped_size);
         free(O65file);
     }
 
     FUNC_LEAVE();
 }
 
-int
-o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
+/* The relocation patches the text and data segments. A file
+   mapping is read-only, so these two are copied, and only these. */
+
+static int
+o65_file_copy_segments(o65_file_t *O65file)
+{
+    uint32 tlen = O65file->header_32.tlen;
+    uint32 dlen = O65file->header_32.dlen;
+    int error = O65ERR_NO_ERROR;
+
+    FUNC_ENTER();
+
+    if (tlen + dlen != 0)
+    {
+        O65file->segments = malloc(tlen + dlen);
+
+        if (!O65file->segments)
+        {
+            error = O65ERR_OUT_OF_MEMORY;
+        }
+        else
+        {
+            if (tlen)
+            {
+                memcpy(O65file->segments, O65file->ptext, tlen);
+                O65file->ptext = O65file->segments;
+            }
+            if (dlen)
+            {
+                memcpy(O65file->segments + tlen, O65file->pdata, dlen);
+                O65file->pdata = O65file->segments + tlen;
+            }
+        }
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
+/* The o65 file is parsed in place: The segments and the names
+   are not copied, but point into Buffer. Thus, Buffer is owned
+   by the o65 file afterwards, and it is released by o65_file_delete()
+   (or here, in case of an error). If MappedSize is not 0, Buffer is
+   a read-only file mapping of that size, else it is malloc()ed. */
+
+static int
+o65_file_parse(char *Buffer, unsigned Length, size_t MappedSize, void **PO65file)
 {
+    uint8 *data = (uint8 *) Buffer;
     o65_file_t *o65file = NULL;
     unsigned ptr = 0;
     int error = O65ERR_UNSPECIFIED;
@@ -1278,13 +1407,14 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
             break;
         }
 
-        o65file = o65_file_alloc(Buffer);
+        o65file = o65_file_alloc(Buffer, MappedSize);
         if (!o65file) {
+            o65_file_release_buffer(Buffer, MappedSize);
             error = O65ERR_OUT_OF_MEMORY;
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_header(Buffer, Length, &ptr, o65file) ) ) {
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_header(data, Length, &ptr, o65file) ) ) {
             break;
         }
 
@@ -1292,7 +1422,7 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_header32(Buffer, Length, &ptr, o65file) ) ) {
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_header32(data, Length, &ptr, o65file) ) ) {
             break;
         }
 
@@ -1300,13 +1430,13 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_oheader(Buffer, Length, &ptr, o65file) ) ) {
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_oheader(data, Length, &ptr, o65file) ) ) {
             break;
         }
 
         /* read the text segment */
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_readtext(Buffer, Length, &ptr,
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_readtext(data, Length, &ptr,
                                 o65file, "text segment",
                                 &o65file->ptext, o65file->header_32.tlen) ) ) {
             break;
@@ -1314,33 +1444,39 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
 
         /* read the data segment */
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_readtext(Buffer, Length, &ptr,
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_readtext(data, Length, &ptr,
                                 o65file, "data segment",
                                 &o65file->pdata, o65file->header_32.dlen) ) ) {
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_references(Buffer, Length, &ptr, o65file) ) ) {
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_references(data, Length, &ptr, o65file) ) ) {
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_reloc(Buffer, Length, &ptr,
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_reloc(data, Length, &ptr,
                                 o65file, "text relocation",
                                 &o65file->text_relocation_list) ) ) {
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_reloc(Buffer, Length, &ptr,
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_reloc(data, Length, &ptr,
                                 o65file, "data relocation",
                                 &o65file->data_relocation_list) ) ) {
             break;
         }
 
-        if ( O65ERR_NO_ERROR != (error = o65_file_load_globals(Buffer, Length, &ptr,
+        if ( O65ERR_NO_ERROR != (error = o65_file_load_globals(data, Length, &ptr,
                                 o65file) ) ) {
             break;
         }
 
+        if (MappedSize != 0) {
+            if ( O65ERR_NO_ERROR != (error = o65_file_copy_segments(o65file) ) ) {
+                break;
+            }
+        }
+
         DBG_O65_SHOW((DBG_PREFIX "This O65 file is a version %u.%u file.",
            O65VERSION_MAJOR(o65file->o65version),
            O65VERSION_MINOR(o65file->o65version)));
@@ -1358,14 +1494,25 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
     FUNC_LEAVE_INT(error);
 }
 
+/* Parse an o65 file from the malloc()ed Buffer, which is owned
+   by the o65 file afterwards. */
+
+int
+o65_file_process(char *Buffer, unsigned Length, void **PO65file)
+{
+    return o65_file_parse(Buffer, Length, 0, PO65file);
+}
+
+/* Load an o65 file. It is mapped into memory and parsed from there,
+   only the text and data segments are copied for the relocation. */
+
 int
-o65_file_load(const char * const Filename, o65_file_t **PO65file)
+o65_file_load(const char * const Filename, void **PO65file)
 {
-    FILE *f = NULL;
     char *buffer = NULL;
+    size_t fileSize = 0;
+    off_t fileSizeStat;
     int error = O65ERR_UNSPECIFIED;
-    int fileSize;
-    int fileSizeSeek;
 
     FUNC_ENTER();
 
@@ -1375,70 +1522,259 @@ o65_file_load(const char * const Filename, o65_file_t **PO65file)
     DBG_O65_SHOW((DBG_PREFIX "Reading O65 file '%s'", Filename));
 
     do {
-        f = fopen(Filename, "rb");
-        if (!f) {
-            DBG_ERROR((DBG_PREFIX "could not open file '%s'", Filename));
-            error = O65ERR_NO_FILE;
+        buffer = (char *) arch_map_file(Filename, &fileSize);
+        if (!buffer) {
+            /* an empty file cannot be mapped */
+            if (arch_filesize(Filename, &fileSizeStat) == 0 && fileSizeStat == 0) {
+                error = O65ERR_FILE_EMPTY;
+            }
+            else {
+                DBG_ERROR((DBG_PREFIX "could not open file '%s'", Filename));
+                error = O65ERR_NO_FILE;
+            }
             break;
         }
 
-        if (fseek(f, 0, SEEK_END) != 0) {
-            error = O65ERR_FILE_HANDLING_ERROR;
+        if (fileSize != (unsigned) fileSize) {
+            arch_unmap_file(buffer, fileSize);
+            error = O65ERR_FILE_TOO_LARGE;
             break;
         }
 
-        fileSizeSeek = ftell(f);
-        if (fileSizeSeek == 0) {
-            error = O65ERR_FILE_EMPTY;
-            break;
+        /* from now on, buffer belongs to the o65 file */
+
+        error = o65_file_parse(buffer, (unsigned) fileSize, fileSize, PO65file);
+
+    } while (0);
+
+    FUNC_LEAVE_INT(error);
+}
+
+static int
+o65_file_reloc_value(o65_file_t *O65file, uint8 Segment, uint32 Reference,
+                     const uint32 Delta[], uint32 *Value)
+{
+    int error = O65ERR_NO_ERROR;
+
+    FUNC_ENTER();
+
+    switch (Segment)
+    {
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_UNDEF:
+        if (Reference < O65file->references_count)
+        {
+            *Value += O65file->references[Reference].address;
         }
+        else
+        {
+            error = O65ERR_UNDEFINED_REFERENCE;
+        }
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_TEXT:
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_DATA:
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_BSS:
+        *Value += Delta[Segment];
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_ABS:
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_ZERO:
+        /* the zero segment is not moved by this loader */
+        break;
+
+    default:
+        error = O65ERR_UNSPECIFIED;
+        break;
+    }
+
+    FUNC_LEAVE_INT(error);
+}
 
-        if (fseek(f, 0, SEEK_SET) != 0) {
-            error = O65ERR_FILE_HANDLING_ERROR;
+static int
+o65_file_reloc_segment(o65_file_t *O65file, const char * const What,
+                       unsigned char *Segment, uint32 SegmentLength,
+                       linkedlist_node_t *List, const uint32 Delta[])
+{
+    linkedlist_node_t *node;
+    int error = O65ERR_NO_ERROR;
+
+    FUNC_ENTER();
+
+    for (node = List->next; !error && !linkedlist_is_last(node); node = node->next)
+    {
+        o65_file_relocation_entry_t *entry = (o65_file_relocation_entry_t *) node->item;
+        unsigned char *p = &Segment[entry->relocAddress];
+        uint32 value;
+
+        if (entry->relocAddress
+            + (entry->type == O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD ? 2 : 1) > SegmentLength)
+        {
+            DBG_ERROR((DBG_PREFIX "%s: relocation address $%04X is outside of the segment.",
+                What, entry->relocAddress));
+            error = O65ERR_UNEXPECTED_END_OF_FILE;
             break;
         }
 
-        buffer = malloc(fileSizeSeek);
-        if (!buffer) {
-            error = O65ERR_OUT_OF_MEMORY;
+        switch (entry->type)
+        {
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD:
+            value = p[0] | (p[1] << 8);
+            error = o65_file_reloc_value(O65file, entry->segment, entry->reference, Delta, &value);
+            p[0] = (unsigned char) value;
+            p[1] = (unsigned char) (value >> 8);
             break;
-        }
 
-        fileSize = fread(buffer, 1, fileSizeSeek + 1, f);
-        if (fileSize == 0) {
-            error = O65ERR_FILE_EMPTY;
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_HIGH:
+            value = (p[0] << 8) | entry->additional;
+            error = o65_file_reloc_value(O65file, entry->segment, entry->reference, Delta, &value);
+            p[0] = (unsigned char) (value >> 8);
             break;
-        }
 
-        if (fileSize == fileSizeSeek && !feof(f)) {
-            error = O65ERR_FILE_HANDLING_ERROR;
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_LOW:
+            value = p[0];
+            error = o65_file_reloc_value(O65file, entry->segment, entry->reference, Delta, &value);
+            p[0] = (unsigned char) value;
+            break;
+
+        default:
+            error = O65ERR_65816_NOT_ALLOWED;
             break;
         }
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
+/* Relocate the text segment to Address, with the data and bss segments
+   following it. All undefined references are resolved against the
+   symbols of the o65 files relocated before, and the globals of this
+   file are added to the symbol table afterwards. */
+
+int
+o65_file_reloc(void *O65File, unsigned int Address)
+{
+    o65_file_t *O65file = O65File;
+    uint32 delta[O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_BSS + 1];
+    uint32 dataAddress;
+    uint32 bssAddress;
+    unsigned int i;
+    int error = O65ERR_NO_ERROR;
 
-        error = o65_file_process(buffer, fileSize, PO65file);
-        if (error) {
+    FUNC_ENTER();
+
+    DBG_ASSERT(O65file != NULL);
+
+    /* if this file was relocated before, its symbols are outdated */
+
+    o65_symbol_delete_module(&O65file->symbols);
+
+    /* resolve the undefined references first, so that we do not
+       start patching if one of them is missing */
+
+    for (i = 0; i < O65file->references_count; i++)
+    {
+        o65_symbol *symbol = o65_symbol_search(O65file->references[i].name);
+
+        if (!symbol)
+        {
+            DBG_ERROR((DBG_PREFIX "Undefined reference to '%s'.",
+                O65file->references[i].name));
+            error = O65ERR_UNDEFINED_REFERENCE;
             break;
         }
 
-    } while (0);
+        O65file->references[i].address = symbol->address;
+    }
+
+    if (!error)
+    {
+        dataAddress = Address + O65file->header_32.tlen;
+        bssAddress = dataAddress + O65file->header_32.dlen;
 
-    if (f != NULL) {
-        fclose(f);
+        memset(delta, 0, sizeof(delta));
+        delta[O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_TEXT] = Address - O65file->header_32.tbase;
+        delta[O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_DATA] = dataAddress - O65file->header_32.dbase;
+        delta[O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_BSS] = bssAddress - O65file->header_32.bbase;
+
+        error = o65_file_reloc_segment(O65file, "text segment",
+            O65file->ptext, O65file->header_32.tlen,
+            &O65file->text_relocation_list, delta);
     }
 
-    if (error) {
-        free(buffer);
+    if (!error)
+    {
+        error = o65_file_reloc_segment(O65file, "data segment",
+            O65file->pdata, O65file->header_32.dlen,
+            &O65file->data_relocation_list, delta);
+    }
+
+    if (!error)
+    {
+        /* remember the new location, in case we are relocated again */
+
+        O65file->header_32.tbase = Address;
+        O65file->header_32.dbase = dataAddress;
+        O65file->header_32.bbase = bssAddress;
+
+        for (i = 0; !error && i < O65file->globals_count; i++)
+        {
+            uint32 value = O65file->globals[i].value;
+
+            error = o65_file_reloc_value(O65file, O65file->globals[i].segmentid,
+                0, delta, &value);
+
+            if (!error)
+            {
+                error = o65_symbol_add(O65file->globals[i].name, (uint16) value,
+                    &O65file->symbols);
+            }
+        }
     }
 
     FUNC_LEAVE_INT(error);
 }
 
+/* Return the text segment of O65File, as it is after the last
+   relocation, and its length in Length. */
+
+const unsigned char *
+o65_file_get_text(void *O65File, unsigned int *Length)
+{
+    o65_file_t *O65file = O65File;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(O65file != NULL);
+    DBG_ASSERT(Length != NULL);
+
+    *Length = O65file->header_32.tlen;
+
+    FUNC_LEAVE_PTR(O65file->ptext, const unsigned char *);
+}
+
+/* Look up the address of the global Name of one of the relocated
+   o65 files. */
+
 int
-o65_file_reloc(o65_file_t *O65file, unsigned int Address)
+o65_symbol_get(const char * const Name, unsigned int *Address)
 {
+    o65_symbol *symbol;
     int error = O65ERR_NO_ERROR;
 
     FUNC_ENTER();
 
+    DBG_ASSERT(Address != NULL);
+
+    symbol = o65_symbol_search(Name);
+
+    if (symbol)
+    {
+        *Address = symbol->address;
+    }
+    else
+    {
+        error = O65ERR_UNDEFINED_REFERENCE;
+    }
+
     FUNC_LEAVE_INT(error);
 }
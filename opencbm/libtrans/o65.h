@@ -32,12 +32,15 @@ enum O65ERR {
     O65ERR_NO_O65_FILE                    = -17,
     O65ERR_UNKNOWN_VERSION                = -18,
     O65ERR_FILE_HANDLING_ERROR            = -19,
-    O65ERR_UNKNOWN_CPU_SPECIFICATION      = -20
+    O65ERR_UNKNOWN_CPU_SPECIFICATION      = -20,
+    O65ERR_DUPLICATE_SYMBOL               = -21
 } O65ERR;
 
 extern int o65_file_process(char *Buffer, unsigned Length, void **PO65file);
 extern int o65_file_load(const char * const Filename, void **PO65file);
 extern int o65_file_reloc(void *O65file, unsigned int Address);
 extern void o65_file_delete(void *O65file);
+extern const unsigned char *o65_file_get_text(void *O65file, unsigned int *Length);
+extern int o65_symbol_get(const char * const Name, unsigned int *Address);
 
 #endif /* #ifndef O65_H */
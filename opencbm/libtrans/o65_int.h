@@ -10,8 +10,10 @@
 #ifndef O65_INT_H
 #define O65_INT_H
 
+#ifdef _MSC_VER
 #pragma warning( push )
 #pragma warning( disable: 4103 )
+#endif
 #include "packon.h"
 
 /*
@@ -129,8 +131,12 @@ struct o65_file_header_oheader_s
 #define O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_SEG    0xa0
 
 
+#ifdef _MSC_VER
 #pragma warning( disable: 4103 )
+#endif
 #include "packoff.h"
+#ifdef _MSC_VER
 #pragma warning( pop )
+#endif
 
 #endif /* #ifndef O65_INT_H */
@@ -16,6 +16,12 @@ static const unsigned char turbomain_drive_prog[] = {
 #include "turbomain.inc"
 };
 
+/* commands understood by the main loop in the drive (turbomain.a65) */
+#define CMD_WRITEMEM 0x00
+#define CMD_READMEM  0x01
+#define CMD_STREAM   0x02
+#define CMD_EXECUTE  0x80
+
 
 /*
 // functions to perform:
@@ -133,7 +139,7 @@ int
 libopencbmtransfer_execute_command(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                                    unsigned int ExecutionAddress)
 {
-    current_transfer_funcs->write1byte(HandleDevice, 0x80);
+    current_transfer_funcs->write1byte(HandleDevice, CMD_EXECUTE);
     current_transfer_funcs->write2byte(HandleDevice, 
         (unsigned char) (ExecutionAddress & 0xFF), 
         (unsigned char) (ExecutionAddress >> 8));
@@ -141,84 +147,105 @@ libopencbmtransfer_execute_command(CBM_FILE HandleDevice, unsigned char DeviceAd
     return 0;
 }
 
-typedef int
-(*ll_read_write_mem)(CBM_FILE HandleDevice, unsigned char DeviceAddress,
-                     unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length);
-
-static int
-libopencbmtransfer_ll_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
-                                unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
-{
-    FUNC_ENTER();
+/*! \brief Transfer a memory range from or to the drive
 
-    DBG_ASSERT(Length < 0x100);
+ The range is transferred as one stream: The drive gets a single
+ descriptor for the whole range, and the blocks follow each other
+ without any command in between. Afterwards, the drive sends the
+ EOR of all bytes transferred, which is compared to the host data.
 
-    current_transfer_funcs->write1byte(HandleDevice, 0x00);
-    current_transfer_funcs->write2byte(HandleDevice,
-        (unsigned char) (MemoryAddress & 0xFF),
-        (unsigned char) (MemoryAddress >> 8));
-    current_transfer_funcs->write1byte(HandleDevice, (unsigned char) Length);
-    current_transfer_funcs->writeblock(HandleDevice, Buffer, Length);
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
 
-    FUNC_LEAVE_INT(0);
-}
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
 
+ \param Buffer
+   The buffer which holds the data to write, or which gets the data read.
 
-static int
-libopencbmtransfer_ll_read_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
-                               unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
-{
-    FUNC_ENTER();
+ \param MemoryAddress
+   The address of the range in the drive memory.
 
-    DBG_ASSERT(Length < 0x100);
+ \param Length
+   The length of the range. It must be less than 64 KB.
 
-    current_transfer_funcs->write1byte(HandleDevice, 0x01);
-    current_transfer_funcs->write2byte(HandleDevice,
-        (unsigned char) (MemoryAddress & 0xFF),
-        (unsigned char) (MemoryAddress >> 8));
-    current_transfer_funcs->write1byte(HandleDevice, (unsigned char) Length);
-    current_transfer_funcs->readblock(HandleDevice, Buffer, Length);
-
-    FUNC_LEAVE_INT(0);
-}
+ \param Read
+   If non-zero, the range is read from the drive; else, it is written.
 
+ \return
+   0 on success, 1 if the checksum does not match.
+*/
 static int
 libopencbmtransfer_read_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                                   unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length,
-                                  ll_read_write_mem function)
+                                  int Read)
 {
     const static char monkey[]={",oO*^!:;"};// for fast moves
 
+    int (*block)(CBM_FILE fd, unsigned char *p, unsigned int length);
+    unsigned char *p = Buffer;
+    unsigned int pages = Length >> 8;
+    unsigned int last = (0x100 - (Length & 0xFF)) & 0xFF;
+    unsigned char checksum = 0;
+    unsigned char drivechecksum = 0;
+    unsigned int i;
+
     FUNC_ENTER();
 
-    // If we have to transfer more than one page, process the complete pages first
+    DBG_ASSERT(Length < 0x10000);
+
+    block = Read ? current_transfer_funcs->readblock : current_transfer_funcs->writeblock;
+
+    current_transfer_funcs->write1byte(HandleDevice,
+        (unsigned char) (CMD_STREAM | (Read ? CMD_READMEM : CMD_WRITEMEM)));
+    current_transfer_funcs->write2byte(HandleDevice,
+        (unsigned char) (MemoryAddress & 0xFF),
+        (unsigned char) (MemoryAddress >> 8));
+    current_transfer_funcs->write2byte(HandleDevice,
+        (unsigned char) pages, (unsigned char) last);
+
+    // process the complete pages first
                                                                         SETSTATEDEBUG(DebugBlockCount = 0);
-    while (Length >= 0x100)
+    while (pages > 0)
     {
-        int c = (Length >> 8) % (sizeof(monkey) - 1);
+        int c = pages % (sizeof(monkey) - 1);
         fprintf(stderr, (c != 0) ? "\b%c" : "\b.%c" , monkey[c]);
         fflush(stderr);
 
                                                                         SETSTATEDEBUG(DebugBlockCount++);
-        function(HandleDevice, DeviceAddress, Buffer, MemoryAddress, 0x00);
+        block(HandleDevice, p, 0x00);
 
-        Buffer += 0x100;
-        MemoryAddress += 0x100;
-        Length -= 0x100;
+        p += 0x100;
+        pages--;
     }
 
-    if (Length > 0)
+    // the last block ends at the end of the range
+    if (last != 0)
     {
-        unsigned int remainder = 0x100 - Length;
                                                                         SETSTATEDEBUG(DebugBlockCount++);
         //fprintf(stderr, "."); fflush(stderr);
         fprintf(stderr, "\010.");
         fflush(stderr);
-        function(HandleDevice, DeviceAddress, Buffer, MemoryAddress - remainder, remainder);
+        block(HandleDevice, p, last);
     }
                                                                         SETSTATEDEBUG(DebugBlockCount = -1);
     fprintf(stderr, "\010.\n");  // fflush(stderr);
 
+    // the trailer: EOR of all bytes, as seen by the drive
+    current_transfer_funcs->read1byte(HandleDevice, &drivechecksum);
+
+    for (i = 0; i < Length; i++)
+    {
+        checksum ^= Buffer[i];
+    }
+
+    if (checksum != drivechecksum)
+    {
+        DBG_ERROR((DBG_PREFIX "checksum mismatch: host $%02X, drive $%02X",
+            checksum, drivechecksum));
+        FUNC_LEAVE_INT(1);
+    }
+
     FUNC_LEAVE_INT(0);
 }
 
@@ -227,7 +254,7 @@ libopencbmtransfer_read_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                             unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
 {
     return libopencbmtransfer_read_write_mem(HandleDevice, DeviceAddress,
-                                  Buffer, MemoryAddress, Length, libopencbmtransfer_ll_read_mem);
+                                  Buffer, MemoryAddress, Length, 1);
 }
 
 int
@@ -235,7 +262,7 @@ libopencbmtransfer_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                             unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
 {
     return libopencbmtransfer_read_write_mem(HandleDevice, DeviceAddress,
-                                  Buffer, MemoryAddress, Length, libopencbmtransfer_ll_write_mem);
+                                  Buffer, MemoryAddress, Length, 0);
 }
 
 int
@@ -0,0 +1,268 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+#include "opencbm.h"
+#include "nibcopy.h"
+
+#include "arch.h"
+#include "libmisc.h"
+
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* setable via command line */
+static nibcopy_severity_e verbosity = sev_warning;
+static int no_progress = 0;
+
+/* other globals */
+static CBM_FILE fd_cbm;
+
+
+static int is_cbm(char *name)
+{
+    return((strcmp(name, "8" ) == 0) || (strcmp(name, "9" ) == 0) ||
+           (strcmp(name, "10") == 0) || (strcmp(name, "11") == 0) );
+}
+
+
+static void help()
+{
+    printf(
+"Usage: nibcopy [OPTION]... DRIVE IMAGE\n"
+"Read a disk track by track into a .g64 or .nib image\n"
+"\n"
+"Options:\n"
+"  -h, --help                display this help and exit\n"
+"  -V, --version             display version information and exit\n"
+"  -@, --adapter=plugin:bus  tell OpenCBM which backend plugin and bus to use\n"
+"  -q, --quiet               quiet output\n"
+"  -v, --verbose             control verbosity (repeatedly, up to 3 times)\n"
+"  -n, --no-progress         do not display progress information\n"
+"\n"
+"  -s, --start-track=TRACK   set start track (default 1)\n"
+"  -e, --end-track=TRACK     set end track (start <= end <= 42, default 41)\n"
+"\n"
+"  -H, --half-tracks         read the half tracks, too\n"
+"\n"
+"  -f, --format=FORMAT       set image format; valid formats:\n"
+"                              g64 (default)  one revolution per track\n"
+"                              nib            raw track reads\n"
+"\n"
+"  -d, --drive-type=TYPE     specify drive type:\n"
+"                              1541\n"
+"                              1570 or 1571\n"
+"\n"
+"  -r, --retry-count=COUNT   set retry count for tracks without a\n"
+"                            revolution found (default 3)\n"
+"\n"
+"  -D, --density-scan        read each track with all densities and keep\n"
+"                            the one with the fewest GCR errors\n"
+"\n"
+"Requires a 1541, 1570 or 1571 drive with a parallel cable, or a 1570\n"
+"or 1571 and an adapter with SRQ (fast serial).\n"
+"\n"
+);
+}
+
+static void hint(char *s)
+{
+    fprintf(stderr, "Try `%s' --help for more information.\n", s);
+}
+
+static void my_message_cb(int severity, const char *format, ...)
+{
+    va_list args;
+
+    static const char *severities[4] =
+    {
+        "Fatal",
+        "Warning",
+        "Info",
+        "Debug"
+    };
+
+    if(verbosity >= severity)
+    {
+        fprintf(stderr, "[%s] ", severities[severity]);
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fprintf(stderr, "\n");
+    }
+}
+
+static int my_status_cb(nibcopy_status status)
+{
+    if(status.halftrack == 0 || no_progress)
+    {
+        return 0;
+    }
+
+    printf("\r%2d%s: %-11s %4d bytes, density %d  %3d%%  %2d/%d",
+           status.halftrack / 2, (status.halftrack & 1) ? ".5" : "  ",
+           status.formatted ? "" : "unformatted",
+           status.length, status.density,
+           100 * status.tracks_processed / status.total_tracks,
+           status.tracks_processed, status.total_tracks);
+
+    fflush(stdout);
+    return 0;
+}
+
+
+static void ARCH_SIGNALDECL reset(int dummy)
+{
+    CBM_FILE fd_cbm_local;
+
+    /*
+     * remember fd_cbm, and make the global one invalid
+     * so that no routine can call a cbm_...() routine
+     * once we have cancelled another one
+     */
+    fd_cbm_local = fd_cbm;
+    fd_cbm = CBM_FILE_INVALID;
+
+    fprintf(stderr, "\nSIGINT caught X-(  Resetting IEC bus...\n");
+    nibcopy_cleanup();
+    cbm_reset(fd_cbm_local);
+    cbm_driver_close(fd_cbm_local);
+    exit(1);
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    nibcopy_settings *settings = nibcopy_get_default_settings();
+
+    char *adapter = NULL;
+    int format;
+
+    int  option;
+    int  rv = 1;
+
+    struct option longopts[] =
+    {
+        { "help"       , no_argument      , NULL, 'h' },
+        { "version"    , no_argument      , NULL, 'V' },
+        { "adapter"    , required_argument, NULL, '@' },
+        { "quiet"      , no_argument      , NULL, 'q' },
+        { "verbose"    , no_argument      , NULL, 'v' },
+        { "no-progress", no_argument      , NULL, 'n' },
+        { "start-track", required_argument, NULL, 's' },
+        { "end-track"  , required_argument, NULL, 'e' },
+        { "half-tracks", no_argument      , NULL, 'H' },
+        { "format"     , required_argument, NULL, 'f' },
+        { "drive-type" , required_argument, NULL, 'd' },
+        { "retry-count", required_argument, NULL, 'r' },
+        { "density-scan", no_argument     , NULL, 'D' },
+        { NULL         , 0                , NULL, 0   }
+    };
+
+    const char shortopts[] ="hVqvns:e:Hf:d:r:D@:";
+
+    while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'h': help();
+                      return 0;
+            case 'V': printf("nibcopy %s\n", OPENCBM_VERSION);
+                      return 0;
+            case 'q': if(verbosity > 0) verbosity--;
+                      break;
+            case 'v': verbosity++;
+                      break;
+            case 'n': no_progress = 1;
+                      break;
+            case 's': settings->start_track = atoi(optarg);
+                      break;
+            case 'e': settings->end_track = atoi(optarg);
+                      break;
+            case 'H': settings->half_tracks = 1;
+                      break;
+            case 'f': format = nibcopy_get_format_index(optarg);
+                      if(format < 0)
+                      {
+                          fprintf(stderr, "Unknown format: %s\n", optarg);
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      settings->format = format;
+                      break;
+            case 'd': if(strcmp(optarg, "1541") == 0)
+                      {
+                          settings->drive_type = cbm_dt_cbm1541;
+                      }
+                      else if(strcmp(optarg, "1570") == 0)
+                      {
+                          settings->drive_type = cbm_dt_cbm1570;
+                      }
+                      else
+                      {
+                          settings->drive_type = atoi(optarg) != 0 ?
+                              cbm_dt_cbm1571 : cbm_dt_cbm1541;
+                      }
+                      break;
+            case 'r': settings->retries = atoi(optarg);
+                      break;
+            case 'D': settings->density_scan = 1;
+                      break;
+            case '@': if (adapter == NULL)
+                          adapter = cbmlibmisc_strdup(optarg);
+                      else
+                      {
+                          my_message_cb(sev_fatal, "--adapter/-@ given more than once.");
+                          hint(argv[0]);
+                          exit(1);
+                      }
+                      break;
+            default : hint(argv[0]);
+                      return 1;
+        }
+    }
+
+    if(optind + 2 != argc)
+    {
+        fprintf(stderr, "Usage: %s [OPTION]... DRIVE IMAGE\n", argv[0]);
+        hint(argv[0]);
+        return 1;
+    }
+
+    if(!is_cbm(argv[optind]))
+    {
+        my_message_cb(0, "source must be a CBM drive");
+        return 1;
+    }
+
+    if(cbm_driver_open_ex(&fd_cbm, adapter) == 0)
+    {
+        arch_set_ctrlbreak_handler(reset);
+
+        rv = nibcopy_read_image(fd_cbm, settings, atoi(argv[optind]),
+                argv[optind+1], my_message_cb, my_status_cb);
+
+        if(!no_progress && rv >= 0)
+        {
+            printf("\n%d tracks copied.\n", rv);
+        }
+
+        cbm_driver_close(fd_cbm);
+        rv = rv < 0 ? 1 : 0;
+    }
+    else
+    {
+        arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
+    }
+
+    cbmlibmisc_strfree(adapter);
+    free(settings);
+
+    return rv;
+}
@@ -9,11 +9,14 @@
 
 #include "opencbm.h"
 #include "libtrans.h"
+#include "o65.h"
 
 #include "arch.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #ifdef LIBOCT_STATE_DEBUG
 # define DEBUG_STATEDEBUG
@@ -29,6 +32,9 @@
 
 #include "debug.h"
 
+// #define TEST_LINES
+#define TEST_TRANSFER
+
 static int startaddress = 0x8000;
 static int transferlength = 0x110;
 static int writedumpfile = 0;
@@ -160,16 +166,274 @@ processParameter(const int argc, char ** argv)
 
 }
 
-#if 0
+/* append a 16 bit value in o65 (little endian) format */
+static unsigned char *
+o65bench_put16(unsigned char *P, unsigned int Value)
+{
+    *P++ = Value & 0xFF;
+    *P++ = (Value >> 8) & 0xFF;
+    return P;
+}
 
-#include "o65.h"
+/* Create a synthetic o65 file in Buffer, returning its length.
+ * The text segment consists of Symbols JSR/JMP instructions, each of
+ * them exporting a global "m<Module>s<n>". Module 0 jumps to itself,
+ * every other module calls the globals of the module before it.
+ */
+static unsigned int
+o65bench_create(unsigned char *Buffer, unsigned int Module, unsigned int Symbols)
+{
+    static const unsigned char o65header[] = { 0x01, 0x00, 'o', '6', '5', 0x00, 0x00, 0x00 };
+    unsigned char *p = Buffer;
+    char name[24];
+    unsigned int i;
+
+    memcpy(p, o65header, sizeof(o65header));
+    p += sizeof(o65header);
+
+    p = o65bench_put16(p, 0x1000);      /* tbase */
+    p = o65bench_put16(p, 3 * Symbols); /* tlen */
+    p = o65bench_put16(p, 0x1000 + 3 * Symbols); /* dbase */
+    p = o65bench_put16(p, 0);           /* dlen */
+    p = o65bench_put16(p, 0x1000 + 3 * Symbols); /* bbase */
+    p = o65bench_put16(p, 0);           /* blen */
+    p = o65bench_put16(p, 0);           /* zbase */
+    p = o65bench_put16(p, 0);           /* zlen */
+    p = o65bench_put16(p, 0);           /* stack */
+    *p++ = 0;                           /* no options */
+
+    /* text segment */
+    for (i = 0; i < Symbols; i++)
+    {
+        *p++ = Module ? 0x20 : 0x4C;
+        p = o65bench_put16(p, Module ? 0 : 0x1000 + 3 * i);
+    }
+
+    /* undefined references */
+    p = o65bench_put16(p, Module ? Symbols : 0);
+    for (i = 0; Module && i < Symbols; i++)
+    {
+        sprintf(name, "m%us%u", Module - 1, i);
+        strcpy((char *) p, name);
+        p += strlen(name) + 1;
+    }
+
+    /* text relocation table */
+    for (i = 0; i < Symbols; i++)
+    {
+        *p++ = i ? 3 : 2;
+        if (Module)
+        {
+            *p++ = 0x80 | 0x00; /* WORD, undefined */
+            p = o65bench_put16(p, i);
+        }
+        else
+        {
+            *p++ = 0x80 | 0x02; /* WORD, text */
+        }
+    }
+    *p++ = 0;
+
+    /* data relocation table */
+    *p++ = 0;
+
+    /* exported globals */
+    p = o65bench_put16(p, Symbols);
+    for (i = 0; i < Symbols; i++)
+    {
+        sprintf(name, "m%us%u", Module, i);
+        strcpy((char *) p, name);
+        p += strlen(name) + 1;
+        *p++ = 0x02;
+        p = o65bench_put16(p, 0x1000 + 3 * i);
+    }
+
+    return p - Buffer;
+}
+
+/* where module Module is relocated to */
+static unsigned int
+o65bench_address(unsigned int Module, unsigned int Symbols)
+{
+    return (0x2000 + 3 * Symbols * Module) & 0xFFFF;
+}
+
+/* Check the relocated text segment of module Module and the values
+ * of its globals. Module 0 must jump into itself, every other module
+ * must call the globals of the module before it.
+ */
+static int
+o65bench_verify(void *O65file, unsigned int Module, unsigned int Symbols)
+{
+    const unsigned char *text;
+    unsigned int length;
+    unsigned int address;
+    unsigned int expected;
+    char name[24];
+    unsigned int i;
+
+    text = o65_file_get_text(O65file, &length);
+
+    if (length != 3 * Symbols)
+    {
+        printf("module %u: text length %u, expected %u\n", Module, length, 3 * Symbols);
+        return 1;
+    }
+
+    for (i = 0; i < Symbols; i++)
+    {
+        expected = (o65bench_address(Module ? Module - 1 : 0, Symbols) + 3 * i) & 0xFFFF;
+
+        if (text[3 * i] != (Module ? 0x20 : 0x4C)
+            || (text[3 * i + 1] | (text[3 * i + 2] << 8)) != expected)
+        {
+            printf("module %u: wrong code at offset %u: $%02X $%02X $%02X, expected target $%04X\n",
+                Module, 3 * i, text[3 * i], text[3 * i + 1], text[3 * i + 2], expected);
+            return 1;
+        }
+
+        sprintf(name, "m%us%u", Module, i);
+        expected = (o65bench_address(Module, Symbols) + 3 * i) & 0xFFFF;
+
+        if (o65_symbol_get(name, &address) != O65ERR_NO_ERROR || address != expected)
+        {
+            printf("module %u: symbol %s is wrong, expected $%04X\n", Module, name, expected);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Write the synthetic o65 file of Module into the current directory */
+static int
+o65bench_write(unsigned int Module, unsigned int Symbols)
+{
+    unsigned char *buffer;
+    unsigned int length;
+    char name[32];
+    FILE *f;
+    int error = 1;
+
+    buffer = malloc(48 * Symbols + 64);
+    if (buffer)
+    {
+        length = o65bench_create(buffer, Module, Symbols);
+
+        sprintf(name, "o65bench%u.o65", Module);
+        f = fopen(name, "wb");
+        if (f)
+        {
+            error = fwrite(buffer, 1, length, f) != length;
+            fclose(f);
+        }
+        free(buffer);
+    }
+
+    return error;
+}
+
+/* Load and relocate a large synthetic set of o65 files, and check the result.
+   With FromFiles, the set is written to files first, and loaded from there. */
+static int
+main_o65bench(unsigned int Modules, unsigned int Symbols, int FromFiles)
+{
+    void **o65file;
+    char *buffer;
+    char name[32];
+    unsigned int length;
+    unsigned int i;
+    clock_t start, loaded, relocated, verified, deleted;
+    int error = 0;
+
+    o65file = calloc(Modules, sizeof(*o65file));
+    if (!o65file)
+        return 1;
+
+    printf("o65 benchmark: %u modules with %u symbols each%s\n", Modules, Symbols,
+        FromFiles ? ", loaded from files" : "");
+
+    for (i = 0; FromFiles && !error && i < Modules; i++)
+    {
+        error = o65bench_write(i, Symbols);
+    }
+
+    start = clock();
+
+    for (i = 0; !error && i < Modules; i++)
+    {
+        if (FromFiles)
+        {
+            sprintf(name, "o65bench%u.o65", i);
+            error = o65_file_load(name, &o65file[i]);
+            continue;
+        }
+
+        buffer = malloc(48 * Symbols + 64);
+        if (!buffer)
+        {
+            error = 1;
+            break;
+        }
+        length = o65bench_create((unsigned char *) buffer, i, Symbols);
+
+        /* buffer belongs to the o65 file from now on */
+        error = o65_file_process(buffer, length, &o65file[i]);
+    }
+
+    loaded = clock();
+
+    for (i = 0; !error && i < Modules; i++)
+    {
+        error = o65_file_reloc(o65file[i], o65bench_address(i, Symbols));
+    }
+
+    relocated = clock();
+
+    for (i = 0; !error && i < Modules; i++)
+    {
+        error = o65bench_verify(o65file[i], i, Symbols);
+    }
+
+    verified = clock();
+
+    for (i = 0; i < Modules; i++)
+    {
+        if (o65file[i])
+            o65_file_delete(o65file[i]);
+    }
+
+    deleted = clock();
+
+    for (i = 0; FromFiles && i < Modules; i++)
+    {
+        sprintf(name, "o65bench%u.o65", i);
+        arch_unlink(name);
+    }
+
+    free(o65file);
+
+    if (error)
+    {
+        printf("error %d\n", error);
+        return 1;
+    }
+
+    printf("load:     %8.3f s\n", (double) (loaded - start) / CLOCKS_PER_SEC);
+    printf("relocate: %8.3f s\n", (double) (relocated - loaded) / CLOCKS_PER_SEC);
+    printf("verify:   %8.3f s\n", (double) (verified - relocated) / CLOCKS_PER_SEC);
+    printf("delete:   %8.3f s\n", (double) (deleted - verified) / CLOCKS_PER_SEC);
+    printf("relocated code and symbols verified.\n");
+
+    return 0;
+}
 
 static int
 main_o65(int argc, char **argv)
 {
     int i;
     int count;
-    PVOID o65file[10];
+    void *o65file[10];
 
     FUNC_ENTER();
 
@@ -177,6 +441,15 @@ main_o65(int argc, char **argv)
     DbgFlags = DBGF_SUCCESS | DBGF_ERROR | DBGF_WARNING | DBGF_ASSERT;
 #endif
 
+    /* "-b [modules [symbols]]" runs the loader benchmark, "-bf"
+       loads the set from files in the current directory */
+    if (argc > 1 && (strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "-bf") == 0))
+    {
+        FUNC_LEAVE_INT(main_o65bench(argc > 2 ? atoi(argv[2]) : 64,
+                                     argc > 3 ? atoi(argv[3]) : 256,
+                                     argv[1][2] == 'f'));
+    }
+
     count = argc > 10 ? 10 : argc - 1;
 
     for (i=0; i < count; i++)
@@ -196,7 +469,6 @@ main_o65(int argc, char **argv)
 
     FUNC_LEAVE_INT(0);
 }
-#endif
 
 static int
 main_testtransfer(int argc, char **argv)
@@ -413,15 +685,17 @@ main_testlines(int argc, char **argv)
     FUNC_LEAVE_INT(0);
 }
 
-// #define TEST_LINES
-#define TEST_TRANSFER
-// #define TEST_O65
-
 int
 ARCH_MAINDECL main(int argc, char **argv)
 {
     arch_set_ctrlbreak_handler(handle_CTRL_C);
 
+    /* "-o65 file..." or "-o65 -b[f] [modules [symbols]]" test the o65 loader */
+    if (argc > 1 && strcmp(argv[1], "-o65") == 0)
+    {
+        return main_o65(argc - 1, argv + 1);
+    }
+
 #ifdef TEST_LINES
     return main_testlines(argc, argv);
 #endif
@@ -429,8 +703,4 @@ ARCH_MAINDECL main(int argc, char **argv)
 #ifdef TEST_TRANSFER
     return main_testtransfer(argc, argv);
 #endif
-
-#ifdef TEST_O65
-    return main_o65(argc, argv);
-#endif
 }
@@ -49,8 +49,13 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
 #include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
+#include <asm/io.h>
 #include <asm/uaccess.h>
 
 #include "cbm_module.h"
@@ -58,6 +63,8 @@
 /* forward references for parallel burst routines */
 int cbm_parallel_burst_read_track(unsigned char *buffer);
 int cbm_parallel_burst_read_track_var(unsigned char *buffer);
+static int cbm_parallel_burst_read_track_to(unsigned char *buffer, int var,
+					    int *length);
 int cbm_parallel_burst_write_track(unsigned char *buffer, int length);
 unsigned char cbm_parallel_burst_read(void);
 int cbm_parallel_burst_write(unsigned char c);
@@ -86,6 +93,22 @@ int reset = 1;			/* >1 => force reset            */
 int hold_clk = 1;		/* >0 => strict C64 behaviour   */
 					/* =0 => release CLK when idle  */
 
+int setup_delay = 70;		/* bit setup time when sending  */
+int ack_delay = 50;		/* DATA hold after a read byte  */
+
+/* the delays are writable at run time, keep them in a sane range */
+#define CBM_DELAY_MIN	10
+#define CBM_DELAY_MAX	100
+
+static inline int cbm_delay(int us)
+{
+	if (us < CBM_DELAY_MIN)
+		return CBM_DELAY_MIN;
+	if (us > CBM_DELAY_MAX)
+		return CBM_DELAY_MAX;
+	return us;
+}
+
 #ifdef DIRECT_PORT_ACCESS
 module_param(port, int, 0444);
 MODULE_PARM_DESC(port, "IO portnumber of parallel port. (default 0x378)");
@@ -113,6 +136,12 @@ MODULE_PARM_DESC(reset,
 module_param(hold_clk, int, 0444);
 MODULE_PARM_DESC(hold_clk,
 		 "0=release CLK when idle, >0=strict C64 behaviour. (default 1)");
+module_param(setup_delay, int, 0644);
+MODULE_PARM_DESC(setup_delay,
+		 "bit setup time in us when sending, lower for faster drives, 10..100. (default 70)");
+module_param(ack_delay, int, 0644);
+MODULE_PARM_DESC(ack_delay,
+		 "time in us to hold DATA after each byte read, 10..100. (default 50)");
 
 MODULE_AUTHOR("Michael Klein");
 MODULE_DESCRIPTION("Serial CBM bus driver module");
@@ -152,6 +181,9 @@ MODULE_ALIAS_MISCDEV(CBM_MINOR);
 
 static unsigned char out_bits, out_eor;
 static int busy;
+static int ring_busy;		/* track reads queued in the ring */
+static int bus_users;		/* requests using the bus besides the ring */
+static DEFINE_SPINLOCK(ring_lock);	/* protects ring_busy and bus_users */
 static int data_reverse;
 
 #ifdef DIRECT_PORT_ACCESS
@@ -310,7 +342,7 @@ static void do_reset(void)
 /*
  *  send byte
  */
-static int send_byte(int b)
+static int send_byte(int b, int setup)
 {
 	int i, ack = 0;
 	unsigned long flags;
@@ -319,7 +351,7 @@ static int send_byte(int b)
 
 	local_irq_save(flags);
 	for (i = 0; i < 8; i++) {
-		udelay(70);
+		udelay(setup);
 		if (!((b >> i) & 1))
 			SET(DATA_OUT);
 		RELEASE(CLK_OUT);
@@ -363,7 +395,36 @@ static void wait_for_listener(void)
 	DPRINTK_INT("cbm: wait_for_listener() got an interrupt\n");
 }
 
-static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
+/*
+ *  the bus belongs to the ring until all queued tracks are read. Every
+ *  other request claims the bus, so no track read can be queued while
+ *  it runs.
+ */
+static int bus_claim(void)
+{
+	unsigned long flags;
+	int rv = 0;
+
+	spin_lock_irqsave(&ring_lock, flags);
+	if (ring_busy)
+		rv = -EBUSY;
+	else
+		bus_users++;
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	return rv;
+}
+
+static void bus_release(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ring_lock, flags);
+	bus_users--;
+	spin_unlock_irqrestore(&ring_lock, flags);
+}
+
+static ssize_t cbm_raw_read(char *buf, size_t count)
 {
 	size_t received = 0;
 	int i, b, bit;
@@ -421,7 +482,7 @@ static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
 			put_user((char)b, buf++);
 
 			if (received % 256)
-				udelay(50);
+				udelay(cbm_delay(ack_delay));
 			else
 				schedule();
 		}
@@ -439,6 +500,17 @@ static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
 	return received;
 }
 
+static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
+{
+	ssize_t rv = bus_claim();
+
+	if (rv == 0) {
+		rv = cbm_raw_read(buf, count);
+		bus_release();
+	}
+	return rv;
+}
+
 static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
 {
 	unsigned char c;
@@ -480,7 +552,8 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
 			if (signal_pending(current)) {
 				rv = -EINTR;
 			} else {
-				if (send_byte(c)) {
+				/* all devices must get ATN bytes, keep them slow */
+				if (send_byte(c, atn ? 70 : cbm_delay(setup_delay))) {
 					sent++;
 					udelay(100);
 				} else {
@@ -520,11 +593,513 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
 static ssize_t cbm_write(struct file *f, const char *buf, size_t cnt,
 			 loff_t *ppos)
 {
-	return cbm_raw_write(buf, cnt, 0, 0);
+	ssize_t rv = bus_claim();
+
+	if (rv == 0) {
+		rv = cbm_raw_write(buf, cnt, 0, 0);
+		bus_release();
+	}
+	return rv;
 }
 
-static long cbm_unlocked_ioctl(struct file *f,
-		     unsigned int cmd, unsigned long arg)
+/*
+ *  Block transfers for the d64copy turbo protocols (serial1, serial2,
+ *  parallel) and for parallel burst. All of them are fully handshaked,
+ *  so they run with interrupts enabled: every wait spins for a short
+ *  while, as the drive usually answers within microseconds, and then
+ *  sleeps, so a busy drive (e.g., reading a sector) does not hog the
+ *  CPU. A pending signal aborts the transfer.
+ */
+#define XFER_CHUNK 256
+
+static unsigned char xfer_buf[XFER_CHUNK];
+
+static int xfer_wait(unsigned char line, int state)
+{
+	int i = 0;
+
+	while (GET(line) != state) {
+		if (i >= 100) {
+			current->state = TASK_INTERRUPTIBLE;
+			schedule_timeout(1);
+			if (signal_pending(current))
+				return -EINTR;
+		} else {
+			i++;
+			udelay(5);
+		}
+	}
+	return 0;
+}
+
+static int s1_read_n(unsigned char *data, int count)
+{
+	int i, b, n, rv;
+
+	for (n = 0; n < count; n++) {
+		data[n] = 0;
+		for (i = 7; i >= 0; i--) {
+			if ((rv = xfer_wait(DATA_IN, 0)) != 0)
+				return rv;
+			RELEASE(CLK_OUT);
+			b = GET(CLK_IN);
+			data[n] = (data[n] >> 1) | (b ? 0x80 : 0);
+			SET(DATA_OUT);
+			if ((rv = xfer_wait(CLK_IN, !b)) != 0)
+				return rv;
+			RELEASE(DATA_OUT);
+			if ((rv = xfer_wait(DATA_IN, 1)) != 0)
+				return rv;
+			SET(CLK_OUT);
+		}
+	}
+	return 0;
+}
+
+static int s1_write_n(const unsigned char *data, int count)
+{
+	int i, b, n, rv;
+
+	for (n = 0; n < count; n++) {
+		for (i = 7; i >= 0; i--) {
+			b = (data[n] >> i) & 1;
+			if (b)
+				SET(DATA_OUT);
+			else
+				RELEASE(DATA_OUT);
+			RELEASE(CLK_OUT);
+			if ((rv = xfer_wait(CLK_IN, 1)) != 0)
+				return rv;
+			if (b)
+				RELEASE(DATA_OUT);
+			else
+				SET(DATA_OUT);
+			if ((rv = xfer_wait(CLK_IN, 0)) != 0)
+				return rv;
+			RELEASE(DATA_OUT);
+			SET(CLK_OUT);
+			if ((rv = xfer_wait(DATA_IN, 1)) != 0)
+				return rv;
+		}
+	}
+	return 0;
+}
+
+static int s2_read_n(unsigned char *data, int count)
+{
+	int i, n, rv;
+
+	for (n = 0; n < count; n++) {
+		data[n] = 0;
+		for (i = 4; i > 0; i--) {
+			if ((rv = xfer_wait(CLK_IN, 0)) != 0)
+				return rv;
+			data[n] = (data[n] >> 1) | (GET(DATA_IN) ? 0x80 : 0);
+			RELEASE(ATN_OUT);
+			if ((rv = xfer_wait(CLK_IN, 1)) != 0)
+				return rv;
+			data[n] = (data[n] >> 1) | (GET(DATA_IN) ? 0x80 : 0);
+			SET(ATN_OUT);
+		}
+	}
+	return 0;
+}
+
+static int s2_write_n(const unsigned char *data, int count)
+{
+	unsigned char c;
+	int i, n, rv;
+
+	for (n = 0; n < count; n++) {
+		c = data[n];
+		for (i = 4; i > 0; i--) {
+			if (c & 1)
+				SET(DATA_OUT);
+			else
+				RELEASE(DATA_OUT);
+			c >>= 1;
+			RELEASE(ATN_OUT);
+			if ((rv = xfer_wait(CLK_IN, 0)) != 0)
+				return rv;
+			if (c & 1)
+				SET(DATA_OUT);
+			else
+				RELEASE(DATA_OUT);
+			c >>= 1;
+			SET(ATN_OUT);
+			if ((rv = xfer_wait(CLK_IN, 1)) != 0)
+				return rv;
+		}
+		RELEASE(DATA_OUT);
+	}
+	return 0;
+}
+
+static int pp_dc_read_n(unsigned char *data, int count)
+{
+	int n, rv;
+
+	if (!data_reverse) {
+		XP_WRITE(0xff);
+		set_data_reverse();
+		udelay(100);
+	}
+	for (n = 0; n + 1 < count; n += 2) {
+		if ((rv = xfer_wait(DATA_IN, 1)) != 0)
+			return rv;
+		data[n] = XP_READ();
+		RELEASE(CLK_OUT);
+		if ((rv = xfer_wait(DATA_IN, 0)) != 0)
+			return rv;
+		data[n + 1] = XP_READ();
+		SET(CLK_OUT);
+	}
+	return 0;
+}
+
+static int pp_dc_write_n(const unsigned char *data, int count)
+{
+	int n, rv;
+
+	if (data_reverse) {
+		set_data_forward();
+		udelay(100);
+	}
+	for (n = 0; n + 1 < count; n += 2) {
+		if ((rv = xfer_wait(DATA_IN, 1)) != 0)
+			return rv;
+		XP_WRITE(data[n]);
+		RELEASE(CLK_OUT);
+		if ((rv = xfer_wait(DATA_IN, 0)) != 0)
+			return rv;
+		XP_WRITE(data[n + 1]);
+		SET(CLK_OUT);
+	}
+	return 0;
+}
+
+static int parburst_read_n(unsigned char *data, int count)
+{
+	int n;
+
+	for (n = 0; n < count; n++)
+		data[n] = cbm_parallel_burst_read();
+	return signal_pending(current) ? -EINTR : 0;
+}
+
+static int parburst_write_n(const unsigned char *data, int count)
+{
+	int n;
+
+	for (n = 0; n < count; n++)
+		cbm_parallel_burst_write(data[n]);
+	return signal_pending(current) ? -EINTR : 0;
+}
+
+/*
+ *  run a block transfer in chunks of XFER_CHUNK bytes, copying the
+ *  data from or to user space between the chunks
+ */
+static int cbm_xfer_n(unsigned int cmd, unsigned char *buffer, int length)
+{
+	int done, count, rv = 0;
+	int pairs = (cmd == CBMCTRL_PP_DC_READ_N)
+	    || (cmd == CBMCTRL_PP_DC_WRITE_N);
+
+	/* the parallel protocol always transfers pairs of bytes */
+	if (pairs)
+		length &= ~1;
+
+	for (done = 0; done < length && rv == 0; done += count) {
+		count = length - done;
+		if (count > XFER_CHUNK)
+			count = XFER_CHUNK;
+
+		switch (cmd) {
+		case CBMCTRL_S1_READ_N:
+			rv = s1_read_n(xfer_buf, count);
+			break;
+		case CBMCTRL_S2_READ_N:
+			rv = s2_read_n(xfer_buf, count);
+			break;
+		case CBMCTRL_PP_DC_READ_N:
+			rv = pp_dc_read_n(xfer_buf, count);
+			break;
+		case CBMCTRL_PARBURST_READ_N:
+			rv = parburst_read_n(xfer_buf, count);
+			break;
+		default:
+			if (copy_from_user(xfer_buf, buffer + done, count))
+				return -EFAULT;
+			if (cmd == CBMCTRL_S1_WRITE_N)
+				rv = s1_write_n(xfer_buf, count);
+			else if (cmd == CBMCTRL_S2_WRITE_N)
+				rv = s2_write_n(xfer_buf, count);
+			else if (cmd == CBMCTRL_PP_DC_WRITE_N)
+				rv = pp_dc_write_n(xfer_buf, count);
+			else
+				rv = parburst_write_n(xfer_buf, count);
+			continue;
+		}
+
+		if (rv == 0 && copy_to_user(buffer + done, xfer_buf, count))
+			return -EFAULT;
+	}
+
+	DPRINTK("cbm_xfer_n: %d of %d bytes, rv=%d\n", done, length, rv);
+
+	return (rv < 0) ? rv : done;
+}
+
+static long cbm_do_ioctl(struct file *f, unsigned int cmd, unsigned long arg);
+
+/*
+ *  execute a list of operations with one ioctl. After the first failing
+ *  operation, only those marked with CBM_BATCH_ALWAYS (e.g. an unlisten
+ *  which has to follow a listen) are still executed. Returns 0, or the
+ *  error of the first failing operation.
+ */
+static int cbm_batch(struct file *f, CBM_BATCH *user_batch)
+{
+	CBM_BATCH batch;
+	CBM_BATCH_OP op;
+	int i, result, rv = 0;
+
+	if (copy_from_user(&batch, user_batch, sizeof(CBM_BATCH)))
+		return -EFAULT;
+
+	for (i = 0; i < batch.count; i++) {
+		if (copy_from_user(&op, &batch.ops[i], sizeof(CBM_BATCH_OP)))
+			return -EFAULT;
+
+		if (rv < 0 && !(op.flags & CBM_BATCH_ALWAYS))
+			result = -ECANCELED;
+		else if (op.cmd == CBMCTRL_BATCH_READ)
+			result = cbm_raw_read((char *)op.buffer, op.length);
+		else if (op.cmd == CBMCTRL_BATCH_WRITE)
+			result = cbm_raw_write((char *)op.buffer, op.length, 0, 0);
+		else if (op.cmd == CBMCTRL_BATCH)
+			result = -EINVAL;
+		else
+			result = cbm_do_ioctl(f, op.cmd, op.arg);
+
+		if (rv == 0 && result < 0)
+			rv = result;
+
+		if (put_user(result, &batch.ops[i].result))
+			return -EFAULT;
+	}
+
+	DPRINTK("cbm_batch: %d operations, rv=%d\n", batch.count, rv);
+
+	return rv;
+}
+
+/*
+ *  the ring of track buffers which can be mmap()ed by user space, see
+ *  CBM_RING_HEADER. Queued track reads are done by ring_work, which
+ *  reads directly into the slots and wakes up poll() after each track.
+ */
+static unsigned char *ring;	/* header page, followed by the slots */
+static int ring_queue[CBM_RING_SLOTS];	/* slot | CBM_RING_VAR, in order */
+static unsigned int ring_head, ring_tail;
+static unsigned char ring_cmd[CBM_RING_SLOTS][CBM_RING_CMD_SIZE];
+static int ring_cmd_length[CBM_RING_SLOTS];
+static DECLARE_WAIT_QUEUE_HEAD(ring_wait);
+static struct workqueue_struct *ring_wq;
+static struct work_struct ring_work;
+
+#define RING_HEADER()  ((CBM_RING_HEADER *) ring)
+#define RING_DATA(n)   (ring + CBM_RING_DATA_OFFSET + (n) * CBM_RING_SLOT_SIZE)
+
+static int ring_alloc(void)
+{
+	unsigned long addr;
+
+	if (ring)
+		return 0;
+
+	ring = (unsigned char *) __get_free_pages(GFP_KERNEL,
+						  get_order(CBM_RING_SIZE));
+	if (ring == NULL)
+		return -ENOMEM;
+
+	memset(ring, 0, CBM_RING_SIZE);
+
+	/* keep the pages in place while they are mapped */
+	for (addr = (unsigned long) ring;
+	     addr < (unsigned long) ring + CBM_RING_SIZE; addr += PAGE_SIZE)
+		SetPageReserved(virt_to_page(addr));
+
+	return 0;
+}
+
+static void ring_free(void)
+{
+	unsigned long addr;
+
+	if (ring == NULL)
+		return;
+
+	for (addr = (unsigned long) ring;
+	     addr < (unsigned long) ring + CBM_RING_SIZE; addr += PAGE_SIZE)
+		ClearPageReserved(virt_to_page(addr));
+
+	free_pages((unsigned long) ring, get_order(CBM_RING_SIZE));
+	ring = NULL;
+}
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20))
+static void ring_work_func(void *data)
+#else
+static void ring_work_func(struct work_struct *work)
+#endif
+{
+	CBM_RING_SLOT *slot;
+	unsigned long flags;
+	int i, n, var, length, result;
+
+	for (;;) {
+		spin_lock_irqsave(&ring_lock, flags);
+		if (ring_head == ring_tail) {
+			ring_busy = 0;
+			spin_unlock_irqrestore(&ring_lock, flags);
+			break;
+		}
+		n = ring_queue[ring_head++ % CBM_RING_SLOTS];
+		spin_unlock_irqrestore(&ring_lock, flags);
+
+		var = n & CBM_RING_VAR;
+		n &= ~CBM_RING_VAR;
+
+		/* tell the drive which track to send */
+		for (i = 0; i < ring_cmd_length[n]; i++)
+			cbm_parallel_burst_write(ring_cmd[n][i]);
+
+		result = cbm_parallel_burst_read_track_to(RING_DATA(n), var,
+							  &length);
+
+		slot = &RING_HEADER()->slot[n];
+		slot->length = length;
+		slot->result = result;
+		smp_wmb();
+		slot->state = CBM_RING_FULL;
+
+		DPRINTK("ring: slot %d full, %d bytes, result=%d\n", n,
+			length, result);
+
+		wake_up_interruptible(&ring_wait);
+	}
+	wake_up_interruptible(&ring_wait);
+}
+
+static int ring_read_track(unsigned long arg)
+{
+	CBM_RING_SLOT *slot;
+	unsigned long flags;
+	int n = arg & ~CBM_RING_VAR;
+
+	if (ring == NULL || ring_wq == NULL)
+		return -ENXIO;
+	if (n < 0 || n >= CBM_RING_SLOTS)
+		return -EINVAL;
+
+	slot = &RING_HEADER()->slot[n];
+
+	spin_lock_irqsave(&ring_lock, flags);
+	if (slot->state != CBM_RING_FREE || bus_users) {
+		spin_unlock_irqrestore(&ring_lock, flags);
+		return -EBUSY;
+	}
+
+	/* user space may change the slot at any time, so keep a copy */
+	ring_cmd_length[n] = slot->cmd_length;
+	if (ring_cmd_length[n] < 0 || ring_cmd_length[n] > CBM_RING_CMD_SIZE) {
+		spin_unlock_irqrestore(&ring_lock, flags);
+		return -EINVAL;
+	}
+	memcpy(ring_cmd[n], slot->cmd, ring_cmd_length[n]);
+
+	slot->state = CBM_RING_QUEUED;
+	ring_queue[ring_tail++ % CBM_RING_SLOTS] = arg & (CBM_RING_VAR | 0xff);
+	ring_busy = 1;
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	queue_work(ring_wq, &ring_work);
+	return 0;
+}
+
+static int ring_release(unsigned long arg)
+{
+	if (ring == NULL || arg >= CBM_RING_SLOTS)
+		return -EINVAL;
+	if (RING_HEADER()->slot[arg].state != CBM_RING_FULL)
+		return -EINVAL;
+
+	RING_HEADER()->slot[arg].state = CBM_RING_FREE;
+	return 0;
+}
+
+/* forget about queued reads and wait for the running one */
+static void ring_reset(void)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&ring_lock, flags);
+	ring_head = ring_tail;
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	if (ring_wq)
+		flush_workqueue(ring_wq);
+
+	if (ring)
+		for (i = 0; i < CBM_RING_SLOTS; i++)
+			RING_HEADER()->slot[i].state = CBM_RING_FREE;
+}
+
+static int cbm_mmap(struct file *f, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int rv;
+
+	if (vma->vm_pgoff != 0 || size > PAGE_ALIGN(CBM_RING_SIZE))
+		return -EINVAL;
+
+	rv = ring_alloc();
+	if (rv)
+		return rv;
+
+	/* driver owned pages: no core dumps of them, no mremap() growing */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0))
+	vm_flags_set(vma, VM_IO | VM_DONTEXPAND);
+#else
+	vma->vm_flags |= VM_IO | VM_DONTEXPAND;
+#endif
+
+	if (remap_pfn_range(vma, vma->vm_start,
+			    virt_to_phys(ring) >> PAGE_SHIFT, size,
+			    vma->vm_page_prot))
+		return -EAGAIN;
+
+	return 0;
+}
+
+static unsigned int cbm_poll(struct file *f, poll_table *wait)
+{
+	int i;
+
+	poll_wait(f, &ring_wait, wait);
+
+	if (ring)
+		for (i = 0; i < CBM_RING_SLOTS; i++)
+			if (RING_HEADER()->slot[i].state == CBM_RING_FULL)
+				return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+static long cbm_do_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 {
 	/* linux parallel burst */
 	PARBURST_RW_VALUE *user_val;
@@ -757,10 +1332,52 @@ static long cbm_unlocked_ioctl(struct file *f,
 		/* and do it: */
 		return cbm_parallel_burst_write_track(kernel_val.buffer,
 						      kernel_val.length);
+
+	case CBMCTRL_S1_READ_N:
+	case CBMCTRL_S1_WRITE_N:
+	case CBMCTRL_S2_READ_N:
+	case CBMCTRL_S2_WRITE_N:
+	case CBMCTRL_PP_DC_READ_N:
+	case CBMCTRL_PP_DC_WRITE_N:
+	case CBMCTRL_PARBURST_READ_N:
+	case CBMCTRL_PARBURST_WRITE_N:
+		user_val = (PARBURST_RW_VALUE *) arg;
+		if (copy_from_user(&kernel_val, user_val,
+				   sizeof(PARBURST_RW_VALUE)))
+			return -EFAULT;
+		if (kernel_val.length < 0)
+			return -EINVAL;
+		return cbm_xfer_n(cmd, kernel_val.buffer, kernel_val.length);
+
+	case CBMCTRL_BATCH:
+		return cbm_batch(f, (CBM_BATCH *) arg);
+
+	case CBMCTRL_RING_READ_TRACK:
+		return ring_read_track(arg);
+
+	case CBMCTRL_RING_RELEASE:
+		return ring_release(arg);
 	}
 	return -EINVAL;
 }
 
+static long cbm_unlocked_ioctl(struct file *f,
+		     unsigned int cmd, unsigned long arg)
+{
+	long rv;
+
+	/* the ring requests check the bus themselves */
+	if (cmd == CBMCTRL_RING_READ_TRACK || cmd == CBMCTRL_RING_RELEASE)
+		return cbm_do_ioctl(f, cmd, arg);
+
+	rv = bus_claim();
+	if (rv == 0) {
+		rv = cbm_do_ioctl(f, cmd, arg);
+		bus_release();
+	}
+	return rv;
+}
+
 static int cbm_open(struct inode *inode, struct file *f)
 {
 	if (busy)
@@ -776,6 +1393,7 @@ static int cbm_open(struct inode *inode, struct file *f)
 
 static int cbm_release(struct inode *inode, struct file *f)
 {
+	ring_reset();
 	if (!hold_clk)
 		RELEASE(CLK_OUT);
 	busy = 0;
@@ -826,6 +1444,8 @@ static const struct file_operations cbm_fops = {
 	.read		= cbm_read,
 	.write		= cbm_write,
 	.unlocked_ioctl	= cbm_unlocked_ioctl,
+	.mmap		= cbm_mmap,
+	.poll		= cbm_poll,
 	.open		= cbm_open,
 	.release	= cbm_release,
 };
@@ -847,6 +1467,9 @@ void cbm_cleanup(void)
 	parport_unregister_device(cbm_device);
 #endif
 	misc_deregister(&cbm_dev);
+	if (ring_wq)
+		destroy_workqueue(ring_wq);
+	ring_free();
 }
 
 int cbm_init(void)
@@ -891,6 +1514,12 @@ int cbm_init(void)
 		return -EBUSY;
 	}
 	DPRINTK("parallel port is mine now\n");
+#endif
+	ring_wq = create_singlethread_workqueue(NAME);
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20))
+	INIT_WORK(&ring_work, ring_work_func, NULL);
+#else
+	INIT_WORK(&ring_work, ring_work_func);
 #endif
 	misc_register(&cbm_dev);
 
@@ -955,7 +1584,13 @@ module_exit(cbm_cleanup);
         (they are all called by the ioctl-function)
 */
 
-int cbm_parallel_burst_read_track(unsigned char *buffer)
+/*
+ *  read a track into the kernel buffer; with var, stop after the 0x55
+ *  end marker. This is used by the ioctls and by the ring, which has
+ *  the driver fill the mmap()ed slots directly.
+ */
+static int cbm_parallel_burst_read_track_to(unsigned char *buffer, int var,
+					    int *length)
 {
 	int i, byte;
 	unsigned long flags;
@@ -966,37 +1601,43 @@ int cbm_parallel_burst_read_track(unsigned char *buffer)
 		byte = cbm_handshaked_read(i & 1);
 		if (byte == -1) {
 			local_irq_restore(flags);
+			*length = i;
 			return 0;
 		}
 		buffer[i] = byte;
+		if (var && byte == 0x55) {
+			i++;
+			break;
+		}
 	}
 
 	cbm_parallel_burst_read();
 	local_irq_restore(flags);
+	*length = i;
 	return 1;
 }
 
-int cbm_parallel_burst_read_track_var(unsigned char *buffer)
+/* user space must not be touched with interrupts disabled */
+static unsigned char track_buf[0x2000];
+
+int cbm_parallel_burst_read_track(unsigned char *buffer)
 {
-	int i, byte;
-	unsigned long flags;
+	int length, rv;
 
-	local_irq_save(flags);
+	rv = cbm_parallel_burst_read_track_to(track_buf, 0, &length);
+	if (copy_to_user(buffer, track_buf, length))
+		return -EFAULT;
+	return rv;
+}
 
-	for (i = 0; i < 0x2000; i += 1) {
-		byte = cbm_handshaked_read(i & 1);
-		if (byte == -1) {
-			local_irq_restore(flags);
-			return 0;
-		}
-		buffer[i] = byte;
-		if (byte == 0x55)
-			break;
-	}
+int cbm_parallel_burst_read_track_var(unsigned char *buffer)
+{
+	int length, rv;
 
-	cbm_parallel_burst_read();
-	local_irq_restore(flags);
-	return 1;
+	rv = cbm_parallel_burst_read_track_to(track_buf, 1, &length);
+	if (copy_to_user(buffer, track_buf, length))
+		return -EFAULT;
+	return rv;
 }
 
 int cbm_parallel_burst_write_track(unsigned char *buffer, int length)
@@ -5,11 +5,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <Windows.h>
 
 #include "cap.h"
 #include "tap-cbm.h"
 #include "misc.h"
+#include "chunks.h"
 
 #define FREQ_C64_PAL    985248
 #define FREQ_C64_NTSC  1022727
@@ -23,11 +25,73 @@
 #define NeedSplit            2
 #define NoSplit              3
 
+// Number of CAP signals converted in one chunk (even, to keep halfwave pairs together).
+#define CHUNK_SIGNALS (64*1024)
 
-__int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNeededSplit, unsigned __int8 TAPv, unsigned __int32 *puiCounter)
+// Conversion job of a worker thread.
+typedef struct _CAP2TAP_JOB {
+	unsigned __int64 ui64Signals[CHUNK_SIGNALS]; // CAP signals of the chunk.
+	__int32          iNumSignals;
+	unsigned __int8  *pucOut;                    // TAP data of the chunk.
+	unsigned __int32 uiOutLen, uiOutSize;
+} CAP2TAP_JOB;
+
+// Conversion parameters and files, shared by all jobs.
+typedef struct _CAP2TAP_CONTEXT {
+	HANDLE           hCAP, hTAP;
+	unsigned __int32 Timer_Precision_MHz, uiFreq;
+	unsigned __int8  TAPv;        // TAP file format version.
+	unsigned __int32 TAP_Counter; // TAP file byte counter.
+} CAP2TAP_CONTEXT;
+
+
+// Append TAP data to the output of a job.
+__int32 PutTAPBytes(CAP2TAP_JOB *pJob, const unsigned __int8 *pucBytes, unsigned __int32 uiNumBytes)
 {
+	unsigned __int8  *pucOut;
+	unsigned __int32 uiOutSize;
+
+	if (pJob->uiOutLen + uiNumBytes > pJob->uiOutSize)
+	{
+		uiOutSize = (pJob->uiOutSize == 0) ? CHUNK_SIGNALS : pJob->uiOutSize;
+		while (pJob->uiOutLen + uiNumBytes > uiOutSize)
+			uiOutSize *= 2;
+
+		pucOut = (unsigned __int8 *) realloc(pJob->pucOut, uiOutSize);
+		if (pucOut == NULL)
+		{
+			printf("Error: Could not allocate memory for TAP data.\n");
+			return -1;
+		}
+		pJob->pucOut = pucOut;
+		pJob->uiOutSize = uiOutSize;
+	}
+
+	memcpy(pJob->pucOut + pJob->uiOutLen, pucBytes, uiNumBytes);
+	pJob->uiOutLen += uiNumBytes;
+
+	return 0;
+}
+
+
+// Append 32bit unsigned integer to the output of a job: LSB first, MSB last.
+__int32 PutTAPSignal_4Bytes(CAP2TAP_JOB *pJob, unsigned __int32 uiSignal)
+{
+	unsigned __int8 buf4[4];
+
+	buf4[0] = (unsigned __int8) ((uiSignal      ) & 0xff);
+	buf4[1] = (unsigned __int8) ((uiSignal >>  8) & 0xff);
+	buf4[2] = (unsigned __int8) ((uiSignal >> 16) & 0xff);
+	buf4[3] = (unsigned __int8) ((uiSignal >> 24) & 0xff);
+
+	return PutTAPBytes(pJob, buf4, 4);
+}
+
+
+__int32 HandlePause(CAP2TAP_JOB *pJob, unsigned __int64 ui64Len, unsigned __int8 uiNeededSplit, unsigned __int8 TAPv)
+{
+	unsigned __int8  ucZero = 0;
 	unsigned __int32 numsplits, i;
-	__int32          FuncRes;
 
 	if (TAPv == TAPv2)
 	{
@@ -52,7 +116,8 @@ __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNee
 				for (i=1; i<=2; i++)
 				{
 					// Write 32bit unsigned integer to image file: LSB first, MSB last.
-					Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_4Bytes(hTAP, 0x55555500, puiCounter));
+					if (PutTAPSignal_4Bytes(pJob, 0x55555500) == -1)
+						return -1;
 					ui64Len -= 0x00555555;
 				}
 			}
@@ -61,7 +126,8 @@ __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNee
 				// Make sure last halfwave is not too short: Pull 0x007fffff.
 				// Does not change numsplits.
 				// Write 32bit unsigned integer to image file: LSB first, MSB last.
-				Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_4Bytes(hTAP, 0x7fffff00, puiCounter));
+				if (PutTAPSignal_4Bytes(pJob, 0x7fffff00) == -1)
+					return -1;
 				ui64Len -= 0x007fffff;
 			}
 		}
@@ -72,13 +138,15 @@ __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNee
 		while (ui64Len > 0x00ffffff)
 		{
 			// Write 32bit unsigned integer to image file: LSB first, MSB last.
-			Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_4Bytes(hTAP, 0xffffff00, puiCounter));
+			if (PutTAPSignal_4Bytes(pJob, 0xffffff00) == -1)
+				return -1;
 			ui64Len -= 0x00ffffff;
 		}
 		if (ui64Len > 0)
 		{
 			// Write 32bit unsigned integer to image file: LSB first, MSB last.
-			Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_4Bytes(hTAP, (unsigned __int32) ((ui64Len << 8) & 0xffffff00), puiCounter));
+			if (PutTAPSignal_4Bytes(pJob, (unsigned __int32) ((ui64Len << 8) & 0xffffff00)) == -1)
+				return -1;
 		}
 	}
 
@@ -86,12 +154,14 @@ __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNee
 	{
 		while (ui64Len > 2040)
 		{
-			Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(hTAP, 0, puiCounter));
+			if (PutTAPBytes(pJob, &ucZero, 1) == -1)
+				return -1;
 			ui64Len -= 2040;
 		}
 		if (ui64Len > 0)
 		{
-			Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(hTAP, 0, puiCounter));
+			if (PutTAPBytes(pJob, &ucZero, 1) == -1)
+				return -1;
 			ui64Len = 0;
 		}
 	}
@@ -211,73 +281,70 @@ __int32 Initialize_TAP_header_and_return_frequencies(HANDLE hCAP, HANDLE hTAP, u
 }
 
 
-// Convert CAP to CBM TAP format.
-__int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
+// Read next chunk of CAP signals.
+__int32 CAP2TAP_ReadChunk(void *pContext, void *pJob)
 {
-	unsigned __int64 ui64Delta, ui64Delta2, ui64Len;
-	unsigned __int32 Timer_Precision_MHz, uiFreq;
-	unsigned __int8  TAPv; // TAP file format version.
-	unsigned __int8  ch;   // Single TAP data byte.
-	__int32          TAP_Counter = 0; // CAP & TAP file byte counters.
-	__int32          FuncRes, ReadFuncRes; // Function call results.
+	CAP2TAP_CONTEXT *pCtx = (CAP2TAP_CONTEXT *) pContext;
+	CAP2TAP_JOB     *pChunk = (CAP2TAP_JOB *) pJob;
+	__int32         iNumSignals, FuncRes;
 
-	if (Initialize_TAP_header_and_return_frequencies(hCAP, hTAP, &Timer_Precision_MHz, &uiFreq) != 0)
-		return -1;
+	pChunk->iNumSignals = 0;
 
-	// Start conversion CAP->TAP.
-
-	// Get target TAP version from header.
-	FuncRes = TAP_CBM_GetHeader_TAPversion(hTAP, &TAPv);
-	if (FuncRes != TAP_CBM_Status_OK)
+	while (pChunk->iNumSignals < CHUNK_SIGNALS)
 	{
-		TAP_CBM_OutputError(FuncRes);
-		return -1;
+		FuncRes = CAP_ReadSignals(pCtx->hCAP, pChunk->ui64Signals + pChunk->iNumSignals, CHUNK_SIGNALS - pChunk->iNumSignals, &iNumSignals, NULL);
+		if (FuncRes == CAP_Status_OK_End_of_file)
+			break;
+		else if (FuncRes != CAP_Status_OK)
+		{
+			CAP_OutputError(FuncRes);
+			return -1;
+		}
+		pChunk->iNumSignals += iNumSignals;
 	}
 
-	// Skip first halfwave (time until first pulse starts).
-	FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL);
-	if (FuncRes == CAP_Status_OK_End_of_file)
-	{
-		printf("Error: Empty image file.");
-		return -1;
-	}
-	else if (FuncRes == CAP_Status_Error_Reading_data)
-	{
-		CAP_OutputError(FuncRes);
-		return -1;
-	}
+	return (pChunk->iNumSignals > 0) ? 1 : 0;
+}
 
-	// Convert while CAP file signal available.
-	while ((ReadFuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+
+// Convert chunk of CAP signals to TAP data (worker thread).
+__int32 CAP2TAP_ConvertChunk(void *pContext, void *pJob)
+{
+	CAP2TAP_CONTEXT  *pCtx = (CAP2TAP_CONTEXT *) pContext;
+	CAP2TAP_JOB      *pChunk = (CAP2TAP_JOB *) pJob;
+	unsigned __int64 ui64Delta, ui64Len;
+	unsigned __int8  ch; // Single TAP data byte.
+	__int32          i = 0;
+
+	pChunk->uiOutLen = 0;
+
+	while (i < pChunk->iNumSignals)
 	{
-		if ((TAPv == TAPv0) || (TAPv == TAPv1))
+		ui64Delta = pChunk->ui64Signals[i++];
+
+		if ((pCtx->TAPv == TAPv0) || (pCtx->TAPv == TAPv1))
 		{
 			// Get and add timestamp of falling edge.
-			FuncRes = CAP_ReadSignal(hCAP, &ui64Delta2, NULL);
-			if (FuncRes == CAP_Status_Error_Reading_data)
-			{
-				CAP_OutputError(FuncRes);
-				return -1;
-			}
-			else if (FuncRes == CAP_Status_OK_End_of_file)
+			// Chunks only end on odd signals at the end of the file.
+			if (i >= pChunk->iNumSignals)
 				break;
 
-			ui64Delta += ui64Delta2;
+			ui64Delta += pChunk->ui64Signals[i++];
 		}
 
-		ui64Len = (ui64Delta*uiFreq/Timer_Precision_MHz+500000)/1000000;
+		ui64Len = (ui64Delta*pCtx->uiFreq/pCtx->Timer_Precision_MHz+500000)/1000000;
 
 		if (ui64Len > 2040) // 8*0xff=2040
 		{
 			// We have a pause.
-			if ((TAPv == TAPv0) || (TAPv == TAPv1))
+			if ((pCtx->TAPv == TAPv0) || (pCtx->TAPv == TAPv1))
 			{
-				if (HandlePause(hTAP, ui64Len, NeedEvenSplitNumber, TAPv, &TAP_Counter) == -1)
+				if (HandlePause(pChunk, ui64Len, NeedEvenSplitNumber, pCtx->TAPv) == -1)
 					return -1;
 			}
 			else
 			{
-				if (HandlePause(hTAP, ui64Len, NeedOddSplitNumber, TAPv, &TAP_Counter) == -1)
+				if (HandlePause(pChunk, ui64Len, NeedOddSplitNumber, pCtx->TAPv) == -1)
 					return -1;
 			}
 		}
@@ -285,22 +352,97 @@ __int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
 		{
 			// We have a data byte.
 			ch = (unsigned __int8) ((ui64Len+4)/8);
-			Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(hTAP, ch, &TAP_Counter));
+			if (PutTAPBytes(pChunk, &ch, 1) == -1)
+				return -1;
 		}
-	} // Convert while CAP file signal available.
+	}
+
+	return 0;
+}
+
+
+// Write TAP data of a converted chunk.
+__int32 CAP2TAP_WriteChunk(void *pContext, void *pJob)
+{
+	CAP2TAP_CONTEXT *pCtx = (CAP2TAP_CONTEXT *) pContext;
+	CAP2TAP_JOB     *pChunk = (CAP2TAP_JOB *) pJob;
+
+	if (pChunk->uiOutLen > 0)
+		Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_Bytes(pCtx->hTAP, pChunk->pucOut, pChunk->uiOutLen, &pCtx->TAP_Counter));
+
+	return 0;
+}
+
+
+// Convert CAP to CBM TAP format.
+// The signals are converted in chunks on one worker thread per processor.
+__int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
+{
+	CAP2TAP_CONTEXT  Context;
+	CHUNK_PIPELINE   Pipeline;
+	CAP2TAP_JOB      *pJobs[CHUNK_MAX_WORKERS];
+	unsigned __int64 ui64Delta;
+	unsigned __int32 uiNumJobs, i;
+	__int32          FuncRes, RetVal = -1;
+
+	memset(&Context, 0, sizeof(Context));
+	Context.hCAP = hCAP;
+	Context.hTAP = hTAP;
+
+	if (Initialize_TAP_header_and_return_frequencies(hCAP, hTAP, &Context.Timer_Precision_MHz, &Context.uiFreq) != 0)
+		return -1;
+
+	// Start conversion CAP->TAP.
+
+	// Get target TAP version from header.
+	FuncRes = TAP_CBM_GetHeader_TAPversion(hTAP, &Context.TAPv);
+	if (FuncRes != TAP_CBM_Status_OK)
+	{
+		TAP_CBM_OutputError(FuncRes);
+		return -1;
+	}
 
-	if (ReadFuncRes == CAP_Status_Error_Reading_data)
+	// Skip first halfwave (time until first pulse starts).
+	FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL);
+	if (FuncRes == CAP_Status_OK_End_of_file)
 	{
-		CAP_OutputError(ReadFuncRes);
+		printf("Error: Empty image file.");
 		return -1;
 	}
+	else if (FuncRes == CAP_Status_Error_Reading_data)
+	{
+		CAP_OutputError(FuncRes);
+		return -1;
+	}
+
+	// Allocate one job per worker thread.
+	uiNumJobs = Chunk_GetNumWorkers();
+	for (i = 0; i < uiNumJobs; i++)
+	{
+		pJobs[i] = (CAP2TAP_JOB *) calloc(1, sizeof(CAP2TAP_JOB));
+		if (pJobs[i] == NULL)
+		{
+			printf("Error: Could not allocate memory for conversion.\n");
+			uiNumJobs = i;
+			goto exit;
+		}
+	}
+
+	Pipeline.pContext = &Context;
+	Pipeline.Read     = CAP2TAP_ReadChunk;
+	Pipeline.Convert  = CAP2TAP_ConvertChunk;
+	Pipeline.Write    = CAP2TAP_WriteChunk;
+
+	// Convert while CAP file signal available.
+	if (Chunk_RunPipeline(&Pipeline, (void **) pJobs, uiNumJobs) != 0)
+		goto exit;
 
 	// Set signal byte count in header (sum of all signal bytes).
-	FuncRes = TAP_CBM_SetHeader_ByteCount(hTAP, TAP_Counter);
+	FuncRes = TAP_CBM_SetHeader_ByteCount(hTAP, Context.TAP_Counter);
 	if (FuncRes != TAP_CBM_Status_OK)
 	{
 		TAP_CBM_OutputError(FuncRes);
-		return -1;
+		goto exit;
 	}
 
 	// Seek to start of file & write image header.
@@ -308,8 +450,17 @@ __int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
 	if (FuncRes != TAP_CBM_Status_OK)
 	{
 		TAP_CBM_OutputError(FuncRes);
-		return -1;
+		goto exit;
 	}
 
-	return 0;
+	RetVal = 0;
+
+	exit:
+	for (i = 0; i < uiNumJobs; i++)
+	{
+		if (pJobs[i]->pucOut != NULL) free(pJobs[i]->pucOut);
+		free(pJobs[i]);
+	}
+
+	return RetVal;
 }
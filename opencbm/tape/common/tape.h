@@ -3,7 +3,9 @@
  *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
 */
 
-// Compatible tape firmware version (check tape_153x.c)
+// Oldest compatible tape firmware version (check tape_153x.c).
+// Version 2 adds the packed capture format, which the plugin only
+// requests if the firmware reports it.
 #define TapeFirmwareVersion 0x0001
 
 // Tape status values (must match xum1541 firmware values in xum1541.h)
@@ -30,6 +32,7 @@
 #define Tape_Status_ERROR_usbRecvByte               (Tape_Status_ERROR - 7)
 #define Tape_Status_ERROR_External_Break            (Tape_Status_ERROR - 8)
 #define Tape_Status_ERROR_Wrong_Tape_Firmware       (Tape_Status_ERROR - 9) // Not returned by firmware.
+#define Tape_Status_ERROR_Write_Underrun             (Tape_Status_ERROR - 10)
 
 // Signal edge definitions.
 #define XUM1541_TAP_WRITE_STARTFALLEDGE 0x20 // start writing with falling edge (1 = true)
@@ -16,6 +16,13 @@
 #define SEEK_START_OF_FILE 1
 #define SEEK_START_OF_DATA 2
 
+// Signal data is read and written through a buffer of this size.
+#define IO_BUFFER_SIZE (64*1024)
+
+#define IO_MODE_NONE  0
+#define IO_MODE_READ  1
+#define IO_MODE_WRITE 2
+
 #define DETAILED_INFO(rv) {fprintf(stderr, "Error : %d\nModule: %s\nBuilt : %s %s\nLine  : %d\n", rv, __FILE__, __DATE__, __TIME__, __LINE__);}
 
 #define ASSERT(x, rv) {if (!x) {DETAILED_INFO(rv); return rv;}}
@@ -26,10 +33,75 @@ typedef struct _INFOBLOCK {
 	char          header[Default_CAP_Header_Size+1]; // + 0-termination
 	unsigned char Machine, Video, StartEdge, SignalFormat;
 	unsigned int  Precision, SignalWidth, StartOfs;
+	unsigned char *IOBuf;        // Signal data buffer.
+	unsigned int  IOPos, IOLen;  // Next byte & bytes in buffer (read), bytes pending (write).
+	unsigned char IOMode;        // Buffer in use for reading or writing.
 	unsigned int  MemTag2;
 } INFOBLOCK, *PINFOBLOCK;
 
 
+// Internal function.
+// Write pending signal data, or give back unused read-ahead to the file position.
+// Must be called before the file is accessed directly (seek, header, close).
+int CAP_SyncBuffer(PINFOBLOCK pInfoBlock)
+{
+	int ret = CAP_Status_OK;
+
+	if ((pInfoBlock->IOMode == IO_MODE_WRITE) && (pInfoBlock->IOLen > 0))
+	{
+		if (fwrite(pInfoBlock->IOBuf, pInfoBlock->IOLen, 1, pInfoBlock->fd) != 1)
+			ret = CAP_Status_Error_Writing_data;
+	}
+	else if ((pInfoBlock->IOMode == IO_MODE_READ) && (pInfoBlock->IOPos < pInfoBlock->IOLen))
+	{
+		if (fseek(pInfoBlock->fd, -(long)(pInfoBlock->IOLen - pInfoBlock->IOPos), SEEK_CUR) != 0)
+			ret = CAP_Status_Error_Seek_failed;
+	}
+
+	pInfoBlock->IOPos = 0;
+	pInfoBlock->IOLen = 0;
+	pInfoBlock->IOMode = IO_MODE_NONE;
+
+	return ret;
+}
+
+
+// Internal function.
+// Prepare signal data buffer for reading or writing.
+int CAP_SetBufferMode(PINFOBLOCK pInfoBlock, unsigned char ucMode)
+{
+	int ret;
+
+	if (pInfoBlock->IOBuf == NULL)
+	{
+		pInfoBlock->IOBuf = (unsigned char *)malloc(IO_BUFFER_SIZE);
+		if (pInfoBlock->IOBuf == NULL)
+			return CAP_Status_Error_Out_of_memory;
+	}
+
+	if (pInfoBlock->IOMode != ucMode)
+	{
+		if ((ret = CAP_SyncBuffer(pInfoBlock)) != CAP_Status_OK)
+			return ret;
+		pInfoBlock->IOMode = ucMode;
+	}
+
+	return CAP_Status_OK;
+}
+
+
+// Internal function.
+// Keep unread bytes and refill read buffer from file.
+void CAP_FillBuffer(PINFOBLOCK pInfoBlock)
+{
+	unsigned int uiRemaining = pInfoBlock->IOLen - pInfoBlock->IOPos;
+
+	memmove(pInfoBlock->IOBuf, pInfoBlock->IOBuf + pInfoBlock->IOPos, uiRemaining);
+	pInfoBlock->IOPos = 0;
+	pInfoBlock->IOLen = uiRemaining + (unsigned int) fread(pInfoBlock->IOBuf + uiRemaining, 1, IO_BUFFER_SIZE - uiRemaining, pInfoBlock->fd);
+}
+
+
 // Exported function.
 // Create (overwrite) an image file for writing.
 int CAP_CreateFile(HANDLE *hHandle, char *pcFilename)
@@ -107,8 +179,16 @@ int CAP_CloseFile(HANDLE *hHandle)
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 
 	if (pInfoBlock->fd != NULL)
+	{
+		if (CAP_SyncBuffer(pInfoBlock) != CAP_Status_OK)
+			return CAP_Status_Error_Writing_data;
+
 		if (fclose(pInfoBlock->fd) != 0)
 			return CAP_Status_Error_Closing_file;
+	}
+
+	if (pInfoBlock->IOBuf != NULL)
+		free(pInfoBlock->IOBuf);
 
 	free(pInfoBlock);
 
@@ -140,6 +220,9 @@ int CAP_GetFileSize(HANDLE hHandle, int *piFileSize)
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 	ASSERT(piFileSize != 0, CAP_Status_Error_Invalid_pointer);
 
+	if (CAP_SyncBuffer(pInfoBlock) != CAP_Status_OK)
+		return CAP_Status_Error_Seek_failed;
+
 	if (fseek(pInfoBlock->fd, 0, SEEK_END) != 0)
 		return CAP_Status_Error_Seek_failed;
 
@@ -159,6 +242,9 @@ int CAP_SeekFile(HANDLE hHandle, char cDestination)
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, CAP_Status_Error_File_not_open);
 
+	if (CAP_SyncBuffer(pInfoBlock) != CAP_Status_OK)
+		return CAP_Status_Error_Seek_failed;
+
 	if (cDestination == SEEK_START_OF_FILE)
 	{
 		if (fseek(pInfoBlock->fd, 0, SEEK_SET) != 0)
@@ -391,6 +477,9 @@ int CAP_WriteHeaderAddon(HANDLE hHandle, unsigned char *pucString, unsigned int
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, CAP_Status_Error_File_not_open);
 
+	if (CAP_SyncBuffer(pInfoBlock) != CAP_Status_OK)
+		return CAP_Status_Error_Writing_header;
+
 	if (fwrite(pucString, uiStringLen, 1, pInfoBlock->fd) != 1)
 		return CAP_Status_Error_Writing_header;
 
@@ -399,81 +488,125 @@ int CAP_WriteHeaderAddon(HANDLE hHandle, unsigned char *pucString, unsigned int
 
 
 // Exported function.
-// Read a signal from image, increment byte counter.
-int CAP_ReadSignal(HANDLE hHandle, unsigned __int64 *pui64Signal, int *piCounter)
+// Read up to iMaxSignals signals from image, increment byte counter.
+// Returns CAP_Status_OK_End_of_file if no signal was left.
+int CAP_ReadSignals(HANDLE hHandle, unsigned __int64 *pui64Signals, int iMaxSignals, int *piNumSignals, int *piCounter)
 {
-	unsigned char    buf5[5]; // Compatible with 40bit signal width.
+	unsigned char    *buf5; // Compatible with 40bit signal width.
 	unsigned __int64 ui64Signal;
+	int              i, ret;
 
 	PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, CAP_Status_Error_File_not_open);
-	ASSERT(pui64Signal != 0, CAP_Status_Error_Invalid_pointer);
+	ASSERT(pui64Signals != 0, CAP_Status_Error_Invalid_pointer);
+	ASSERT(piNumSignals != 0, CAP_Status_Error_Invalid_pointer);
+
+	*piNumSignals = 0;
+
+	if ((ret = CAP_SetBufferMode(pInfoBlock, IO_MODE_READ)) != CAP_Status_OK)
+		return ret;
 
-	if (fread(buf5, 5, 1, pInfoBlock->fd) != 1)
+	for (i = 0; i < iMaxSignals; i++)
 	{
-		if (feof(pInfoBlock->fd) == 0)
+		if (pInfoBlock->IOLen - pInfoBlock->IOPos < 5)
+		{
+			CAP_FillBuffer(pInfoBlock);
+			if (pInfoBlock->IOLen < 5)
+				break;
+		}
+
+		buf5 = pInfoBlock->IOBuf + pInfoBlock->IOPos;
+		pInfoBlock->IOPos += 5;
+
+		ui64Signal = buf5[0];
+		ui64Signal = (ui64Signal << 8) + buf5[1];
+		ui64Signal = (ui64Signal << 8) + buf5[2];
+		ui64Signal = (ui64Signal << 8) + buf5[3];
+		ui64Signal = (ui64Signal << 8) + buf5[4];
+
+		pui64Signals[i] = ui64Signal;
+	}
+
+	*piNumSignals = i;
+
+	if (piCounter != NULL)
+		(*piCounter) += 5*i;
+
+	if (i == 0)
+	{
+		if (ferror(pInfoBlock->fd) != 0)
 			return CAP_Status_Error_Reading_data;
 		else
 			return CAP_Status_OK_End_of_file;
 	}
 
-	ui64Signal = buf5[0];
-	ui64Signal = (ui64Signal << 8) + buf5[1];
-	ui64Signal = (ui64Signal << 8) + buf5[2];
-	ui64Signal = (ui64Signal << 8) + buf5[3];
-	ui64Signal = (ui64Signal << 8) + buf5[4];
+	return CAP_Status_OK;
+}
 
-	*pui64Signal = ui64Signal;
 
-	if (piCounter != NULL)
-		(*piCounter)+=5;
+// Exported function.
+// Read a signal from image, increment byte counter.
+int CAP_ReadSignal(HANDLE hHandle, unsigned __int64 *pui64Signal, int *piCounter)
+{
+	int iNumSignals;
 
-	return CAP_Status_OK;
+	return CAP_ReadSignals(hHandle, pui64Signal, 1, &iNumSignals, piCounter);
 }
 
 
-// Internal function.
-// Write a single byte to image, increment counter.
-int CAP_WriteSingleByte(HANDLE hHandle, unsigned char ucByte, int *piCounter)
+// Exported function.
+// Write iNumSignals signals to image, increment counter for each written byte.
+int CAP_WriteSignals(HANDLE hHandle, const unsigned __int64 *pui64Signals, int iNumSignals, int *piCounter)
 {
+	unsigned char    *buf5;
+	unsigned __int64 ui64Signal;
+	int              i, ret;
+
 	PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
 	ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
+	ASSERT(pui64Signals != 0, CAP_Status_Error_Invalid_pointer);
 
 	if (pInfoBlock->fd == NULL)
 		return CAP_Status_Error_File_not_open;
 
-	if (fwrite(&ucByte, 1, 1, pInfoBlock->fd) != 1)
-		return CAP_Status_Error_Writing_data;
+	if ((ret = CAP_SetBufferMode(pInfoBlock, IO_MODE_WRITE)) != CAP_Status_OK)
+		return ret;
+
+	for (i = 0; i < iNumSignals; i++)
+	{
+		if (pInfoBlock->IOLen + 5 > IO_BUFFER_SIZE)
+		{
+			if (fwrite(pInfoBlock->IOBuf, pInfoBlock->IOLen, 1, pInfoBlock->fd) != 1)
+				return CAP_Status_Error_Writing_data;
+			pInfoBlock->IOLen = 0;
+		}
+
+		buf5 = pInfoBlock->IOBuf + pInfoBlock->IOLen;
+		pInfoBlock->IOLen += 5;
+
+		ui64Signal = pui64Signals[i];
+		buf5[0] = (unsigned char) ((ui64Signal >> 32) & 0xff);
+		buf5[1] = (unsigned char) ((ui64Signal >> 24) & 0xff);
+		buf5[2] = (unsigned char) ((ui64Signal >> 16) & 0xff);
+		buf5[3] = (unsigned char) ((ui64Signal >>  8) & 0xff);
+		buf5[4] = (unsigned char) ((ui64Signal      ) & 0xff);
+	}
 
 	if (piCounter != NULL)
-		(*piCounter)++;
+		(*piCounter) += 5*iNumSignals;
 
 	return CAP_Status_OK;
 }
 
+
 // Exported function.
 // Write a signal to image, increment counter for each written byte.
 int CAP_WriteSignal(HANDLE hHandle, unsigned __int64 ui64Signal, int *piCounter)
 {
-	if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 32) & 0xff), piCounter ) != CAP_Status_OK)
-		return CAP_Status_Error_Writing_data;
-
-	if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 24) & 0xff), piCounter ) != CAP_Status_OK)
-		return CAP_Status_Error_Writing_data;
-
-	if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 16) & 0xff), piCounter ) != CAP_Status_OK)
-		return CAP_Status_Error_Writing_data;
-
-	if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 8) & 0xff), piCounter ) != CAP_Status_OK)
-		return CAP_Status_Error_Writing_data;
-
-	if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal) & 0xff), piCounter ) != CAP_Status_OK)
-		return CAP_Status_Error_Writing_data;
-
-	return CAP_Status_OK;
+	return CAP_WriteSignals(hHandle, &ui64Signal, 1, piCounter);
 }
 
 
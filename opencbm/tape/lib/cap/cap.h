@@ -93,9 +93,16 @@ int CAP_WriteHeaderAddon(HANDLE hHandle, unsigned char *pucString, unsigned int
 // Read a signal from image, increment byte counter.
 int CAP_ReadSignal(HANDLE hHandle, unsigned __int64 *pui64Signal, int *piCounter);
 
+// Read up to iMaxSignals signals from image, increment byte counter.
+// Returns CAP_Status_OK_End_of_file if no signal was left.
+int CAP_ReadSignals(HANDLE hHandle, unsigned __int64 *pui64Signals, int iMaxSignals, int *piNumSignals, int *piCounter);
+
 // Write a signal to image, increment counter for each written byte.
 int CAP_WriteSignal(HANDLE hHandle, unsigned __int64 ui64Signal, int *piCounter);
 
+// Write iNumSignals signals to image, increment counter for each written byte.
+int CAP_WriteSignals(HANDLE hHandle, const unsigned __int64 *pui64Signals, int iNumSignals, int *piCounter);
+
 // Verify header contents (Signature, Version, Precision, Machine, Video, StartEdge, SignalFormat, SignalWidth, StartOfs).
 int CAP_isValidHeader(HANDLE hHandle);
 
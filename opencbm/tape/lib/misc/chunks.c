@@ -0,0 +1,149 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#include <Windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chunks.h"
+
+typedef struct _CHUNK_WORKER {
+	CHUNK_PIPELINE *pPipeline;
+	void           *pJob;
+	HANDLE         hStart, hDone, hThread;
+	BOOL           bQuit, bBusy;
+	__int32        Result;
+} CHUNK_WORKER;
+
+
+// Worker thread: convert a chunk each time it is started.
+DWORD WINAPI ChunkWorkerThread(LPVOID lpParam)
+{
+	CHUNK_WORKER *pWorker = (CHUNK_WORKER *) lpParam;
+
+	for (;;)
+	{
+		WaitForSingleObject(pWorker->hStart, INFINITE);
+		if (pWorker->bQuit)
+			break;
+
+		pWorker->Result = pWorker->pPipeline->Convert(pWorker->pPipeline->pContext, pWorker->pJob);
+		SetEvent(pWorker->hDone);
+	}
+
+	return 0;
+}
+
+
+// Exported function.
+// Return number of worker threads to use (one per processor).
+unsigned __int32 Chunk_GetNumWorkers(void)
+{
+	SYSTEM_INFO SystemInfo;
+
+	GetSystemInfo(&SystemInfo);
+
+	if (SystemInfo.dwNumberOfProcessors < 1)
+		return 1;
+	if (SystemInfo.dwNumberOfProcessors > CHUNK_MAX_WORKERS)
+		return CHUNK_MAX_WORKERS;
+
+	return SystemInfo.dwNumberOfProcessors;
+}
+
+
+// Internal function.
+// Wait for worker to finish its chunk, write chunk if no error occurred so far.
+void Chunk_Finish(CHUNK_WORKER *pWorker, __int32 *pRetVal)
+{
+	WaitForSingleObject(pWorker->hDone, INFINITE);
+	pWorker->bBusy = FALSE;
+
+	if (*pRetVal == 0)
+		if ((pWorker->Result != 0) || (pWorker->pPipeline->Write(pWorker->pPipeline->pContext, pWorker->pJob) != 0))
+			*pRetVal = -1;
+}
+
+
+// Exported function.
+// Run the pipeline with one worker thread per job until the input is exhausted.
+__int32 Chunk_RunPipeline(CHUNK_PIPELINE *pPipeline, void **ppJobs, unsigned __int32 uiNumJobs)
+{
+	CHUNK_WORKER     Workers[CHUNK_MAX_WORKERS];
+	DWORD            dwThreadId;
+	unsigned __int32 uiNumWorkers = 0, i, k;
+	__int32          FuncRes, RetVal = 0;
+	BOOL             bEnd = FALSE;
+
+	if ((uiNumJobs < 1) || (uiNumJobs > CHUNK_MAX_WORKERS))
+		return -1;
+
+	memset(Workers, 0, sizeof(Workers));
+
+	// Start worker threads.
+	for (i = 0; i < uiNumJobs; i++)
+	{
+		Workers[i].pPipeline = pPipeline;
+		Workers[i].pJob = ppJobs[i];
+		Workers[i].hStart = CreateEvent(NULL, FALSE, FALSE, NULL);
+		Workers[i].hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if ((Workers[i].hStart != NULL) && (Workers[i].hDone != NULL))
+			Workers[i].hThread = CreateThread(NULL, 0, ChunkWorkerThread, &Workers[i], 0, &dwThreadId);
+
+		if (Workers[i].hThread == NULL)
+		{
+			printf("Error: Could not create worker thread.\n");
+			if (Workers[i].hStart != NULL) CloseHandle(Workers[i].hStart);
+			if (Workers[i].hDone != NULL) CloseHandle(Workers[i].hDone);
+			RetVal = -1;
+			break;
+		}
+		uiNumWorkers++;
+	}
+
+	// Keep all workers busy: Once the oldest chunk is converted and written,
+	// the next chunk is read into its job and the worker is started again.
+	i = 0;
+	while ((RetVal == 0) && !bEnd)
+	{
+		if (Workers[i].bBusy)
+		{
+			Chunk_Finish(&Workers[i], &RetVal);
+			if (RetVal != 0)
+				break;
+		}
+
+		FuncRes = pPipeline->Read(pPipeline->pContext, Workers[i].pJob);
+		if (FuncRes < 0)
+			RetVal = -1;
+		else if (FuncRes == 0)
+			bEnd = TRUE;
+		else
+		{
+			Workers[i].bBusy = TRUE;
+			SetEvent(Workers[i].hStart);
+		}
+
+		i = (i + 1) % uiNumWorkers;
+	}
+
+	// Write remaining chunks, starting with the oldest one.
+	for (k = 0; k < uiNumWorkers; k++)
+		if (Workers[(i + k) % uiNumWorkers].bBusy)
+			Chunk_Finish(&Workers[(i + k) % uiNumWorkers], &RetVal);
+
+	// Stop worker threads.
+	for (i = 0; i < uiNumWorkers; i++)
+	{
+		Workers[i].bQuit = TRUE;
+		SetEvent(Workers[i].hStart);
+		WaitForSingleObject(Workers[i].hThread, INFINITE);
+		CloseHandle(Workers[i].hThread);
+		CloseHandle(Workers[i].hStart);
+		CloseHandle(Workers[i].hDone);
+	}
+
+	return RetVal;
+}
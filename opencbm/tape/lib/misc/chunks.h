@@ -0,0 +1,50 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#ifndef __TAP_CHUNKS_H_
+#define __TAP_CHUNKS_H_
+
+#include <Windows.h>
+
+// Maximum number of worker threads.
+#define CHUNK_MAX_WORKERS 16
+
+// Parallel chunk conversion:
+// The calling thread reads the input chunk by chunk, the chunks are
+// converted on worker threads, and the calling thread writes the
+// converted chunks in input order.
+typedef struct _CHUNK_PIPELINE {
+	void    *pContext;
+
+	// Read next chunk into job.
+	//   Return values:
+	//    1: chunk read
+	//    0: end of input
+	//   -1: an error occurred
+	__int32 (*Read)(void *pContext, void *pJob);
+
+	// Convert chunk, called on a worker thread.
+	//   Return values:
+	//    0: chunk converted
+	//   -1: an error occurred
+	__int32 (*Convert)(void *pContext, void *pJob);
+
+	// Write converted chunk.
+	//   Return values:
+	//    0: chunk written
+	//   -1: an error occurred
+	__int32 (*Write)(void *pContext, void *pJob);
+} CHUNK_PIPELINE;
+
+// Return number of worker threads to use (one per processor).
+unsigned __int32 Chunk_GetNumWorkers(void);
+
+// Run the pipeline with one worker thread per job until the input is exhausted.
+//   Return values:
+//    0: all chunks converted and written
+//   -1: an error occurred
+__int32 Chunk_RunPipeline(CHUNK_PIPELINE *pPipeline, void **ppJobs, unsigned __int32 uiNumJobs);
+
+#endif
@@ -43,6 +43,9 @@ __int32 OutputError(__int32 Status)
 		case Tape_Status_ERROR_Wrong_Tape_Firmware:
 			printf("Wrong tape firmware version.\n");
 			break;
+		case Tape_Status_ERROR_Write_Underrun:
+			printf("Write underrun: signal data did not arrive in time, some signals were stretched.\n");
+			break;
 		default:
 			// printf("Unknown error: %d\n", Status);
 			return -1;
@@ -16,6 +16,13 @@
 #define SEEK_START_OF_FILE 1
 #define SEEK_START_OF_DATA 2
 
+// Signal data is read and written through a buffer of this size.
+#define IO_BUFFER_SIZE (64*1024)
+
+#define IO_MODE_NONE  0
+#define IO_MODE_READ  1
+#define IO_MODE_WRITE 2
+
 #define DETAILED_INFO(rv) {fprintf(stderr, "Error : %d\nModule: %s\nBuilt : %s %s\nLine  : %d\n", rv, __FILE__, __DATE__, __TIME__, __LINE__);}
 
 #define ASSERT(x, rv) {if (!x) {DETAILED_INFO(rv); return rv;}}
@@ -26,10 +33,75 @@ typedef struct _INFOBLOCK {
 	char          header[Header_Size_TAP_CBM+1]; // + 0-termination
 	unsigned char Machine, Video, TAPversion;
 	unsigned int  ByteCount;
+	unsigned char *IOBuf;        // Signal data buffer.
+	unsigned int  IOPos, IOLen;  // Next byte & bytes in buffer (read), bytes pending (write).
+	unsigned char IOMode;        // Buffer in use for reading or writing.
 	unsigned int  MemTag2;
 } INFOBLOCK, *PINFOBLOCK;
 
 
+// Internal function.
+// Write pending signal data, or give back unused read-ahead to the file position.
+// Must be called before the file is accessed directly (seek, header, close).
+int TAP_CBM_SyncBuffer(PINFOBLOCK pInfoBlock)
+{
+	int ret = TAP_CBM_Status_OK;
+
+	if ((pInfoBlock->IOMode == IO_MODE_WRITE) && (pInfoBlock->IOLen > 0))
+	{
+		if (fwrite(pInfoBlock->IOBuf, pInfoBlock->IOLen, 1, pInfoBlock->fd) != 1)
+			ret = TAP_CBM_Status_Error_Writing_data;
+	}
+	else if ((pInfoBlock->IOMode == IO_MODE_READ) && (pInfoBlock->IOPos < pInfoBlock->IOLen))
+	{
+		if (fseek(pInfoBlock->fd, -(long)(pInfoBlock->IOLen - pInfoBlock->IOPos), SEEK_CUR) != 0)
+			ret = TAP_CBM_Status_Error_Seek_failed;
+	}
+
+	pInfoBlock->IOPos = 0;
+	pInfoBlock->IOLen = 0;
+	pInfoBlock->IOMode = IO_MODE_NONE;
+
+	return ret;
+}
+
+
+// Internal function.
+// Prepare signal data buffer for reading or writing.
+int TAP_CBM_SetBufferMode(PINFOBLOCK pInfoBlock, unsigned char ucMode)
+{
+	int ret;
+
+	if (pInfoBlock->IOBuf == NULL)
+	{
+		pInfoBlock->IOBuf = (unsigned char *)malloc(IO_BUFFER_SIZE);
+		if (pInfoBlock->IOBuf == NULL)
+			return TAP_CBM_Status_Error_Out_of_memory;
+	}
+
+	if (pInfoBlock->IOMode != ucMode)
+	{
+		if ((ret = TAP_CBM_SyncBuffer(pInfoBlock)) != TAP_CBM_Status_OK)
+			return ret;
+		pInfoBlock->IOMode = ucMode;
+	}
+
+	return TAP_CBM_Status_OK;
+}
+
+
+// Internal function.
+// Keep unread bytes and refill read buffer from file.
+void TAP_CBM_FillBuffer(PINFOBLOCK pInfoBlock)
+{
+	unsigned int uiRemaining = pInfoBlock->IOLen - pInfoBlock->IOPos;
+
+	memmove(pInfoBlock->IOBuf, pInfoBlock->IOBuf + pInfoBlock->IOPos, uiRemaining);
+	pInfoBlock->IOPos = 0;
+	pInfoBlock->IOLen = uiRemaining + (unsigned int) fread(pInfoBlock->IOBuf + uiRemaining, 1, IO_BUFFER_SIZE - uiRemaining, pInfoBlock->fd);
+}
+
+
 // Exported function.
 // Create (overwrite) an image file for writing.
 int TAP_CBM_CreateFile(HANDLE *hHandle, char *pcFilename)
@@ -105,8 +177,16 @@ int TAP_CBM_CloseFile(HANDLE *hHandle)
 	ASSERT(pInfoBlock != 0, TAP_CBM_Status_Error_Invalid_Handle);
 
 	if (pInfoBlock->fd != NULL)
+	{
+		if (TAP_CBM_SyncBuffer(pInfoBlock) != TAP_CBM_Status_OK)
+			return TAP_CBM_Status_Error_Writing_data;
+
 		if (fclose(pInfoBlock->fd) != 0)
 			return TAP_CBM_Status_Error_Closing_file;
+	}
+
+	if (pInfoBlock->IOBuf != NULL)
+		free(pInfoBlock->IOBuf);
 
 	free(pInfoBlock);
 
@@ -139,6 +219,9 @@ int TAP_CBM_GetFileSize(HANDLE hHandle, int *piFileSize)
 	ASSERT(piFileSize != 0, TAP_CBM_Status_Error_Invalid_pointer);
 	ASSERT(pInfoBlock->fd != 0, TAP_CBM_Status_Error_File_not_open);
 
+	if (TAP_CBM_SyncBuffer(pInfoBlock) != TAP_CBM_Status_OK)
+		return TAP_CBM_Status_Error_Seek_failed;
+
 	if (fseek(pInfoBlock->fd, 0, SEEK_END) != 0)
 		return TAP_CBM_Status_Error_Seek_failed;
 
@@ -158,6 +241,9 @@ int TAP_CBM_SeekFile(HANDLE hHandle, char cDestination)
 	ASSERT(pInfoBlock != 0, TAP_CBM_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, TAP_CBM_Status_Error_File_not_open);
 
+	if (TAP_CBM_SyncBuffer(pInfoBlock) != TAP_CBM_Status_OK)
+		return TAP_CBM_Status_Error_Seek_failed;
+
 	if (cDestination == SEEK_START_OF_FILE)
 	{
 		if (fseek(pInfoBlock->fd, 0, SEEK_SET) != 0)
@@ -315,97 +401,153 @@ int TAP_CBM_WriteHeader(HANDLE hHandle)
 
 
 // Exported function.
-// Read a signal from image, increment counter for each read byte.
-int TAP_CBM_ReadSignal(HANDLE hHandle, unsigned int *puiSignal, unsigned int *puiCounter)
+// Read up to uiMaxSignals signals from image, increment counter for each read byte.
+// Returns TAP_CBM_Status_OK_End_of_file if no signal was left.
+int TAP_CBM_ReadSignals(HANDLE hHandle, unsigned int *puiSignals, unsigned int uiMaxSignals, unsigned int *puiNumSignals, unsigned int *puiCounter)
 {
-	unsigned char buf3[3];
-	unsigned char ch;
-	unsigned int  uiSignal;
+	unsigned char *buf;
+	unsigned int  uiSignal, uiSignalBytes, i;
+	int           ret;
 
 	PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
 	ASSERT(pInfoBlock != 0, TAP_CBM_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, TAP_CBM_Status_Error_File_not_open);
-	ASSERT(puiSignal != 0, TAP_CBM_Status_Error_Invalid_pointer);
+	ASSERT(puiSignals != 0, TAP_CBM_Status_Error_Invalid_pointer);
+	ASSERT(puiNumSignals != 0, TAP_CBM_Status_Error_Invalid_pointer);
 	ASSERT(puiCounter != 0, TAP_CBM_Status_Error_Invalid_pointer);
 
-	if (fread(&ch, 1, 1, pInfoBlock->fd) != 1)
-	{
-		if (feof(pInfoBlock->fd) == 0)
-			return TAP_CBM_Status_Error_Reading_data;
-		else
-			return TAP_CBM_Status_OK_End_of_file;
-	}
+	*puiNumSignals = 0;
 
-	if (ch == 0) // Pause detected.
+	if ((ret = TAP_CBM_SetBufferMode(pInfoBlock, IO_MODE_READ)) != TAP_CBM_Status_OK)
+		return ret;
+
+	for (i = 0; i < uiMaxSignals; i++)
 	{
-		if (pInfoBlock->TAPversion == TAPv0)
-			*puiSignal = 2040; // 8*0xff=2040
-		else
+		// A pause takes 4 bytes (TAPv1/TAPv2), everything else 1 byte.
+		if (pInfoBlock->IOLen - pInfoBlock->IOPos < 4)
+			TAP_CBM_FillBuffer(pInfoBlock);
+
+		if (pInfoBlock->IOPos >= pInfoBlock->IOLen)
+			break;
+
+		buf = pInfoBlock->IOBuf + pInfoBlock->IOPos;
+
+		if (buf[0] == 0) // Pause detected.
 		{
-			if (fread(buf3, 3, 1, pInfoBlock->fd) != 1)
+			if (pInfoBlock->TAPversion == TAPv0)
 			{
-				if (feof(pInfoBlock->fd) == 0)
-					return TAP_CBM_Status_Error_Reading_data;
-				else
-					return TAP_CBM_Status_OK_End_of_file;
+				uiSignal = 2040; // 8*0xff=2040
+				uiSignalBytes = 1;
 			}
+			else
+			{
+				if (pInfoBlock->IOLen - pInfoBlock->IOPos < 4)
+					break;
 
-			(*puiCounter)+=3;
-
-			uiSignal = buf3[2];
-			uiSignal = (uiSignal << 8) | buf3[1];
-			uiSignal = (uiSignal << 8) | buf3[0];
-			*puiSignal = uiSignal;
+				uiSignal = buf[3];
+				uiSignal = (uiSignal << 8) | buf[2];
+				uiSignal = (uiSignal << 8) | buf[1];
+				uiSignalBytes = 4;
+			}
 		}
+		else // Data detected.
+		{
+			uiSignal = ((unsigned int)buf[0])*8;
+			uiSignalBytes = 1;
+		}
+
+		pInfoBlock->IOPos += uiSignalBytes;
+		(*puiCounter) += uiSignalBytes;
+		puiSignals[i] = uiSignal;
 	}
-	else // Data detected.
-		*puiSignal = ((unsigned int)ch)*8;
 
-	(*puiCounter)++;
+	*puiNumSignals = i;
+
+	if (i == 0)
+	{
+		if (ferror(pInfoBlock->fd) != 0)
+			return TAP_CBM_Status_Error_Reading_data;
+		else
+			return TAP_CBM_Status_OK_End_of_file;
+	}
 
 	return TAP_CBM_Status_OK;
 }
 
 
 // Exported function.
-// Write a single unsigned char to image file.
-int TAP_CBM_WriteSignal_1Byte(HANDLE hHandle, unsigned char ucByte, unsigned int *puiCounter)
+// Read a signal from image, increment counter for each read byte.
+int TAP_CBM_ReadSignal(HANDLE hHandle, unsigned int *puiSignal, unsigned int *puiCounter)
+{
+	unsigned int uiNumSignals;
+
+	return TAP_CBM_ReadSignals(hHandle, puiSignal, 1, &uiNumSignals, puiCounter);
+}
+
+
+// Exported function.
+// Write encoded signal bytes to image file, increment counter for each written byte.
+int TAP_CBM_WriteSignal_Bytes(HANDLE hHandle, const unsigned char *pucBytes, unsigned int uiNumBytes, unsigned int *puiCounter)
 {
+	unsigned int uiLen;
+	int          ret;
+
 	PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
 	ASSERT(pInfoBlock != 0, TAP_CBM_Status_Error_Invalid_Handle);
 	ASSERT(pInfoBlock->fd != 0, TAP_CBM_Status_Error_File_not_open);
+	ASSERT(pucBytes != 0, TAP_CBM_Status_Error_Invalid_pointer);
 	ASSERT(puiCounter != 0, TAP_CBM_Status_Error_Invalid_pointer);
 
-	if (fwrite(&ucByte, 1, 1, pInfoBlock->fd) != 1)
-		return TAP_CBM_Status_Error_Writing_data;
+	if ((ret = TAP_CBM_SetBufferMode(pInfoBlock, IO_MODE_WRITE)) != TAP_CBM_Status_OK)
+		return ret;
+
+	(*puiCounter) += uiNumBytes;
+
+	while (uiNumBytes > 0)
+	{
+		if (pInfoBlock->IOLen == IO_BUFFER_SIZE)
+		{
+			if (fwrite(pInfoBlock->IOBuf, pInfoBlock->IOLen, 1, pInfoBlock->fd) != 1)
+				return TAP_CBM_Status_Error_Writing_data;
+			pInfoBlock->IOLen = 0;
+		}
 
-	(*puiCounter)++;
+		uiLen = IO_BUFFER_SIZE - pInfoBlock->IOLen;
+		if (uiLen > uiNumBytes)
+			uiLen = uiNumBytes;
+
+		memcpy(pInfoBlock->IOBuf + pInfoBlock->IOLen, pucBytes, uiLen);
+		pInfoBlock->IOLen += uiLen;
+		pucBytes += uiLen;
+		uiNumBytes -= uiLen;
+	}
 
 	return TAP_CBM_Status_OK;
 }
 
 
 // Exported function.
-// Write 32bit unsigned integer to image file: LSB first, MSB last.
-int TAP_CBM_WriteSignal_4Bytes(HANDLE hHandle, unsigned int uiSignal, unsigned int *puiCounter)
+// Write a single unsigned char to image file.
+int TAP_CBM_WriteSignal_1Byte(HANDLE hHandle, unsigned char ucByte, unsigned int *puiCounter)
 {
-	int ret;
-
-	if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal      ) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-		return ret;
+	return TAP_CBM_WriteSignal_Bytes(hHandle, &ucByte, 1, puiCounter);
+}
 
-	if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >>  8) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-		return ret;
 
-	if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >> 16) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-		return ret;
+// Exported function.
+// Write 32bit unsigned integer to image file: LSB first, MSB last.
+int TAP_CBM_WriteSignal_4Bytes(HANDLE hHandle, unsigned int uiSignal, unsigned int *puiCounter)
+{
+	unsigned char buf4[4];
 
-	if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >> 24) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-		return ret;
+	buf4[0] = (unsigned char) ((uiSignal      ) & 0xff);
+	buf4[1] = (unsigned char) ((uiSignal >>  8) & 0xff);
+	buf4[2] = (unsigned char) ((uiSignal >> 16) & 0xff);
+	buf4[3] = (unsigned char) ((uiSignal >> 24) & 0xff);
 
-	return TAP_CBM_Status_OK;
+	return TAP_CBM_WriteSignal_Bytes(hHandle, buf4, 4, puiCounter);
 }
 
 
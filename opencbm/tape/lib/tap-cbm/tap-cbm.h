@@ -66,6 +66,13 @@ int TAP_CBM_WriteHeader(HANDLE hHandle);
 // Read a signal from image, increment counter for each read byte.
 int TAP_CBM_ReadSignal(HANDLE hHandle, unsigned int *puiSignal, unsigned int *puiCounter);
 
+// Read up to uiMaxSignals signals from image, increment counter for each read byte.
+// Returns TAP_CBM_Status_OK_End_of_file if no signal was left.
+int TAP_CBM_ReadSignals(HANDLE hHandle, unsigned int *puiSignals, unsigned int uiMaxSignals, unsigned int *puiNumSignals, unsigned int *puiCounter);
+
+// Write encoded signal bytes to image file, increment counter for each written byte.
+int TAP_CBM_WriteSignal_Bytes(HANDLE hHandle, const unsigned char *pucBytes, unsigned int uiNumBytes, unsigned int *puiCounter);
+
 // Write a single unsigned char to image file.
 int TAP_CBM_WriteSignal_1Byte(HANDLE hHandle, unsigned char ucByte, unsigned int *puiCounter);
 
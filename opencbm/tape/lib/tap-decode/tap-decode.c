@@ -0,0 +1,770 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Windows.h>
+#include <malloc.h>
+
+#include "tap-decode.h"
+
+// CBM standard loader (C64/VC20 ROM):
+// - Leader of short pulses, followed by bytes.
+// - Byte: new data marker (long, medium), 8 data bits LSB first and an
+//   odd parity bit. Bit 0 is (short, medium), bit 1 is (medium, short).
+// - End of data marker: (long, short).
+// - Every block is written twice. The first copy starts with the
+//   countdown $89..$81, the second one with $09..$01.
+// - The last byte of a block is the XOR checksum of the data bytes.
+
+// Nominal C64 PAL pulse lengths in TAP units (8 cycles).
+#define Nominal_Short  0x30
+#define Nominal_Medium 0x42
+#define Nominal_Long   0x56
+
+// Pulse length histogram: units of 8 cycles.
+#define HISTOGRAM_SIZE 256
+
+// Minimum number of short pulses for a leader.
+#define MIN_LEADER_PULSES 64
+
+// Short pulses ending a block without end-of-data marker.
+#define MIN_TRAILER_PULSES 16
+
+// Maximum number of consecutive pulse errors before a block is given up.
+#define MAX_RESYNC_PULSES 64
+
+// Pulses are (re)classified with the thresholds of the current block in windows of this size.
+#define CLASSIFY_WINDOW 4096
+
+// Pulses deviating more than this (percent) from their class length are counted as bad.
+#define BAD_PULSE_PERCENT 15
+
+#define COUNTDOWN_LEN 9
+
+typedef struct _DECODER {
+	const unsigned __int32 *puiPulses;
+	unsigned __int8        *pucClasses;
+	unsigned __int32       uiNumPulses;
+	unsigned __int32       uiClassifiedEnd;   // Pulses up to here are classified with the block thresholds.
+	unsigned __int32       uiPeak[3];         // Peaks of the current block.
+	unsigned __int32       uiThreshold[4];    // Thresholds of the current block.
+} DECODER;
+
+
+// Exported function.
+// Classify pulses (cycles) into TAP_DEC_Pulse_* using the given 4 thresholds.
+// Written without branches, so the compiler can vectorize the loop.
+void TAP_DEC_ClassifyPulses(const unsigned __int32 *puiPulses, unsigned __int8 *pucClasses, unsigned __int32 uiNumPulses, const unsigned __int32 *puiThreshold)
+{
+	unsigned __int32 t0 = puiThreshold[0], t1 = puiThreshold[1], t2 = puiThreshold[2], t3 = puiThreshold[3];
+	unsigned __int32 i, p;
+
+	for (i = 0; i < uiNumPulses; i++)
+	{
+		p = puiPulses[i];
+		pucClasses[i] = (unsigned __int8) ((p > t0) + (p > t1) + (p > t2) + (p > t3));
+	}
+}
+
+
+// Internal function.
+// Derive the thresholds from the short/medium/long peaks.
+void TAP_DEC_SetThresholds(unsigned __int32 *puiPeak, unsigned __int32 *puiThreshold)
+{
+	puiThreshold[0] = puiPeak[0]*6/10;
+	puiThreshold[1] = (puiPeak[0] + puiPeak[1])/2;
+	puiThreshold[2] = (puiPeak[1] + puiPeak[2])/2;
+	puiThreshold[3] = puiPeak[2]*14/10;
+}
+
+
+// Internal function.
+// Weighted mean (cycles) of the histogram bins [uiFrom, uiTo), 0 if too few pulses.
+unsigned __int32 TAP_DEC_HistogramMean(unsigned __int32 *puiHistogram, unsigned __int32 uiFrom, unsigned __int32 uiTo, unsigned __int32 uiNumPulses)
+{
+	unsigned __int64 ui64Sum = 0;
+	unsigned __int32 uiWeight = 0, i;
+
+	if (uiTo > HISTOGRAM_SIZE)
+		uiTo = HISTOGRAM_SIZE;
+
+	for (i = uiFrom; i < uiTo; i++)
+	{
+		ui64Sum += (unsigned __int64) puiHistogram[i]*(8*i+4);
+		uiWeight += puiHistogram[i];
+	}
+
+	if ((uiWeight == 0) || (uiWeight*1000 < uiNumPulses))
+		return 0;
+
+	return (unsigned __int32) (ui64Sum/uiWeight);
+}
+
+
+// Internal function.
+// Find the short/medium/long pulse peaks in the pulse length histogram.
+// The short pulse peak is the highest one (leaders). Medium and long pulses
+// are searched in the windows given by the ratios of the nominal lengths,
+// which don't depend on tape speed.
+int TAP_DEC_FindPeaks(const unsigned __int32 *puiPulses, unsigned __int32 uiNumPulses, unsigned __int32 *puiPeak)
+{
+	unsigned __int32 Histogram[HISTOGRAM_SIZE], Smooth[HISTOGRAM_SIZE];
+	unsigned __int32 Bounds[4], i, Best = 0, BestPos = 0, Mean;
+
+	memset(Histogram, 0, sizeof(Histogram));
+	memset(Smooth, 0, sizeof(Smooth));
+
+	for (i = 0; i < uiNumPulses; i++)
+		if ((puiPulses[i] >> 3) < HISTOGRAM_SIZE)
+			Histogram[puiPulses[i] >> 3]++;
+
+	for (i = 2; i < HISTOGRAM_SIZE-2; i++)
+		Smooth[i] = Histogram[i-2] + 2*Histogram[i-1] + 3*Histogram[i] + 2*Histogram[i+1] + Histogram[i+2];
+
+	// Bins below 0x10 are noise.
+	for (i = 0x10; i < HISTOGRAM_SIZE-2; i++)
+		if (Smooth[i] > Best)
+		{
+			Best = Smooth[i];
+			BestPos = i;
+		}
+
+	if ((Best == 0) || (Best*1000 < uiNumPulses))
+		return TAP_DEC_Status_Error_No_pulse_peaks;
+
+	// Window bounds halfway between the nominal lengths (S:M:L = 0x30:0x42:0x56).
+	// The maximum may be anywhere on a broad short pulse peak, so center
+	// the windows on the mean of the short pulses a few times.
+	puiPeak[0] = 8*BestPos+4;
+	for (i = 0; i < 3; i++)
+	{
+		Bounds[0] = puiPeak[0]*(3*Nominal_Short - Nominal_Medium)/(16*Nominal_Short);
+		Bounds[1] = puiPeak[0]*(Nominal_Short + Nominal_Medium)/(16*Nominal_Short);
+		Bounds[2] = puiPeak[0]*(Nominal_Medium + Nominal_Long)/(16*Nominal_Short);
+		Bounds[3] = puiPeak[0]*(3*Nominal_Long - Nominal_Medium)/(16*Nominal_Short);
+
+		Mean = TAP_DEC_HistogramMean(Histogram, Bounds[0], Bounds[1], uiNumPulses);
+		if ((Mean == 0) || (Mean == puiPeak[0]))
+			break;
+		puiPeak[0] = Mean;
+	}
+
+	puiPeak[1] = TAP_DEC_HistogramMean(Histogram, Bounds[1], Bounds[2], uiNumPulses);
+	puiPeak[2] = TAP_DEC_HistogramMean(Histogram, Bounds[2], Bounds[3]+1, uiNumPulses);
+
+	// Without data (leader only), scale the nominal values from the short pulse peak.
+	if (puiPeak[1] == 0)
+		puiPeak[1] = puiPeak[0]*Nominal_Medium/Nominal_Short;
+	if (puiPeak[2] == 0)
+		puiPeak[2] = puiPeak[0]*Nominal_Long/Nominal_Short;
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Internal function.
+// Return class of pulse, classify next window with the block thresholds if needed.
+unsigned __int8 TAP_DEC_GetClass(DECODER *pDec, unsigned __int32 uiPos)
+{
+	unsigned __int32 uiLen;
+
+	if (uiPos >= pDec->uiClassifiedEnd)
+	{
+		uiLen = pDec->uiNumPulses - uiPos;
+		if (uiLen > CLASSIFY_WINDOW)
+			uiLen = CLASSIFY_WINDOW;
+		TAP_DEC_ClassifyPulses(pDec->puiPulses + uiPos, pDec->pucClasses + uiPos, uiLen, pDec->uiThreshold);
+		pDec->uiClassifiedEnd = uiPos + uiLen;
+	}
+
+	return pDec->pucClasses[uiPos];
+}
+
+
+// Internal function.
+// Check if a pulse deviates too much from the length of its class.
+BOOL TAP_DEC_IsBadPulse(DECODER *pDec, unsigned __int32 uiPos, unsigned __int8 ucClass)
+{
+	unsigned __int32 p = pDec->puiPulses[uiPos], Peak;
+
+	if ((ucClass < TAP_DEC_Pulse_Short) || (ucClass > TAP_DEC_Pulse_Long))
+		return TRUE;
+
+	Peak = pDec->uiPeak[ucClass - TAP_DEC_Pulse_Short];
+	if (p > Peak)
+		return ((p - Peak)*100 > Peak*BAD_PULSE_PERCENT);
+	else
+		return ((Peak - p)*100 > Peak*BAD_PULSE_PERCENT);
+}
+
+
+// Internal function.
+// Append a byte to a block.
+int TAP_DEC_AppendByte(TAP_DEC_BLOCK *pBlock, unsigned __int32 *puiSize, unsigned __int8 ucByte, unsigned __int8 ucParityError)
+{
+	unsigned __int8 *pucData, *pucParityError;
+
+	if (pBlock->uiLen == *puiSize)
+	{
+		*puiSize = (*puiSize == 0) ? 256 : 2*(*puiSize);
+		pucData = (unsigned __int8 *) realloc(pBlock->pucData, *puiSize);
+		if (pucData == NULL)
+			return TAP_DEC_Status_Error_Out_of_memory;
+		pBlock->pucData = pucData;
+		pucParityError = (unsigned __int8 *) realloc(pBlock->pucParityError, *puiSize);
+		if (pucParityError == NULL)
+			return TAP_DEC_Status_Error_Out_of_memory;
+		pBlock->pucParityError = pucParityError;
+	}
+
+	pBlock->pucData[pBlock->uiLen] = ucByte;
+	pBlock->pucParityError[pBlock->uiLen] = ucParityError;
+	pBlock->uiLen++;
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Internal function.
+// Read the bytes of a block following a leader, until end-of-data marker or trailer.
+int TAP_DEC_ReadBlockBytes(DECODER *pDec, unsigned __int32 *puiPos, TAP_DEC_BLOCK *pBlock)
+{
+	unsigned __int32 p = *puiPos, n = pDec->uiNumPulses, uiSize = 0, uiRun, uiResync = 0, bit;
+	unsigned __int8  c0, c1, ucByte, ucParity, ucBit;
+	BOOL             bInSync = FALSE;
+	int              ret;
+
+	while (p+1 < n)
+	{
+		c0 = TAP_DEC_GetClass(pDec, p);
+		c1 = TAP_DEC_GetClass(pDec, p+1);
+
+		if ((c0 == TAP_DEC_Pulse_Long) && (c1 == TAP_DEC_Pulse_Short))
+		{
+			// End of data marker.
+			pBlock->bEndMarker = TRUE;
+			p += 2;
+			break;
+		}
+
+		// Right after a byte, a long pulse which came out as medium one
+		// still marks the next byte (no bit starts with two medium pulses).
+		if (!(   ((c0 == TAP_DEC_Pulse_Long) && (c1 == TAP_DEC_Pulse_Medium))
+		      || (bInSync && (c0 == TAP_DEC_Pulse_Medium) && (c1 == TAP_DEC_Pulse_Medium) && (pDec->puiPulses[p] > pDec->puiPulses[p+1]))))
+		{
+			bInSync = FALSE;
+
+			if (c0 == TAP_DEC_Pulse_Short)
+			{
+				// Trailer or next leader: block is over.
+				for (uiRun = 0; (p+uiRun < n) && (uiRun < MIN_TRAILER_PULSES) && (TAP_DEC_GetClass(pDec, p+uiRun) == TAP_DEC_Pulse_Short); uiRun++);
+				if (uiRun == MIN_TRAILER_PULSES)
+					break;
+			}
+			else if (c0 == TAP_DEC_Pulse_Pause)
+				break;
+
+			// Out of sync, look for next byte marker.
+			pBlock->uiPulseErrors++;
+			p++;
+			if (++uiResync > MAX_RESYNC_PULSES)
+				break;
+			continue;
+		}
+
+		// New data marker.
+		pBlock->uiBadPulses += TAP_DEC_IsBadPulse(pDec, p, c0) + TAP_DEC_IsBadPulse(pDec, p+1, c1);
+		p += 2;
+		uiResync = 0;
+
+		if (p + 18 > n)
+			break;
+
+		// 8 data bits (LSB first) and odd parity bit.
+		ucByte = 0;
+		ucParity = 1;
+		for (bit = 0; bit < 9; bit++, p += 2)
+		{
+			c0 = TAP_DEC_GetClass(pDec, p);
+			c1 = TAP_DEC_GetClass(pDec, p+1);
+
+			if ((c0 == TAP_DEC_Pulse_Short) && (c1 == TAP_DEC_Pulse_Medium))
+				ucBit = 0;
+			else if ((c0 == TAP_DEC_Pulse_Medium) && (c1 == TAP_DEC_Pulse_Short))
+				ucBit = 1;
+			else
+			{
+				// Best guess: the longer pulse comes first for bit 1.
+				pBlock->uiPulseErrors += 2;
+				ucBit = (pDec->puiPulses[p] > pDec->puiPulses[p+1]) ? 1 : 0;
+			}
+			pBlock->uiBadPulses += TAP_DEC_IsBadPulse(pDec, p, c0) + TAP_DEC_IsBadPulse(pDec, p+1, c1);
+
+			if (bit < 8)
+			{
+				ucByte |= ucBit << bit;
+				ucParity ^= ucBit;
+			}
+			else
+				ucParity ^= ucBit;
+		}
+
+		if (ucParity != 0)
+			pBlock->uiParityErrors++;
+
+		if ((ret = TAP_DEC_AppendByte(pBlock, &uiSize, ucByte, ucParity)) != TAP_DEC_Status_OK)
+			return ret;
+
+		bInSync = TRUE;
+	}
+
+	pBlock->uiPulses = p - *puiPos;
+	*puiPos = p;
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Internal function.
+// Check countdown, strip countdown and checksum.
+//   Return values:
+//    1: CBM standard loader block
+//    0: no CBM standard loader block
+int TAP_DEC_FinishBlock(TAP_DEC_BLOCK *pBlock)
+{
+	unsigned __int32 i, uiFirst = 0, uiRepeated = 0;
+	unsigned __int8  ucChecksum = 0;
+
+	if (pBlock->uiLen < COUNTDOWN_LEN+1)
+		return 0;
+
+	for (i = 0; i < COUNTDOWN_LEN; i++)
+	{
+		if (pBlock->pucData[i] == 0x89-i) uiFirst++;
+		if (pBlock->pucData[i] == 0x09-i) uiRepeated++;
+	}
+
+	if ((uiFirst < COUNTDOWN_LEN/2+1) && (uiRepeated < COUNTDOWN_LEN/2+1))
+		return 0;
+
+	pBlock->bRepeated = (uiRepeated > uiFirst);
+
+	// Parity errors in the countdown don't matter.
+	for (i = 0; i < COUNTDOWN_LEN; i++)
+		if (pBlock->pucParityError[i])
+			pBlock->uiParityErrors--;
+
+	pBlock->uiLen -= COUNTDOWN_LEN+1;
+	memmove(pBlock->pucData, pBlock->pucData+COUNTDOWN_LEN, pBlock->uiLen+1);
+	memmove(pBlock->pucParityError, pBlock->pucParityError+COUNTDOWN_LEN, pBlock->uiLen+1);
+
+	for (i = 0; i < pBlock->uiLen; i++)
+		ucChecksum ^= pBlock->pucData[i];
+
+	pBlock->bChecksumOK = (ucChecksum == pBlock->pucData[pBlock->uiLen]);
+
+	return 1;
+}
+
+
+// Internal function.
+// Add a block to the tape.
+int TAP_DEC_AddBlock(TAP_DEC_TAPE *pTape, unsigned __int32 *puiSize, TAP_DEC_BLOCK *pBlock)
+{
+	TAP_DEC_BLOCK *pBlocks;
+
+	if (pTape->uiNumBlocks == *puiSize)
+	{
+		*puiSize = (*puiSize == 0) ? 64 : 2*(*puiSize);
+		pBlocks = (TAP_DEC_BLOCK *) realloc(pTape->pBlocks, *puiSize * sizeof(TAP_DEC_BLOCK));
+		if (pBlocks == NULL)
+			return TAP_DEC_Status_Error_Out_of_memory;
+		pTape->pBlocks = pBlocks;
+	}
+
+	pTape->pBlocks[pTape->uiNumBlocks++] = *pBlock;
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Internal function.
+// Merge the two copies of a block: take a copy with good checksum,
+// else take each byte from the copy without parity error.
+// Returns index of the block used (first one if merged), -1 if none available.
+__int32 TAP_DEC_MergeCopies(TAP_DEC_TAPE *pTape, __int32 iFirst, __int32 iSecond, unsigned __int8 **ppucData, unsigned __int32 *puiLen, BOOL *pbChecksumOK)
+{
+	TAP_DEC_BLOCK    *pFirst, *pSecond;
+	unsigned __int8  ucChecksum = 0;
+	unsigned __int32 i;
+	__int32          iUsed;
+
+	*ppucData = NULL;
+	*puiLen = 0;
+	*pbChecksumOK = FALSE;
+
+	if ((iFirst < 0) && (iSecond < 0))
+		return -1;
+
+	if ((iFirst < 0) || ((iSecond >= 0) && !pTape->pBlocks[iFirst].bChecksumOK && pTape->pBlocks[iSecond].bChecksumOK))
+		iUsed = iSecond;
+	else
+		iUsed = iFirst;
+
+	pFirst = &pTape->pBlocks[iUsed];
+	*ppucData = (unsigned __int8 *) malloc(pFirst->uiLen + 1);
+	if (*ppucData == NULL)
+		return -1;
+	memcpy(*ppucData, pFirst->pucData, pFirst->uiLen);
+	*puiLen = pFirst->uiLen;
+	*pbChecksumOK = pFirst->bChecksumOK;
+
+	if (pFirst->bChecksumOK || (iFirst < 0) || (iSecond < 0))
+		return iUsed;
+
+	pSecond = &pTape->pBlocks[iSecond];
+	if (pSecond->uiLen != pFirst->uiLen)
+		return iUsed;
+
+	for (i = 0; i < pFirst->uiLen; i++)
+	{
+		if (pFirst->pucParityError[i] && !pSecond->pucParityError[i])
+			(*ppucData)[i] = pSecond->pucData[i];
+		ucChecksum ^= (*ppucData)[i];
+	}
+
+	// Checksum of both copies should be the same, take any good one.
+	*pbChecksumOK = ((!pFirst->pucParityError[pFirst->uiLen] && (ucChecksum == pFirst->pucData[pFirst->uiLen]))
+	              || (!pSecond->pucParityError[pSecond->uiLen] && (ucChecksum == pSecond->pucData[pSecond->uiLen])));
+
+	return iUsed;
+}
+
+
+// Internal function.
+// Assemble files from header and data blocks.
+int TAP_DEC_AssembleFiles(TAP_DEC_TAPE *pTape)
+{
+	TAP_DEC_FILE     File;
+	unsigned __int8  *pucHeader;
+	unsigned __int32 i = 0, uiLen, uiSize = 0, k;
+	__int32          iSecond, iFirstData, iSecondData;
+	BOOL             bChecksumOK;
+	TAP_DEC_FILE     *pFiles;
+
+	while (i < pTape->uiNumBlocks)
+	{
+		if (   (pTape->pBlocks[i].uiLen != TAP_DEC_Header_Size)
+			|| ((pTape->pBlocks[i].pucData[0] != TAP_DEC_Type_Prg_Relocatable) && (pTape->pBlocks[i].pucData[0] != TAP_DEC_Type_Prg)))
+		{
+			i++;
+			continue;
+		}
+
+		// Header: first copy, maybe followed by the second one.
+		memset(&File, 0, sizeof(File));
+		iSecond = -1;
+		if ((i+1 < pTape->uiNumBlocks) && pTape->pBlocks[i+1].bRepeated && (pTape->pBlocks[i+1].uiLen == TAP_DEC_Header_Size))
+			iSecond = i+1;
+
+		File.iHeaderBlock = TAP_DEC_MergeCopies(pTape, pTape->pBlocks[i].bRepeated ? -1 : (__int32)i, pTape->pBlocks[i].bRepeated ? (__int32)i : iSecond, &pucHeader, &uiLen, &bChecksumOK);
+		if (File.iHeaderBlock < 0)
+			return TAP_DEC_Status_Error_Out_of_memory;
+
+		i = (iSecond >= 0) ? iSecond+1 : i+1;
+
+		File.ucType  = pucHeader[0];
+		File.uiStart = pucHeader[1] | (pucHeader[2] << 8);
+		File.uiEnd   = pucHeader[3] | (pucHeader[4] << 8);
+		memcpy(File.cName, pucHeader+5, 16);
+		File.cName[16] = 0;
+		for (k = 16; (k > 0) && ((File.cName[k-1] == ' ') || (File.cName[k-1] == 0)); k--)
+			File.cName[k-1] = 0;
+		free(pucHeader);
+
+		// Data: first copy and/or second copy of the expected length.
+		uiLen = (File.uiEnd - File.uiStart) & 0xffff;
+		iFirstData = iSecondData = -1;
+		if ((i < pTape->uiNumBlocks) && (pTape->pBlocks[i].uiLen == uiLen) && !pTape->pBlocks[i].bRepeated)
+			iFirstData = i++;
+		if ((i < pTape->uiNumBlocks) && (pTape->pBlocks[i].uiLen == uiLen) && pTape->pBlocks[i].bRepeated)
+			iSecondData = i++;
+
+		File.iDataBlock = TAP_DEC_MergeCopies(pTape, iFirstData, iSecondData, &File.pucData, &File.uiLen, &File.bChecksumOK);
+		if ((File.iDataBlock >= 0) && (File.pucData == NULL))
+			return TAP_DEC_Status_Error_Out_of_memory;
+
+		if (pTape->uiNumFiles == uiSize)
+		{
+			uiSize = (uiSize == 0) ? 16 : 2*uiSize;
+			pFiles = (TAP_DEC_FILE *) realloc(pTape->pFiles, uiSize * sizeof(TAP_DEC_FILE));
+			if (pFiles == NULL)
+			{
+				if (File.pucData != NULL) free(File.pucData);
+				return TAP_DEC_Status_Error_Out_of_memory;
+			}
+			pTape->pFiles = pFiles;
+		}
+		pTape->pFiles[pTape->uiNumFiles++] = File;
+	}
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Exported function.
+// Decode CBM standard loader blocks from full wave pulse lengths (cycles), assemble files.
+int TAP_DEC_Decode(const unsigned __int32 *puiPulses, unsigned __int32 uiNumPulses, TAP_DEC_TAPE *pTape)
+{
+	DECODER          Dec;
+	TAP_DEC_BLOCK    Block;
+	unsigned __int64 ui64Sum;
+	unsigned __int32 uiPos = 0, uiRunStart, uiBlocksSize = 0, i;
+	int              ret = TAP_DEC_Status_OK;
+
+	if ((puiPulses == NULL) || (pTape == NULL))
+		return TAP_DEC_Status_Error_Invalid_pointer;
+
+	memset(pTape, 0, sizeof(TAP_DEC_TAPE));
+	memset(&Dec, 0, sizeof(Dec));
+	memset(&Block, 0, sizeof(Block));
+
+	// Adapt thresholds to the pulse lengths found on the tape.
+	if ((ret = TAP_DEC_FindPeaks(puiPulses, uiNumPulses, pTape->uiPeak)) != TAP_DEC_Status_OK)
+		return ret;
+	TAP_DEC_SetThresholds(pTape->uiPeak, pTape->uiThreshold);
+
+	Dec.puiPulses = puiPulses;
+	Dec.uiNumPulses = uiNumPulses;
+	Dec.pucClasses = (unsigned __int8 *) malloc(uiNumPulses + 1);
+	if (Dec.pucClasses == NULL)
+		return TAP_DEC_Status_Error_Out_of_memory;
+
+	// Classify all pulses with the thresholds of the whole tape.
+	TAP_DEC_ClassifyPulses(puiPulses, Dec.pucClasses, uiNumPulses, pTape->uiThreshold);
+	Dec.uiClassifiedEnd = uiNumPulses;
+
+	while (uiPos < uiNumPulses)
+	{
+		// Find leader.
+		if (Dec.pucClasses[uiPos] != TAP_DEC_Pulse_Short)
+		{
+			uiPos++;
+			continue;
+		}
+		uiRunStart = uiPos;
+		while ((uiPos < uiNumPulses) && (Dec.pucClasses[uiPos] == TAP_DEC_Pulse_Short))
+			uiPos++;
+		if (uiPos - uiRunStart < MIN_LEADER_PULSES)
+			continue;
+
+		// Adapt thresholds to the tape speed of this block, measured on the leader.
+		// The first pulses of the leader are skipped, the motor may still speed up.
+		ui64Sum = 0;
+		for (i = uiRunStart + (uiPos - uiRunStart)/4; i < uiPos; i++)
+			ui64Sum += puiPulses[i];
+		ui64Sum /= uiPos - (uiRunStart + (uiPos - uiRunStart)/4);
+		for (i = 0; i < 3; i++)
+			Dec.uiPeak[i] = (unsigned __int32) (pTape->uiPeak[i]*ui64Sum/pTape->uiPeak[0]);
+		TAP_DEC_SetThresholds(Dec.uiPeak, Dec.uiThreshold);
+		Dec.uiClassifiedEnd = uiPos;
+
+		memset(&Block, 0, sizeof(Block));
+		Block.uiPulseStart = uiRunStart;
+		Block.uiLeaderPulses = uiPos - uiRunStart;
+
+		if ((ret = TAP_DEC_ReadBlockBytes(&Dec, &uiPos, &Block)) != TAP_DEC_Status_OK)
+			break;
+
+		Block.uiPulseEnd = uiPos;
+
+		if (TAP_DEC_FinishBlock(&Block))
+		{
+			if ((ret = TAP_DEC_AddBlock(pTape, &uiBlocksSize, &Block)) != TAP_DEC_Status_OK)
+				break;
+		}
+		else
+		{
+			if (Block.uiLen > 0)
+				pTape->uiUnknownBlocks++;
+			if (Block.pucData != NULL) free(Block.pucData);
+			if (Block.pucParityError != NULL) free(Block.pucParityError);
+		}
+		Block.pucData = NULL;
+		Block.pucParityError = NULL;
+	}
+
+	if (Block.pucData != NULL) free(Block.pucData);
+	if (Block.pucParityError != NULL) free(Block.pucParityError);
+	free(Dec.pucClasses);
+
+	if (ret == TAP_DEC_Status_OK)
+		ret = TAP_DEC_AssembleFiles(pTape);
+
+	if (ret != TAP_DEC_Status_OK)
+		TAP_DEC_Free(pTape);
+
+	return ret;
+}
+
+
+// Exported function.
+// Free all memory of a decoded tape.
+void TAP_DEC_Free(TAP_DEC_TAPE *pTape)
+{
+	unsigned __int32 i;
+
+	if (pTape == NULL)
+		return;
+
+	for (i = 0; i < pTape->uiNumBlocks; i++)
+	{
+		if (pTape->pBlocks[i].pucData != NULL) free(pTape->pBlocks[i].pucData);
+		if (pTape->pBlocks[i].pucParityError != NULL) free(pTape->pBlocks[i].pucParityError);
+	}
+	if (pTape->pBlocks != NULL) free(pTape->pBlocks);
+
+	for (i = 0; i < pTape->uiNumFiles; i++)
+		if (pTape->pFiles[i].pucData != NULL) free(pTape->pFiles[i].pucData);
+	if (pTape->pFiles != NULL) free(pTape->pFiles);
+
+	memset(pTape, 0, sizeof(TAP_DEC_TAPE));
+}
+
+
+// Internal function.
+// Convert PETSCII file name into a file system name.
+void TAP_DEC_MakeFileName(char *pcDest, const char *pcName)
+{
+	for (; *pcName != 0; pcName++, pcDest++)
+	{
+		if (   ((*pcName >= 'A') && (*pcName <= 'Z'))
+			|| ((*pcName >= '0') && (*pcName <= '9'))
+			|| (*pcName == '-') || (*pcName == '.'))
+			*pcDest = *pcName;
+		else
+			*pcDest = '_';
+	}
+	*pcDest = 0;
+}
+
+
+// Exported function.
+// Write all program files to the given directory (NULL: current directory).
+int TAP_DEC_WritePRGs(TAP_DEC_TAPE *pTape, char *pcDirectory, unsigned __int32 *puiNumWritten)
+{
+	TAP_DEC_FILE     *pFile;
+	char             cName[17], cPath[_MAX_PATH];
+	unsigned __int8  ucAddr[2];
+	unsigned __int32 i;
+	FILE             *fd;
+
+	if ((pTape == NULL) || (puiNumWritten == NULL))
+		return TAP_DEC_Status_Error_Invalid_pointer;
+
+	*puiNumWritten = 0;
+
+	for (i = 0; i < pTape->uiNumFiles; i++)
+	{
+		pFile = &pTape->pFiles[i];
+		if (pFile->pucData == NULL)
+			continue;
+
+		// Number the files, names on tape don't need to be unique.
+		TAP_DEC_MakeFileName(cName, pFile->cName);
+		if (pcDirectory != NULL)
+			_snprintf(cPath, sizeof(cPath), "%s\\%03u_%s.prg", pcDirectory, i+1, cName);
+		else
+			_snprintf(cPath, sizeof(cPath), "%03u_%s.prg", i+1, cName);
+		cPath[sizeof(cPath)-1] = 0;
+
+		fd = fopen(cPath, "wb");
+		if (fd == NULL)
+			return TAP_DEC_Status_Error_Creating_file;
+
+		ucAddr[0] = (unsigned __int8) (pFile->uiStart & 0xff);
+		ucAddr[1] = (unsigned __int8) (pFile->uiStart >> 8);
+
+		if (   (fwrite(ucAddr, 2, 1, fd) != 1)
+			|| ((pFile->uiLen > 0) && (fwrite(pFile->pucData, pFile->uiLen, 1, fd) != 1)))
+		{
+			fclose(fd);
+			return TAP_DEC_Status_Error_Writing_data;
+		}
+
+		if (fclose(fd) != 0)
+			return TAP_DEC_Status_Error_Writing_data;
+
+		(*puiNumWritten)++;
+	}
+
+	return TAP_DEC_Status_OK;
+}
+
+
+// Exported function.
+// Output quality report of all blocks and files.
+void TAP_DEC_OutputReport(TAP_DEC_TAPE *pTape, FILE *fd)
+{
+	TAP_DEC_BLOCK    *pBlock;
+	TAP_DEC_FILE     *pFile;
+	unsigned __int32 i;
+
+	fprintf(fd, "Pulse lengths (cycles): short %u, medium %u, long %u\n", pTape->uiPeak[0], pTape->uiPeak[1], pTape->uiPeak[2]);
+	fprintf(fd, "Thresholds (cycles)   : %u / %u / %u / %u\n\n", pTape->uiThreshold[0], pTape->uiThreshold[1], pTape->uiThreshold[2], pTape->uiThreshold[3]);
+
+	fprintf(fd, "Block  Pulse pos  Leader  Copy  Length  Checksum  Parity  Pulse err  Bad pulses  End\n");
+	for (i = 0; i < pTape->uiNumBlocks; i++)
+	{
+		pBlock = &pTape->pBlocks[i];
+		fprintf(fd, "%5u  %9u  %6u  %4s  %6u  %8s  %6u  %9u  %9.2f%%  %3s\n",
+			i+1, pBlock->uiPulseStart, pBlock->uiLeaderPulses, pBlock->bRepeated ? "2nd" : "1st",
+			pBlock->uiLen, pBlock->bChecksumOK ? "OK" : "BAD", pBlock->uiParityErrors, pBlock->uiPulseErrors,
+			(pBlock->uiPulses == 0) ? 0.0 : (100.0*pBlock->uiBadPulses/pBlock->uiPulses),
+			pBlock->bEndMarker ? "yes" : "no");
+	}
+	if (pTape->uiUnknownBlocks > 0)
+		fprintf(fd, "%u leader(s) followed by data in non-standard format.\n", pTape->uiUnknownBlocks);
+
+	fprintf(fd, "\nFile  Type  Name              Start  End    Header  Data   Checksum\n");
+	for (i = 0; i < pTape->uiNumFiles; i++)
+	{
+		pFile = &pTape->pFiles[i];
+		fprintf(fd, "%4u  %4s  %-16s  $%04X  $%04X  %6d  %5d  %s\n",
+			i+1, (pFile->ucType == TAP_DEC_Type_Prg) ? "PRG" : "RPRG", pFile->cName,
+			pFile->uiStart, pFile->uiEnd, pFile->iHeaderBlock+1, pFile->iDataBlock+1,
+			(pFile->pucData == NULL) ? "MISSING" : (pFile->bChecksumOK ? "OK" : "BAD"));
+	}
+}
+
+
+// Exported function.
+// Outputs info on error status to console.
+void TAP_DEC_OutputError(int Status)
+{
+	switch (Status)
+	{
+		case TAP_DEC_Status_Error_Invalid_pointer:
+			printf("Invalid pointer in tape decoding.\n");
+			break;
+		case TAP_DEC_Status_Error_Out_of_memory:
+			printf("Out of memory in tape decoding.\n");
+			break;
+		case TAP_DEC_Status_Error_No_pulse_peaks:
+			printf("No pulses of CBM standard loader found.\n");
+			break;
+		case TAP_DEC_Status_Error_Creating_file:
+			printf("Can't create PRG file.\n");
+			break;
+		case TAP_DEC_Status_Error_Writing_data:
+			printf("Writing PRG file failed.\n");
+			break;
+		default:
+			printf("Unknown error (%d)\n", Status);
+			break;
+	}
+}
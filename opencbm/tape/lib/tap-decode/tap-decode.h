@@ -0,0 +1,93 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#ifndef __TAP_DECODE_H_
+#define __TAP_DECODE_H_
+
+#include <Windows.h>
+#include <stdio.h>
+
+// Status results from exported functions
+#define TAP_DEC_Status_OK                     0
+#define TAP_DEC_Status_Error_Invalid_pointer -2
+#define TAP_DEC_Status_Error_Out_of_memory   -3
+#define TAP_DEC_Status_Error_No_pulse_peaks  -4
+#define TAP_DEC_Status_Error_Creating_file   -5
+#define TAP_DEC_Status_Error_Writing_data    -13
+
+// Pulse classes
+#define TAP_DEC_Pulse_Noise  0 // Too short for a short pulse.
+#define TAP_DEC_Pulse_Short  1
+#define TAP_DEC_Pulse_Medium 2
+#define TAP_DEC_Pulse_Long   3
+#define TAP_DEC_Pulse_Pause  4 // Too long for a long pulse.
+
+// File types in CBM header blocks
+#define TAP_DEC_Type_Prg_Relocatable 1
+#define TAP_DEC_Type_Seq_Data        2
+#define TAP_DEC_Type_Prg             3
+#define TAP_DEC_Type_Seq_Header      4
+#define TAP_DEC_Type_End_Of_Tape     5
+
+// Size of a CBM header block
+#define TAP_DEC_Header_Size 192
+
+// A block as read from tape (one copy).
+typedef struct _TAP_DEC_BLOCK {
+	unsigned __int32 uiPulseStart, uiPulseEnd; // Position in pulse stream (leader start, block end).
+	unsigned __int32 uiLeaderPulses;           // Number of leader pulses.
+	BOOL             bRepeated;                // Second copy (countdown $09..$01 instead of $89..$81).
+	unsigned __int8  *pucData;                 // Block data without countdown and checksum.
+	unsigned __int8  *pucParityError;          // Parity error flag for each data byte.
+	unsigned __int32 uiLen;
+	BOOL             bChecksumOK;
+	unsigned __int32 uiParityErrors;           // Bytes with parity errors.
+	unsigned __int32 uiPulseErrors;            // Pulses which did not fit into the byte structure.
+	unsigned __int32 uiBadPulses;              // Pulses far off their class length.
+	unsigned __int32 uiPulses;                 // Pulses of the block (without leader).
+	BOOL             bEndMarker;               // Block ended with end-of-data marker.
+} TAP_DEC_BLOCK;
+
+// A file assembled from a header and a data block (both copies merged).
+typedef struct _TAP_DEC_FILE {
+	unsigned __int8  ucType;
+	char             cName[17];                // File name, 0-terminated (PETSCII).
+	unsigned __int32 uiStart, uiEnd;           // Load & end address.
+	unsigned __int8  *pucData;                 // Merged data, NULL if data block missing.
+	unsigned __int32 uiLen;
+	BOOL             bChecksumOK;              // Checksum of merged data OK.
+	__int32          iHeaderBlock, iDataBlock; // Index of first used block copy (-1: missing).
+} TAP_DEC_FILE;
+
+// Decoded tape.
+typedef struct _TAP_DEC_TAPE {
+	unsigned __int32 uiPeak[3];                // Pulse lengths (cycles) of short/medium/long pulses.
+	unsigned __int32 uiThreshold[4];           // Noise/S, S/M, M/L, L/pause thresholds (cycles).
+	TAP_DEC_BLOCK    *pBlocks;
+	unsigned __int32 uiNumBlocks;
+	TAP_DEC_FILE     *pFiles;
+	unsigned __int32 uiNumFiles;
+	unsigned __int32 uiUnknownBlocks;          // Leaders followed by non-standard data.
+} TAP_DEC_TAPE;
+
+// Classify pulses (cycles) into TAP_DEC_Pulse_* using the given 4 thresholds.
+void TAP_DEC_ClassifyPulses(const unsigned __int32 *puiPulses, unsigned __int8 *pucClasses, unsigned __int32 uiNumPulses, const unsigned __int32 *puiThreshold);
+
+// Decode CBM standard loader blocks from full wave pulse lengths (cycles), assemble files.
+int TAP_DEC_Decode(const unsigned __int32 *puiPulses, unsigned __int32 uiNumPulses, TAP_DEC_TAPE *pTape);
+
+// Free all memory of a decoded tape.
+void TAP_DEC_Free(TAP_DEC_TAPE *pTape);
+
+// Write all program files to the given directory (NULL: current directory).
+int TAP_DEC_WritePRGs(TAP_DEC_TAPE *pTape, char *pcDirectory, unsigned __int32 *puiNumWritten);
+
+// Output quality report of all blocks and files.
+void TAP_DEC_OutputReport(TAP_DEC_TAPE *pTape, FILE *fd);
+
+// Outputs info on error status to console.
+void TAP_DEC_OutputError(int Status);
+
+#endif
@@ -0,0 +1,881 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tap-stats.h"
+
+// The image is never loaded: all passes read the pulses directly from the
+// mapped file. The first pass builds the lowest level of the summary pyramid
+// (min/max/time of every TAP_STAT_NODE_PULSES pulses) and the histogram, the
+// second pass finds dropouts and measures the speed. Both passes split the
+// image into ranges of nodes which are processed in parallel. Queries on the
+// pyramid (summaries for zooming, time <-> pulse lookup) only read a few
+// nodes per level and at most two partial nodes from the image.
+
+// Machine frequencies (cycles per second), for TAP images.
+#define FREQ_C64_PAL    985248
+#define FREQ_C64_NTSC  1022727
+#define FREQ_VIC_PAL   1108405
+#define FREQ_VIC_NTSC  1022727
+#define FREQ_C16_PAL    886724
+#define FREQ_C16_NTSC   894886
+
+// CAP image layout.
+#define CAP_HEADER_SIZE    0xA0
+#define CAP_SIGNAL_SIZE    5
+
+// TAP image layout.
+#define TAP_HEADER_SIZE    0x14
+
+// Pulses within +-1/PEAK_TOLERANCE of the histogram peak are used for speed measurement.
+#define PEAK_TOLERANCE 4
+
+// Longer pulses are pauses, not dropouts (ns).
+#define MAX_GAP_LENGTH 5000000
+
+typedef struct _CURSOR {
+	const TAP_STAT_IMAGE *pImage;
+	size_t               Pos;
+} CURSOR;
+
+// Work of one thread.
+typedef struct _JOB {
+	TAP_STAT_IMAGE   *pImage;
+	unsigned int     uiFirstNode, uiEndNode;
+	unsigned int     *puiHistogram;  // Pass 1: histogram of this job.
+	unsigned int     *puiMainCount;  // Pass 2: per node, pulses around the peak (shared, indexed by node).
+	TAP_STAT_UINT64  *pui64MainTime; // Pass 2: per node, their total length (shared, indexed by node).
+	TAP_STAT_DROPOUT *pDropouts;     // Pass 2: dropouts of this job.
+	unsigned int     uiNumDropouts, uiDropoutSize;
+	int              iStatus;
+} JOB;
+
+
+// Internal function.
+// Read a 40bit CAP timestamp (hi/lo order).
+TAP_STAT_UINT64 TAP_STAT_ReadCAPSignal(const unsigned char *p)
+{
+	return ((TAP_STAT_UINT64) p[0] << 32) | ((TAP_STAT_UINT64) p[1] << 24) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 8) | p[4];
+}
+
+
+// Internal function.
+// Read one TAP signal (cycles) and advance the position.
+//   Return values:
+//    1: signal read
+//    0: end of data
+int TAP_STAT_ReadTAPSignal(const TAP_STAT_IMAGE *pImage, size_t *pPos, TAP_STAT_UINT64 *pui64Cycles)
+{
+	const unsigned char *p = pImage->pucImage + *pPos;
+
+	if (*pPos >= pImage->DataEnd)
+		return 0;
+
+	if (p[0] != 0)
+	{
+		*pui64Cycles = (unsigned int) p[0] << 3;
+		(*pPos)++;
+	}
+	else if (pImage->ucTAPversion == 0)
+	{
+		// Overflow, length unknown.
+		*pui64Cycles = 256 << 3;
+		(*pPos)++;
+	}
+	else
+	{
+		if (*pPos + 4 > pImage->DataEnd)
+			return 0;
+		*pui64Cycles = p[1] | ((unsigned int) p[2] << 8) | ((unsigned int) p[3] << 16);
+		*pPos += 4;
+	}
+
+	return 1;
+}
+
+
+// Internal function.
+// Convert a length in image units to ns, limited to 32 bits.
+unsigned int TAP_STAT_ToNs(const TAP_STAT_IMAGE *pImage, TAP_STAT_UINT64 ui64Len)
+{
+	if (pImage->iFormat == TAP_STAT_Format_CAP)
+		ui64Len = ui64Len*1000/pImage->uiPrecision;
+	else
+		ui64Len = ui64Len*1000000000/pImage->uiFreq;
+
+	return (ui64Len > 0xffffffff) ? 0xffffffff : (unsigned int) ui64Len;
+}
+
+
+// Internal function.
+// Read the next full wave pulse (ns). Only called for existing pulses.
+unsigned int TAP_STAT_NextPulse(CURSOR *pCursor)
+{
+	const TAP_STAT_IMAGE *pImage = pCursor->pImage;
+	TAP_STAT_UINT64      ui64Len, ui64Len2;
+
+	if (pImage->iFormat == TAP_STAT_Format_CAP)
+	{
+		ui64Len = TAP_STAT_ReadCAPSignal(pImage->pucImage + pCursor->Pos) + TAP_STAT_ReadCAPSignal(pImage->pucImage + pCursor->Pos + CAP_SIGNAL_SIZE);
+		pCursor->Pos += 2*CAP_SIGNAL_SIZE;
+	}
+	else
+	{
+		TAP_STAT_ReadTAPSignal(pImage, &pCursor->Pos, &ui64Len);
+		if (pImage->ucTAPversion == 2)
+		{
+			// TAPv2 stores halfwaves.
+			TAP_STAT_ReadTAPSignal(pImage, &pCursor->Pos, &ui64Len2);
+			ui64Len += ui64Len2;
+		}
+	}
+
+	return TAP_STAT_ToNs(pImage, ui64Len);
+}
+
+
+// Internal function.
+// Position a cursor on a pulse.
+void TAP_STAT_Seek(const TAP_STAT_IMAGE *pImage, CURSOR *pCursor, unsigned int uiPulse)
+{
+	unsigned int i;
+
+	pCursor->pImage = pImage;
+
+	if (pImage->iFormat == TAP_STAT_Format_CAP)
+	{
+		// Skip first halfwave (time until first pulse starts).
+		pCursor->Pos = pImage->DataOfs + (1 + 2*(size_t) uiPulse)*CAP_SIGNAL_SIZE;
+		return;
+	}
+
+	pCursor->Pos = pImage->pNodeOfs[uiPulse/TAP_STAT_NODE_PULSES];
+	for (i = 0; i < uiPulse % TAP_STAT_NODE_PULSES; i++)
+		TAP_STAT_NextPulse(pCursor);
+}
+
+
+// Internal function.
+// Add a pulse or a summary to a summary.
+void TAP_STAT_AddPulse(TAP_STAT_SUMMARY *pSummary, unsigned int uiPulse)
+{
+	if (uiPulse < pSummary->uiMin) pSummary->uiMin = uiPulse;
+	if (uiPulse > pSummary->uiMax) pSummary->uiMax = uiPulse;
+	pSummary->ui64Time += uiPulse;
+	pSummary->uiCount++;
+}
+
+void TAP_STAT_AddSummary(TAP_STAT_SUMMARY *pSummary, const TAP_STAT_SUMMARY *pAdd)
+{
+	if (pAdd->uiCount == 0)
+		return;
+	if (pAdd->uiMin < pSummary->uiMin) pSummary->uiMin = pAdd->uiMin;
+	if (pAdd->uiMax > pSummary->uiMax) pSummary->uiMax = pAdd->uiMax;
+	pSummary->ui64Time += pAdd->ui64Time;
+	pSummary->uiCount += pAdd->uiCount;
+}
+
+void TAP_STAT_ClearSummary(TAP_STAT_SUMMARY *pSummary)
+{
+	pSummary->uiMin = 0xffffffff;
+	pSummary->uiMax = 0;
+	pSummary->ui64Time = 0;
+	pSummary->uiCount = 0;
+}
+
+
+// Internal function.
+// Check CAP header and locate the signal data.
+int TAP_STAT_OpenCAP(TAP_STAT_IMAGE *pImage)
+{
+	const char   *pcHeader = (const char *) pImage->pucImage;
+	unsigned int uiNumSignals;
+
+	if (strncmp(pcHeader + 0x20, "1us", 16) == 0)
+		pImage->uiPrecision = 1;
+	else if (strncmp(pcHeader + 0x20, "62.5ns", 16) == 0)
+		pImage->uiPrecision = 16;
+	else
+		return TAP_STAT_Status_Error_Unsupported_format;
+
+	// Only relative 40bit timestamps, as written by tapread.
+	if ((strncmp(pcHeader + 0x60, "Relative", 16) != 0) || (strncmp(pcHeader + 0x70, "40bit", 16) != 0))
+		return TAP_STAT_Status_Error_Unsupported_format;
+
+	pImage->DataOfs = ((size_t) pImage->pucImage[0x80] << 24) | (pImage->pucImage[0x81] << 16) | (pImage->pucImage[0x82] << 8) | pImage->pucImage[0x83];
+	if ((pImage->DataOfs < CAP_HEADER_SIZE) || (pImage->DataOfs > pImage->Size))
+		return TAP_STAT_Status_Error_Unsupported_format;
+
+	uiNumSignals = (unsigned int) ((pImage->Size - pImage->DataOfs)/CAP_SIGNAL_SIZE);
+	pImage->DataEnd = pImage->DataOfs + (size_t) uiNumSignals*CAP_SIGNAL_SIZE;
+
+	// Skip first halfwave, pair the others.
+	pImage->uiNumPulses = (uiNumSignals > 0) ? (uiNumSignals - 1)/2 : 0;
+
+	return TAP_STAT_Status_OK;
+}
+
+
+// Internal function.
+// Check TAP header, count the pulses and index the start of every node.
+int TAP_STAT_OpenTAP(TAP_STAT_IMAGE *pImage)
+{
+	const unsigned char *p = pImage->pucImage;
+	unsigned int        uiDataSize, uiNumNodes = 0, uiNodeSize = 0, uiSignals = 0;
+	unsigned int        uiSignalsPerPulse;
+	TAP_STAT_UINT64     ui64Cycles;
+	size_t              Pos, *pNodeOfs;
+
+	pImage->ucTAPversion = p[0x0c];
+	if (pImage->ucTAPversion > 2)
+		return TAP_STAT_Status_Error_Unsupported_format;
+
+	if      ((p[0x0d] == 0) && (p[0x0e] == 0)) pImage->uiFreq = FREQ_C64_PAL;
+	else if ((p[0x0d] == 0) && (p[0x0e] == 1)) pImage->uiFreq = FREQ_C64_NTSC;
+	else if ((p[0x0d] == 1) && (p[0x0e] == 0)) pImage->uiFreq = FREQ_VIC_PAL;
+	else if ((p[0x0d] == 1) && (p[0x0e] == 1)) pImage->uiFreq = FREQ_VIC_NTSC;
+	else if ((p[0x0d] == 2) && (p[0x0e] == 0)) pImage->uiFreq = FREQ_C16_PAL;
+	else if ((p[0x0d] == 2) && (p[0x0e] == 1)) pImage->uiFreq = FREQ_C16_NTSC;
+	else
+		return TAP_STAT_Status_Error_Unsupported_format;
+
+	// Data size from header (little endian), limited to the file size.
+	uiDataSize = p[0x10] | (p[0x11] << 8) | (p[0x12] << 16) | ((unsigned int) p[0x13] << 24);
+	pImage->DataOfs = TAP_HEADER_SIZE;
+	pImage->DataEnd = pImage->Size;
+	if (uiDataSize < pImage->Size - TAP_HEADER_SIZE)
+		pImage->DataEnd = TAP_HEADER_SIZE + uiDataSize;
+
+	// Sequential pass: the pulses have variable length in the image.
+	uiSignalsPerPulse = (pImage->ucTAPversion == 2) ? 2 : 1;
+	Pos = pImage->DataOfs;
+	while (1)
+	{
+		if (uiSignals % (uiSignalsPerPulse*TAP_STAT_NODE_PULSES) == 0)
+		{
+			if (uiNumNodes == uiNodeSize)
+			{
+				uiNodeSize = (uiNodeSize == 0) ? 4096 : 2*uiNodeSize;
+				pNodeOfs = (size_t *) realloc(pImage->pNodeOfs, uiNodeSize*sizeof(size_t));
+				if (pNodeOfs == NULL)
+					return TAP_STAT_Status_Error_Out_of_memory;
+				pImage->pNodeOfs = pNodeOfs;
+			}
+			pImage->pNodeOfs[uiNumNodes++] = Pos;
+		}
+
+		if (!TAP_STAT_ReadTAPSignal(pImage, &Pos, &ui64Cycles))
+			break;
+		uiSignals++;
+	}
+
+	pImage->uiNumPulses = uiSignals/uiSignalsPerPulse;
+
+	return TAP_STAT_Status_OK;
+}
+
+
+// Exported function.
+// Map a CAP or TAP image and index its pulses.
+int TAP_STAT_Open(TAP_STAT_IMAGE *pImage, const char *pcFilename)
+{
+	int RetVal;
+
+	if ((pImage == NULL) || (pcFilename == NULL))
+		return TAP_STAT_Status_Error_Invalid_pointer;
+
+	memset(pImage, 0, sizeof(TAP_STAT_IMAGE));
+
+	pImage->pucImage = (const unsigned char *) arch_map_file(pcFilename, &pImage->Size);
+	if (pImage->pucImage == NULL)
+		return TAP_STAT_Status_Error_Opening_file;
+
+	// Detect image format by signature.
+	if ((pImage->Size >= CAP_HEADER_SIZE) && (strncmp((const char *) pImage->pucImage, "TAPEIMAGE", 16) == 0))
+	{
+		pImage->iFormat = TAP_STAT_Format_CAP;
+		RetVal = TAP_STAT_OpenCAP(pImage);
+	}
+	else if ((pImage->Size >= TAP_HEADER_SIZE) && ((memcmp(pImage->pucImage, "C64-TAPE-RAW", 12) == 0) || (memcmp(pImage->pucImage, "C16-TAPE-RAW", 12) == 0)))
+	{
+		pImage->iFormat = TAP_STAT_Format_TAP;
+		RetVal = TAP_STAT_OpenTAP(pImage);
+	}
+	else
+		RetVal = TAP_STAT_Status_Error_Unknown_format;
+
+	if ((RetVal == TAP_STAT_Status_OK) && (pImage->uiNumPulses == 0))
+		RetVal = TAP_STAT_Status_Error_No_pulses;
+
+	if (RetVal != TAP_STAT_Status_OK)
+		TAP_STAT_Close(pImage);
+
+	return RetVal;
+}
+
+
+// Exported function.
+// Release all memory and the mapping of an image.
+void TAP_STAT_Close(TAP_STAT_IMAGE *pImage)
+{
+	unsigned int i;
+
+	if (pImage->pucImage != NULL) arch_unmap_file(pImage->pucImage, pImage->Size);
+	if (pImage->pNodeOfs != NULL) free(pImage->pNodeOfs);
+	for (i = 0; i < pImage->uiNumLevels; i++)
+		if (pImage->pLevel[i] != NULL) free(pImage->pLevel[i]);
+	if (pImage->puiHistogram != NULL) free(pImage->puiHistogram);
+	if (pImage->pDropouts != NULL) free(pImage->pDropouts);
+	if (pImage->pWindows != NULL) free(pImage->pWindows);
+
+	memset(pImage, 0, sizeof(TAP_STAT_IMAGE));
+}
+
+
+// Internal function.
+// Pass 1: Summarize the nodes of a job and build its histogram.
+void TAP_STAT_SummaryJob(void *pContext)
+{
+	JOB              *pJob = (JOB *) pContext;
+	TAP_STAT_IMAGE   *pImage = pJob->pImage;
+	TAP_STAT_SUMMARY *pNode;
+	CURSOR           Cursor;
+	unsigned int     uiNode, uiPulse, uiEnd, uiLen, uiBin;
+
+	TAP_STAT_Seek(pImage, &Cursor, pJob->uiFirstNode*TAP_STAT_NODE_PULSES);
+
+	for (uiNode = pJob->uiFirstNode; uiNode < pJob->uiEndNode; uiNode++)
+	{
+		pNode = &pImage->pLevel[0][uiNode];
+		TAP_STAT_ClearSummary(pNode);
+
+		uiEnd = (uiNode + 1)*TAP_STAT_NODE_PULSES;
+		if (uiEnd > pImage->uiNumPulses)
+			uiEnd = pImage->uiNumPulses;
+
+		for (uiPulse = uiNode*TAP_STAT_NODE_PULSES; uiPulse < uiEnd; uiPulse++)
+		{
+			uiLen = TAP_STAT_NextPulse(&Cursor);
+			TAP_STAT_AddPulse(pNode, uiLen);
+
+			uiBin = uiLen/pImage->uiBinWidth;
+			pJob->puiHistogram[(uiBin < pImage->uiNumBins) ? uiBin : pImage->uiNumBins]++;
+		}
+	}
+}
+
+
+// Internal function.
+// Pulse length fits into the CBM loader pulse range (short to long).
+int TAP_STAT_IsDataPulse(const TAP_STAT_IMAGE *pImage, unsigned int uiLen)
+{
+	return (uiLen >= pImage->uiPeak/2) && (uiLen <= pImage->uiPeak*5/2);
+}
+
+
+// Internal function.
+// Pass 2: Find the dropouts and measure the pulses around the peak in the nodes of a job.
+void TAP_STAT_DropoutJob(void *pContext)
+{
+	JOB              *pJob = (JOB *) pContext;
+	TAP_STAT_IMAGE   *pImage = pJob->pImage;
+	TAP_STAT_DROPOUT *pDropouts;
+	CURSOR           Cursor;
+	TAP_STAT_UINT64  ui64Time;
+	unsigned int     uiFirst, uiEnd, uiPulse, uiPrev = 0, uiCur, uiNext, uiNode;
+	unsigned int     uiPeakMin = pImage->uiPeak - pImage->uiPeak/PEAK_TOLERANCE,
+	                 uiPeakMax = pImage->uiPeak + pImage->uiPeak/PEAK_TOLERANCE;
+	int              iType;
+
+	uiFirst = pJob->uiFirstNode*TAP_STAT_NODE_PULSES;
+	uiEnd = pJob->uiEndNode*TAP_STAT_NODE_PULSES;
+	if (uiEnd > pImage->uiNumPulses)
+		uiEnd = pImage->uiNumPulses;
+
+	ui64Time = TAP_STAT_GetTime(pImage, uiFirst);
+	if (uiFirst > 0)
+		TAP_STAT_GetPulses(pImage, uiFirst - 1, 1, &uiPrev);
+
+	TAP_STAT_Seek(pImage, &Cursor, uiFirst);
+	uiCur = TAP_STAT_NextPulse(&Cursor);
+
+	for (uiPulse = uiFirst; uiPulse < uiEnd; uiPulse++)
+	{
+		// Look one pulse ahead, also beyond the end of the job.
+		uiNext = (uiPulse + 1 < pImage->uiNumPulses) ? TAP_STAT_NextPulse(&Cursor) : 0;
+
+		if ((uiCur >= uiPeakMin) && (uiCur <= uiPeakMax))
+		{
+			uiNode = uiPulse/TAP_STAT_NODE_PULSES;
+			pJob->puiMainCount[uiNode]++;
+			pJob->pui64MainTime[uiNode] += uiCur;
+		}
+
+		iType = 0;
+		if ((uiCur > 3*pImage->uiPeak) && (uiCur < MAX_GAP_LENGTH) && TAP_STAT_IsDataPulse(pImage, uiPrev) && TAP_STAT_IsDataPulse(pImage, uiNext))
+			iType = TAP_STAT_Dropout_Gap;
+		else if ((uiCur < pImage->uiPeak/2) && (TAP_STAT_IsDataPulse(pImage, uiPrev) || TAP_STAT_IsDataPulse(pImage, uiNext)))
+			iType = TAP_STAT_Dropout_Glitch;
+
+		if ((iType != 0) && (pJob->iStatus == TAP_STAT_Status_OK))
+		{
+			if (pJob->uiNumDropouts == pJob->uiDropoutSize)
+			{
+				pJob->uiDropoutSize = (pJob->uiDropoutSize == 0) ? 256 : 2*pJob->uiDropoutSize;
+				pDropouts = (TAP_STAT_DROPOUT *) realloc(pJob->pDropouts, pJob->uiDropoutSize*sizeof(TAP_STAT_DROPOUT));
+				if (pDropouts == NULL)
+					pJob->iStatus = TAP_STAT_Status_Error_Out_of_memory;
+				else
+					pJob->pDropouts = pDropouts;
+			}
+			if (pJob->iStatus == TAP_STAT_Status_OK)
+			{
+				pJob->pDropouts[pJob->uiNumDropouts].uiPulse = uiPulse;
+				pJob->pDropouts[pJob->uiNumDropouts].ui64Time = ui64Time;
+				pJob->pDropouts[pJob->uiNumDropouts].uiLength = uiCur;
+				pJob->pDropouts[pJob->uiNumDropouts].iType = iType;
+				pJob->uiNumDropouts++;
+			}
+		}
+
+		ui64Time += uiCur;
+		uiPrev = uiCur;
+		uiCur = uiNext;
+	}
+}
+
+
+// Internal function.
+// Split the nodes into one job per thread and run the jobs in parallel.
+// A job runs in the calling thread if no thread can be started.
+void TAP_STAT_RunJobs(JOB *pJobs, unsigned int uiNumJobs, ARCH_THREAD_FUNCTION Function)
+{
+	ARCH_THREAD  *pThreads;
+	int          *pStarted;
+	unsigned int i;
+
+	pThreads = (ARCH_THREAD *) calloc(uiNumJobs, sizeof(ARCH_THREAD));
+	pStarted = (int *) calloc(uiNumJobs, sizeof(int));
+
+	for (i = 1; i < uiNumJobs; i++)
+		if ((pThreads != NULL) && (pStarted != NULL))
+			pStarted[i] = (arch_thread_start(&pThreads[i], Function, &pJobs[i]) == 0);
+
+	Function(&pJobs[0]);
+
+	for (i = 1; i < uiNumJobs; i++)
+	{
+		if ((pStarted != NULL) && pStarted[i])
+			arch_thread_join(pThreads[i]);
+		else
+			Function(&pJobs[i]);
+	}
+
+	if (pThreads != NULL) free(pThreads);
+	if (pStarted != NULL) free(pStarted);
+}
+
+
+// Internal function.
+// Find the histogram peak and refine it with the centroid of the neighbouring bins.
+void TAP_STAT_FindPeak(TAP_STAT_IMAGE *pImage)
+{
+	TAP_STAT_UINT64 ui64Sum = 0, ui64Weight = 0;
+	unsigned int    i, uiMax = 0, uiFrom, uiTo;
+
+	for (i = 1; i < pImage->uiNumBins; i++)
+		if (pImage->puiHistogram[i] > pImage->puiHistogram[uiMax])
+			uiMax = i;
+
+	uiFrom = (uiMax >= 2) ? uiMax - 2 : 0;
+	uiTo = (uiMax + 2 < pImage->uiNumBins) ? uiMax + 2 : pImage->uiNumBins - 1;
+
+	for (i = uiFrom; i <= uiTo; i++)
+	{
+		ui64Sum += pImage->puiHistogram[i];
+		ui64Weight += (TAP_STAT_UINT64) pImage->puiHistogram[i]*(2*i + 1);
+	}
+
+	pImage->uiPeak = (ui64Sum == 0) ? 0 : (unsigned int) (ui64Weight*pImage->uiBinWidth/(2*ui64Sum));
+}
+
+
+// Internal function.
+// Build the upper pyramid levels from level 0.
+int TAP_STAT_BuildPyramid(TAP_STAT_IMAGE *pImage)
+{
+	unsigned int L, i, uiSize;
+
+	while ((pImage->uiLevelSize[pImage->uiNumLevels - 1] > 1) && (pImage->uiNumLevels < TAP_STAT_MAX_LEVELS))
+	{
+		L = pImage->uiNumLevels;
+		uiSize = (pImage->uiLevelSize[L - 1] + TAP_STAT_LEVEL_FACTOR - 1)/TAP_STAT_LEVEL_FACTOR;
+
+		pImage->pLevel[L] = (TAP_STAT_SUMMARY *) malloc(uiSize*sizeof(TAP_STAT_SUMMARY));
+		if (pImage->pLevel[L] == NULL)
+			return TAP_STAT_Status_Error_Out_of_memory;
+		pImage->uiLevelSize[L] = uiSize;
+		pImage->uiNumLevels++;
+
+		for (i = 0; i < uiSize; i++)
+			TAP_STAT_ClearSummary(&pImage->pLevel[L][i]);
+		for (i = 0; i < pImage->uiLevelSize[L - 1]; i++)
+			TAP_STAT_AddSummary(&pImage->pLevel[L][i/TAP_STAT_LEVEL_FACTOR], &pImage->pLevel[L - 1][i]);
+	}
+
+	return TAP_STAT_Status_OK;
+}
+
+
+// Internal function.
+// Compute the speed drift windows from the per node measurements.
+int TAP_STAT_BuildWindows(TAP_STAT_IMAGE *pImage, const unsigned int *puiMainCount, const TAP_STAT_UINT64 *pui64MainTime)
+{
+	TAP_STAT_UINT64 ui64WindowNs = (TAP_STAT_UINT64) pImage->uiWindowMs*1000000, ui64NodeStart = 0;
+	TAP_STAT_UINT64 ui64MainTime = 0, *pui64WindowTime;
+	unsigned int    i, uiWindow, uiMainCount = 0;
+	TAP_STAT_SUMMARY Total;
+
+	TAP_STAT_GetSummary(pImage, 0, pImage->uiNumPulses, &Total);
+
+	pImage->uiNumWindows = (unsigned int) ((Total.ui64Time + ui64WindowNs - 1)/ui64WindowNs);
+	pImage->pWindows = (TAP_STAT_WINDOW *) calloc(pImage->uiNumWindows, sizeof(TAP_STAT_WINDOW));
+	pui64WindowTime = (TAP_STAT_UINT64 *) calloc(pImage->uiNumWindows, sizeof(TAP_STAT_UINT64));
+	if ((pImage->pWindows == NULL) || (pui64WindowTime == NULL))
+	{
+		if (pui64WindowTime != NULL) free(pui64WindowTime);
+		return TAP_STAT_Status_Error_Out_of_memory;
+	}
+
+	// Nodes are assigned to the window they start in.
+	for (i = 0; i < pImage->uiLevelSize[0]; i++)
+	{
+		uiWindow = (unsigned int) (ui64NodeStart/ui64WindowNs);
+		pImage->pWindows[uiWindow].uiPulses += puiMainCount[i];
+		pui64WindowTime[uiWindow] += pui64MainTime[i];
+		uiMainCount += puiMainCount[i];
+		ui64MainTime += pui64MainTime[i];
+		ui64NodeStart += pImage->pLevel[0][i].ui64Time;
+	}
+
+	pImage->uiPeakMean = (uiMainCount == 0) ? 0 : (unsigned int) (ui64MainTime/uiMainCount);
+
+	// Speed is inverse to the pulse length.
+	for (i = 0; i < pImage->uiNumWindows; i++)
+		if (pImage->pWindows[i].uiPulses >= TAP_STAT_MIN_WINDOW_PULSES)
+			pImage->pWindows[i].iDrift = (int) ((TAP_STAT_UINT64) pImage->uiPeakMean*pImage->pWindows[i].uiPulses*10000/pui64WindowTime[i]) - 10000;
+
+	free(pui64WindowTime);
+
+	return TAP_STAT_Status_OK;
+}
+
+
+// Exported function.
+// Build the summary pyramid, the histogram, the dropout list and the speed drift windows.
+// uiNumThreads == 0: one thread per processor.
+int TAP_STAT_Analyze(TAP_STAT_IMAGE *pImage, unsigned int uiBinWidth, unsigned int uiNumBins, unsigned int uiWindowMs, unsigned int uiNumThreads)
+{
+	JOB             *pJobs = NULL;
+	unsigned int    *puiMainCount = NULL;
+	TAP_STAT_UINT64 *pui64MainTime = NULL;
+	unsigned int    i, j, uiNumNodes, uiNumDropouts = 0;
+	int             RetVal = TAP_STAT_Status_Error_Out_of_memory;
+
+	if ((pImage == NULL) || (pImage->pucImage == NULL) || (uiBinWidth == 0) || (uiNumBins == 0) || (uiWindowMs == 0))
+		return TAP_STAT_Status_Error_Invalid_pointer;
+
+	pImage->uiBinWidth = uiBinWidth;
+	pImage->uiNumBins = uiNumBins;
+	pImage->uiWindowMs = uiWindowMs;
+
+	uiNumNodes = (pImage->uiNumPulses + TAP_STAT_NODE_PULSES - 1)/TAP_STAT_NODE_PULSES;
+
+	if (uiNumThreads == 0)
+		uiNumThreads = arch_cpu_count();
+	if (uiNumThreads > uiNumNodes)
+		uiNumThreads = uiNumNodes;
+
+	pImage->uiNumLevels = 1;
+	pImage->uiLevelSize[0] = uiNumNodes;
+	pImage->pLevel[0] = (TAP_STAT_SUMMARY *) malloc(uiNumNodes*sizeof(TAP_STAT_SUMMARY));
+	pImage->puiHistogram = (unsigned int *) calloc(uiNumBins + 1, sizeof(unsigned int));
+	pJobs = (JOB *) calloc(uiNumThreads, sizeof(JOB));
+	if ((pImage->pLevel[0] == NULL) || (pImage->puiHistogram == NULL) || (pJobs == NULL))
+		goto exit;
+
+	for (i = 0; i < uiNumThreads; i++)
+	{
+		pJobs[i].pImage = pImage;
+		pJobs[i].uiFirstNode = (unsigned int) ((TAP_STAT_UINT64) uiNumNodes*i/uiNumThreads);
+		pJobs[i].uiEndNode = (unsigned int) ((TAP_STAT_UINT64) uiNumNodes*(i + 1)/uiNumThreads);
+		pJobs[i].puiHistogram = (unsigned int *) calloc(uiNumBins + 1, sizeof(unsigned int));
+		if (pJobs[i].puiHistogram == NULL)
+			goto exit;
+	}
+
+	// Pass 1: pyramid level 0 and histogram.
+	TAP_STAT_RunJobs(pJobs, uiNumThreads, TAP_STAT_SummaryJob);
+
+	for (i = 0; i < uiNumThreads; i++)
+		for (j = 0; j <= uiNumBins; j++)
+			pImage->puiHistogram[j] += pJobs[i].puiHistogram[j];
+
+	RetVal = TAP_STAT_BuildPyramid(pImage);
+	if (RetVal != TAP_STAT_Status_OK)
+		goto exit;
+
+	TAP_STAT_FindPeak(pImage);
+
+	// Pass 2: dropouts and speed measurement, needs the peak.
+	RetVal = TAP_STAT_Status_Error_Out_of_memory;
+	puiMainCount = (unsigned int *) calloc(uiNumNodes, sizeof(unsigned int));
+	pui64MainTime = (TAP_STAT_UINT64 *) calloc(uiNumNodes, sizeof(TAP_STAT_UINT64));
+	if ((puiMainCount == NULL) || (pui64MainTime == NULL))
+		goto exit;
+
+	if (pImage->uiPeak > 0)
+	{
+		for (i = 0; i < uiNumThreads; i++)
+		{
+			pJobs[i].puiMainCount = puiMainCount;
+			pJobs[i].pui64MainTime = pui64MainTime;
+		}
+
+		TAP_STAT_RunJobs(pJobs, uiNumThreads, TAP_STAT_DropoutJob);
+
+		for (i = 0; i < uiNumThreads; i++)
+		{
+			if (pJobs[i].iStatus != TAP_STAT_Status_OK)
+				goto exit;
+			uiNumDropouts += pJobs[i].uiNumDropouts;
+		}
+
+		// Jobs are in tape order.
+		if (uiNumDropouts > 0)
+		{
+			pImage->pDropouts = (TAP_STAT_DROPOUT *) malloc(uiNumDropouts*sizeof(TAP_STAT_DROPOUT));
+			if (pImage->pDropouts == NULL)
+				goto exit;
+			for (i = 0; i < uiNumThreads; i++)
+			{
+				memcpy(pImage->pDropouts + pImage->uiNumDropouts, pJobs[i].pDropouts, pJobs[i].uiNumDropouts*sizeof(TAP_STAT_DROPOUT));
+				pImage->uiNumDropouts += pJobs[i].uiNumDropouts;
+			}
+		}
+	}
+
+	RetVal = TAP_STAT_BuildWindows(pImage, puiMainCount, pui64MainTime);
+
+    exit:
+	if (pJobs != NULL)
+	{
+		for (i = 0; i < uiNumThreads; i++)
+		{
+			if (pJobs[i].puiHistogram != NULL) free(pJobs[i].puiHistogram);
+			if (pJobs[i].pDropouts != NULL) free(pJobs[i].pDropouts);
+		}
+		free(pJobs);
+	}
+	if (puiMainCount != NULL) free(puiMainCount);
+	if (pui64MainTime != NULL) free(pui64MainTime);
+
+	return RetVal;
+}
+
+
+// Exported function.
+// Read pulse lengths (ns) directly from the image. Returns the number of pulses read.
+unsigned int TAP_STAT_GetPulses(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, unsigned int *puiPulses)
+{
+	CURSOR       Cursor;
+	unsigned int i;
+
+	if (uiFirst >= pImage->uiNumPulses)
+		return 0;
+	if (uiCount > pImage->uiNumPulses - uiFirst)
+		uiCount = pImage->uiNumPulses - uiFirst;
+
+	TAP_STAT_Seek(pImage, &Cursor, uiFirst);
+	for (i = 0; i < uiCount; i++)
+		puiPulses[i] = TAP_STAT_NextPulse(&Cursor);
+
+	return uiCount;
+}
+
+
+// Internal function.
+// Add the nodes [uiFrom, uiTo) of a pyramid level, using the next level for the aligned middle part.
+void TAP_STAT_SumNodes(const TAP_STAT_IMAGE *pImage, unsigned int uiLevel, unsigned int uiFrom, unsigned int uiTo, TAP_STAT_SUMMARY *pSummary)
+{
+	unsigned int uiUpFrom, uiUpTo;
+
+	if (uiLevel + 1 < pImage->uiNumLevels)
+	{
+		uiUpFrom = (uiFrom + TAP_STAT_LEVEL_FACTOR - 1)/TAP_STAT_LEVEL_FACTOR;
+		uiUpTo = uiTo/TAP_STAT_LEVEL_FACTOR;
+
+		if (uiUpFrom < uiUpTo)
+		{
+			TAP_STAT_SumNodes(pImage, uiLevel, uiFrom, uiUpFrom*TAP_STAT_LEVEL_FACTOR, pSummary);
+			TAP_STAT_SumNodes(pImage, uiLevel + 1, uiUpFrom, uiUpTo, pSummary);
+			uiFrom = uiUpTo*TAP_STAT_LEVEL_FACTOR;
+		}
+	}
+
+	for (; uiFrom < uiTo; uiFrom++)
+		TAP_STAT_AddSummary(pSummary, &pImage->pLevel[uiLevel][uiFrom]);
+}
+
+
+// Exported function.
+// Summarize a range of pulses using the pyramid.
+void TAP_STAT_GetSummary(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, TAP_STAT_SUMMARY *pSummary)
+{
+	CURSOR       Cursor;
+	unsigned int uiEnd, uiNodeFrom, uiNodeTo;
+
+	TAP_STAT_ClearSummary(pSummary);
+
+	if (uiFirst >= pImage->uiNumPulses)
+		return;
+	if (uiCount > pImage->uiNumPulses - uiFirst)
+		uiCount = pImage->uiNumPulses - uiFirst;
+	uiEnd = uiFirst + uiCount;
+
+	// Whole nodes from the pyramid (the last node may be partial at the end of the tape).
+	uiNodeFrom = (uiFirst + TAP_STAT_NODE_PULSES - 1)/TAP_STAT_NODE_PULSES;
+	uiNodeTo = (uiEnd == pImage->uiNumPulses) ? pImage->uiLevelSize[0] : uiEnd/TAP_STAT_NODE_PULSES;
+
+	if (uiNodeFrom >= uiNodeTo)
+	{
+		// Range within a single node.
+		TAP_STAT_Seek(pImage, &Cursor, uiFirst);
+		for (; uiFirst < uiEnd; uiFirst++)
+			TAP_STAT_AddPulse(pSummary, TAP_STAT_NextPulse(&Cursor));
+		return;
+	}
+
+	// Pulses before the first whole node.
+	if (uiFirst < uiNodeFrom*TAP_STAT_NODE_PULSES)
+	{
+		TAP_STAT_Seek(pImage, &Cursor, uiFirst);
+		for (; uiFirst < uiNodeFrom*TAP_STAT_NODE_PULSES; uiFirst++)
+			TAP_STAT_AddPulse(pSummary, TAP_STAT_NextPulse(&Cursor));
+	}
+
+	TAP_STAT_SumNodes(pImage, 0, uiNodeFrom, uiNodeTo, pSummary);
+
+	// Pulses after the last whole node.
+	if (uiNodeTo*TAP_STAT_NODE_PULSES < uiEnd)
+	{
+		TAP_STAT_Seek(pImage, &Cursor, uiNodeTo*TAP_STAT_NODE_PULSES);
+		for (uiFirst = uiNodeTo*TAP_STAT_NODE_PULSES; uiFirst < uiEnd; uiFirst++)
+			TAP_STAT_AddPulse(pSummary, TAP_STAT_NextPulse(&Cursor));
+	}
+}
+
+
+// Exported function.
+// Summarize a range of pulses in uiNumBuckets buckets of equal pulse count (e.g., one per screen line).
+void TAP_STAT_GetSummaries(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, unsigned int uiNumBuckets, TAP_STAT_SUMMARY *pSummaries)
+{
+	unsigned int i, uiFrom, uiTo;
+
+	for (i = 0; i < uiNumBuckets; i++)
+	{
+		uiFrom = uiFirst + (unsigned int) ((TAP_STAT_UINT64) uiCount*i/uiNumBuckets);
+		uiTo = uiFirst + (unsigned int) ((TAP_STAT_UINT64) uiCount*(i + 1)/uiNumBuckets);
+		TAP_STAT_GetSummary(pImage, uiFrom, uiTo - uiFrom, &pSummaries[i]);
+	}
+}
+
+
+// Exported function.
+// Start time (ns) of a pulse.
+TAP_STAT_UINT64 TAP_STAT_GetTime(const TAP_STAT_IMAGE *pImage, unsigned int uiPulse)
+{
+	TAP_STAT_SUMMARY Summary;
+
+	TAP_STAT_GetSummary(pImage, 0, uiPulse, &Summary);
+
+	return Summary.ui64Time;
+}
+
+
+// Exported function.
+// Index of the pulse running at the given time (ns), uiNumPulses if beyond the end.
+unsigned int TAP_STAT_FindTime(const TAP_STAT_IMAGE *pImage, TAP_STAT_UINT64 ui64Time)
+{
+	CURSOR          Cursor;
+	TAP_STAT_UINT64 ui64Start = 0;
+	unsigned int    uiLevel, uiNode = 0, uiEnd, uiPulse;
+
+	// Descend the pyramid: find the node containing the time on every level.
+	for (uiLevel = pImage->uiNumLevels; uiLevel-- > 0; )
+	{
+		uiEnd = (uiLevel + 1 == pImage->uiNumLevels) ? pImage->uiLevelSize[uiLevel] : uiNode + TAP_STAT_LEVEL_FACTOR;
+		if (uiEnd > pImage->uiLevelSize[uiLevel])
+			uiEnd = pImage->uiLevelSize[uiLevel];
+
+		for (; uiNode < uiEnd; uiNode++)
+		{
+			if (ui64Start + pImage->pLevel[uiLevel][uiNode].ui64Time > ui64Time)
+				break;
+			ui64Start += pImage->pLevel[uiLevel][uiNode].ui64Time;
+		}
+
+		if (uiNode == uiEnd)
+			return pImage->uiNumPulses;
+
+		if (uiLevel > 0)
+			uiNode *= TAP_STAT_LEVEL_FACTOR;
+	}
+
+	// Find the pulse within the node.
+	uiPulse = uiNode*TAP_STAT_NODE_PULSES;
+	TAP_STAT_Seek(pImage, &Cursor, uiPulse);
+	for (; uiPulse < pImage->uiNumPulses; uiPulse++)
+	{
+		ui64Start += TAP_STAT_NextPulse(&Cursor);
+		if (ui64Start > ui64Time)
+			break;
+	}
+
+	return uiPulse;
+}
+
+
+// Exported function.
+// Outputs info on error status to console.
+void TAP_STAT_OutputError(int Status)
+{
+	switch (Status)
+	{
+		case TAP_STAT_Status_Error_Opening_file:
+			printf("Error: Could not open image file.\n");
+			break;
+		case TAP_STAT_Status_Error_Invalid_pointer:
+			printf("Error: Invalid parameter.\n");
+			break;
+		case TAP_STAT_Status_Error_Out_of_memory:
+			printf("Error: Out of memory.\n");
+			break;
+		case TAP_STAT_Status_Error_Unknown_format:
+			printf("Error: Neither CAP nor TAP image.\n");
+			break;
+		case TAP_STAT_Status_Error_Unsupported_format:
+			printf("Error: Unsupported image header.\n");
+			break;
+		case TAP_STAT_Status_Error_No_pulses:
+			printf("Error: Image contains no pulses.\n");
+			break;
+		default:
+			printf("Error: Unknown error (%d).\n", Status);
+	}
+}
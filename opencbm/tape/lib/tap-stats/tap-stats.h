@@ -0,0 +1,134 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#ifndef __TAP_STATS_H_
+#define __TAP_STATS_H_
+
+#include <stdio.h>
+
+#include <arch.h>
+
+// Unlike the other tape libraries, the statistics engine is portable:
+// it works on memory-mapped CAP/TAP images and uses the arch thread helpers.
+typedef ARCH_CBM_LINUX_WIN(unsigned long long, unsigned __int64) TAP_STAT_UINT64;
+#define TAP_STAT_PRIu64 ARCH_CBM_LINUX_WIN("llu", "I64u")
+
+// Status results from exported functions
+#define TAP_STAT_Status_OK                        0
+#define TAP_STAT_Status_Error_Opening_file       -1
+#define TAP_STAT_Status_Error_Invalid_pointer    -2
+#define TAP_STAT_Status_Error_Out_of_memory      -3
+#define TAP_STAT_Status_Error_Unknown_format     -4
+#define TAP_STAT_Status_Error_Unsupported_format -5
+#define TAP_STAT_Status_Error_No_pulses          -6
+
+// Image formats
+#define TAP_STAT_Format_CAP 1
+#define TAP_STAT_Format_TAP 2
+
+// Dropout types
+#define TAP_STAT_Dropout_Gap    1 // Long pulse between data pulses (signal lost).
+#define TAP_STAT_Dropout_Glitch 2 // Short pulse next to data pulses (noise, split pulse).
+
+// Pulses summarized by a node of the lowest pyramid level.
+#define TAP_STAT_NODE_PULSES 64
+
+// Nodes of a pyramid level summarized by a node of the next level.
+#define TAP_STAT_LEVEL_FACTOR 8
+
+// Maximum number of pyramid levels (64*8^10 pulses are more than enough).
+#define TAP_STAT_MAX_LEVELS 11
+
+// Min/max summary of a range of pulses. Pulse lengths are in nanoseconds.
+typedef struct _TAP_STAT_SUMMARY {
+	unsigned int    uiMin, uiMax;  // Shortest/longest pulse.
+	TAP_STAT_UINT64 ui64Time;      // Sum of the pulse lengths.
+	unsigned int    uiCount;       // Number of pulses.
+} TAP_STAT_SUMMARY;
+
+// A detected dropout.
+typedef struct _TAP_STAT_DROPOUT {
+	unsigned int    uiPulse;       // Index of the pulse.
+	TAP_STAT_UINT64 ui64Time;      // Start of the pulse (ns from start of tape).
+	unsigned int    uiLength;      // Length of the pulse (ns).
+	int             iType;         // TAP_STAT_Dropout_*
+} TAP_STAT_DROPOUT;
+
+// Windows with fewer pulses around the main peak have no speed value.
+#define TAP_STAT_MIN_WINDOW_PULSES 32
+
+// Speed of a time window, measured on the pulses around the main peak.
+typedef struct _TAP_STAT_WINDOW {
+	unsigned int    uiPulses;      // Pulses around the main peak in this window.
+	int             iDrift;        // Speed deviation from the tape average in 1/100 percent (+: faster).
+} TAP_STAT_WINDOW;
+
+// An analyzed image.
+typedef struct _TAP_STAT_IMAGE {
+	// Mapped image
+	const unsigned char *pucImage;
+	size_t              Size;
+	int                 iFormat;            // TAP_STAT_Format_*
+	size_t              DataOfs;            // Start of the signal data.
+	size_t              DataEnd;            // End of the signal data.
+	unsigned int        uiPrecision;        // CAP: timestamps per microsecond.
+	unsigned int        uiFreq;             // TAP: machine cycles per second.
+	unsigned char       ucTAPversion;       // TAP: 0, 1 or 2 (halfwaves).
+
+	// Pulses
+	unsigned int        uiNumPulses;        // Full wave pulses.
+	size_t              *pNodeOfs;          // TAP: image offset of the first pulse of every node.
+
+	// Summary pyramid, level 0 summarizes TAP_STAT_NODE_PULSES pulses per node.
+	unsigned int        uiNumLevels;
+	unsigned int        uiLevelSize[TAP_STAT_MAX_LEVELS];
+	TAP_STAT_SUMMARY    *pLevel[TAP_STAT_MAX_LEVELS];
+
+	// Pulse length histogram, the last bin counts all longer pulses.
+	unsigned int        uiBinWidth;         // ns
+	unsigned int        uiNumBins;
+	unsigned int        *puiHistogram;
+	unsigned int        uiPeak;             // Most frequent pulse length (ns).
+	unsigned int        uiPeakMean;         // Average length of the pulses around the peak (ns).
+
+	// Dropouts, in tape order.
+	TAP_STAT_DROPOUT    *pDropouts;
+	unsigned int        uiNumDropouts;
+
+	// Speed drift per time window.
+	unsigned int        uiWindowMs;
+	TAP_STAT_WINDOW     *pWindows;
+	unsigned int        uiNumWindows;
+} TAP_STAT_IMAGE;
+
+// Map a CAP or TAP image and index its pulses.
+int TAP_STAT_Open(TAP_STAT_IMAGE *pImage, const char *pcFilename);
+
+// Build the summary pyramid, the histogram, the dropout list and the speed drift windows.
+// uiNumThreads == 0: one thread per processor.
+int TAP_STAT_Analyze(TAP_STAT_IMAGE *pImage, unsigned int uiBinWidth, unsigned int uiNumBins, unsigned int uiWindowMs, unsigned int uiNumThreads);
+
+// Release all memory and the mapping of an image.
+void TAP_STAT_Close(TAP_STAT_IMAGE *pImage);
+
+// Read pulse lengths (ns) directly from the image. Returns the number of pulses read.
+unsigned int TAP_STAT_GetPulses(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, unsigned int *puiPulses);
+
+// Summarize a range of pulses using the pyramid.
+void TAP_STAT_GetSummary(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, TAP_STAT_SUMMARY *pSummary);
+
+// Summarize a range of pulses in uiNumBuckets buckets of equal pulse count (e.g., one per screen line).
+void TAP_STAT_GetSummaries(const TAP_STAT_IMAGE *pImage, unsigned int uiFirst, unsigned int uiCount, unsigned int uiNumBuckets, TAP_STAT_SUMMARY *pSummaries);
+
+// Start time (ns) of a pulse.
+TAP_STAT_UINT64 TAP_STAT_GetTime(const TAP_STAT_IMAGE *pImage, unsigned int uiPulse);
+
+// Index of the pulse running at the given time (ns), uiNumPulses if beyond the end.
+unsigned int TAP_STAT_FindTime(const TAP_STAT_IMAGE *pImage, TAP_STAT_UINT64 ui64Time);
+
+// Outputs info on error status to console.
+void TAP_STAT_OutputError(int Status);
+
+#endif
@@ -5,12 +5,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <Windows.h>
 
 #include <arch.h>
 #include "cap.h"
 #include "tap-cbm.h"
 #include "misc.h"
+#include "chunks.h"
 
 #define FREQ_C64_PAL    985248
 #define FREQ_C64_NTSC  1022727
@@ -22,12 +24,30 @@
 #define NeedSplit            2
 #define NoSplit              3
 
+// Number of TAP signals converted in one chunk.
+#define CHUNK_SIGNALS (64*1024)
+
 // Global variables
 unsigned __int8   CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat;
 unsigned __int32  CAP_Precision, CAP_SignalWidth, CAP_StartOfs;
 unsigned __int8   TAP_Machine, TAP_Video, TAPv;
 unsigned __int32  TAP_ByteCount;
 
+// Conversion job of a worker thread.
+typedef struct _TAP2CAP_JOB {
+	unsigned __int32 uiSignals[CHUNK_SIGNALS];     // TAP signals of the chunk.
+	unsigned __int32 uiNumSignals;
+	unsigned __int64 ui64Out[2*CHUNK_SIGNALS];     // CAP signals of the chunk (up to two halfwaves each).
+	__int32          iNumOut;
+} TAP2CAP_JOB;
+
+// Conversion parameters and files, shared by all jobs.
+typedef struct _TAP2CAP_CONTEXT {
+	HANDLE           hCAP, hTAP;
+	unsigned __int32 uiFreq;
+	unsigned __int32 TAP_Counter; // TAP file byte counter.
+} TAP2CAP_CONTEXT;
+
 
 __int32 HandleDeltaAndWriteToCAP(HANDLE hCAP, unsigned __int64 ui64Delta, unsigned __int8 uiSplit)
 {
@@ -142,14 +162,93 @@ __int32 Initialize_CAP_header_and_return_frequency(HANDLE hCAP, HANDLE hTAP, uns
 }
 
 
+// Read next chunk of TAP signals.
+__int32 TAP2CAP_ReadChunk(void *pContext, void *pJob)
+{
+	TAP2CAP_CONTEXT  *pCtx = (TAP2CAP_CONTEXT *) pContext;
+	TAP2CAP_JOB      *pChunk = (TAP2CAP_JOB *) pJob;
+	unsigned __int32 uiNumSignals;
+	__int32          FuncRes;
+
+	pChunk->uiNumSignals = 0;
+
+	while (pChunk->uiNumSignals < CHUNK_SIGNALS)
+	{
+		FuncRes = TAP_CBM_ReadSignals(pCtx->hTAP, pChunk->uiSignals + pChunk->uiNumSignals, CHUNK_SIGNALS - pChunk->uiNumSignals, &uiNumSignals, &pCtx->TAP_Counter);
+		if (FuncRes == TAP_CBM_Status_OK_End_of_file)
+			break;
+		else if (FuncRes != TAP_CBM_Status_OK)
+		{
+			TAP_CBM_OutputError(FuncRes);
+			return -1;
+		}
+		pChunk->uiNumSignals += uiNumSignals;
+	}
+
+	return (pChunk->uiNumSignals > 0) ? 1 : 0;
+}
+
+
+// Convert chunk of TAP signals to CAP signals (worker thread).
+__int32 TAP2CAP_ConvertChunk(void *pContext, void *pJob)
+{
+	TAP2CAP_CONTEXT  *pCtx = (TAP2CAP_CONTEXT *) pContext;
+	TAP2CAP_JOB      *pChunk = (TAP2CAP_JOB *) pJob;
+	unsigned __int64 ui64Delta, ui64SplitLen;
+	unsigned __int32 i;
+
+	pChunk->iNumOut = 0;
+
+	for (i = 0; i < pChunk->uiNumSignals; i++)
+	{
+		ui64Delta = pChunk->uiSignals[i];
+		ui64Delta = (ui64Delta*1000000*CAP_Precision+pCtx->uiFreq/2)/pCtx->uiFreq;
+
+		if ((TAPv == TAPv0) || (TAPv == TAPv1))
+		{
+			// Generate two halfwaves.
+			ui64SplitLen = ui64Delta/2;
+			pChunk->ui64Out[pChunk->iNumOut++] = ui64SplitLen;
+			pChunk->ui64Out[pChunk->iNumOut++] = ui64Delta-ui64SplitLen;
+		}
+		else
+		{
+			// Generate one halfwave.
+			pChunk->ui64Out[pChunk->iNumOut++] = ui64Delta;
+		}
+	}
+
+	return 0;
+}
+
+
+// Write CAP signals of a converted chunk.
+__int32 TAP2CAP_WriteChunk(void *pContext, void *pJob)
+{
+	TAP2CAP_CONTEXT *pCtx = (TAP2CAP_CONTEXT *) pContext;
+	TAP2CAP_JOB     *pChunk = (TAP2CAP_JOB *) pJob;
+	__int32         FuncRes;
+
+	Check_CAP_Error_TextRetM1(CAP_WriteSignals(pCtx->hCAP, pChunk->ui64Out, pChunk->iNumOut, NULL));
+
+	return 0;
+}
+
+
 // Convert CBM TAP to CAP format.
+// The signals are converted in chunks on one worker thread per processor.
 __int32 CBMTAP2CAP(HANDLE hCAP, HANDLE hTAP)
 {
+	TAP2CAP_CONTEXT  Context;
+	CHUNK_PIPELINE   Pipeline;
+	TAP2CAP_JOB      *pJobs[CHUNK_MAX_WORKERS];
 	unsigned __int64 ui64Delta;
-	unsigned __int32 uiDelta, uiFreq;
-	unsigned __int32 TAP_Counter = 0; // CAP & TAP file byte counters.
-	unsigned __int8  ch;
-	__int32          FuncRes;
+	unsigned __int32 uiNumJobs, i;
+	__int32          FuncRes, RetVal = -1;
+
+	memset(&Context, 0, sizeof(Context));
+	Context.hCAP = hCAP;
+	Context.hTAP = hTAP;
 
 	// Seek to & read image header, extract & verify header contents.
 	FuncRes = TAP_CBM_ReadHeader(hTAP);
@@ -167,7 +266,7 @@ __int32 CBMTAP2CAP(HANDLE hCAP, HANDLE hTAP)
 		return -1;
 	}
 
-	if (Initialize_CAP_header_and_return_frequency(hCAP, hTAP, &uiFreq) != 0)
+	if (Initialize_CAP_header_and_return_frequency(hCAP, hTAP, &Context.uiFreq) != 0)
 		return -1;
 
 	// Start conversion TAP->CAP.
@@ -177,31 +276,31 @@ __int32 CBMTAP2CAP(HANDLE hCAP, HANDLE hTAP)
 	if (HandleDeltaAndWriteToCAP(hCAP, ui64Delta, NoSplit) == -1)
 		return -1;
 
-	// Conversion loop.
-	while ((FuncRes = TAP_CBM_ReadSignal(hTAP, &uiDelta, &TAP_Counter)) == TAP_CBM_Status_OK)
+	// Allocate one job per worker thread.
+	uiNumJobs = Chunk_GetNumWorkers();
+	for (i = 0; i < uiNumJobs; i++)
 	{
-		ui64Delta = uiDelta;
-		ui64Delta = (ui64Delta*1000000*CAP_Precision+uiFreq/2)/uiFreq;
-
-		if ((TAPv == TAPv0) || (TAPv == TAPv1))
+		pJobs[i] = (TAP2CAP_JOB *) malloc(sizeof(TAP2CAP_JOB));
+		if (pJobs[i] == NULL)
 		{
-			// Generate two halfwaves.
-			if (HandleDeltaAndWriteToCAP(hCAP, ui64Delta, NeedSplit) == -1)
-				return -1;
-		}
-		else
-		{
-			// Generate one halfwave.
-			if (HandleDeltaAndWriteToCAP(hCAP, ui64Delta, NoSplit) == -1)
-				return -1;
+			printf("Error: Could not allocate memory for conversion.\n");
+			uiNumJobs = i;
+			goto exit;
 		}
 	}
 
-	if (FuncRes == TAP_CBM_Status_Error_Reading_data)
-	{
-		TAP_CBM_OutputError(FuncRes);
-		return -1;
-	}
+	Pipeline.pContext = &Context;
+	Pipeline.Read     = TAP2CAP_ReadChunk;
+	Pipeline.Convert  = TAP2CAP_ConvertChunk;
+	Pipeline.Write    = TAP2CAP_WriteChunk;
 
-	return 0;
+	// Conversion loop.
+	if (Chunk_RunPipeline(&Pipeline, (void **) pJobs, uiNumJobs) == 0)
+		RetVal = 0;
+
+	exit:
+	for (i = 0; i < uiNumJobs; i++)
+		free(pJobs[i]);
+
+	return RetVal;
 }
@@ -98,7 +98,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 		RetVal = -1;
 		goto exit2;
 	}
-	if (Status != TapeFirmwareVersion)
+	if (Status < TapeFirmwareVersion)
 	{
 		printf("\nError [get_ver]: ");
 		OutputError(Tape_Status_ERROR_Wrong_Tape_Firmware);
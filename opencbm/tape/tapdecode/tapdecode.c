@@ -0,0 +1,276 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch.h>
+#include "cap.h"
+#include "tap-cbm.h"
+#include "tap-decode.h"
+#include "misc.h"
+
+// Machine frequencies (cycles per second).
+#define FREQ_C64_PAL    985248
+#define FREQ_C64_NTSC  1022727
+#define FREQ_VIC_PAL   1108405
+#define FREQ_VIC_NTSC  1022727
+
+// Number of signals read at once.
+#define SIGNAL_BATCH_SIZE 4096
+
+BOOL ReportOnly = FALSE;
+
+
+void usage(void)
+{
+	printf("\nUsage:   tapdecode [-r] <input.cap|input.tap> [output directory]\n\n");
+	printf("Decodes CBM standard loader files and writes them as PRG files.\n");
+	printf("Options: -r : Only output the block quality report, no PRG files.\n\n");
+	printf("Example: tapdecode myfile.tap\n");
+}
+
+
+__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[], __int32 *piArg)
+{
+	*piArg = 1;
+
+	if ((argc > 1) && (strcmp(argv[1], "-r") == 0))
+	{
+		ReportOnly = TRUE;
+		(*piArg)++;
+	}
+
+	if ((argc - *piArg == 1) || (argc - *piArg == 2)) return 0;
+	else return -1;
+}
+
+
+// Append a full wave pulse length (cycles) to the pulse buffer.
+__int32 AddPulse(unsigned __int32 **ppuiPulses, unsigned __int32 *puiNumPulses, unsigned __int32 *puiSize, unsigned __int64 ui64Cycles)
+{
+	unsigned __int32 *puiPulses;
+
+	if (*puiNumPulses == *puiSize)
+	{
+		*puiSize = (*puiSize == 0) ? 65536 : 2*(*puiSize);
+		puiPulses = (unsigned __int32 *) realloc(*ppuiPulses, *puiSize * sizeof(unsigned __int32));
+		if (puiPulses == NULL)
+		{
+			printf("Error: Out of memory.\n");
+			return -1;
+		}
+		*ppuiPulses = puiPulses;
+	}
+
+	(*ppuiPulses)[(*puiNumPulses)++] = (ui64Cycles > 0xffffffff) ? 0xffffffff : (unsigned __int32) ui64Cycles;
+
+	return 0;
+}
+
+
+// Read all pulses from a CAP image, convert timestamps to machine cycles.
+__int32 ReadCAPPulses(HANDLE hCAP, unsigned __int32 **ppuiPulses, unsigned __int32 *puiNumPulses)
+{
+	unsigned __int64 ui64Signals[SIGNAL_BATCH_SIZE], ui64HalfWave = 0;
+	unsigned __int32 Timer_Precision_MHz, uiFreq, uiSize = 0;
+	unsigned __int8  CAP_Machine, CAP_Video;
+	__int32          iNumSignals, i, FuncRes;
+	BOOL             bSkipFirst = TRUE, bHaveHalfWave = FALSE;
+
+	Check_CAP_Error_TextRetM1(CAP_GetHeader_Machine(hCAP, &CAP_Machine));
+	Check_CAP_Error_TextRetM1(CAP_GetHeader_Video(hCAP, &CAP_Video));
+	Check_CAP_Error_TextRetM1(CAP_GetHeader_Precision(hCAP, &Timer_Precision_MHz));
+
+	if (     (CAP_Machine == CAP_Machine_C64)  && (CAP_Video == CAP_Video_PAL))
+		uiFreq = FREQ_C64_PAL;
+	else if ((CAP_Machine == CAP_Machine_C64)  && (CAP_Video == CAP_Video_NTSC))
+		uiFreq = FREQ_C64_NTSC;
+	else if ((CAP_Machine == CAP_Machine_VC20) && (CAP_Video == CAP_Video_PAL))
+		uiFreq = FREQ_VIC_PAL;
+	else if ((CAP_Machine == CAP_Machine_VC20) && (CAP_Video == CAP_Video_NTSC))
+		uiFreq = FREQ_VIC_NTSC;
+	else
+	{
+		printf("Error: Only C64 and VC20 tapes are supported.\n");
+		return -1;
+	}
+
+	while (1)
+	{
+		FuncRes = CAP_ReadSignals(hCAP, ui64Signals, SIGNAL_BATCH_SIZE, &iNumSignals, NULL);
+		if (FuncRes == CAP_Status_OK_End_of_file)
+			break;
+		else if (FuncRes != CAP_Status_OK)
+		{
+			CAP_OutputError(FuncRes);
+			return -1;
+		}
+
+		for (i = 0; i < iNumSignals; i++)
+		{
+			// Skip first halfwave (time until first pulse starts).
+			if (bSkipFirst)
+			{
+				bSkipFirst = FALSE;
+				continue;
+			}
+
+			// Add timestamps of rising and falling edge.
+			if (!bHaveHalfWave)
+			{
+				ui64HalfWave = ui64Signals[i];
+				bHaveHalfWave = TRUE;
+				continue;
+			}
+			bHaveHalfWave = FALSE;
+
+			if (AddPulse(ppuiPulses, puiNumPulses, &uiSize, ((ui64HalfWave + ui64Signals[i])*uiFreq/Timer_Precision_MHz+500000)/1000000) == -1)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+// Read all pulses from a TAP image.
+__int32 ReadTAPPulses(HANDLE hTAP, unsigned __int32 **ppuiPulses, unsigned __int32 *puiNumPulses)
+{
+	unsigned __int32 uiSignals[SIGNAL_BATCH_SIZE], uiNumSignals, uiCounter = 0, uiHalfWave = 0, uiSize = 0, i;
+	unsigned __int8  TAP_Machine, TAPv;
+	__int32          FuncRes;
+	BOOL             bHaveHalfWave = FALSE;
+
+	Check_TAP_CBM_Error_TextRetM1(TAP_CBM_GetHeader_Machine(hTAP, &TAP_Machine));
+	Check_TAP_CBM_Error_TextRetM1(TAP_CBM_GetHeader_TAPversion(hTAP, &TAPv));
+
+	if (TAP_Machine == TAP_Machine_C16)
+	{
+		printf("Error: Only C64 and VC20 tapes are supported.\n");
+		return -1;
+	}
+
+	while (1)
+	{
+		FuncRes = TAP_CBM_ReadSignals(hTAP, uiSignals, SIGNAL_BATCH_SIZE, &uiNumSignals, &uiCounter);
+		if (FuncRes == TAP_CBM_Status_OK_End_of_file)
+			break;
+		else if (FuncRes != TAP_CBM_Status_OK)
+		{
+			TAP_CBM_OutputError(FuncRes);
+			return -1;
+		}
+
+		for (i = 0; i < uiNumSignals; i++)
+		{
+			// TAPv2 stores halfwaves.
+			if (TAPv == TAPv2)
+			{
+				if (!bHaveHalfWave)
+				{
+					uiHalfWave = uiSignals[i];
+					bHaveHalfWave = TRUE;
+					continue;
+				}
+				bHaveHalfWave = FALSE;
+				if (AddPulse(ppuiPulses, puiNumPulses, &uiSize, (unsigned __int64) uiHalfWave + uiSignals[i]) == -1)
+					return -1;
+			}
+			else if (AddPulse(ppuiPulses, puiNumPulses, &uiSize, uiSignals[i]) == -1)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+// Main routine.
+//   Return values:
+//    0: decoding finished ok
+//   -1: an error occurred
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+	HANDLE           hCAP = NULL, hTAP;
+	TAP_DEC_TAPE     Tape;
+	unsigned __int32 *puiPulses = NULL, uiNumPulses = 0, uiNumWritten;
+	__int32          iArg, FuncRes, RetVal = -1;
+
+	printf("\nTAPDECODE v1.00 - CBM standard loader tape decoder\n");
+	printf("Copyright 2012 Arnd Menge\n\n");
+
+	if (Evaluate_Commandline_Params(argc, argv, &iArg) == -1)
+	{
+		usage();
+		goto exit;
+	}
+
+	// Read pulses from CAP or TAP image, depending on image signature.
+	if ((CAP_OpenFile(&hCAP, argv[iArg]) == CAP_Status_OK) && (CAP_ReadHeader(hCAP) == CAP_Status_OK))
+	{
+		FuncRes = ReadCAPPulses(hCAP, &puiPulses, &uiNumPulses);
+		CAP_CloseFile(&hCAP);
+	}
+	else
+	{
+		if (hCAP != NULL)
+			CAP_CloseFile(&hCAP);
+
+		FuncRes = TAP_CBM_OpenFile(&hTAP, argv[iArg]);
+		if (FuncRes != TAP_CBM_Status_OK)
+		{
+			TAP_CBM_OutputError(FuncRes);
+			goto exit;
+		}
+
+		FuncRes = TAP_CBM_ReadHeader(hTAP);
+		if (FuncRes != TAP_CBM_Status_OK)
+		{
+			printf("Error: Neither CAP nor TAP image.\n");
+			TAP_CBM_CloseFile(&hTAP);
+			goto exit;
+		}
+
+		FuncRes = ReadTAPPulses(hTAP, &puiPulses, &uiNumPulses);
+		TAP_CBM_CloseFile(&hTAP);
+	}
+
+	if (FuncRes != 0)
+		goto exit;
+
+	printf("Decoding %u pulses: %s\n\n", uiNumPulses, argv[iArg]);
+
+	FuncRes = TAP_DEC_Decode(puiPulses, uiNumPulses, &Tape);
+	if (FuncRes != TAP_DEC_Status_OK)
+	{
+		TAP_DEC_OutputError(FuncRes);
+		goto exit;
+	}
+
+	TAP_DEC_OutputReport(&Tape, stdout);
+
+	if (!ReportOnly)
+	{
+		FuncRes = TAP_DEC_WritePRGs(&Tape, (iArg+1 < argc) ? argv[iArg+1] : NULL, &uiNumWritten);
+		printf("\n%u PRG file(s) written.\n", uiNumWritten);
+		if (FuncRes != TAP_DEC_Status_OK)
+		{
+			TAP_DEC_OutputError(FuncRes);
+			TAP_DEC_Free(&Tape);
+			goto exit;
+		}
+	}
+
+	TAP_DEC_Free(&Tape);
+	RetVal = 0;
+
+    exit:
+	if (puiPulses != NULL)
+		free(puiPulses);
+	printf("\n");
+	return RetVal;
+}
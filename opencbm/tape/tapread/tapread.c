@@ -23,6 +23,33 @@ CBM_FILE         fd;
 CRITICAL_SECTION CritSec_fd, CritSec_BreakHandler;
 BOOL             fd_Initialized = FALSE, AbortTapeOps = FALSE;
 
+// Number of signals written to the image at once
+#define SIGNAL_BATCH_SIZE 4096
+
+// Streaming capture:
+// The plugin delivers the capture data in chunks while the tape is read.
+// The chunks are put into a ring of fixed size, from where a converter
+// thread takes them, converts them and appends them to the CAP file.
+// Thus, the memory needed does not depend on the length of the tape.
+#define STREAM_CHUNK_SIZE (64*1024) // Size of a chunk (at least the plugin transfer size).
+#define STREAM_RING_SLOTS 16        // Number of chunks in the ring.
+#define STREAM_CARRY_SIZE 4         // Room for an incomplete signal in front of a chunk.
+
+typedef struct
+{
+	unsigned __int8  *pucSlot[STREAM_RING_SLOTS];   // Chunk buffers, data starts at STREAM_CARRY_SIZE.
+	unsigned __int32  uiSlotLen[STREAM_RING_SLOTS]; // Chunk lengths, 0 marks the end of the capture.
+	unsigned __int32  uiHead, uiTail;               // Next slot to fill/convert.
+	HANDLE            hSlotFree, hSlotFilled;       // Semaphores counting free/filled slots.
+	HANDLE            hThread;                      // Converter thread.
+	HANDLE            hCAP;                         // CAP file to append to.
+	unsigned __int8   ucCarry[STREAM_CARRY_SIZE];   // Incomplete signal at the end of the last chunk.
+	__int32           iCarryLen;
+	unsigned __int64  ui64TotalTapeTime;
+	unsigned __int32  uiNumSignals;
+	BOOL              bWriteError;
+} CaptureStream;
+
 
 void usage(void)
 {
@@ -38,9 +65,10 @@ void usage(void)
 	printf("  -spec48k: Spectrum48K \n");
 	printf("  -x      : custom/unknown\n");
 	printf("\n");
-	printf("You can specify the buffer size for the capture data (optional):\n\n");
+	printf("By default, the capture data is written to the file while the tape is read.\n");
+	printf("Alternatively, you can capture into a buffer first (optional):\n\n");
 	printf("  -b10 :  10 Megabyte\n");
-	printf("  -b25 :  25 Megabyte (default)\n");
+	printf("  -b25 :  25 Megabyte\n");
 	printf("  -b50 :  50 Megabyte\n");
 	printf("  -b100: 100 Megabyte\n");
 	printf("\n");
@@ -64,7 +92,7 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeB
 		return -1;
 	}
 
-	*piTapeBufferSize = 1024*1024*25; // Default buffer size: 25MB.
+	*piTapeBufferSize = 0; // Default: streaming capture, no buffer for the whole tape.
 
 	// Evaluate flags.
 	while (--argc && (*(++argv)[0] == '-'))
@@ -181,7 +209,7 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeB
 
 	if (bBufferSize == 0)
 	{
-		printf("* Buffer size: 25 MB\n"); // use default value
+		printf("* Streaming capture\n"); // use default value
 	}
 	else if (bBufferSize > 1)
 	{
@@ -250,16 +278,15 @@ void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds, unsigned __int32
 }
 
 
-// Convert timestamps to 5 bytes, downscale precision to 1us if requested and write to CAP file.
-__int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen, unsigned __int32 *puiTotalTapeTimeSeconds, unsigned __int32 *puiNumSignals)
+// Convert the complete timestamps in the buffer to 5 bytes, downscale precision to 1us if requested and write to CAP file.
+// Returns the number of bytes consumed; an incomplete timestamp at the end of the buffer is left over.
+// Returns -1 on error.
+__int32 ConvertAndWriteSignals(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iLen, unsigned __int64 *pui64TotalTapeTime, unsigned __int32 *puiNumSignals)
 {
-	unsigned __int64 ui64Delta, ui64TotalTapeTime = 0;
-	__int32          FuncRes, i = 0;
+	unsigned __int64 ui64Delta, ui64Signals[SIGNAL_BATCH_SIZE];
+	__int32          FuncRes, iNumSignals = 0, i = 0;
 
-	*puiTotalTapeTimeSeconds = 0;
-	*puiNumSignals = 0;
-
-	while (i < iCaptureLen)
+	while (i+2 <= iLen)
 	{
 		ui64Delta = pucTapeBuffer[i];
 		ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+1];
@@ -272,6 +299,8 @@ __int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer,
 		else
 		{
 			// Long signal (>=2ms)
+			if (i+5 > iLen)
+				break;
 			ui64Delta &= 0x7fff;
 			ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+2];
 			ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+3];
@@ -279,12 +308,29 @@ __int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer,
 			i += 5;
 		}
 
-		ui64TotalTapeTime += ui64Delta;
+		*pui64TotalTapeTime += ui64Delta;
 		(*puiNumSignals)++;
 
 		if (CAP_Precision == 1) ui64Delta = (ui64Delta + 8) >> 4; // downscale by 16
 
-		FuncRes = CAP_WriteSignal(hCAP, ui64Delta, NULL);
+		ui64Signals[iNumSignals++] = ui64Delta;
+
+		if (iNumSignals == SIGNAL_BATCH_SIZE)
+		{
+			FuncRes = CAP_WriteSignals(hCAP, ui64Signals, iNumSignals, NULL);
+			if (FuncRes != CAP_Status_OK)
+			{
+				CAP_OutputError(FuncRes);
+				return -1;
+			}
+			iNumSignals = 0;
+		}
+	}
+
+	// Write remaining signals.
+	if (iNumSignals > 0)
+	{
+		FuncRes = CAP_WriteSignals(hCAP, ui64Signals, iNumSignals, NULL);
 		if (FuncRes != CAP_Status_OK)
 		{
 			CAP_OutputError(FuncRes);
@@ -292,21 +338,39 @@ __int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer,
 		}
 	}
 
+	return i;
+}
+
+
+// Calculate tape length in seconds.
+unsigned __int32 TapeTimeSeconds(unsigned __int64 ui64TotalTapeTime)
+{
+	return (unsigned __int32) (((ui64TotalTapeTime + 8000000) >> 10)/15625); //16000000;
+}
+
+
+// Convert timestamps to 5 bytes, downscale precision to 1us if requested and write to CAP file.
+__int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen, unsigned __int32 *puiTotalTapeTimeSeconds, unsigned __int32 *puiNumSignals)
+{
+	unsigned __int64 ui64TotalTapeTime = 0;
+
+	*puiTotalTapeTimeSeconds = 0;
+	*puiNumSignals = 0;
+
+	if (ConvertAndWriteSignals(hCAP, pucTapeBuffer, iCaptureLen, &ui64TotalTapeTime, puiNumSignals) == -1)
+		return -1;
+
 	// Calculate tape length in seconds.
-	*puiTotalTapeTimeSeconds = (unsigned __int32) (((ui64TotalTapeTime + 8000000) >> 10)/15625); //16000000;
+	*puiTotalTapeTimeSeconds = TapeTimeSeconds(ui64TotalTapeTime);
 
 	return 0;
 }
 
 
-// Write tape image to specified image file.
-__int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen)
+// Write CAP file header.
+__int32 WriteCaptureFileHeader(HANDLE hCAP)
 {
-	unsigned __int32 uiTotalTapeTimeSeconds, uiNumSignals;
-	__int32          FuncRes;
-
-	if (iCaptureLen == 0)
-		printf("Empty capture file.\n");
+	__int32 FuncRes;
 
 	FuncRes = CAP_SetHeader(hCAP, CAP_Precision, CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat, CAP_SignalWidth, CAP_StartOfs);
 	if (FuncRes != CAP_Status_OK)
@@ -329,6 +393,21 @@ __int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer
 		return -1;
 	}
 
+	return 0;
+}
+
+
+// Write tape image to specified image file.
+__int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen)
+{
+	unsigned __int32 uiTotalTapeTimeSeconds, uiNumSignals;
+
+	if (iCaptureLen == 0)
+		printf("Empty capture file.\n");
+
+	if (WriteCaptureFileHeader(hCAP) == -1)
+		return -1;
+
 	// Convert timestamps to 5 bytes, downscale precision to 1us if requested and write to CAP file.
 	if (ConvertAndWriteCaptureData(hCAP, pucTapeBuffer, iCaptureLen, &uiTotalTapeTimeSeconds, &uiNumSignals) == -1)
 		return -1;
@@ -340,7 +419,150 @@ __int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer
 }
 
 
-__int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBufferSize, __int32 *piCaptureLen)
+// Converter thread of the streaming capture:
+// Takes the chunks from the ring, converts them and appends them to the CAP file.
+DWORD WINAPI StreamConverterThread(LPVOID lpParam)
+{
+	CaptureStream   *pStream = (CaptureStream *) lpParam;
+	unsigned __int8 *pucData;
+	__int32          iLen, iConsumed;
+
+	for (;;)
+	{
+		WaitForSingleObject(pStream->hSlotFilled, INFINITE);
+
+		iLen = pStream->uiSlotLen[pStream->uiTail];
+		if (iLen == 0)
+			break; // End of capture.
+
+		if (!pStream->bWriteError)
+		{
+			// Put the incomplete signal of the last chunk in front of this one.
+			pucData = pStream->pucSlot[pStream->uiTail] + STREAM_CARRY_SIZE - pStream->iCarryLen;
+			memcpy(pucData, pStream->ucCarry, pStream->iCarryLen);
+			iLen += pStream->iCarryLen;
+
+			iConsumed = ConvertAndWriteSignals(pStream->hCAP, pucData, iLen, &pStream->ui64TotalTapeTime, &pStream->uiNumSignals);
+			if (iConsumed == -1)
+			{
+				pStream->bWriteError = TRUE;
+			}
+			else
+			{
+				pStream->iCarryLen = iLen - iConsumed;
+				memcpy(pStream->ucCarry, pucData + iConsumed, pStream->iCarryLen);
+			}
+		}
+
+		pStream->uiTail = (pStream->uiTail + 1) % STREAM_RING_SLOTS;
+		ReleaseSemaphore(pStream->hSlotFree, 1, NULL);
+	}
+
+	return 0;
+}
+
+
+// Put a chunk into the ring, waiting for a free slot if the converter thread is behind.
+void StreamPutChunk(CaptureStream *pStream, const unsigned __int8 *pucData, unsigned __int32 uiLen)
+{
+	WaitForSingleObject(pStream->hSlotFree, INFINITE);
+
+	memcpy(pStream->pucSlot[pStream->uiHead] + STREAM_CARRY_SIZE, pucData, uiLen);
+	pStream->uiSlotLen[pStream->uiHead] = uiLen;
+	pStream->uiHead = (pStream->uiHead + 1) % STREAM_RING_SLOTS;
+
+	ReleaseSemaphore(pStream->hSlotFilled, 1, NULL);
+}
+
+
+// Capture callback of the streaming capture, called by the plugin for every chunk.
+//   Return values:
+//    0: continue capture
+//    1: abort capture (CAP file could not be written)
+int StreamCaptureCallback(void *Context, const unsigned char *Data, unsigned int Length)
+{
+	CaptureStream    *pStream = (CaptureStream *) Context;
+	unsigned __int32 uiLen;
+
+	while (Length > 0)
+	{
+		uiLen = (Length > STREAM_CHUNK_SIZE) ? STREAM_CHUNK_SIZE : Length;
+		StreamPutChunk(pStream, Data, uiLen);
+		Data += uiLen;
+		Length -= uiLen;
+	}
+
+	return pStream->bWriteError ? 1 : 0;
+}
+
+
+// Set up the ring and start the converter thread of the streaming capture.
+__int32 StreamStart(CaptureStream *pStream, HANDLE hCAP)
+{
+	DWORD    dwThreadId;
+	__int32  i;
+
+	memset(pStream, 0, sizeof(*pStream));
+	pStream->hCAP = hCAP;
+
+	for (i = 0; i < STREAM_RING_SLOTS; i++)
+	{
+		pStream->pucSlot[i] = malloc(STREAM_CARRY_SIZE + STREAM_CHUNK_SIZE);
+		if (pStream->pucSlot[i] == NULL)
+		{
+			printf("Error: Could not allocate memory for capture data.\n");
+			return -1;
+		}
+	}
+
+	pStream->hSlotFree = CreateSemaphore(NULL, STREAM_RING_SLOTS, STREAM_RING_SLOTS, NULL);
+	pStream->hSlotFilled = CreateSemaphore(NULL, 0, STREAM_RING_SLOTS, NULL);
+	if ((pStream->hSlotFree == NULL) || (pStream->hSlotFilled == NULL))
+	{
+		printf("Error: Could not create semaphores.\n");
+		return -1;
+	}
+
+	pStream->hThread = CreateThread(NULL, 0, StreamConverterThread, pStream, 0, &dwThreadId);
+	if (pStream->hThread == NULL)
+	{
+		printf("Error: Could not create converter thread.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+// Mark the end of the capture, wait for the converter thread and release the ring.
+//   Return values:
+//    0: all capture data written to the CAP file
+//   -1: an error occurred
+__int32 StreamStop(CaptureStream *pStream)
+{
+	__int32 i;
+
+	if (pStream->hThread != NULL)
+	{
+		StreamPutChunk(pStream, NULL, 0); // End marker.
+		WaitForSingleObject(pStream->hThread, INFINITE);
+		CloseHandle(pStream->hThread);
+	}
+
+	if (pStream->hSlotFree != NULL) CloseHandle(pStream->hSlotFree);
+	if (pStream->hSlotFilled != NULL) CloseHandle(pStream->hSlotFilled);
+
+	for (i = 0; i < STREAM_RING_SLOTS; i++)
+		if (pStream->pucSlot[i] != NULL) free(pStream->pucSlot[i]);
+
+	return pStream->bWriteError ? -1 : 0;
+}
+
+
+// Capture the tape.
+// With pStream == NULL, the whole capture is read into pucTapeBuffer.
+// Else, pucTapeBuffer is used for the single chunks, which are given to the converter thread.
+__int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBufferSize, __int32 *piCaptureLen, CaptureStream *pStream)
 {
 	unsigned __int8 ReadConfig, ReadConfig2;
 	__int32         Status, BytesRead, BytesWritten, FuncRes;
@@ -369,7 +591,7 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
 				printf("%d\n", Status);
 		return -1;
 	}
-	if (Status != TapeFirmwareVersion)
+	if (Status < TapeFirmwareVersion)
 	{
 		printf("\nError [get_ver]: ");
 		OutputError(Tape_Status_ERROR_Wrong_Tape_Firmware);
@@ -586,7 +808,10 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
 	//   - XUM1541_Error_NoTapeSupport
 	//   - XUM1541_Error_NoDiskTapeMode
 	//   - XUM1541_Error_TapeCmdInDiskMode
-	FuncRes = cbm_tap_start_capture(fd, pucTapeBuffer, iTapeBufferSize, &Status, &BytesRead);
+	if (pStream != NULL)
+		FuncRes = cbm_tap_start_capture_stream(fd, pucTapeBuffer, iTapeBufferSize, StreamCaptureCallback, pStream, &Status, &BytesRead);
+	else
+		FuncRes = cbm_tap_start_capture(fd, pucTapeBuffer, iTapeBufferSize, &Status, &BytesRead);
 	if (FuncRes < 0)
 	{
 		printf("\nReturned error [capture]: ");
@@ -595,7 +820,7 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
 		return -1;
 	}
 	*piCaptureLen = BytesRead;
-	if (*piCaptureLen >= iTapeBufferSize)
+	if ((pStream == NULL) && (*piCaptureLen >= iTapeBufferSize))
 	{
 		printf("\nError [capture]: Buffer full, use larger buffer size!\n");
 		return -1;
@@ -656,6 +881,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 	__int8          filename[_MAX_PATH];
 	__int32         iCaptureLen, iTapeBufferSize = 0;
 	__int32         FuncRes, RetVal = -1;
+	CaptureStream   Stream, *pStream = NULL;
 
 	printf("\ntapread v1.00 - Commodore 1530/1531 tape image creator\n");
 	printf("Copyright 2012 Arnd Menge\n\n");
@@ -679,7 +905,14 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 		goto exit;
 	}
 
-	// Allocate memory for tape image.
+	// Without a buffer size, the capture data is streamed to the file in chunks.
+	if (iTapeBufferSize == 0)
+	{
+		pStream = &Stream;
+		iTapeBufferSize = STREAM_CHUNK_SIZE;
+	}
+
+	// Allocate memory for tape image (or a single chunk of it).
 	if (AllocateImageBuffer(&pucTapeBuffer, iTapeBufferSize) == -1)
 		goto exit;
 
@@ -701,11 +934,28 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 		goto exit;
 	}
 
+	if (pStream != NULL)
+	{
+		// The header goes first, the data is appended while capturing.
+		if (WriteCaptureFileHeader(hCAP) == -1)
+		{
+			CAP_CloseFile(&hCAP);
+			goto exit;
+		}
+		if (StreamStart(pStream, hCAP) == -1)
+		{
+			StreamStop(pStream);
+			CAP_CloseFile(&hCAP);
+			goto exit;
+		}
+	}
+
 	EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
 
 	if (cbm_driver_open_ex(&fd, NULL) != 0)
 	{
 		printf("Driver error.\n");
+		if (pStream != NULL) StreamStop(pStream);
 		CAP_CloseFile(&hCAP);
 		LeaveCriticalSection(&CritSec_fd);
 		goto exit;
@@ -714,13 +964,28 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 	fd_Initialized = TRUE;
 	LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
 
-	RetVal = CaptureTape(fd, pucTapeBuffer, iTapeBufferSize, &iCaptureLen);
+	RetVal = CaptureTape(fd, pucTapeBuffer, iTapeBufferSize, &iCaptureLen, pStream);
 
 	EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
 	cbm_driver_close(fd);
 	fd_Initialized = FALSE;
 	LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
 
+	if (pStream != NULL)
+	{
+		// Wait until the converter thread has written the remaining chunks.
+		if (StreamStop(pStream) == -1)
+			RetVal = -1;
+		else if (RetVal == 0)
+		{
+			if (iCaptureLen == 0)
+				printf("Empty capture file.\n");
+
+			// Print tape length to console.
+			OutputTapeLength(TapeTimeSeconds(pStream->ui64TotalTapeTime), pStream->uiNumSignals, iCaptureLen);
+		}
+	}
+
 	if (RetVal != 0)
 	{
 		CAP_CloseFile(&hCAP);
@@ -728,7 +993,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 	}
 
 	// Write tape image to specified image file.
-	RetVal = WriteTapeBufferToCaptureFile(hCAP, pucTapeBuffer, iCaptureLen);
+	if (pStream == NULL)
+		RetVal = WriteTapeBufferToCaptureFile(hCAP, pucTapeBuffer, iCaptureLen);
 
 	FuncRes = CAP_CloseFile(&hCAP);
 	if (FuncRes != CAP_Status_OK)
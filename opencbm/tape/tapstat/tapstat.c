@@ -0,0 +1,292 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch.h>
+#include "tap-stats.h"
+
+// Histogram bins, the bin width is given on the commandline.
+#define NUM_BINS 512
+
+// Histogram bar width (characters).
+#define BAR_WIDTH 50
+
+// Number of dropouts listed.
+#define MAX_LISTED_DROPOUTS 100
+
+unsigned int BinWidth   = 4;     // us
+unsigned int WindowMs   = 10000;
+unsigned int NumThreads = 0;     // one per processor
+int          Zoom       = 0;
+double       ZoomFrom, ZoomTo;   // seconds
+unsigned int ZoomBuckets;
+
+
+void usage(void)
+{
+	printf("Usage: tapstat [-bX] [-wY] [-tZ] [-zFROM:TO:N] <filename.cap|filename.tap>\n");
+	printf("\n");
+	printf("  -bX         : histogram bin width X microseconds (default 4)\n");
+	printf("  -wY         : speed drift window Y milliseconds (default 10000)\n");
+	printf("  -tZ         : use Z threads (default: one per processor)\n");
+	printf("  -zFROM:TO:N : min/max summary of N buckets from FROM to TO seconds\n");
+	printf("\n");
+	printf("Examples:\n");
+	printf("  tapstat myfile.cap\n");
+	printf("  tapstat -b2 -w1000 myfile.tap\n");
+	printf("  tapstat -z10:12.5:40 myfile.cap\n");
+}
+
+
+int EvaluateCommandlineParams(int argc, char *argv[], char **ppcFilename)
+{
+	// Evaluate flags.
+	while (--argc && (*(++argv)[0] == '-'))
+	{
+		if ((*argv)[1] == 'b')
+			BinWidth = atoi(&(argv[0][2]));
+		else if ((*argv)[1] == 'w')
+			WindowMs = atoi(&(argv[0][2]));
+		else if ((*argv)[1] == 't')
+			NumThreads = atoi(&(argv[0][2]));
+		else if ((*argv)[1] == 'z')
+		{
+			if ((sscanf(&(argv[0][2]), "%lf:%lf:%u", &ZoomFrom, &ZoomTo, &ZoomBuckets) != 3) || (ZoomFrom < 0) || (ZoomTo <= ZoomFrom) || (ZoomBuckets == 0))
+			{
+				printf("Error: invalid zoom range.\n\n");
+				return -1;
+			}
+			Zoom = 1;
+		}
+		else
+		{
+			printf("Error: invalid commandline parameter.\n\n");
+			return -1;
+		}
+	}
+
+	if ((BinWidth == 0) || (WindowMs == 0))
+	{
+		printf("Error: bin width and window must not be zero.\n\n");
+		return -1;
+	}
+
+	if (argc != 1)
+	{
+		printf("Error: invalid number of commandline parameters.\n\n");
+		return -1;
+	}
+
+	*ppcFilename = *argv;
+	return 0;
+}
+
+
+// Format a tape position (ns) as minutes:seconds.milliseconds.
+const char *FormatTime(TAP_STAT_UINT64 ui64Time, char *pcBuffer)
+{
+	unsigned int uiMs = (unsigned int) (ui64Time/1000000);
+
+	sprintf(pcBuffer, "%3u:%02u.%03u", uiMs/60000, (uiMs/1000) % 60, uiMs % 1000);
+	return pcBuffer;
+}
+
+
+void OutputImageInfo(const TAP_STAT_IMAGE *pImage, const char *pcFilename)
+{
+	TAP_STAT_SUMMARY Total;
+	char             cTime[32];
+
+	TAP_STAT_GetSummary(pImage, 0, pImage->uiNumPulses, &Total);
+
+	if (pImage->iFormat == TAP_STAT_Format_CAP)
+		printf("Image:    %s (CAP, %s)\n", pcFilename, (pImage->uiPrecision == 1) ? "1us" : "62.5ns");
+	else
+		printf("Image:    %s (TAP v%u, %u Hz)\n", pcFilename, pImage->ucTAPversion, pImage->uiFreq);
+
+	printf("Pulses:   %u\n", pImage->uiNumPulses);
+	printf("Length:   %s\n", FormatTime(Total.ui64Time, cTime));
+	printf("Shortest: %.2f us\n", Total.uiMin/1000.0);
+	printf("Longest:  %.2f us\n\n", Total.uiMax/1000.0);
+}
+
+
+void OutputHistogram(const TAP_STAT_IMAGE *pImage)
+{
+	unsigned int i, j, uiMax = 0, uiBar;
+
+	for (i = 0; i < pImage->uiNumBins; i++)
+		if (pImage->puiHistogram[i] > uiMax)
+			uiMax = pImage->puiHistogram[i];
+
+	printf("Pulse length histogram (us):\n");
+
+	// Omit bins below 1/1000 of the peak.
+	for (i = 0; i < pImage->uiNumBins; i++)
+	{
+		if ((pImage->puiHistogram[i] == 0) || ((TAP_STAT_UINT64) pImage->puiHistogram[i]*1000 < uiMax))
+			continue;
+
+		uiBar = (unsigned int) ((TAP_STAT_UINT64) pImage->puiHistogram[i]*BAR_WIDTH/uiMax);
+		printf("  %5u-%-5u %9u ", i*BinWidth, (i + 1)*BinWidth, pImage->puiHistogram[i]);
+		for (j = 0; j < uiBar; j++)
+			printf("#");
+		printf("\n");
+	}
+
+	if (pImage->puiHistogram[pImage->uiNumBins] > 0)
+		printf("  %5u+      %9u\n", pImage->uiNumBins*BinWidth, pImage->puiHistogram[pImage->uiNumBins]);
+
+	printf("\nPeak:     %.2f us (mean around peak %.2f us)\n\n", pImage->uiPeak/1000.0, pImage->uiPeakMean/1000.0);
+}
+
+
+void OutputDrift(const TAP_STAT_IMAGE *pImage)
+{
+	TAP_STAT_SUMMARY Summary;
+	unsigned int     i, uiFirst, uiEnd;
+	char             cTime[32];
+	int              iMin = 0, iMax = 0, bValid = 0;
+
+	printf("Speed drift (window %u ms):\n", pImage->uiWindowMs);
+	printf("         Time   Pulses    Drift   Min (us)   Max (us)\n");
+
+	for (i = 0; i < pImage->uiNumWindows; i++)
+	{
+		uiFirst = TAP_STAT_FindTime(pImage, (TAP_STAT_UINT64) i*pImage->uiWindowMs*1000000);
+		uiEnd = TAP_STAT_FindTime(pImage, (TAP_STAT_UINT64) (i + 1)*pImage->uiWindowMs*1000000);
+		TAP_STAT_GetSummary(pImage, uiFirst, uiEnd - uiFirst, &Summary);
+
+		printf("  %s %8u ", FormatTime((TAP_STAT_UINT64) i*pImage->uiWindowMs*1000000, cTime), pImage->pWindows[i].uiPulses);
+		if (pImage->pWindows[i].uiPulses < TAP_STAT_MIN_WINDOW_PULSES)
+			printf("       -");
+		else
+		{
+			printf("%+7.2f%%", pImage->pWindows[i].iDrift/100.0);
+			if (!bValid || (pImage->pWindows[i].iDrift < iMin)) iMin = pImage->pWindows[i].iDrift;
+			if (!bValid || (pImage->pWindows[i].iDrift > iMax)) iMax = pImage->pWindows[i].iDrift;
+			bValid = 1;
+		}
+
+		if (Summary.uiCount > 0)
+			printf(" %10.2f %10.2f", Summary.uiMin/1000.0, Summary.uiMax/1000.0);
+		printf("\n");
+	}
+
+	if (bValid)
+		printf("\nDrift range: %+.2f%% .. %+.2f%%\n\n", iMin/100.0, iMax/100.0);
+	else
+		printf("\nDrift range: no data pulses found\n\n");
+}
+
+
+void OutputDropouts(const TAP_STAT_IMAGE *pImage)
+{
+	unsigned int i;
+	char         cTime[32];
+
+	printf("Dropouts: %u\n", pImage->uiNumDropouts);
+
+	for (i = 0; (i < pImage->uiNumDropouts) && (i < MAX_LISTED_DROPOUTS); i++)
+		printf("  %s pulse %9u: %-6s %10.2f us\n", FormatTime(pImage->pDropouts[i].ui64Time, cTime), pImage->pDropouts[i].uiPulse,
+		       (pImage->pDropouts[i].iType == TAP_STAT_Dropout_Gap) ? "gap" : "glitch", pImage->pDropouts[i].uiLength/1000.0);
+
+	if (pImage->uiNumDropouts > MAX_LISTED_DROPOUTS)
+		printf("  ...\n");
+
+	printf("\n");
+}
+
+
+int OutputZoom(const TAP_STAT_IMAGE *pImage)
+{
+	TAP_STAT_SUMMARY *pSummaries;
+	TAP_STAT_UINT64  ui64Time;
+	unsigned int     i, uiFirst, uiEnd;
+	char             cTime[32];
+
+	pSummaries = (TAP_STAT_SUMMARY *) malloc(ZoomBuckets*sizeof(TAP_STAT_SUMMARY));
+	if (pSummaries == NULL)
+	{
+		TAP_STAT_OutputError(TAP_STAT_Status_Error_Out_of_memory);
+		return -1;
+	}
+
+	uiFirst = TAP_STAT_FindTime(pImage, (TAP_STAT_UINT64) (ZoomFrom*1e9));
+	uiEnd = TAP_STAT_FindTime(pImage, (TAP_STAT_UINT64) (ZoomTo*1e9));
+
+	TAP_STAT_GetSummaries(pImage, uiFirst, uiEnd - uiFirst, ZoomBuckets, pSummaries);
+
+	printf("Pulses %u to %u in %u buckets:\n", uiFirst, uiEnd, ZoomBuckets);
+	printf("         Time   Pulses   Min (us)  Mean (us)   Max (us)\n");
+
+	ui64Time = TAP_STAT_GetTime(pImage, uiFirst);
+	for (i = 0; i < ZoomBuckets; i++)
+	{
+		printf("  %s %8u", FormatTime(ui64Time, cTime), pSummaries[i].uiCount);
+		if (pSummaries[i].uiCount > 0)
+			printf(" %10.2f %10.2f %10.2f", pSummaries[i].uiMin/1000.0, pSummaries[i].ui64Time/1000.0/pSummaries[i].uiCount, pSummaries[i].uiMax/1000.0);
+		printf("\n");
+		ui64Time += pSummaries[i].ui64Time;
+	}
+
+	printf("\n");
+	free(pSummaries);
+	return 0;
+}
+
+
+// Main routine.
+//   Return values:
+//    0: analysis finished ok
+//   -1: an error occurred
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+	TAP_STAT_IMAGE Image;
+	char           *pcFilename;
+	int            FuncRes;
+
+	printf("\nTAPSTAT v1.00 - Tape image pulse statistics\n");
+	printf("Copyright 2012 Arnd Menge\n\n");
+
+	if (EvaluateCommandlineParams(argc, argv, &pcFilename) == -1)
+	{
+		usage();
+		return -1;
+	}
+
+	FuncRes = TAP_STAT_Open(&Image, pcFilename);
+	if (FuncRes != TAP_STAT_Status_OK)
+	{
+		TAP_STAT_OutputError(FuncRes);
+		return -1;
+	}
+
+	FuncRes = TAP_STAT_Analyze(&Image, BinWidth*1000, NUM_BINS, WindowMs, NumThreads);
+	if (FuncRes != TAP_STAT_Status_OK)
+	{
+		TAP_STAT_OutputError(FuncRes);
+		TAP_STAT_Close(&Image);
+		return -1;
+	}
+
+	OutputImageInfo(&Image, pcFilename);
+
+	if (Zoom)
+		FuncRes = OutputZoom(&Image);
+	else
+	{
+		OutputHistogram(&Image);
+		OutputDrift(&Image);
+		OutputDropouts(&Image);
+	}
+
+	TAP_STAT_Close(&Image);
+
+	return FuncRes;
+}
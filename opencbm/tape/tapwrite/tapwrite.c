@@ -22,6 +22,33 @@ CBM_FILE         fd;
 CRITICAL_SECTION CritSec_fd, CritSec_BreakHandler;
 BOOL             fd_Initialized = FALSE, AbortTapeOps = FALSE;
 
+// Number of signals read from the image at once
+#define SIGNAL_BATCH_SIZE 4096
+
+// Streaming write:
+// A reader thread converts the image into chunks of tape firmware deltas
+// and puts them into a ring of fixed size, from where the plugin takes
+// them while the tape is written. Thus, the memory needed does not depend
+// on the length of the tape, and writing starts without reading the
+// whole image first.
+#define STREAM_CHUNK_SIZE (64*1024) // Size of a chunk.
+#define STREAM_RING_SLOTS 4         // Number of chunks in the ring.
+
+typedef struct
+{
+	unsigned __int8  *pucSlot[STREAM_RING_SLOTS];   // Chunk buffers.
+	unsigned __int32  uiSlotLen[STREAM_RING_SLOTS]; // Chunk lengths, 0 marks the end of the data.
+	unsigned __int32  uiHead, uiTail;               // Next slot to fill/write.
+	unsigned __int32  uiSlotPos;                    // Bytes of the current slot already given to the plugin.
+	HANDLE            hSlotFree, hSlotFilled;       // Semaphores counting free/filled slots.
+	HANDLE            hThread;                      // Reader thread.
+	HANDLE            hCAP;                         // CAP file to read from.
+	unsigned __int8   *pucBuffer;                   // Chunk buffer of the plugin.
+	unsigned __int32  uiDeltaBytes;                 // Number of delta bytes, from ScanCaptureFile().
+	volatile BOOL     bAbort;                       // Stop reading, the write is finished.
+	BOOL              bReadError, bEndSeen;
+} WriteStream;
+
 // Start/stop delay
 BOOL             StartDelayActivated = FALSE,
                  StopDelayActivated = FALSE;
@@ -141,59 +168,123 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[
 }
 
 
-__int32 AllocateImageBuffer(HANDLE hCAP, void **ppucTapeBuffer, __int32 *piTapeBufferSize)
+// Print tape length to console.
+void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds)
 {
-	__int32 FuncRes;
+	unsigned __int32 hours, mins, secs;
 
-	// Return file size of image file (moves file pointer).
-	FuncRes = CAP_GetFileSize(hCAP, piTapeBufferSize);
-	if (FuncRes != CAP_Status_OK)
+	hours = (uiTotalTapeTimeSeconds/3600);
+	printf("Tape recording time: %uh", hours);
+	mins = ((uiTotalTapeTimeSeconds - hours*3600)/60);
+	printf(" %um", mins);
+	secs = ((uiTotalTapeTimeSeconds - hours*3600) - mins*60);
+	printf(" %us\n\n", secs);
+}
+
+
+// Convert a CAP signal to a 16MHz hardware delta.
+// Replaces the first timestamp by the start delay and enforces the minimum signal length.
+unsigned __int64 ConvertSignal(unsigned __int64 ui64Delta, BOOL FirstSignal, BOOL bVerbose)
+{
+	unsigned __int64 ShortWarning, ShortError;
+
+	if (CAP_Precision == 16)
 	{
-		CAP_OutputError(FuncRes);
-		return -1;
+		ShortWarning = 16*75; // 75us
+		ShortError = 16*60;   // 60us
+	}
+	else
+	{
+		ShortWarning = 75; // 75us
+		ShortError = 60;   // 60us
 	}
 
-	if (*piTapeBufferSize < 0)
+	if (FirstSignal)
 	{
-		printf("Error: Illegal tape image buffer size.\n");
-		return -1;
+		// Replace first timestamp with start delay if requested
+		if (StartDelayActivated == TRUE)
+		{
+			if (StartDelay == 0)
+				ui64Delta = 1600; // 100us minimum
+			else
+			{
+				ui64Delta = StartDelay;
+				ui64Delta *= 15625; //16000000;
+				ui64Delta <<= 10;
+			}
+		}
 	}
+	else
+		if (CAP_Precision == 1) ui64Delta <<= 4; // Convert from 1MHz to 16MHz.
 
-	// Allocate memory for tape image.
-	*ppucTapeBuffer = malloc(*piTapeBufferSize);
-	if (*ppucTapeBuffer == NULL)
+	if (bVerbose && (ui64Delta < ShortWarning)) printf("Warning - Short signal length detected: 0x%.10X\n", ui64Delta);
+	if (ui64Delta < ShortError)
 	{
-		printf("Error: Could not allocate memory for capture data.\n");
-		return -1;
+		if (bVerbose) printf("Warning - Replaced by minimum signal length.\n");
+		ui64Delta = ShortError;
 	}
 
-	// Initialize memory for tape image.
-	memset(*ppucTapeBuffer, 0x00, *piTapeBufferSize);
+	return ui64Delta;
+}
 
-	return 0;
+
+// Final delta for the stop delay.
+unsigned __int64 StopDelaySignal(void)
+{
+	unsigned __int64 ui64Delta;
+
+	if (StopDelay == 0xffffffff)
+		ui64Delta = 0xffffffffff;
+	else
+	{
+		ui64Delta = StopDelay;
+		ui64Delta *= 15625;
+		ui64Delta <<= 10; //16000000;
+	}
+
+	return ui64Delta;
 }
 
 
-// Print tape length to console.
-void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds)
+// Encode a delta in the tape firmware format.
+// If pucBuffer is NULL, only the length is returned.
+//   Return values:
+//    2: short signal (<2ms)
+//    5: long signal (>=2ms)
+__int32 PutDelta(unsigned __int8 *pucBuffer, unsigned __int64 ui64Delta)
 {
-	unsigned __int32 hours, mins, secs;
+	if (ui64Delta < 0x8000)
+	{
+		// Short signal (<2ms)
+		if (pucBuffer != NULL)
+		{
+			pucBuffer[0] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
+			pucBuffer[1] = (unsigned __int8) (ui64Delta & 0xff);
+		}
+		return 2;
+	}
 
-	hours = (uiTotalTapeTimeSeconds/3600);
-	printf("Tape recording time: %uh", hours);
-	mins = ((uiTotalTapeTimeSeconds - hours*3600)/60);
-	printf(" %um", mins);
-	secs = ((uiTotalTapeTimeSeconds - hours*3600) - mins*60);
-	printf(" %us\n\n", secs);
+	// Long signal (>=2ms)
+	if (pucBuffer != NULL)
+	{
+		pucBuffer[0] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
+		pucBuffer[1] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
+		pucBuffer[2] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
+		pucBuffer[3] = (unsigned __int8)  ((ui64Delta >>  8) & 0xff);
+		pucBuffer[4] = (unsigned __int8)  (ui64Delta & 0xff);
+	}
+	return 5;
 }
 
 
-// Read tape image into memory.
-__int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *piCaptureLen)
+// Scan the tape image: check the signals, count the delta bytes and print the tape length.
+// The image is rewound to the start of the image data afterwards.
+__int32 ScanCaptureFile(HANDLE hCAP, unsigned __int32 *puiDeltaBytes)
 {
-	unsigned __int64 ui64Delta = 0, ShortWarning, ShortError, MinLength, ui64TotalTapeTime = 0;
+	unsigned __int64 ui64Delta, ui64TotalTapeTime = 0;
+	unsigned __int64 ui64Deltas[SIGNAL_BATCH_SIZE];
 	unsigned __int32 uiTotalTapeTimeSeconds;
-	__int32          FuncRes;
+	__int32          FuncRes, iNumSignals, i;
 	BOOL             FirstSignal = TRUE;
 
 	// Seek to start of image file and read image header, extract & verify header contents, seek to start of image data.
@@ -212,124 +303,278 @@ __int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *pi
 		return -1;
 	}
 
-	if (CAP_Precision == 16)
+	*puiDeltaBytes = 0;
+
+	// Read timestamps, convert to 16MHz hardware resolution if necessary.
+	while ((FuncRes = CAP_ReadSignals(hCAP, ui64Deltas, SIGNAL_BATCH_SIZE, &iNumSignals, NULL)) == CAP_Status_OK)
 	{
-		ShortWarning = 16*75; // 75us
-		ShortError = 16*60;   // 60us
+		for (i = 0; i < iNumSignals; i++)
+		{
+			ui64Delta = ConvertSignal(ui64Deltas[i], FirstSignal, TRUE);
+			FirstSignal = FALSE;
+
+			ui64TotalTapeTime += ui64Delta;
+			*puiDeltaBytes += PutDelta(NULL, ui64Delta);
+		}
 	}
-	else
+
+	if (FuncRes == CAP_Status_Error_Reading_data)
 	{
-		ShortWarning = 75; // 75us
-		ShortError = 60;   // 60us
+		CAP_OutputError(FuncRes);
+		return -1;
+	}
+
+	// Add final timestamp for stop delay
+	if (StopDelayActivated == TRUE)
+	{
+		ui64Delta = StopDelaySignal();
+		ui64TotalTapeTime += ui64Delta;
+		*puiDeltaBytes += PutDelta(NULL, ui64Delta);
+	}
+
+	// Calculate tape recording length.
+	uiTotalTapeTimeSeconds = (unsigned __int32) ((ui64TotalTapeTime >> 10)/15625); //16000000;
+	OutputTapeLength(uiTotalTapeTimeSeconds);
+
+	// Rewind for the write stream.
+	FuncRes = CAP_ReadHeader(hCAP);
+	if (FuncRes != CAP_Status_OK)
+	{
+		CAP_OutputError(FuncRes);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+// Pass the current slot on to the plugin and take the next free one.
+// The reader thread always owns exactly one slot, which it fills.
+void StreamNextSlot(WriteStream *pStream, unsigned __int32 uiLen)
+{
+	pStream->uiSlotLen[pStream->uiHead] = uiLen;
+	pStream->uiHead = (pStream->uiHead + 1) % STREAM_RING_SLOTS;
+	ReleaseSemaphore(pStream->hSlotFilled, 1, NULL);
+
+	WaitForSingleObject(pStream->hSlotFree, INFINITE);
+}
+
+
+// Append a delta to the current slot, passing the slot on if it is full.
+void StreamPutDelta(WriteStream *pStream, unsigned __int32 *puiLen, unsigned __int64 ui64Delta)
+{
+	// No room for another long signal.
+	if (*puiLen + 5 > STREAM_CHUNK_SIZE)
+	{
+		StreamNextSlot(pStream, *puiLen);
+		*puiLen = 0;
 	}
 
-	// Keep space for leading number of deltas.
-	*piCaptureLen = 5;
+	*puiLen += PutDelta(pStream->pucSlot[pStream->uiHead] + *puiLen, ui64Delta);
+}
+
+
+// Reader thread of the streaming write:
+// Reads the signals from the CAP file, converts them and puts them into the ring.
+DWORD WINAPI StreamReaderThread(LPVOID lpParam)
+{
+	WriteStream      *pStream = (WriteStream *) lpParam;
+	unsigned __int64 ui64Deltas[SIGNAL_BATCH_SIZE];
+	unsigned __int8  *pucSlot;
+	unsigned __int32 uiLen;
+	__int32          FuncRes = CAP_Status_OK, iNumSignals, i;
+	BOOL             FirstSignal = TRUE;
+
+	WaitForSingleObject(pStream->hSlotFree, INFINITE);
+	pucSlot = pStream->pucSlot[pStream->uiHead];
+
+	// Send number of delta bytes first.
+	pucSlot[0] = 0x80;
+	pucSlot[1] = (pStream->uiDeltaBytes >> 24) & 0xff;
+	pucSlot[2] = (pStream->uiDeltaBytes >> 16) & 0xff;
+	pucSlot[3] = (pStream->uiDeltaBytes >>  8) & 0xff;
+	pucSlot[4] =  pStream->uiDeltaBytes & 0xff;
+	uiLen = 5;
 
 	// Read timestamps, convert to 16MHz hardware resolution if necessary.
-	while ((FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+	while (!pStream->bAbort && ((FuncRes = CAP_ReadSignals(pStream->hCAP, ui64Deltas, SIGNAL_BATCH_SIZE, &iNumSignals, NULL)) == CAP_Status_OK))
 	{
-		if (FirstSignal)
+		for (i = 0; i < iNumSignals; i++)
 		{
-			// Replace first timestamp with start delay if requested
-			if (StartDelayActivated == TRUE)
-			{
-				if (StartDelay == 0)
-					ui64Delta = 1600; // 100us minimum
-				else
-				{
-					ui64Delta = StartDelay;
-					ui64Delta *= 15625; //16000000;
-					ui64Delta <<= 10;
-				}
-			}
+			StreamPutDelta(pStream, &uiLen, ConvertSignal(ui64Deltas[i], FirstSignal, FALSE));
 			FirstSignal = FALSE;
 		}
-		else
-			if (CAP_Precision == 1) ui64Delta <<= 4; // Convert from 1MHz to 16MHz.
+	}
 
-		if (ui64Delta < ShortWarning) printf("Warning - Short signal length detected: 0x%.10X\n", ui64Delta);
-		if (ui64Delta < ShortError)
+	if (!pStream->bAbort)
+	{
+		if (FuncRes == CAP_Status_Error_Reading_data)
+		{
+			CAP_OutputError(FuncRes);
+			pStream->bReadError = TRUE;
+		}
+		else
 		{
-			printf("Warning - Replaced by minimum signal length.\n");
-			ui64Delta = ShortError;
+			// Add final timestamp for stop delay
+			if (StopDelayActivated == TRUE)
+				StreamPutDelta(pStream, &uiLen, StopDelaySignal());
+
+			// Pass the last slot on.
+			if (uiLen > 0)
+				StreamNextSlot(pStream, uiLen);
 		}
+	}
 
-		ui64TotalTapeTime += ui64Delta;
+	// End marker.
+	pStream->uiSlotLen[pStream->uiHead] = 0;
+	pStream->uiHead = (pStream->uiHead + 1) % STREAM_RING_SLOTS;
+	ReleaseSemaphore(pStream->hSlotFilled, 1, NULL);
+
+	return 0;
+}
+
+
+// Write callback of the streaming write, called by the plugin for every chunk.
+//   Return values:
+//   >0: number of bytes put into Data
+//    0: all data written
+//   -1: abort write (Ctrl-C or CAP file could not be read)
+int StreamWriteCallback(void *Context, unsigned char *Data, unsigned int Length)
+{
+	WriteStream      *pStream = (WriteStream *) Context;
+	unsigned __int32 uiLen;
+
+	if (AbortTapeOps)
+		return -1;
+
+	if (pStream->bEndSeen)
+		return 0;
 
-		if (ui64Delta < 0x8000)
+	// Take the next slot from the ring.
+	if (pStream->uiSlotPos == 0)
+	{
+		WaitForSingleObject(pStream->hSlotFilled, INFINITE);
+		if (pStream->uiSlotLen[pStream->uiTail] == 0)
 		{
-			// Short signal (<2ms)
-			(*piCaptureLen) += 2;
+			pStream->bEndSeen = TRUE;
+			return pStream->bReadError ? -1 : 0;
 		}
-		else
+	}
+
+	uiLen = pStream->uiSlotLen[pStream->uiTail] - pStream->uiSlotPos;
+	if (uiLen > Length)
+		uiLen = Length;
+
+	memcpy(Data, pStream->pucSlot[pStream->uiTail] + pStream->uiSlotPos, uiLen);
+	pStream->uiSlotPos += uiLen;
+
+	// Give the slot back to the reader thread when it is used up.
+	if (pStream->uiSlotPos == pStream->uiSlotLen[pStream->uiTail])
+	{
+		pStream->uiSlotPos = 0;
+		pStream->uiTail = (pStream->uiTail + 1) % STREAM_RING_SLOTS;
+		ReleaseSemaphore(pStream->hSlotFree, 1, NULL);
+	}
+
+	return uiLen;
+}
+
+
+// Set up the ring and start the reader thread of the streaming write.
+__int32 StreamStart(WriteStream *pStream, HANDLE hCAP, unsigned __int32 uiDeltaBytes)
+{
+	DWORD    dwThreadId;
+	__int32  i;
+
+	memset(pStream, 0, sizeof(*pStream));
+	pStream->hCAP = hCAP;
+	pStream->uiDeltaBytes = uiDeltaBytes;
+
+	for (i = 0; i < STREAM_RING_SLOTS; i++)
+	{
+		pStream->pucSlot[i] = malloc(STREAM_CHUNK_SIZE);
+		if (pStream->pucSlot[i] == NULL)
 		{
-			// Long signal (>=2ms)
-			(*piCaptureLen) += 5;
-			pucTapeBuffer[*piCaptureLen-5] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
-			pucTapeBuffer[*piCaptureLen-4] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
-			pucTapeBuffer[*piCaptureLen-3] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
+			printf("Error: Could not allocate memory for write data.\n");
+			return -1;
 		}
-		pucTapeBuffer[*piCaptureLen-2] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
-		pucTapeBuffer[*piCaptureLen-1] = (unsigned __int8) (ui64Delta & 0xff);
 	}
 
-	if (FuncRes == CAP_Status_Error_Reading_data)
+	pStream->pucBuffer = malloc(STREAM_CHUNK_SIZE);
+	if (pStream->pucBuffer == NULL)
 	{
-		CAP_OutputError(FuncRes);
+		printf("Error: Could not allocate memory for write data.\n");
 		return -1;
 	}
 
-	// Add final timestamp for stop delay
-	if (StopDelayActivated == TRUE)
+	pStream->hSlotFree = CreateSemaphore(NULL, STREAM_RING_SLOTS, STREAM_RING_SLOTS, NULL);
+	pStream->hSlotFilled = CreateSemaphore(NULL, 0, STREAM_RING_SLOTS, NULL);
+	if ((pStream->hSlotFree == NULL) || (pStream->hSlotFilled == NULL))
 	{
-		if (StopDelay == 0xffffffff)
-			ui64Delta = 0xffffffffff;
-		else
-		{
-			ui64Delta = StopDelay;
-			ui64Delta *= 15625;
-			ui64Delta <<= 10; //16000000;
-		}
+		printf("Error: Could not create semaphores.\n");
+		return -1;
+	}
 
-		ui64TotalTapeTime += ui64Delta;
+	pStream->hThread = CreateThread(NULL, 0, StreamReaderThread, pStream, 0, &dwThreadId);
+	if (pStream->hThread == NULL)
+	{
+		printf("Error: Could not create reader thread.\n");
+		return -1;
+	}
+
+	return 0;
+}
 
-		if (ui64Delta < 0x8000)
+
+// Stop the reader thread and release the ring.
+//   Return values:
+//    0: the whole CAP file was read
+//   -1: an error occurred
+__int32 StreamStop(WriteStream *pStream)
+{
+	__int32 i;
+
+	if (pStream->hThread != NULL)
+	{
+		// Let the reader thread run into the end marker, if the write stopped early.
+		pStream->bAbort = TRUE;
+		if (pStream->uiSlotPos != 0)
 		{
-			// Short signal (<2ms)
-			(*piCaptureLen) += 2;
+			pStream->uiSlotPos = 0;
+			pStream->uiTail = (pStream->uiTail + 1) % STREAM_RING_SLOTS;
+			ReleaseSemaphore(pStream->hSlotFree, 1, NULL);
 		}
-		else
+		while (!pStream->bEndSeen)
 		{
-			// Long signal (>=2ms)
-			(*piCaptureLen) += 5;
-			pucTapeBuffer[*piCaptureLen-5] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
-			pucTapeBuffer[*piCaptureLen-4] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
-			pucTapeBuffer[*piCaptureLen-3] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
+			WaitForSingleObject(pStream->hSlotFilled, INFINITE);
+			if (pStream->uiSlotLen[pStream->uiTail] == 0)
+				pStream->bEndSeen = TRUE;
+			else
+				ReleaseSemaphore(pStream->hSlotFree, 1, NULL);
+			pStream->uiTail = (pStream->uiTail + 1) % STREAM_RING_SLOTS;
 		}
-		pucTapeBuffer[*piCaptureLen-2] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
-		pucTapeBuffer[*piCaptureLen-1] = (unsigned __int8) (ui64Delta & 0xff);
+
+		WaitForSingleObject(pStream->hThread, INFINITE);
+		CloseHandle(pStream->hThread);
 	}
 
-	// Send number of delta bytes first.
-	pucTapeBuffer[0] = 0x80;
-	pucTapeBuffer[1] = ((*piCaptureLen-5) >> 24) & 0xff;
-	pucTapeBuffer[2] = ((*piCaptureLen-5) >> 16) & 0xff;
-	pucTapeBuffer[3] = ((*piCaptureLen-5) >>  8) & 0xff;
-	pucTapeBuffer[4] =  (*piCaptureLen-5) & 0xff;
+	if (pStream->hSlotFree != NULL) CloseHandle(pStream->hSlotFree);
+	if (pStream->hSlotFilled != NULL) CloseHandle(pStream->hSlotFilled);
 
-	// Calculate tape recording length.
-	uiTotalTapeTimeSeconds = (unsigned __int32) ((ui64TotalTapeTime >> 10)/15625); //16000000;
-	OutputTapeLength(uiTotalTapeTimeSeconds);
+	for (i = 0; i < STREAM_RING_SLOTS; i++)
+		if (pStream->pucSlot[i] != NULL) free(pStream->pucSlot[i]);
 
-	return 0;
+	if (pStream->pucBuffer != NULL) free(pStream->pucBuffer);
+
+	return pStream->bReadError ? -1 : 0;
 }
 
 
-__int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32 uiCaptureLen)
+__int32 WriteTape(CBM_FILE fd, HANDLE hCAP, unsigned __int32 uiDeltaBytes)
 {
 	__int32         Status, BytesRead, BytesWritten, FuncRes;
 	unsigned __int8 WriteConfig, WriteConfig2;
+	WriteStream     Stream;
 
 	// Check abort flag.
 	if (AbortTapeOps)
@@ -355,7 +600,7 @@ __int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32
 				printf("%d\n", Status);
 		return -1;
 	}
-	if (Status != TapeFirmwareVersion)
+	if (Status < TapeFirmwareVersion)
 	{
 		printf("\nError [get_ver]: ");
 		OutputError(Tape_Status_ERROR_Wrong_Tape_Firmware);
@@ -571,11 +816,19 @@ __int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32
 	//   - Tape_Status_ERROR_Sense_Not_On_Record
 	//   - Tape_Status_ERROR_Device_Not_Configured
 	//   - Tape_Status_ERROR_Device_Disconnected
+	//   - Tape_Status_ERROR_Write_Underrun
 	//   FuncRes values concerning tape mode:
 	//   - XUM1541_Error_NoTapeSupport
 	//   - XUM1541_Error_NoDiskTapeMode
 	//   - XUM1541_Error_TapeCmdInDiskMode
-	FuncRes = cbm_tap_start_write(fd, pucTapeBuffer, uiCaptureLen, &Status, &BytesWritten);
+	if (StreamStart(&Stream, hCAP, uiDeltaBytes) == -1)
+	{
+		StreamStop(&Stream);
+		return -1;
+	}
+	FuncRes = cbm_tap_start_write_stream(fd, Stream.pucBuffer, STREAM_CHUNK_SIZE, StreamWriteCallback, &Stream, &Status, &BytesWritten);
+	if (StreamStop(&Stream) == -1)
+		return -1;
 	if (FuncRes < 0)
 	{
 		printf("\nReturned error [write]: ");
@@ -590,7 +843,7 @@ __int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32
 			printf("%d\n", Status);
 		return -1;
 	}
-	if (uiCaptureLen != BytesWritten)
+	if ((5 + uiDeltaBytes) != BytesWritten)
 	{
 		printf("\nError [write]: Short write.\n");
 		return -1;
@@ -638,11 +891,10 @@ BOOL BreakHandler(DWORD fdwCtrlType)
 //   -1: an error occurred
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
-	HANDLE          hCAP;
-	unsigned __int8 *pucTapeBuffer = NULL;
-	__int8          filename[_MAX_PATH];
-	__int32         iCaptureLen = 0, iTapeBufferSize;
-	__int32         FuncRes, RetVal = -1;
+	HANDLE           hCAP = NULL;
+	__int8           filename[_MAX_PATH];
+	unsigned __int32 uiDeltaBytes = 0;
+	__int32          FuncRes, RetVal = -1;
 
 	printf("\ntapwrite v1.00 - Commodore 1530/1531 tape mastering software\n");
 	printf("Copyright 2012 Arnd Menge\n\n");
@@ -667,19 +919,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 		goto exit;
 	}
 
-	// Allocate memory for tape image.
-	if (AllocateImageBuffer(hCAP, &pucTapeBuffer, &iTapeBufferSize) == -1)
-	{
-		CAP_CloseFile(&hCAP);
-		goto exit;
-	}
-
-	// Read tape image into memory.
-	RetVal = ReadCaptureFile(hCAP, pucTapeBuffer, &iCaptureLen);
-
-	CAP_CloseFile(&hCAP);
-
-	if (RetVal == -1)
+	// Check tape image, the signals are read again while writing.
+	if (ScanCaptureFile(hCAP, &uiDeltaBytes) == -1)
 		goto exit;
 
 	EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
@@ -694,7 +935,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 	fd_Initialized = TRUE;
 	LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
 
-	RetVal = WriteTape(fd, pucTapeBuffer, iCaptureLen);
+	RetVal = WriteTape(fd, hCAP, uiDeltaBytes);
 
 	EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
 	cbm_driver_close(fd);
@@ -704,7 +945,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     exit:
 	DeleteCriticalSection(&CritSec_fd);
 	DeleteCriticalSection(&CritSec_BreakHandler);
-   	if (pucTapeBuffer != NULL) free(pucTapeBuffer);
+   	if (hCAP != NULL) CAP_CloseFile(&hCAP);
    	printf("\n");
    	return RetVal;
 }
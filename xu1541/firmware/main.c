@@ -28,6 +28,7 @@ typedef uchar byte_t;
 #define MODE_PP        3
 #define MODE_P2        4
 #define MODE_EEPROM    5
+#define MODE_PIPE      6
 static uchar io_mode;
 
 #include "xu1541.h"
@@ -115,7 +116,26 @@ uchar	usbFunctionSetup(uchar data[8], byte_t *replyBuf) {
 
   case XU1541_GET_RESULT:
     xu1541_get_result(replyBuf);
-    return 2;
+    return 4;
+
+  case XU1541_PIPE_READ:
+  case XU1541_PIPE_WRITE:
+    /* do what is still queued before taking the next chunk. This runs
+       the whole IEC transfer of the previous chunk from within the
+       setup request, so USB is not served meanwhile and the host's
+       control transfer is NAKed for up to USB_TIMEOUT. The host side
+       sends the chunk again if it times out. */
+    xu1541_handle();
+
+    if(data[1] == XU1541_PIPE_READ) {
+      io_mode = MODE_PIPE;
+      xu1541_prepare_pipe_read(data[4]);
+      return 0xff;
+    }
+
+    io_mode = MODE_ORIGINAL;
+    xu1541_prepare_pipe_write(data[2], data[4]);
+    return(data[2]?0xff:0x00);
 
   case XU1541_READ:
     io_mode = MODE_ORIGINAL;
@@ -309,6 +329,10 @@ uchar usbFunctionRead( uchar *data, uchar len )
       rv = xu1541_read(data, len);
       break;
 
+    case MODE_PIPE:
+      rv = xu1541_pipe_read(data, len);
+      break;
+
     case MODE_S1:
       rv = s1_read(data, len);
       break;
@@ -35,6 +35,12 @@
 uchar io_buffer[XU1541_IO_BUFFER_SIZE];
 uchar io_buffer_fill, io_request, io_offset, io_result;
 
+/* pipelined transfers: length of the next read, number of the current */
+/* read chunk, last read was short, dropping a failed write, state is */
+/* to be sent first, bytes written since the first chunk */
+static uchar io_next, io_seq, io_short, io_drop, io_header;
+static ushort io_done;
+
 /* fast conversion between logical and physical mapping */
 static const uchar iec2hw_table[] PROGMEM = {
   0,
@@ -405,6 +411,7 @@ void xu1541_handle(void) {
     DEBUGF("h-wr %d\n", io_buffer_fill);
     LED_ON();
     io_result = cbm_raw_write(io_buffer, io_buffer_fill, 0, 0);
+    io_done += io_result;
     LED_OFF();
 
     io_request = XU1541_IO_RESULT;
@@ -418,6 +425,7 @@ void xu1541_handle(void) {
     DEBUGF("h-rd %d\n", io_buffer_fill);
 
     io_offset = 0;
+    io_short = 1;
 
     LED_ON();
 
@@ -507,6 +515,9 @@ void xu1541_handle(void) {
 
     } while(received < io_buffer_fill && ok && !eoi);
 
+    /* only a full chunk without eoi may be followed by the next one */
+    io_short = !ok || eoi || (received != io_buffer_fill);
+
     if(!ok) {
       EVENT(EVENT_READ_ERROR);
       DEBUGF("read io err\n");
@@ -530,6 +541,7 @@ void xu1541_request_read(uchar len) {
   /* store request */
   io_buffer_fill = len;   // save requested lenght
   io_request = XU1541_IO_READ;
+  io_seq = 0;
 }
 
 uchar xu1541_read(uchar *data, uchar len) {
@@ -551,23 +563,72 @@ uchar xu1541_read(uchar *data, uchar len) {
     len = 0;
 
   /* stop after last byte has been transferred */
-  if(!io_buffer_fill)
+  if(!io_buffer_fill) {
     io_request = XU1541_IO_IDLE;
 
+    /* pipelined read: go on with the next chunk right away */
+    if(io_next && !io_short) {
+      io_buffer_fill = io_next;
+      io_request = XU1541_IO_READ;
+      io_seq++;
+    }
+    io_next = 0;
+  }
+
   return len;
 }
 
+void xu1541_prepare_pipe_read(uchar next) {
+  io_next = next;
+  io_header = 1;
+}
+
+/* pipelined read: state and chunk number first, data only if done */
+uchar xu1541_pipe_read(uchar *data, uchar len) {
+  uchar hdr = 0;
+
+  if(io_header) {
+    io_header = 0;
+    data[0] = io_request;
+    data[1] = io_seq;
+
+    /* short packet ends the transfer, host asks again */
+    if(io_request != XU1541_IO_READ_DONE)
+      return 2;
+
+    data += 2;
+    len -= 2;
+    hdr = 2;
+  }
+
+  return hdr + xu1541_read(data, len);
+}
+
 void xu1541_prepare_write(uchar len) {
   io_request = XU1541_IO_WRITE_PREPARED;
   io_offset = 0;
   io_buffer_fill = len;
+  io_drop = 0;
+}
+
+/* pipelined write: the previous chunk has been written already */
+void xu1541_prepare_pipe_write(uchar len, uchar flags) {
+  if(flags & XU1541_PIPE_FIRST)
+    io_done = 0;
+  else if((io_request == XU1541_IO_RESULT) && !io_result) {
+    /* a chunk failed, take the rest from USB but don't write it */
+    io_drop = 1;
+    return;
+  }
+
+  xu1541_prepare_write(len);
 }
 
 /* write to buffer */
 uchar xu1541_write(uchar *data, uchar len) {
   if(io_request != XU1541_IO_WRITE_PREPARED) {
     DEBUGF("no wr (%d)\n", io_request);
-    return 0;
+    return io_drop ? len : 0;
   }
 
   DEBUGF("st %d\n", len);
@@ -588,6 +649,7 @@ void xu1541_get_result(unsigned char *data) {
 
   data[0] = io_request;
   data[1] = io_result;
+  *(ushort*)(data+2) = io_done;
 
   DEBUGF("r %d/%d\n", data[0], data[1]);
 
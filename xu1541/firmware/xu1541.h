@@ -64,6 +64,9 @@ extern void  xu1541_prepare_write(uchar len);
 extern uchar xu1541_write(uchar *data, uchar len);
 extern void  xu1541_handle(void);
 extern void  xu1541_get_result(uchar *data);
+extern uchar xu1541_pipe_read(uchar *data, uchar len);
+extern void  xu1541_prepare_pipe_read(uchar next);
+extern void  xu1541_prepare_pipe_write(uchar len, uchar flags);
 
 /* low level io on single lines */
 extern uchar xu1541_wait(uchar line, uchar state);
@@ -26,10 +26,11 @@
 #define XU1541_CAP_PROTO_S2          0x0020   /* supports serial2 protocol */
 #define XU1541_CAP_PROTO_PP          0x0040   /* supports parallel protocol */
 #define XU1541_CAP_PROTO_P2          0x0080   /* supports parallel2 protocol */
+#define XU1541_CAP_PIPELINE          0x0100   /* supports pipelined read/write */
 
 #define XU1541_CAP_BOOTLOADER        0x4000   /* device is in bootloader mode */
 
-#define XU1541_CAPABILIIES  (XU1541_CAP_CBM | XU1541_CAP_LL | XU1541_CAP_PP  | XU1541_CAP_PROTO_S1 | XU1541_CAP_PROTO_S2 | XU1541_CAP_PROTO_PP | XU1541_CAP_PROTO_P2)
+#define XU1541_CAPABILIIES  (XU1541_CAP_CBM | XU1541_CAP_LL | XU1541_CAP_PP  | XU1541_CAP_PROTO_S1 | XU1541_CAP_PROTO_S2 | XU1541_CAP_PROTO_PP | XU1541_CAP_PROTO_P2 | XU1541_CAP_PIPELINE)
 
 #define XU1541_READ                  1
 #define XU1541_WRITE                 2
@@ -69,6 +70,16 @@
 /* start the flash bootloader */
 #define XU1541_FLASH                 (XU1541_IOCTL + 22)
 
+/* from version x.19 on, pipelined read/write (XU1541_CAP_PIPELINE): */
+/* PIPE_READ returns state and chunk number in front of the data and */
+/* starts reading the next chunk (wIndex bytes) right after this one */
+/* has been fetched. PIPE_WRITE may follow the previous chunk without */
+/* waiting for its result, a failed chunk makes the device drop the */
+/* rest. GET_RESULT then also returns the number of bytes written. */
+#define XU1541_PIPE_READ             (XU1541_IOCTL + 23)
+#define XU1541_PIPE_WRITE            (XU1541_IOCTL + 24)
+#define XU1541_PIPE_FIRST            0x01   /* PIPE_WRITE wIndex: first chunk */
+
 /* special protocol codes begin at 32 */
 #define XU1541_S1                    (32)
 #define XU1541_S2                    (XU1541_S1 + 1)
@@ -0,0 +1,62 @@
+/*
+ * Board interface routines for the host simulation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include "xum1541.h"
+
+// Period of the board timer, like the 100 ms timer on the real boards
+#define BOARD_TIMER_NS  SIM_MS(100)
+
+static uint8_t statusValue;
+static uint64_t timerNext;
+
+// Initialize the board (timer)
+void
+board_init(void)
+{
+    timerNext = sim_now + BOARD_TIMER_NS;
+}
+
+// Initialize the board IO ports for IEC mode
+void
+board_init_iec(void)
+{
+    iec_release(IO_OUTPUT_MASK);
+    sim_fw_pp_out = false;
+}
+
+uint8_t
+board_get_status()
+{
+    return statusValue;
+}
+
+// Status indicators, only kept for the simulated host to look at.
+void
+board_set_status(uint8_t status)
+{
+    statusValue = status;
+}
+
+void
+board_update_display()
+{
+}
+
+/*
+ * Signal that the board_update_display() should be called if the timer
+ * has fired (every ~100 ms of simulated time).
+ */
+bool
+board_timer_fired()
+{
+    if (sim_now < timerNext)
+        return false;
+
+    timerNext = sim_now + BOARD_TIMER_NS;
+    return true;
+}
@@ -0,0 +1,139 @@
+/*
+ * Board interface for the host simulation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _BOARD_SIM_H
+#define _BOARD_SIM_H
+
+#include "sim/sim.h"
+
+// Initialize the board (timer, indicators)
+void board_init(void);
+// Initialize the IO ports for IEC mode
+void board_init_iec(void);
+
+/*
+ * Mapping of iec lines to the simulated bus. The IO pins are the same
+ * bits as the IEC_* specifiers, and a set bit pulls the line.
+ */
+#define IO_DATA         _BV(0)
+#define IO_CLK          _BV(1)
+#define IO_ATN          _BV(2)
+#define IO_RESET        _BV(3)
+#define IO_SRQ          _BV(7)
+#define IO_OUTPUT_MASK  (IO_ATN | IO_CLK | IO_DATA | IO_RESET | IO_SRQ)
+
+// The simulated drive knows the 1571 fast serial protocol
+#define SRQ_NIB_SUPPORT 1
+
+#define INLINE          static inline __attribute__((always_inline))
+
+/*
+ * Routines for getting/setting individual IEC lines and parallel port.
+ * Each costs the cycles of the port access on the AVR, and the clock
+ * advances before reading so the other side gets a chance to react.
+ */
+
+INLINE void
+iec_set(uint8_t line)
+{
+    sim_fw_lines |= line;
+    sim_cycles(SIM_IO_CYCLES);
+}
+
+INLINE void
+iec_release(uint8_t line)
+{
+    if ((line & sim_fw_lines & IO_SRQ) != 0)
+        sim_srq_clock();
+    sim_fw_lines &= ~line;
+    sim_cycles(SIM_IO_CYCLES);
+}
+
+INLINE void
+iec_set_release(uint8_t s, uint8_t r)
+{
+    if ((r & sim_fw_lines & IO_SRQ) != 0)
+        sim_srq_clock();
+    sim_fw_lines = (sim_fw_lines & ~r) | s;
+    sim_cycles(SIM_IO_CYCLES);
+}
+
+INLINE uint8_t
+iec_get(uint8_t line)
+{
+    sim_cycles(SIM_IO_CYCLES);
+    return (sim_bus_lines() & line) != 0 ? 1 : 0;
+}
+
+INLINE uint8_t
+iec_pp_read(void)
+{
+    sim_fw_pp_out = false;
+    sim_cycles(SIM_IO_CYCLES);
+    return sim_pp_value();
+}
+
+INLINE void
+iec_pp_write(uint8_t val)
+{
+    sim_fw_pp = val;
+    sim_fw_pp_out = true;
+    sim_cycles(SIM_IO_CYCLES);
+}
+
+INLINE uint8_t
+iec_poll_pins(void)
+{
+    sim_cycles(SIM_IO_CYCLES);
+    return ~sim_bus_lines();
+}
+
+// Fast serial, the same as on the ZoomFloppy
+INLINE uint8_t
+iec_srq_read(void)
+{
+    uint8_t i, data;
+
+    data = 0;
+    for (i = 8; i != 0; --i) {
+        while (!iec_get(IO_SRQ))
+            ;
+        while (iec_get(IO_SRQ))
+            ;
+        DELAY_US(0.375);
+        data = (data << 1) | (iec_get(IO_DATA) ? 0 : 1);
+    }
+
+    return data;
+}
+
+INLINE void
+iec_srq_write(uint8_t data)
+{
+    uint8_t i;
+
+    for (i = 8; i != 0; --i) {
+        if ((data & 0x80))
+            iec_release(IO_DATA);
+        else
+            iec_set(IO_DATA);
+        iec_set(IO_SRQ);
+        data <<= 1;
+        DELAY_US(0.3);
+        iec_release(IO_SRQ);
+        DELAY_US(0.935);
+    }
+}
+
+// Status indicators (printed when they change)
+uint8_t board_get_status(void);
+void board_set_status(uint8_t status);
+void board_update_display(void);
+bool board_timer_fired(void);
+
+#endif // _BOARD_SIM_H
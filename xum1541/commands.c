@@ -23,6 +23,10 @@ typedef void (*Write2Fn_t)(uint8_t *data);
 static uint16_t usbDataLen;
 static uint8_t usbDataDir = XUM_DATA_DIR_NONE;
 
+// Where the transfers go, see usbSetIoMode().
+static uint8_t usbIoMode = USB_IO_HOST;
+static uint8_t *usbLocalPtr, *usbLocalBuf;
+
 // Are we in the middle of a command sequence (XUM1541_INIT .. SHUTDOWN)?
 #define XUM1541_CMD_IN_PROGRESS 0x80
 static uint8_t cmdSeqInProgress;
@@ -79,9 +83,28 @@ cbm_init(void)
     return protoFn;
 }
 
+/*
+ * Let the firmware run the protocol handlers for its own purposes.
+ * With USB_IO_LOCAL, transfers go to or come from buf instead of the
+ * host. With USB_IO_NESTED, they are part of a transfer to the host
+ * that is already running, so usbInitIo()/usbIoDone() do nothing.
+ */
+void
+usbSetIoMode(uint8_t mode, uint8_t *buf)
+{
+    usbIoMode = mode;
+    usbLocalBuf = buf;
+}
+
 void
 usbInitIo(uint16_t len, uint8_t dir)
 {
+    if (usbIoMode == USB_IO_LOCAL) {
+        usbLocalPtr = usbLocalBuf;
+        return;
+    } else if (usbIoMode == USB_IO_NESTED)
+        return;
+
 #ifdef DEBUG
     if (usbDataDir != XUM_DATA_DIR_NONE)
         DEBUGF(DBG_ERROR, "ERR: usbInitIo left in bad state %d\n", usbDataDir);
@@ -113,6 +136,9 @@ usbInitIo(uint16_t len, uint8_t dir)
 void
 usbIoDone(void)
 {
+    if (usbIoMode != USB_IO_HOST)
+        return;
+
     // Finalize any outstanding transactions
     if (usbDataDir == ENDPOINT_DIR_IN) {
         /*
@@ -149,6 +175,10 @@ usbIoDone(void)
 int8_t
 usbSendByte(uint8_t data)
 {
+    if (usbIoMode == USB_IO_LOCAL) {
+        *usbLocalPtr++ = data;
+        return doDeviceReset ? -1 : 0;
+    }
 
 #ifdef DEBUG
     if (usbDataDir != ENDPOINT_DIR_IN) {
@@ -180,6 +210,10 @@ usbSendByte(uint8_t data)
 int8_t
 usbRecvByte(uint8_t *data)
 {
+    if (usbIoMode == USB_IO_LOCAL) {
+        *data = *usbLocalPtr++;
+        return doDeviceReset ? -1 : 0;
+    }
 
 #ifdef DEBUG
     if (usbDataDir != ENDPOINT_DIR_OUT) {
@@ -212,18 +246,91 @@ usbRecvByte(uint8_t *data)
     return 0;
 }
 
+/*
+ * Block transfers for the protocol loops. usbSendByte()/usbRecvByte()
+ * ask the endpoint and check for a reset with every byte, which costs
+ * more than some of the protocols spend on the bus. These just move
+ * the byte and count down the endpoint bank. Only when a bank is full
+ * (or used up) is it handed over and the next one waited for. With the
+ * double banked endpoints, the bus protocol goes on while the host
+ * takes the previous bank. A reset is noticed at the next bank.
+ *
+ * They only work on transfers to and from the host (USB_IO_HOST).
+ * Otherwise usbInitBlockIo() returns false and the caller has to use
+ * usbSendByte()/usbRecvByte().
+ */
+uint8_t usbBankLeft;
+
+bool
+usbInitBlockIo(uint16_t len, uint8_t dir)
+{
+    usbInitIo(len, dir);
+    if (usbIoMode != USB_IO_HOST)
+        return false;
+    if (dir == ENDPOINT_DIR_IN) {
+        usbBankLeft = XUM_ENDPOINT_BULK_SIZE;
+    } else {
+        // The data of the current bank counts as read from the start.
+        usbBankLeft = Endpoint_BytesInEndpoint();
+        usbDataLen -= usbBankLeft;
+    }
+    return true;
+}
+
+void
+usbBlockIoDone(void)
+{
+    // Let usbIoDone() discard what is left of the current OUT bank.
+    if (usbIoMode == USB_IO_HOST && usbDataDir == ENDPOINT_DIR_OUT)
+        usbDataLen += usbBankLeft;
+    usbIoDone();
+}
+
+// Hand the full IN bank to the host and wait for a free one.
+int8_t
+usbNextInBank(void)
+{
+    Endpoint_ClearIN();
+    usbDataLen -= XUM_ENDPOINT_BULK_SIZE;
+    usbBankLeft = XUM_ENDPOINT_BULK_SIZE;
+    while (!Endpoint_IsReadWriteAllowed() && !doDeviceReset)
+        ;
+    if (doDeviceReset) {
+        DEBUGF(DBG_ERROR, "sndrst\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Release the used up OUT bank and wait for the host to fill the next.
+int8_t
+usbNextOutBank(void)
+{
+    Endpoint_ClearOUT();
+    while (!Endpoint_IsReadWriteAllowed() && !doDeviceReset)
+        ;
+    if (doDeviceReset) {
+        DEBUGF(DBG_ERROR, "rcvrst\n");
+        usbBankLeft = 0;
+        return -1;
+    }
+    usbBankLeft = Endpoint_BytesInEndpoint();
+    usbDataLen -= usbBankLeft;
+    return 0;
+}
+
 static uint8_t
 ioReadLoop(ReadFn_t readFn, uint16_t len)
 {
     uint8_t data;
 
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbInitBlockIo(len, ENDPOINT_DIR_IN);
     while (len-- != 0) {
         data = readFn();
-        if (usbSendByte(data) != 0)
+        if (usbSendBlockByte(data) != 0)
             break;
     }
-    usbIoDone();
+    usbBlockIoDone();
     return 0;
 }
 
@@ -232,13 +339,13 @@ ioWriteLoop(WriteFn_t writeFn, uint16_t len)
 {
     uint8_t data;
 
-    usbInitIo(len, ENDPOINT_DIR_OUT);
+    usbInitBlockIo(len, ENDPOINT_DIR_OUT);
     while (len-- != 0) {
-        if (usbRecvByte(&data) != 0)
+        if (usbRecvBlockByte(&data) != 0)
             break;
         writeFn(data);
     }
-    usbIoDone();
+    usbBlockIoDone();
     return 0;
 }
 
@@ -247,14 +354,14 @@ ioRead2Loop(Read2Fn_t readFn, uint16_t len)
 {
     uint8_t data[2];
 
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbInitBlockIo(len, ENDPOINT_DIR_IN);
     while (len != 0) {
         readFn(data);
-        if (usbSendByte(data[0]) != 0 || usbSendByte(data[1]) != 0)
+        if (usbSendBlockByte(data[0]) != 0 || usbSendBlockByte(data[1]) != 0)
             break;
         len -= 2;
     }
-    usbIoDone();
+    usbBlockIoDone();
     return 0;
 }
 
@@ -263,14 +370,14 @@ ioWrite2Loop(Write2Fn_t writeFn, uint16_t len)
 {
     uint8_t data[2];
 
-    usbInitIo(len, ENDPOINT_DIR_OUT);
+    usbInitBlockIo(len, ENDPOINT_DIR_OUT);
     while (len != 0) {
-        if (usbRecvByte(&data[0]) != 0 || usbRecvByte(&data[1]) != 0)
+        if (usbRecvBlockByte(&data[0]) != 0 || usbRecvBlockByte(&data[1]) != 0)
             break;
         writeFn(data);
         len -= 2;
     }
-    usbIoDone();
+    usbBlockIoDone();
     return 0;
 }
 
@@ -285,7 +392,7 @@ ioReadNibLoop(uint16_t len, bool earlyExit)
         return 0;
 
     suppressNibCmd = false;
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbInitBlockIo(len, ENDPOINT_DIR_IN);
     iec_release(IO_DATA);
 
     /*
@@ -306,7 +413,7 @@ ioReadNibLoop(uint16_t len, bool earlyExit)
         }
 
         // Send the byte via USB
-        if (usbSendByte(data) != 0)
+        if (usbSendBlockByte(data) != 0)
             break;
 
         // If requested, terminate early on seeing a special marker.
@@ -314,7 +421,7 @@ ioReadNibLoop(uint16_t len, bool earlyExit)
         if (earlyExit && data == 0x55)
             break;
     }
-    usbIoDone();
+    usbBlockIoDone();
 
     // All bytes read ok so read the final dummy byte
     nib_parburst_read();
@@ -332,7 +439,7 @@ ioWriteNibLoop(uint16_t len)
         return 0;
 
     suppressNibCmd = false;
-    usbInitIo(len, ENDPOINT_DIR_OUT);
+    usbInitBlockIo(len, ENDPOINT_DIR_OUT);
     iec_release(IO_DATA);
 
     /*
@@ -346,7 +453,7 @@ ioWriteNibLoop(uint16_t len)
 
     for (i = 0; i < len; i++) {
         // Get the byte via USB
-        if (usbRecvByte(&data) != 0)
+        if (usbRecvBlockByte(&data) != 0)
             break;
 
         // Write a byte to the parport
@@ -363,7 +470,7 @@ ioWriteNibLoop(uint16_t len)
     nib_write_handshaked(0, i & 1);
     nib_parburst_read();
 
-    usbIoDone();
+    usbBlockIoDone();
     return 0;
 }
 
@@ -379,7 +486,7 @@ ioReadNibSrqLoop(uint16_t len)
         return 0;
 
     suppressNibCmd = false;
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbInitBlockIo(len, ENDPOINT_DIR_IN);
     iec_release(IO_SRQ | IO_CLK | IO_DATA | IO_ATN);
 
     /*
@@ -404,10 +511,10 @@ ioReadNibSrqLoop(uint16_t len)
             iec_release(IO_CLK);
 
         // Send the byte to the host via USB
-        if (usbSendByte(data) != 0)
+        if (usbSendBlockByte(data) != 0)
             break;
     }
-    usbIoDone();
+    usbBlockIoDone();
 
     // All bytes read ok so read the final dummy byte
     nib_srqburst_read();
@@ -426,7 +533,7 @@ ioWriteNibSrqLoop(uint16_t len)
         return 0;
 
     suppressNibCmd = false;
-    usbInitIo(len, ENDPOINT_DIR_OUT);
+    usbInitBlockIo(len, ENDPOINT_DIR_OUT);
     iec_release(IO_SRQ | IO_CLK | IO_DATA | IO_ATN);
 
     /*
@@ -440,7 +547,7 @@ ioWriteNibSrqLoop(uint16_t len)
 
     for (i = 0; i < len; i++) {
         // Get data byte from USB.
-        if (usbRecvByte(&data) != 0)
+        if (usbRecvBlockByte(&data) != 0)
             break;
 
         // Write data byte via SRQ, break if timeout error.
@@ -453,7 +560,74 @@ ioWriteNibSrqLoop(uint16_t len)
     // Read back the dummy result.
     nib_srqburst_read();
 
+    usbBlockIoDone();
+    return 0;
+}
+
+/*
+ * Longest wait for a burst byte, in rounds of 65536 polls (some 30 ms
+ * each on a 16 MHz AVR). The drive may have to start the motor and
+ * search the directory before the first byte.
+ */
+#define BURST_WAIT_ROUNDS 200
+
+/*
+ * Request the next byte of a burst transfer by toggling CLK and shift
+ * it in via SRQ. The drive may have to read a sector first, so wait
+ * for it, but give up after BURST_WAIT_ROUNDS or if the host aborts.
+ */
+static bool
+burst_read_byte(uint8_t *data)
+{
+    uint16_t polls;
+    uint8_t rounds;
+
+    if (iec_get(IO_CLK))
+        iec_release(IO_CLK);
+    else
+        iec_set(IO_CLK);
+
+    rounds = 0;
+    for (polls = 1; !iec_get(IO_SRQ); polls++) {
+        // Keep the poll loop tight, the first SRQ pulse is short.
+        if (polls == 0 && (++rounds == BURST_WAIT_ROUNDS || !TimerWorker()))
+            return false;
+    }
+    *data = iec_srq_read();
+    return true;
+}
+
+/*
+ * Read one block of a 1571/1581 burst fastload (the "U0" 0x1f command).
+ * It starts with a status byte. 0 and 1 are followed by 254 data bytes,
+ * 0x1f (last block) by a count and that many bytes. Other values are
+ * errors and end the file. The host gets the block as it came in.
+ */
+static uint8_t
+ioReadBurstLoop(uint16_t len)
+{
+    uint16_t i, blockLen;
+    uint8_t data;
+
+    usbInitIo(len, ENDPOINT_DIR_IN);
+    blockLen = 1;
+    for (i = 0; i < blockLen && i < len; i++) {
+        if (!burst_read_byte(&data)) {
+            DEBUGF(DBG_ERROR, "burst abrt\n");
+            break;
+        }
+        if (usbSendByte(data) != 0)
+            break;
+
+        if (i == 0 && data < 2)
+            blockLen = 1 + 254;
+        else if (i == 0 && data == 0x1f)
+            blockLen = 2;
+        else if (i == 1 && blockLen == 2)
+            blockLen = 2 + data;
+    }
     usbIoDone();
+
     return 0;
 }
 
@@ -673,9 +847,9 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
     switch (cmd) {
     case XUM1541_READ:
         // Disallow any other protocols if in IEEE mode.
-        if ((currState & XUM1541_IEEE488_PRESENT) == 0)
-            proto = XUM_RW_PROTO(request[1]);
-        else
+        proto = XUM_RW_PROTO(request[1]);
+        if ((currState & XUM1541_IEEE488_PRESENT) != 0 &&
+            proto != XUM1541_DOS_READ)
             proto = XUM1541_CBM;
         DEBUGF(DBG_INFO, "rd:%d %d\n", proto, len);
         // loop to read all the bytes now, sending back each as we get it
@@ -719,10 +893,18 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
             ioReadLoop(nib_srqburst_read_checked, len);
             ret = 0;
             break;
+        case XUM1541_BURST_LOAD:
+            ioReadBurstLoop(len);
+            ret = 0;
+            break;
 #endif // SRQ_NIB_SUPPORT
+        case XUM1541_DOS_READ:
+            dos_read_blocks(len);
+            ret = 0;
+            break;
 #ifdef TAPE_SUPPORT
         case XUM1541_TAP:
-            XUM_SET_STATUS_VAL(status, Tape_Capture());
+            XUM_SET_STATUS_VAL(status, Tape_Capture(XUM_RW_FLAGS(request[1]) & XUM_TAP_PACKED));
             break;
         case XUM1541_TAP_CONFIG:
             XUM_SET_STATUS_VAL(status, Tape_DownloadConfig());
@@ -735,9 +917,9 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
         break;
     case XUM1541_WRITE:
         // Disallow any other protocols if in IEEE mode.
-        if ((currState & XUM1541_IEEE488_PRESENT) == 0)
-            proto = XUM_RW_PROTO(request[1]);
-        else
+        proto = XUM_RW_PROTO(request[1]);
+        if ((currState & XUM1541_IEEE488_PRESENT) != 0 &&
+            proto != XUM1541_DOS_READ)
             proto = XUM1541_CBM;
         DEBUGF(DBG_INFO, "wr:%d %d\n", proto, len);
         // loop to fetch each byte and write it as we get it
@@ -780,6 +962,10 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
             ret = 0;
             break;
 #endif // SRQ_NIB_SUPPORT
+        case XUM1541_DOS_READ:
+            dos_set_blocks(len);
+            ret = 0;
+            break;
 #ifdef TAPE_SUPPORT
         case XUM1541_TAP:
             XUM_SET_STATUS_VAL(status, Tape_Write());
@@ -814,6 +1000,21 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
     case XUM1541_IEC_SETRELEASE:
         cmds->cbm_setrelease(/*set*/request[1], /*release*/request[2]);
         break;
+    case XUM1541_IEC_TIMING:
+        // IEEE-488 has a real handshake, there is nothing to tune.
+        if ((currState & XUM1541_IEEE488_PRESENT)) {
+            XUM_SET_STATUS_VAL(status, 0);
+            break;
+        }
+        if (request[2] == XUM_IEC_PROFILE_CALIBRATE) {
+            XUM_SET_STATUS_VAL(status, dos_calibrate(request[1]));
+        } else {
+            XUM_SET_STATUS_VAL(status,
+                iec_set_timing(request[1], request[2], 0, 0));
+        }
+        DEBUGF(DBG_INFO, "timing %d=%x\n", request[1],
+            XUM_GET_STATUS_VAL(status));
+        break;
     case XUM1541_PP_READ:
         // Disallow if in IEEE mode.
         if ((currState & XUM1541_IEEE488_PRESENT)) {
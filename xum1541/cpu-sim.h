@@ -0,0 +1,31 @@
+/*
+ * CPU initialization and delay routines for the host simulation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _CPU_SIM_H
+#define _CPU_SIM_H
+
+#include "sim/sim.h"
+
+// Nothing to set up, the simulated clock always runs at F_CPU.
+static inline void
+cpu_init(void)
+{
+}
+
+static inline void
+cpu_bootloader_start(void)
+{
+    sim_fatal("firmware entered the bootloader");
+}
+
+// Delays advance the simulated clock, running the drive and host meanwhile.
+#define DELAY_MS(x) sim_delay_us((x) * 1000.0)
+#define DELAY_US(x) sim_delay_us(x)
+#define DELAY_US_VAR(x) sim_delay_us(x)
+
+#endif // _CPU_SIM_H
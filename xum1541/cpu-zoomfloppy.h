@@ -33,5 +33,7 @@ cpu_bootloader_start(void)
 // Timer and delay functions
 #define DELAY_MS(x) _delay_ms(x)
 #define DELAY_US(x) _delay_us(x)
+// Delay for a time only known at run time (us), 4 cycles per loop
+#define DELAY_US_VAR(x) _delay_loop_2((uint16_t)(x) * (F_CPU / 4000000UL))
 
 #endif // _CPU_ZOOMFLOPPY_H
@@ -0,0 +1,281 @@
+/*
+ * DOS block reader: read disk blocks like the "original" transfer mode
+ *
+ * For each block, this sends "U1" to the command channel, reads the
+ * error channel, sends "B-P" and reads the 256 bytes from the data
+ * channel. These are the same steps the host would do, but without a
+ * USB round trip for each one. It works with any drive, IEC or IEEE.
+ *
+ * The same helpers run the IEC timing calibration, see dos_calibrate().
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include "xum1541.h"
+
+// Longest error channel message we look at, "00, OK,00,00" and longer
+#define DOS_STATUS_LEN      40
+
+/*
+ * Calibration: the drive memory we read back with "M-R" (the 1541 ROM
+ * jump table), how often each timing has to get it right and the steps
+ * of the search.
+ */
+#define CAL_ADDR            0xffe0
+#define CAL_LEN             32
+#define CAL_TRIES           4
+#define CAL_STEP            5
+#define CAL_TS_MIN          20
+#define CAL_ACK_MIN         5
+
+// Device, channel and the track/sector pairs, set by dos_set_blocks()
+static uint8_t dosDevice, dosChannel, dosCount;
+static uint8_t dosBlocks[XUM_DOS_MAX_BLOCKS * 2];
+
+// Run a bus transfer on a local buffer. Returns true if all bytes went.
+static bool
+dos_write(uint8_t *buf, uint8_t len, uint8_t flags)
+{
+    uint16_t rv;
+
+    usbSetIoMode(USB_IO_LOCAL, buf);
+    rv = cmds->cbm_raw_write(len, flags);
+    usbSetIoMode(USB_IO_HOST, NULL);
+    return rv == len;
+}
+
+// Send LISTEN or TALK (cmd = 0x20 or 0x40) for the given channel.
+static bool
+dos_address(uint8_t cmd, uint8_t channel)
+{
+    uint8_t buf[2];
+
+    buf[0] = cmd | dosDevice;
+    buf[1] = 0x60 | channel;
+    return dos_write(buf, 2, XUM_WRITE_ATN |
+        (cmd == 0x40 ? XUM_WRITE_TALK : 0));
+}
+
+// Send UNLISTEN or UNTALK
+static void
+dos_unaddress(uint8_t cmd)
+{
+    dos_write(&cmd, 1, XUM_WRITE_ATN);
+}
+
+// Append a decimal number and a separator to a command.
+static uint8_t *
+dos_number(uint8_t *p, uint8_t n, uint8_t sep)
+{
+    if (n >= 100)
+        *p++ = '0' + n / 100;
+    if (n >= 10)
+        *p++ = '0' + n / 10 % 10;
+    *p++ = '0' + n % 10;
+    if (sep != 0)
+        *p++ = sep;
+    return p;
+}
+
+// Send a command to the command channel.
+static bool
+dos_command(uint8_t *cmd, uint8_t len)
+{
+    bool ok;
+
+    if (!dos_address(0x20, 15))
+        return false;
+    ok = dos_write(cmd, len, 0);
+    dos_unaddress(0x3f);
+    return ok;
+}
+
+// Read the error channel and return the error number, 0xff if none.
+static uint8_t
+dos_status(void)
+{
+    uint8_t buf[DOS_STATUS_LEN];
+    uint16_t len;
+
+    if (!dos_address(0x40, 15))
+        return 0xff;
+    usbSetIoMode(USB_IO_LOCAL, buf);
+    len = cmds->cbm_raw_read(sizeof(buf));
+    usbSetIoMode(USB_IO_HOST, NULL);
+    dos_unaddress(0x5f);
+
+    if (len < 2 || buf[0] < '0' || buf[0] > '9' ||
+        buf[1] < '0' || buf[1] > '9')
+        return 0xff;
+    return (buf[0] - '0') * 10 + buf[1] - '0';
+}
+
+/*
+ * Read one block to the host. The data bytes go right through from the
+ * data channel, then the error number follows.
+ */
+static bool
+dos_read_block(uint8_t track, uint8_t sector)
+{
+    uint8_t cmd[16], *p, status;
+    uint16_t len;
+
+    // "U1:<channel> 0 <track> <sector>"
+    p = cmd;
+    *p++ = 'U';
+    *p++ = '1';
+    *p++ = ':';
+    p = dos_number(p, dosChannel, ' ');
+    p = dos_number(p, 0, ' ');
+    p = dos_number(p, track, ' ');
+    p = dos_number(p, sector, 0);
+    status = 0xff;
+    if (dos_command(cmd, p - cmd))
+        status = dos_status();
+
+    // "B-P:<channel> 0"
+    len = 0;
+    if (status == 0) {
+        p = cmd + 4;
+        cmd[0] = 'B';
+        cmd[1] = '-';
+        cmd[2] = 'P';
+        cmd[3] = ':';
+        p = dos_number(p, dosChannel, ' ');
+        p = dos_number(p, 0, 0);
+        if (dos_command(cmd, p - cmd) &&
+            dos_address(0x40, dosChannel)) {
+            usbSetIoMode(USB_IO_NESTED, NULL);
+            len = cmds->cbm_raw_read(256);
+            usbSetIoMode(USB_IO_HOST, NULL);
+            dos_unaddress(0x5f);
+        }
+        if (len != 256)
+            status = 0xff;
+    }
+
+    // Pad a short (or no) block so the host can count on the size.
+    for (; len < 256; len++) {
+        if (usbSendByte(0) != 0)
+            return false;
+    }
+    return usbSendByte(status) == 0;
+}
+
+// Take the device, channel and track/sector pairs from the host.
+void
+dos_set_blocks(uint16_t len)
+{
+    uint8_t i, data;
+
+    dosCount = 0;
+    usbInitIo(len, ENDPOINT_DIR_OUT);
+    for (i = 0; i < len && i < 2 + sizeof(dosBlocks); i++) {
+        if (usbRecvByte(&data) != 0)
+            break;
+        if (i == 0)
+            dosDevice = data;
+        else if (i == 1)
+            dosChannel = data;
+        else
+            dosBlocks[i - 2] = data;
+    }
+    if (i >= 2)
+        dosCount = (i - 2) / 2;
+    usbIoDone();
+}
+
+// Read the blocks and send them to the host.
+void
+dos_read_blocks(uint16_t len)
+{
+    uint8_t i;
+
+    usbInitIo(len, ENDPOINT_DIR_IN);
+    for (i = 0; i < dosCount && len >= XUM_DOS_BLOCK_SIZE; i++) {
+        if (!dos_read_block(dosBlocks[2 * i], dosBlocks[2 * i + 1]))
+            break;
+        len -= XUM_DOS_BLOCK_SIZE;
+        wdt_reset();
+    }
+    dosCount = 0;
+    usbIoDone();
+}
+
+// Read the calibration memory with "M-R". Returns true if all bytes came.
+static bool
+dos_mem_read(uint8_t *buf)
+{
+    uint8_t cmd[6];
+    uint16_t len;
+
+    cmd[0] = 'M';
+    cmd[1] = '-';
+    cmd[2] = 'R';
+    cmd[3] = CAL_ADDR & 0xff;
+    cmd[4] = CAL_ADDR >> 8;
+    cmd[5] = CAL_LEN;
+    if (!dos_command(cmd, sizeof(cmd)) || !dos_address(0x40, 15))
+        return false;
+    usbSetIoMode(USB_IO_LOCAL, buf);
+    len = cmds->cbm_raw_read(CAL_LEN);
+    usbSetIoMode(USB_IO_HOST, NULL);
+    dos_unaddress(0x5f);
+    return len == CAL_LEN;
+}
+
+// Try a timing a few times. Returns true if it read back ref each time.
+static bool
+dos_cal_try(const uint8_t *ref, uint8_t ts, uint8_t ack)
+{
+    uint8_t buf[CAL_LEN], i;
+
+    iec_set_timing(dosDevice, 0, ts, ack);
+    for (i = 0; i < CAL_TRIES; i++) {
+        wdt_reset();
+        if (!dos_mem_read(buf) || memcmp(buf, ref, CAL_LEN) != 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Find the shortest setup time, then the shortest acknowledge time the
+ * device takes without errors, starting from the 1541 timing. Each one
+ * gets one more step for margin. Returns the timing like
+ * iec_set_timing(), or 0 with the 1541 timing if the device didn't
+ * answer.
+ */
+uint16_t
+dos_calibrate(uint8_t dev)
+{
+    uint8_t ref[CAL_LEN], ts, ack, safeTs, safeAck;
+    uint16_t safe;
+
+    dosDevice = dev;
+    safe = iec_set_timing(dev, XUM_IEC_PROFILE_1541, 0, 0);
+    safeTs = safe & 0xff;
+    safeAck = safe >> 8;
+    if (!dos_mem_read(ref))
+        return 0;
+
+    for (ts = CAL_TS_MIN; ts < safeTs; ts += CAL_STEP) {
+        if (dos_cal_try(ref, ts, safeAck))
+            break;
+    }
+    ts = (ts + CAL_STEP < safeTs) ? ts + CAL_STEP : safeTs;
+
+    for (ack = CAL_ACK_MIN; ack < safeAck; ack += CAL_STEP) {
+        if (dos_cal_try(ref, ts, ack))
+            break;
+    }
+    ack = (ack + CAL_STEP < safeAck) ? ack + CAL_STEP : safeAck;
+
+    // Check the result once more, fall back to the safe timing if it fails.
+    if (!dos_cal_try(ref, ts, ack))
+        return iec_set_timing(dev, XUM_IEC_PROFILE_1541, 0, 0);
+    DEBUGF(DBG_INFO, "cal %d: ts %d ack %d\n", dev, ts, ack);
+    return iec_set_timing(dev, 0, ts, ack);
+}
@@ -37,6 +37,17 @@
 #define IEC_T_DA    80   // Min talk-attention ack hold time (us)
 #define IEC_T_FR    60   // Min EOI acknowledge time (us)
 
+/*
+ * JiffyDOS timing. The host announces itself by holding CLK this long
+ * before the last bit of a byte under ATN; a JiffyDOS drive answers by
+ * pulling DATA for about 100 us, starting 200 us into the wait.
+ * Data bytes then go as four bit pairs on CLK and DATA plus a status
+ * pair, each valid for one slot after the start edge.
+ */
+#define JIFFY_T_DETECT  400 // Host hold-off before the last ATN bit (us)
+#define JIFFY_T_SLOT    13  // Time each bit pair is valid (us)
+#define JIFFY_T_SAMPLE  9   // Read: sample point within a slot (us)
+
 static void iec_reset(bool forever);
 static uint16_t iec_raw_write(uint16_t len, uint8_t flags);
 static uint16_t iec_raw_read(uint16_t len);
@@ -44,6 +55,32 @@ static bool iec_wait(uint8_t line, uint8_t state);
 static uint8_t iec_poll(void);
 static void iec_setrelease(uint8_t set, uint8_t release);
 
+// Set if the device answered the JiffyDOS probe of the last ATN command
+static uint8_t jiffy;
+
+/*
+ * Timing profiles. The delays of the standard protocol are sized for
+ * the slowest drive, a stock 1541. Faster drives get by with less, so
+ * each device address has its own timing, see iec_set_timing(). Bytes
+ * under ATN always go with the 1541 timing, all devices must get them.
+ */
+struct iec_timing {
+    uint8_t ts;     // bit setup time when we talk (us)
+    uint8_t ack;    // time we hold DATA after each byte we read (us)
+};
+
+static const struct iec_timing iecProfiles[] = {
+    { IEC_T_S + 55, 50 },   // XUM_IEC_PROFILE_1541, see send_byte()
+    { 60,           30 },   // XUM_IEC_PROFILE_1571
+    { 50,           20 },   // XUM_IEC_PROFILE_1581
+    { 30,           10 },   // XUM_IEC_PROFILE_FAST
+};
+
+static struct iec_timing iecTiming[31];
+
+// Timing of the device addressed by the last ATN command
+static struct iec_timing curTiming;
+
 static struct ProtocolFunctions iecFunctions = {
     .cbm_reset = iec_reset,
     .cbm_raw_write = iec_raw_write,
@@ -83,11 +120,40 @@ iec2hw(uint8_t iec)
 struct ProtocolFunctions *
 iec_init()
 {
+    uint8_t dev;
+
+    for (dev = 0; dev < sizeof(iecTiming) / sizeof(iecTiming[0]); dev++)
+        iecTiming[dev] = iecProfiles[XUM_IEC_PROFILE_1541];
+    curTiming = iecProfiles[XUM_IEC_PROFILE_1541];
+
     iec_release(IO_ATN | IO_CLK | IO_DATA | IO_RESET);
     DELAY_US(10);
     return &iecFunctions;
 }
 
+/*
+ * Set the timing for a device to a profile (XUM_IEC_PROFILE_*) or to
+ * the given times, if ts and ack are not 0. Returns the timing in use,
+ * setup time in the low byte and acknowledge time in the high byte.
+ */
+uint16_t
+iec_set_timing(uint8_t dev, uint8_t profile, uint8_t ts, uint8_t ack)
+{
+    struct iec_timing *t;
+
+    if (dev >= sizeof(iecTiming) / sizeof(iecTiming[0]))
+        return 0;
+    t = &iecTiming[dev];
+    if (ts != 0 && ack != 0) {
+        t->ts = ts;
+        t->ack = ack;
+    } else if (profile < sizeof(iecProfiles) / sizeof(iecProfiles[0]))
+        *t = iecProfiles[profile];
+
+    // It is used from the next ATN command on.
+    return t->ts | (t->ack << 8);
+}
+
 /*
  * All exit paths have to take ~200 us total for the timing in
  * wait_for_free_bus() to be correct. Once we're past the point of finding
@@ -176,6 +242,7 @@ static void
 iec_reset(bool forever)
 {
     DEBUGF(DBG_ALL, "reset\n");
+    jiffy = 0;
     iec_release(IO_DATA | IO_ATN | IO_CLK);
 
     /*
@@ -240,15 +307,34 @@ iec_wait_clk(void)
  *
  * The hold time did not appear to have any effect. In fact, reducing the
  * hold time to 15 us still worked fine.
+ *
+ * Data bytes use the setup time of the device's timing profile instead.
  */
 static uint8_t
-send_byte(uint8_t b)
+send_byte(uint8_t b, uint8_t probe, uint8_t atn)
 {
-    uint8_t i, ack = 0;
+    uint8_t i, n, ack = 0;
 
     for (i = 8; i != 0; i--) {
         // Wait for Ts (setup) with additional padding
-        DELAY_US(IEC_T_S + 55);
+        if (atn)
+            DELAY_US(IEC_T_S + 55);
+        else
+            DELAY_US_VAR(curTiming.ts);
+
+        /*
+         * JiffyDOS probe: stretch the setup time of the last bit and see
+         * if the device pulls DATA meanwhile. Wait until it lets go
+         * before we continue with the bit.
+         */
+        if (i == 1 && probe) {
+            for (n = JIFFY_T_DETECT / 10; n != 0; n--) {
+                DELAY_US(10);
+                if (iec_get(IO_DATA))
+                    jiffy = 1;
+            }
+            iec_wait_timeout_2ms(IO_DATA, 0);
+        }
 
         // Set the bit value on the DATA line and wait for it to settle.
         if (!(b & 1)) {
@@ -299,6 +385,120 @@ wait_for_listener(void)
     return true;
 }
 
+// Put two bits on CLK and DATA for JiffyDOS, released = 1.
+static void
+jiffy_put(uint8_t clk, uint8_t data)
+{
+    uint8_t set = 0;
+
+    if (!clk)
+        set |= IO_CLK;
+    if (!data)
+        set |= IO_DATA;
+    iec_set_release(set, (IO_CLK | IO_DATA) & ~set);
+}
+
+/*
+ * Send a byte via JiffyDOS. We hold CLK and the listener releases DATA
+ * when it is ready. Releasing CLK starts the byte, then bits 4/5, 6/7,
+ * 3/1 and 2/0 follow on CLK/DATA, one pair per slot. In the last slot,
+ * CLK released signals EOI. The listener acknowledges by pulling DATA.
+ */
+static uint8_t
+jiffy_send_byte(uint8_t b, uint8_t last)
+{
+    uint8_t ack;
+
+    // Wait forever (IEC_T_H) for the listener, as wait_for_listener().
+    while (iec_get(IO_DATA)) {
+        if (!TimerWorker())
+            return 0;
+    }
+
+    // The pairs are timed from our CLK edge, so keep IRQs out.
+    cli();
+    iec_release(IO_CLK);
+    DELAY_US(JIFFY_T_SLOT);
+    jiffy_put(b & 0x10, b & 0x20);
+    DELAY_US(JIFFY_T_SLOT);
+    jiffy_put(b & 0x40, b & 0x80);
+    DELAY_US(JIFFY_T_SLOT);
+    jiffy_put(b & 0x08, b & 0x02);
+    DELAY_US(JIFFY_T_SLOT);
+    jiffy_put(b & 0x04, b & 0x01);
+    DELAY_US(JIFFY_T_SLOT);
+    jiffy_put(last, 1);
+    sei();
+
+    ack = iec_wait_timeout_2ms(IO_DATA, IO_DATA);
+    iec_set(IO_CLK);
+    if (!ack) {
+        DEBUGF(DBG_ERROR, "jsndbyte nak\n");
+    }
+
+    return ack;
+}
+
+/*
+ * Receive a byte via JiffyDOS. The talker has released CLK to say it is
+ * ready and we release DATA to start the byte. Bits 0/1, 2/3, 4/5 and
+ * 6/7 follow on CLK/DATA, then CLK released in the last slot for EOI.
+ * We hold DATA again as acknowledge, until we're ready for the next byte.
+ */
+static uint8_t
+jiffy_recv_byte(void)
+{
+    uint8_t pins, b;
+
+    cli();
+    iec_release(IO_DATA);
+    DELAY_US(JIFFY_T_SLOT + JIFFY_T_SAMPLE);
+    pins = iec_poll_pins();
+    b = ((pins & IO_CLK) ? 0x01 : 0) | ((pins & IO_DATA) ? 0x02 : 0);
+    DELAY_US(JIFFY_T_SLOT);
+    pins = iec_poll_pins();
+    b |= ((pins & IO_CLK) ? 0x04 : 0) | ((pins & IO_DATA) ? 0x08 : 0);
+    DELAY_US(JIFFY_T_SLOT);
+    pins = iec_poll_pins();
+    b |= ((pins & IO_CLK) ? 0x10 : 0) | ((pins & IO_DATA) ? 0x20 : 0);
+    DELAY_US(JIFFY_T_SLOT);
+    pins = iec_poll_pins();
+    b |= ((pins & IO_CLK) ? 0x40 : 0) | ((pins & IO_DATA) ? 0x80 : 0);
+    DELAY_US(JIFFY_T_SLOT);
+    if (iec_get(IO_CLK) == 0)
+        eoi = 1;
+    iec_set(IO_DATA);
+    sei();
+
+    return b;
+}
+
+/*
+ * Write bytes via JiffyDOS. There is no presence check like the standard
+ * protocol does, the listener simply holds DATA until it is ready.
+ */
+static uint16_t
+jiffy_raw_write(uint16_t len)
+{
+    uint16_t rv = len;
+    uint8_t data;
+
+    iec_set_release(IO_CLK, IO_DATA);
+    while (len != 0) {
+        // Get a data byte from host, quitting if it signalled an abort.
+        if (usbRecvByte(&data) != 0 || !jiffy_send_byte(data, len == 1)) {
+            DEBUGF(DBG_ERROR, "write: jiffy err\n");
+            iec_release(IO_CLK);
+            rv = 0;
+            break;
+        }
+        len--;
+        wdt_reset();
+    }
+
+    return rv;
+}
+
 /*
  * Write bytes to the drive via the CBM default protocol.
  * Returns number of successful written bytes or 0 on error.
@@ -318,6 +518,10 @@ iec_raw_write(uint16_t len, uint8_t flags)
     if (len == 0)
         return 0;
 
+    // A new command under ATN ends JiffyDOS until it is probed again.
+    if (atn)
+        jiffy = 0;
+
     usbInitIo(len, ENDPOINT_DIR_OUT);
 
     /*
@@ -332,6 +536,13 @@ iec_raw_write(uint16_t len, uint8_t flags)
         return 0;
     }
 
+    if (jiffy && !atn) {
+        rv = jiffy_raw_write(len);
+        usbIoDone();
+        DEBUGF(DBG_INFO, "wrv=%d\n", rv);
+        return rv;
+    }
+
     iec_release(IO_DATA);
     iec_set(IO_CLK | (atn ? IO_ATN : 0));
     IEC_DELAY();
@@ -389,7 +600,12 @@ iec_raw_write(uint16_t len, uint8_t flags)
             rv = 0;
             break;
         }
-        if (send_byte(data)) {
+        // The following data bytes go with the timing of this device.
+        if (atn && data >= 0x20 && data < 0x60 && (data & 0x1f) != 0x1f)
+            curTiming = iecTiming[data & 0x1f];
+
+        if (send_byte(data, atn && len == 1 && (flags & XUM_WRITE_JIFFY),
+            atn)) {
             len--;
             DELAY_US(IEC_T_BB);
         } else {
@@ -407,6 +623,16 @@ iec_raw_write(uint16_t len, uint8_t flags)
      * the minimum time before releasing ATN (IEC_T_R).
      */
     if (rv != 0) {
+#ifdef SRQ_NIB_SUPPORT
+        /*
+         * Announce a fast serial host to 1571/1581 drives by shifting out
+         * a byte via SRQ while ATN is still active. By now, the drives
+         * are surely in their ATN handler and have the shift register set.
+         */
+        if (atn && (flags & XUM_WRITE_FAST))
+            iec_srq_write(0xff);
+#endif
+
         // Talk-ATN turn around (talker and listener exchange roles).
         if (talk) {
             // Hold DATA and release ATN, waiting talk-ATN release time.
@@ -472,6 +698,15 @@ iec_raw_read(uint16_t len)
             return 0;
         }
 
+        if (jiffy) {
+            ok = 1;
+            if (usbSendByte(jiffy_recv_byte()))
+                break;
+            count++;
+            wdt_reset();
+            continue;
+        }
+
         /* release DATA line */
         iec_release(IO_DATA);
 
@@ -520,7 +755,7 @@ iec_raw_read(uint16_t len)
             if (usbSendByte(b))
                 break;
             count++;
-            DELAY_US(50);
+            DELAY_US_VAR(curTiming.ack);
         }
 
         wdt_reset();
@@ -112,6 +112,7 @@
 #define IEEE_DATA   (IeeePin(IEEE_DATA_IO))
 
 #define    ATN_DELAY    90 // Bus delay after ATN in us
+#define    BYTE_TIMEOUT 65000 // Handshake timeout of a data byte in us
 
 // STATICS
 //static uint8_t ieee_device;             // current device#
@@ -122,6 +123,7 @@ static volatile uint16_t ieee_timer;
 static int16_t last_byte;               // -1=kein byte
 static volatile bool ieee_listen;
 static volatile bool ieee_talk;
+static bool ieee_block;                 // moving whole endpoint banks
 
 // Internal function definitions
 static void IeeeInitLines(void);
@@ -177,6 +179,39 @@ static void DelayMs(uint16_t ms)
     while(!IsTimeout());
 }
 
+//
+// Wait for an input line to go high (released) or low, about every us.
+// IsTimeout() waits 10 us per call, which would be added to each edge
+// of the byte handshake. Returns true on timeout.
+//
+INLINE bool IeeeWaitLine(uint8_t pin, bool high)
+{
+    uint16_t us;
+
+    for(us = BYTE_TIMEOUT; (IeeeGet(pin) != 0) != high; us--)
+    {
+        if(us == 0)
+            return true;
+        DELAY_US(1);
+        wdt_reset();
+    }
+    return false;
+}
+
+//
+// Move a byte to or from the host, a bank at a time if we can.
+// See usbInitBlockIo().
+//
+INLINE int8_t IeeeUsbSend(uint8_t data)
+{
+    return ieee_block ? usbSendBlockByte(data) : usbSendByte(data);
+}
+
+INLINE int8_t IeeeUsbRecv(uint8_t *data)
+{
+    return ieee_block ? usbRecvBlockByte(data) : usbRecvByte(data);
+}
+
 //
 // LED blinker for debugging
 //
@@ -417,12 +452,12 @@ ieee_raw_write(uint16_t len, uint8_t flags)
     eoi = 0;
     ieee_status = 0;
 
-    usbInitIo(len, ENDPOINT_DIR_OUT);
+    ieee_block = usbInitBlockIo(len, ENDPOINT_DIR_OUT);
 
     if(atn && len >= 1)
     {
         // get device# from USB 
-        if (usbRecvByte(&device) != 0) 
+        if (IeeeUsbRecv(&device) != 0) 
         {
             return 0;
         }
@@ -442,7 +477,7 @@ ieee_raw_write(uint16_t len, uint8_t flags)
         else
         {
             // get secondary-address from USB
-            if (usbRecvByte(&sa) != 0) 
+            if (IeeeUsbRecv(&sa) != 0) 
             {
                 return 0;
             }
@@ -483,7 +518,7 @@ ieee_raw_write(uint16_t len, uint8_t flags)
     //
     while (len != 0) {
         // Get a data byte from host, quitting if it signalled an abort.
-        if (usbRecvByte(&data) != 0) 
+        if (IeeeUsbRecv(&data) != 0) 
         {
             rv = 0;
             break;
@@ -498,7 +533,7 @@ ieee_raw_write(uint16_t len, uint8_t flags)
         // watchdog
         wdt_reset();
     }
-    usbIoDone();
+    usbBlockIoDone();
 
     return rv;
 }
@@ -513,13 +548,13 @@ ieee_raw_read(uint16_t len)
     uint8_t     by;
     uint16_t to, count;
 
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    ieee_block = usbInitBlockIo(len, ENDPOINT_DIR_IN);
 
     count = 0;
     do {
         // read again after EOI??
         if (eoi) {
-            usbIoDone();
+            usbBlockIoDone();
             return 0;
         }
 
@@ -534,7 +569,7 @@ ieee_raw_read(uint16_t len)
             if(to >= 20 || !TimerWorker()) 
             {
                 /* 1.3 (20 * 65ms) sec timeout */
-                usbIoDone();
+                usbBlockIoDone();
                 return 0;
             }
             to++;
@@ -542,14 +577,14 @@ ieee_raw_read(uint16_t len)
 
  
         // Send the data byte to host, quitting if it signalled an abort.
-        if (usbSendByte(by))
+        if (IeeeUsbSend(by))
             break;
 
         count++;
         wdt_reset();
     } while (count != len && !eoi);
 
-    usbIoDone();
+    usbBlockIoDone();
     return count;
 }
 
@@ -574,16 +609,10 @@ static int8_t IeeeByteOut(uint8_t by)
     _delay_us(5);
     IeeeDav(0);
 
-    ieee_timer = 65;                                // 65ms timeout
-
-    while(!IEEE_NDAC)                                // WAIT FOR DAC
+    if(IeeeWaitLine(IEEE_NDAC_I, true))            // WAIT FOR DAC
     {
-        if(IsTimeout())
-        {
-            ieee_status |= IEEE_ST_WRTO;            // 65ms write timeout
-            rc = 1;
-            break;
-        }
+        ieee_status |= IEEE_ST_WRTO;                // 65ms write timeout
+        rc = 1;
     }
 
     IeeeDav(1);
@@ -606,22 +635,13 @@ static uint8_t IeeeIn(void)
     IeeeNdac(0);                    // NDAC low
     IeeeNrfd(1);                    // ready for data!
     
-    ieee_timer = 65;                // 65ms timeout
-
-    while(1)                        // WAIT FOR DAV
+    if(IeeeWaitLine(IEEE_DAV_I, false))    // WAIT FOR DAV, 65ms timeout
     {
-        if(!IEEE_DAV) 
-        {
-            break;
-        }
-        if(IsTimeout())
-        {
-            ieee_status |= IEEE_ST_RDTO;    // read timeout
+        ieee_status |= IEEE_ST_RDTO;    // read timeout
 
-            IeeeNdac(0);            // NDAC low
-            IeeeNrfd(0);            // NRFD low
-            return 0;
-        }
+        IeeeNdac(0);                // NDAC low
+        IeeeNrfd(0);                // NRFD low
+        return 0;
     }
     _delay_us(1);
     rc = ~IEEE_DATA;
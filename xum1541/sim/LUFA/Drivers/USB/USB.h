@@ -0,0 +1,107 @@
+/*
+ * Host simulation of the xum1541: stand-in for the LUFA USB driver
+ *
+ * Only the device mode calls used by the firmware are provided. The
+ * endpoints are emulated in sim/sim.c, where the simulated host feeds
+ * and drains them.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_LUFA_USB_H
+#define _SIM_LUFA_USB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+#define ENDPOINT_DIR_OUT            0
+#define ENDPOINT_DIR_IN             1
+#define EP_TYPE_CONTROL             0
+#define EP_TYPE_BULK                2
+#define ENDPOINT_BANK_SINGLE        0
+#define ENDPOINT_BANK_DOUBLE        1
+
+#define CONTROL_REQTYPE_DIRECTION   0x80
+#define CONTROL_REQTYPE_TYPE        0x60
+#define REQDIR_HOSTTODEVICE         (0 << 7)
+#define REQDIR_DEVICETOHOST         (1 << 7)
+#define REQTYPE_STANDARD            (0 << 5)
+#define REQTYPE_CLASS               (1 << 5)
+
+enum USB_Device_States_t {
+    DEVICE_STATE_Unattached = 0,
+    DEVICE_STATE_Powered,
+    DEVICE_STATE_Default,
+    DEVICE_STATE_Addressed,
+    DEVICE_STATE_Configured,
+    DEVICE_STATE_Suspended,
+};
+
+enum Endpoint_Stream_RW_ErrorCodes_t {
+    ENDPOINT_RWSTREAM_NoError = 0,
+    ENDPOINT_RWSTREAM_EndpointStalled,
+    ENDPOINT_RWSTREAM_DeviceDisconnected,
+    ENDPOINT_RWSTREAM_Timeout,
+    ENDPOINT_RWSTREAM_CallbackAborted,
+};
+
+enum StreamCallback_Return_ErrorCodes_t {
+    STREAMCALLBACK_Continue = 0,
+    STREAMCALLBACK_Abort,
+};
+
+typedef struct {
+    uint8_t  bmRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} USB_Request_Header_t;
+
+typedef uint8_t (*StreamCallbackPtr_t)(void);
+
+extern volatile uint8_t USB_DeviceState;
+extern USB_Request_Header_t USB_ControlRequest;
+
+void USB_Init(void);
+void USB_ShutDown(void);
+
+bool Endpoint_ConfigureEndpoint(uint8_t Number, uint8_t Type,
+    uint8_t Direction, uint16_t Size, uint8_t Banks);
+void Endpoint_SelectEndpoint(uint8_t EndpointNumber);
+uint8_t Endpoint_GetCurrentEndpoint(void);
+void Endpoint_ResetFIFO(uint8_t EndpointNumber);
+void Endpoint_ResetDataToggle(void);
+bool Endpoint_IsEnabled(void);
+bool Endpoint_IsConfigured(void);
+bool Endpoint_IsReadWriteAllowed(void);
+bool Endpoint_IsINReady(void);
+bool Endpoint_IsOUTReceived(void);
+uint16_t Endpoint_BytesInEndpoint(void);
+void Endpoint_ClearSETUP(void);
+void Endpoint_ClearIN(void);
+void Endpoint_ClearOUT(void);
+void Endpoint_StallTransaction(void);
+void Endpoint_ClearStall(void);
+bool Endpoint_IsStalled(void);
+uint8_t Endpoint_Read_Byte(void);
+void Endpoint_Write_Byte(uint8_t Byte);
+uint8_t Endpoint_Read_Stream_LE(void *Buffer, uint16_t Length,
+    StreamCallbackPtr_t Callback);
+uint8_t Endpoint_Write_Stream_LE(const void *Buffer, uint16_t Length,
+    StreamCallbackPtr_t Callback);
+uint8_t Endpoint_Discard_Stream(uint16_t Length,
+    StreamCallbackPtr_t Callback);
+uint8_t Endpoint_Write_Control_Stream_LE(const void *Buffer, uint16_t Length);
+
+// Event handlers implemented by the firmware (main.c)
+void EVENT_USB_Device_Connect(void);
+void EVENT_USB_Device_Disconnect(void);
+void EVENT_USB_Device_ConfigurationChanged(void);
+void EVENT_USB_Device_UnhandledControlRequest(void);
+
+#endif // _SIM_LUFA_USB_H
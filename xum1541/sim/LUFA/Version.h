@@ -0,0 +1,15 @@
+/*
+ * Host simulation of the xum1541: stand-in for <LUFA/Version.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_LUFA_VERSION_H
+#define _SIM_LUFA_VERSION_H
+
+#define LUFA_VERSION_INTEGER    0x091223
+#define LUFA_VERSION_STRING     "091223"
+
+#endif // _SIM_LUFA_VERSION_H
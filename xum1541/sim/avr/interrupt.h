@@ -0,0 +1,18 @@
+/*
+ * Host simulation of the xum1541: stand-in for <avr/interrupt.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_AVR_INTERRUPT_H
+#define _SIM_AVR_INTERRUPT_H
+
+#include "sim/sim.h"
+
+// The only interrupt is the USB control request, see sim_usb_control().
+#define cli()                   sim_irq_enable(false)
+#define sei()                   sim_irq_enable(true)
+
+#endif // _SIM_AVR_INTERRUPT_H
@@ -0,0 +1,17 @@
+/*
+ * Host simulation of the xum1541: stand-in for <avr/io.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_AVR_IO_H
+#define _SIM_AVR_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define _BV(bit)        (1 << (bit))
+
+#endif // _SIM_AVR_IO_H
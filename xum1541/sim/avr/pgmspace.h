@@ -0,0 +1,20 @@
+/*
+ * Host simulation of the xum1541: stand-in for <avr/pgmspace.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_AVR_PGMSPACE_H
+#define _SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(p)        (*(const uint8_t *)(p))
+#define printf_P                printf
+
+#endif // _SIM_AVR_PGMSPACE_H
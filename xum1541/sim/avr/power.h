@@ -0,0 +1,16 @@
+/*
+ * Host simulation of the xum1541: stand-in for <avr/power.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_AVR_POWER_H
+#define _SIM_AVR_POWER_H
+
+#define clock_div_1             0
+#define clock_div_8             3
+#define clock_prescale_set(x)   do { } while (0)
+
+#endif // _SIM_AVR_POWER_H
@@ -0,0 +1,21 @@
+/*
+ * Host simulation of the xum1541: stand-in for <avr/wdt.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_AVR_WDT_H
+#define _SIM_AVR_WDT_H
+
+#include "sim/sim.h"
+
+#define WDTO_1S                 6
+
+// The watchdog never fires, but each reset costs a cycle like wdr does.
+#define wdt_enable(x)           do { } while (0)
+#define wdt_disable()           do { } while (0)
+#define wdt_reset()             sim_cycles(1)
+
+#endif // _SIM_AVR_WDT_H
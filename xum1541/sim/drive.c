@@ -0,0 +1,942 @@
+/*
+ * Host simulation of the xum1541: virtual drive on the IEC bus
+ *
+ * The drive side of each protocol follows the 6502 code in opencbm
+ * (libd64copy s1.a65, s2.a65, pp1541.a65) and the nibtools drive code,
+ * line by line where it matters for the handshake.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xum1541.h"
+#include "sim/drive.h"
+
+// Reasons to abandon what the drive is doing
+#define DRV_RESET       1
+#define DRV_ATN         2
+#define DRV_MODE        3
+
+// JiffyDOS bit pair slot and where we sample a slot as listener
+#define JIFFY_SLOT      SIM_US(13)
+#define JIFFY_SAMPLE    SIM_US(6)
+
+struct drive_config drive_cfg = {
+    .device = 8,
+    .react = SIM_US(5),
+    .ts = SIM_US(120),      // measured on a 1541, see iec.c
+    .tv = SIM_US(70),
+    .nibByte = SIM_US(26),  // one GCR byte at speed zone 3
+    .nibStart = SIM_MS(5),
+    .boot = SIM_MS(1200),
+    .srqBit = SIM_US(4),    // CIA serial port of a 1571 at 2 MHz
+    .burstBlock = SIM_MS(20),
+};
+
+uint8_t drive_buf[DRIVE_BUF_SIZE];
+uint16_t drive_len;
+uint8_t drive_file[DRIVE_BUF_SIZE];
+uint16_t drive_file_len;
+
+static jmp_buf drvAbort;
+static uint8_t drvMode, drvRunMode;
+static bool drvAtnAbort, drvInReset;
+static bool drvListener, drvTalker, drvJiffy;
+static bool drvBurstLoad;
+static uint8_t drvChannel;
+static uint16_t drvTalkPos;
+
+// DOS emulation: the block read by "U1", its "B-P" position, last error
+static uint8_t drvBlock[256];
+static uint8_t drvBlockPos, drvError, drvErrorTrack, drvErrorSector;
+
+// "M-R": the memory the next talk on channel 15 sends instead of an error
+static uint16_t drvMemAddr, drvMemLen;
+
+static volatile bool jobPending;
+static uint8_t jobType;
+
+static void
+drv_pull(uint8_t lines)
+{
+    sim_drv_lines |= lines;
+}
+
+static void
+drv_release(uint8_t lines)
+{
+    sim_drv_lines &= ~lines;
+}
+
+static void
+drv_set(uint8_t lines, bool pull)
+{
+    if (pull)
+        drv_pull(lines);
+    else
+        drv_release(lines);
+}
+
+static bool
+drv_get(uint8_t line)
+{
+    return (sim_bus_lines() & line) != 0;
+}
+
+// Check for events that make the drive drop what it is doing.
+static void
+drv_check(void)
+{
+    if ((sim_fw_lines & IEC_RESET) != 0 && !drvInReset)
+        longjmp(drvAbort, DRV_RESET);
+    if (drvMode != drvRunMode)
+        longjmp(drvAbort, DRV_MODE);
+    if (drvAtnAbort && drv_get(IEC_ATN))
+        longjmp(drvAbort, DRV_ATN);
+}
+
+static void
+drv_delay(uint64_t ns)
+{
+    sim_sleep(ns);
+    drv_check();
+}
+
+// Poll until the line is in the given state (true = active).
+static void
+drv_wait(uint8_t line, bool state)
+{
+    while (drv_get(line) != state)
+        drv_delay(drive_cfg.react);
+}
+
+static bool
+drv_wait_timeout(uint8_t line, bool state, uint64_t ns)
+{
+    uint64_t end = sim_now + ns;
+
+    while (drv_get(line) != state) {
+        if (sim_now >= end)
+            return false;
+        drv_delay(drive_cfg.react);
+    }
+    return true;
+}
+
+// Hold the lines through reset and the boot time, then come up idle.
+static void
+drv_reset(void)
+{
+    drvInReset = true;
+    drv_release(IEC_DATA | IEC_CLOCK);
+    sim_drv_pp_out = false;
+    while ((sim_fw_lines & IEC_RESET) != 0)
+        sim_sleep(drive_cfg.react);
+
+    drv_pull(IEC_DATA | IEC_CLOCK);
+    sim_sleep(drive_cfg.boot);
+    drv_release(IEC_DATA | IEC_CLOCK);
+
+    drvMode = DRIVE_IEC;
+    drvListener = drvTalker = false;
+    jobPending = false;
+    drvInReset = false;
+}
+
+/*
+ * Receive a byte as listener. The talker has just released CLK.
+ * Returns the byte and whether the talker signalled EOI. Under ATN,
+ * a JiffyDOS drive answers if the talker holds the last bit back.
+ */
+static uint8_t
+drv_recv_byte(bool *eoi, bool atn)
+{
+    uint8_t data = 0;
+    int i;
+
+    // Ready for data. The talker pulls CLK within 200 us unless EOI.
+    *eoi = false;
+    drv_release(IEC_DATA);
+    if (!drv_wait_timeout(IEC_CLOCK, true, SIM_US(200))) {
+        *eoi = true;
+        drv_pull(IEC_DATA);
+        drv_delay(SIM_US(60));
+        drv_release(IEC_DATA);
+        drv_wait(IEC_CLOCK, true);
+    }
+
+    // Bits are valid while CLK is released, LSB first, released = 1.
+    for (i = 0; i < 8; i++) {
+        if (i == 7 && atn && drive_cfg.jiffy &&
+            !drv_wait_timeout(IEC_CLOCK, false, SIM_US(218))) {
+            drv_pull(IEC_DATA);
+            drv_delay(SIM_US(100));
+            drv_release(IEC_DATA);
+            drvJiffy = true;
+        }
+        drv_wait(IEC_CLOCK, false);
+        data = (data >> 1) | (drv_get(IEC_DATA) ? 0 : 0x80);
+        drv_wait(IEC_CLOCK, true);
+
+        // A talker that releases CLK before we are done gets a bit lost.
+        if (drive_cfg.listenBit != 0)
+            drv_delay(drive_cfg.listenBit);
+    }
+
+    // Frame handshake
+    drv_delay(drive_cfg.react);
+    drv_pull(IEC_DATA);
+    return data;
+}
+
+/*
+ * Send a byte as talker. We hold CLK, the listener holds DATA.
+ */
+static void
+drv_send_byte(uint8_t data, bool eoi)
+{
+    int i;
+
+    // Ready to send, wait for the listener to be ready for data.
+    drv_release(IEC_CLOCK);
+    drv_wait(IEC_DATA, false);
+
+    // Signal EOI by not pulling CLK until the listener acknowledges it.
+    if (eoi) {
+        drv_wait(IEC_DATA, true);
+        drv_wait(IEC_DATA, false);
+    }
+    drv_delay(SIM_US(40));
+    drv_pull(IEC_CLOCK);
+
+    for (i = 0; i < 8; i++, data >>= 1) {
+        drv_delay(drive_cfg.ts);
+        drv_set(IEC_DATA, (data & 1) == 0);
+        drv_release(IEC_CLOCK);
+        drv_delay(drive_cfg.tv);
+        drv_pull(IEC_CLOCK);
+        drv_release(IEC_DATA);
+    }
+
+    // Frame handshake from the listener, then the time between bytes
+    drv_wait_timeout(IEC_DATA, true, SIM_MS(1));
+    drv_delay(SIM_US(100));
+}
+
+/*
+ * JiffyDOS byte as listener. The talker has just released CLK to start
+ * it; bits 4/5, 6/7, 3/1 and 2/0 follow on CLK/DATA, then EOI on CLK.
+ */
+static uint8_t
+drv_jiffy_recv(bool *eoi)
+{
+    static const uint8_t bits[8] = {
+        0x10, 0x20, 0x40, 0x80, 0x08, 0x02, 0x04, 0x01
+    };
+    uint8_t data = 0;
+    int i;
+
+    drv_delay(JIFFY_SAMPLE);
+    for (i = 0; i < 8; i += 2) {
+        drv_delay(JIFFY_SLOT);
+        if (!drv_get(IEC_CLOCK))
+            data |= bits[i];
+        if (!drv_get(IEC_DATA))
+            data |= bits[i + 1];
+    }
+    drv_delay(JIFFY_SLOT);
+    *eoi = !drv_get(IEC_CLOCK);
+
+    drv_pull(IEC_DATA);
+    return data;
+}
+
+/*
+ * JiffyDOS byte as talker. The listener has just released DATA to start
+ * it; bits 0/1, 2/3, 4/5 and 6/7 follow on CLK/DATA, then EOI on CLK.
+ */
+static void
+drv_jiffy_send(uint8_t data, bool eoi)
+{
+    int i;
+
+    for (i = 0; i < 8; i += 2, data >>= 2) {
+        drv_delay(JIFFY_SLOT);
+        drv_set(IEC_CLOCK, (data & 1) == 0);
+        drv_set(IEC_DATA, (data & 2) == 0);
+    }
+    drv_delay(JIFFY_SLOT);
+    drv_set(IEC_CLOCK, !eoi);
+    drv_release(IEC_DATA);
+    drv_delay(JIFFY_SLOT);
+    drv_pull(IEC_CLOCK);
+}
+
+/*
+ * Send a byte of a burst transfer via SRQ, MSB first, once the host
+ * toggles CLK.
+ */
+static void
+drv_burst_send(uint8_t data, bool *clk)
+{
+    int i;
+
+    while (drv_get(IEC_CLOCK) == *clk)
+        drv_delay(drive_cfg.react);
+    *clk = !*clk;
+
+    for (i = 0; i < 8; i++, data <<= 1) {
+        drv_set(IEC_DATA, (data & 0x80) == 0);
+        drv_pull(IEC_SRQ);
+        drv_delay(drive_cfg.srqBit / 2);
+        drv_release(IEC_SRQ);
+        drv_delay(drive_cfg.srqBit / 2);
+    }
+    drv_release(IEC_DATA);
+}
+
+/*
+ * Burst fastload ("U0" 0x1f) as the 1571/1581 ROM does it. Each block
+ * is a status byte, 0 with 254 data bytes or 0x1f with a count and the
+ * rest. An empty file stands for "file not found" (status 2).
+ */
+static void
+drv_burst_load(void)
+{
+    uint16_t pos, n;
+    bool clk;
+
+    drvAtnAbort = true;
+    drv_release(IEC_DATA | IEC_CLOCK);
+    clk = drv_get(IEC_CLOCK);
+
+    if (drive_file_len == 0)
+        drv_burst_send(0x02, &clk);
+    for (pos = 0; pos < drive_file_len; ) {
+        drv_delay(drive_cfg.burstBlock);
+        n = drive_file_len - pos;
+        if (n > 254) {
+            drv_burst_send(0x00, &clk);
+            n = 254;
+        } else {
+            drv_burst_send(0x1f, &clk);
+            drv_burst_send(n, &clk);
+        }
+        while (n-- != 0)
+            drv_burst_send(drive_file[pos++], &clk);
+    }
+}
+
+uint8_t
+drive_dos_block(uint8_t track, uint8_t sector, uint8_t *buf)
+{
+    uint8_t sectors;
+    uint16_t i;
+
+    if (track < 18)
+        sectors = 21;
+    else if (track < 25)
+        sectors = 19;
+    else if (track < 31)
+        sectors = 18;
+    else
+        sectors = 17;
+    if (track == 0 || track > 35 || sector >= sectors) {
+        memset(buf, 0, 256);
+        return 66;
+    }
+    for (i = 0; i < 256; i++)
+        buf[i] = track * 7 + sector * 29 + i;
+    return 0;
+}
+
+// Parse up to max decimal numbers from the command, skipping the rest.
+static uint8_t
+drv_dos_numbers(uint16_t pos, uint8_t *num, uint8_t max)
+{
+    uint8_t n = 0;
+
+    while (pos < drive_len && n < max) {
+        if (drive_buf[pos] < '0' || drive_buf[pos] > '9') {
+            pos++;
+            continue;
+        }
+        num[n] = 0;
+        while (pos < drive_len && drive_buf[pos] >= '0' &&
+            drive_buf[pos] <= '9')
+            num[n] = num[n] * 10 + drive_buf[pos++] - '0';
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Run a command sent to channel 15, only what the DOS block reader and
+ * the timing calibration need.
+ */
+static void
+drv_dos_command(void)
+{
+    uint8_t num[4];
+
+    drvError = 0;
+    drvMemLen = 0;
+    drvErrorTrack = drvErrorSector = 0;
+    if (drive_len >= 2 && drive_buf[0] == 'U' &&
+        (drive_buf[1] == '1' || drive_buf[1] == 'A')) {
+        if (drv_dos_numbers(2, num, 4) != 4) {
+            drvError = 30;
+            return;
+        }
+        drvError = drive_dos_block(num[2], num[3], drvBlock);
+        drvErrorTrack = num[2];
+        drvErrorSector = num[3];
+        drvBlockPos = 0;
+    } else if (drive_len >= 3 && memcmp(drive_buf, "B-P", 3) == 0) {
+        if (drv_dos_numbers(3, num, 2) != 2)
+            drvError = 30;
+        else
+            drvBlockPos = num[1];
+    } else if (drive_len >= 5 && memcmp(drive_buf, "M-R", 3) == 0) {
+        // Address and length are binary, one byte without a length.
+        drvMemAddr = drive_buf[3] | (drive_buf[4] << 8);
+        drvMemLen = drive_len >= 6 ? drive_buf[5] : 1;
+        if (drvMemLen == 0)
+            drvMemLen = 256;
+    } else
+        drvError = 31;
+}
+
+// Put what a talk on the channel sends into the buffer.
+static void
+drv_dos_talk(void)
+{
+    const char *msg;
+
+    if (drvChannel == 15 && drvMemLen != 0) {
+        // The "ROM" is a pattern made from the address.
+        for (drive_len = 0; drive_len < drvMemLen; drive_len++) {
+            drive_buf[drive_len] = (drvMemAddr + drive_len) * 11 +
+                ((drvMemAddr + drive_len) >> 8);
+        }
+        drvMemLen = 0;
+    } else if (drvChannel == 15) {
+        switch (drvError) {
+        case 0:
+            msg = "OK";
+            break;
+        case 66:
+            msg = "ILLEGAL TRACK OR SECTOR";
+            break;
+        default:
+            msg = "SYNTAX ERROR";
+            break;
+        }
+        drive_len = sprintf((char *)drive_buf, "%02u, %s,%02u,%02u\r",
+            drvError, msg, drvErrorTrack, drvErrorSector);
+        drvError = drvErrorTrack = drvErrorSector = 0;
+    } else {
+        drive_len = 256 - drvBlockPos;
+        memcpy(drive_buf, drvBlock + drvBlockPos, drive_len);
+    }
+}
+
+static void
+drv_command(uint8_t cmd)
+{
+    uint8_t dev = cmd & 0x1f;
+
+    switch (cmd & 0xe0) {
+    case 0x20:
+        if (cmd == 0x3f) {
+            // Commands to channel 15 run once the host unlistens.
+            if (drvListener && drvChannel == 15 && drive_cfg.burst &&
+                drive_len >= 3 && drive_buf[0] == 'U' &&
+                drive_buf[1] == '0' && (drive_buf[2] & 0x1f) == 0x1f)
+                drvBurstLoad = true;
+            else if (drvListener && drvChannel == 15 && drive_cfg.dos)
+                drv_dos_command();
+            drvListener = false;
+        } else if (dev == drive_cfg.device) {
+            drvListener = true;
+            drvTalker = false;
+        }
+        break;
+    case 0x40:
+        if (cmd == 0x5f)
+            drvTalker = false;
+        else if (dev == drive_cfg.device) {
+            drvTalker = true;
+            drvListener = false;
+        }
+        break;
+    default:
+        // Secondary address (data channel, close or open)
+        drvChannel = cmd & 0x0f;
+        if (drvListener)
+            drive_len = 0;
+        if (drvTalker) {
+            drvTalkPos = 0;
+            if (drive_cfg.dos)
+                drv_dos_talk();
+        }
+        break;
+    }
+}
+
+static void
+drv_listen(void)
+{
+    bool eoi;
+    uint8_t data;
+
+    drvAtnAbort = true;
+    for (;;) {
+        // The talker holds CLK and releases it when it is ready to send.
+        drv_wait(IEC_CLOCK, true);
+        if (drvJiffy) {
+            // JiffyDOS: we say when we're ready, the talker starts.
+            drv_release(IEC_DATA);
+            drv_wait(IEC_CLOCK, false);
+            data = drv_jiffy_recv(&eoi);
+        } else {
+            drv_wait(IEC_CLOCK, false);
+            data = drv_recv_byte(&eoi, false);
+        }
+        if (drive_len < DRIVE_BUF_SIZE - 1)
+            drive_buf[drive_len++] = data;
+
+        // The JiffyDOS ack is held for as long as storing the byte takes.
+        if (drvJiffy)
+            drv_delay(SIM_US(20));
+    }
+}
+
+static void
+drv_talk(void)
+{
+    // Turnaround: wait for the listener to release CLK, then take it.
+    drvAtnAbort = true;
+    drv_wait(IEC_CLOCK, false);
+    drv_pull(IEC_CLOCK);
+    drv_release(IEC_DATA);
+    drv_delay(SIM_US(80));
+
+    /*
+     * The buffer is looked at only once the listener is ready, so the
+     * script can fill it after the TALK.
+     */
+    while (drvJiffy) {
+        // The listener holds DATA until it took the last byte.
+        drv_wait(IEC_DATA, true);
+        if (drvTalkPos >= drive_len) {
+            // After EOI, show we're done. Otherwise time the host out.
+            if (drvTalkPos != 0)
+                drv_release(IEC_CLOCK);
+            for (;;)
+                drv_delay(drive_cfg.react);
+        }
+        drv_release(IEC_CLOCK);
+        drv_wait(IEC_DATA, false);
+        drv_jiffy_send(drive_buf[drvTalkPos], drvTalkPos == drive_len - 1);
+        drvTalkPos++;
+    }
+    for (;;) {
+        drv_release(IEC_CLOCK);
+        drv_wait(IEC_DATA, false);
+        if (drvTalkPos >= drive_len) {
+            // Nothing left to send, so just time out the listener.
+            for (;;)
+                drv_delay(drive_cfg.react);
+        }
+        drv_send_byte(drive_buf[drvTalkPos], drvTalkPos == drive_len - 1);
+        drvTalkPos++;
+    }
+}
+
+static void
+drv_atn(void)
+{
+    bool eoi;
+
+    // Answer ATN as every device does, dropping whatever it was doing.
+    drvAtnAbort = false;
+    drvJiffy = drvBurstLoad = false;
+    drv_release(IEC_CLOCK);
+    drv_pull(IEC_DATA);
+    sim_drv_pp_out = false;
+    sim_drv_sr_bits = 0;
+
+    for (;;) {
+        // The talker holds CLK and releases it once it is ready to send.
+        while (!drv_get(IEC_CLOCK) && drv_get(IEC_ATN))
+            drv_delay(drive_cfg.react);
+        while (drv_get(IEC_CLOCK) && drv_get(IEC_ATN))
+            drv_delay(drive_cfg.react);
+        if (!drv_get(IEC_ATN))
+            break;
+        drv_command(drv_recv_byte(&eoi, true));
+    }
+
+    // A fast host shifts a byte in via SRQ while ATN is active.
+    if (drvBurstLoad && sim_drv_sr_bits >= 8)
+        drv_burst_load();
+    else if (drvListener)
+        drv_listen();
+    else if (drvTalker)
+        drv_talk();
+    drv_release(IEC_DATA | IEC_CLOCK);
+}
+
+// s1: one bit per CLK/DATA handshake, see s1.a65
+static uint8_t
+drv_s1_recv(void)
+{
+    uint8_t data = 0;
+    bool bit;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        drv_wait(IEC_CLOCK, false);
+        drv_release(IEC_CLOCK | IEC_DATA);
+        bit = drv_get(IEC_DATA);
+        data = (data << 1) | bit;
+        drv_pull(IEC_CLOCK);
+        drv_wait(IEC_DATA, !bit);
+        drv_release(IEC_CLOCK);
+        drv_wait(IEC_CLOCK, true);
+        drv_pull(IEC_DATA);
+    }
+    return data;
+}
+
+static void
+drv_s1_send(uint8_t data)
+{
+    bool bit;
+    int i;
+
+    for (i = 0; i < 8; i++, data >>= 1) {
+        bit = data & 1;
+        drv_set(IEC_CLOCK, bit);
+        drv_release(IEC_DATA);
+        drv_wait(IEC_DATA, true);
+        drv_set(IEC_CLOCK, !bit);
+        drv_wait(IEC_DATA, false);
+        drv_release(IEC_CLOCK);
+        drv_pull(IEC_DATA);
+        drv_wait(IEC_CLOCK, true);
+    }
+}
+
+// s2: two bits per ATN cycle, the drive answers on CLK, see s2.a65
+static uint8_t
+drv_s2_recv(void)
+{
+    uint8_t data = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        drv_wait(IEC_ATN, false);
+        data = (data >> 1) | (drv_get(IEC_DATA) ? 0x80 : 0);
+        drv_release(IEC_CLOCK);
+        drv_wait(IEC_ATN, true);
+        data = (data >> 1) | (drv_get(IEC_DATA) ? 0x80 : 0);
+        drv_pull(IEC_CLOCK);
+    }
+    return data;
+}
+
+static void
+drv_s2_send(uint8_t data)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        drv_set(IEC_DATA, data & 1);
+        drv_release(IEC_CLOCK);
+        data >>= 1;
+        drv_wait(IEC_ATN, false);
+        drv_set(IEC_DATA, data & 1);
+        drv_pull(IEC_CLOCK);
+        data >>= 1;
+        drv_wait(IEC_ATN, true);
+    }
+    drv_release(IEC_DATA);
+}
+
+// pp: two bytes per DATA cycle on the parallel port, see pp1541.a65
+static void
+drv_pp_recv(uint8_t *data)
+{
+    drv_pull(IEC_DATA);
+    drv_wait(IEC_CLOCK, false);
+    data[0] = sim_pp_value();
+    drv_release(IEC_DATA);
+    drv_wait(IEC_CLOCK, true);
+    data[1] = sim_pp_value();
+}
+
+static void
+drv_pp_send(const uint8_t *data)
+{
+    sim_drv_pp_out = true;
+    sim_drv_pp = data[0];
+    drv_pull(IEC_DATA);
+    drv_wait(IEC_CLOCK, false);
+    sim_drv_pp = data[1];
+    drv_release(IEC_DATA);
+    drv_wait(IEC_CLOCK, true);
+}
+
+// p2: one byte per CLK cycle on the parallel port
+static uint8_t
+drv_p2_recv(void)
+{
+    uint8_t data;
+
+    drv_wait(IEC_CLOCK, false);
+    data = sim_pp_value();
+    drv_release(IEC_DATA);
+    drv_wait(IEC_CLOCK, true);
+    drv_pull(IEC_DATA);
+    return data;
+}
+
+static void
+drv_p2_send(uint8_t data)
+{
+    sim_drv_pp_out = true;
+    sim_drv_pp = data;
+    drv_wait(IEC_CLOCK, false);
+    drv_release(IEC_DATA);
+    drv_wait(IEC_CLOCK, true);
+    drv_pull(IEC_DATA);
+}
+
+/*
+ * nibtools: ATN handshaked bytes. The hardware ATN acknowledge pulls DATA
+ * as soon as the host sets ATN. The drive flips ATNA to release DATA once
+ * it is ready, and the hardware pulls DATA again when ATN is released.
+ */
+static void
+drv_parburst_send(uint8_t data)
+{
+    drv_wait(IEC_ATN, true);
+    drv_delay(SIM_US(13));
+    sim_drv_pp_out = true;
+    sim_drv_pp = data;
+    sim_drv_atna = true;
+    drv_release(IEC_DATA);
+    drv_wait(IEC_ATN, false);
+    drv_pull(IEC_DATA);
+    sim_drv_atna = false;
+    sim_drv_pp_out = false;
+}
+
+static uint8_t
+drv_parburst_recv(void)
+{
+    uint8_t data;
+
+    drv_wait(IEC_ATN, true);
+    drv_delay(SIM_US(13));
+    sim_drv_atna = true;
+    drv_release(IEC_DATA);
+    drv_wait(IEC_ATN, false);
+    data = sim_pp_value();
+    drv_pull(IEC_DATA);
+    sim_drv_atna = false;
+    return data;
+}
+
+/*
+ * Track transfers: nibtools sends the 00,55,aa,ff,XX command first. Then
+ * the drive streams one byte per GCR byte time and toggles DATA for each.
+ * It does not wait for the host, so a host that falls behind gets
+ * corrupted data, just like with the real drive.
+ */
+static void
+drv_nib_command(void)
+{
+    int i;
+
+    for (i = 0; i < 5; i++)
+        drv_parburst_recv();
+}
+
+static void
+drv_nib_send(void)
+{
+    uint16_t i;
+
+    drv_nib_command();
+    drv_parburst_send(0);
+    sim_drv_pp_out = true;
+    for (i = 0; i < drive_len; i++) {
+        drv_delay(drive_cfg.nibByte);
+        sim_drv_pp = drive_buf[i];
+        drv_set(IEC_DATA, i & 1);
+    }
+    drv_parburst_send(0);
+}
+
+static void
+drv_nib_recv(void)
+{
+    uint16_t i;
+
+    // The command is followed by one track alignment byte.
+    drv_nib_command();
+    drv_parburst_recv();
+    drv_delay(drive_cfg.nibStart);
+    for (i = 0; i <= drive_len; i++) {
+        drv_set(IEC_DATA, i & 1);
+        drv_delay(drive_cfg.nibByte);
+        drive_buf[i] = sim_pp_value();
+    }
+    drv_parburst_send(0);
+}
+
+static void
+drv_run_job(void)
+{
+    uint16_t i;
+    bool send = (jobType == DRIVE_JOB_SEND || jobType == DRIVE_JOB_NIB_SEND);
+
+    if (drvRunMode == DRIVE_NIB && jobType == DRIVE_JOB_SEND) {
+        drv_nib_send();
+        return;
+    }
+    if (drvRunMode == DRIVE_NIB && jobType == DRIVE_JOB_RECV) {
+        drv_nib_recv();
+        return;
+    }
+
+    // s2 starts each transfer by waiting for the host to set ATN.
+    if (drvRunMode == DRIVE_S2)
+        drv_wait(IEC_ATN, true);
+
+    for (i = 0; i < drive_len; i++) {
+        switch (drvRunMode) {
+        case DRIVE_S1:
+            if (send)
+                drv_s1_send(drive_buf[i]);
+            else
+                drive_buf[i] = drv_s1_recv();
+            break;
+        case DRIVE_S2:
+            if (send)
+                drv_s2_send(drive_buf[i]);
+            else
+                drive_buf[i] = drv_s2_recv();
+            break;
+        case DRIVE_PP:
+            if (send)
+                drv_pp_send(&drive_buf[i]);
+            else
+                drv_pp_recv(&drive_buf[i]);
+            i++;
+            break;
+        case DRIVE_P2:
+            if (send)
+                drv_p2_send(drive_buf[i]);
+            else
+                drive_buf[i] = drv_p2_recv();
+            break;
+        case DRIVE_NIB:
+            if (send)
+                drv_parburst_send(drive_buf[i]);
+            else
+                drive_buf[i] = drv_parburst_recv();
+            break;
+        }
+    }
+    sim_drv_pp_out = false;
+}
+
+// Drive code for the fast protocols, waiting for jobs from the script
+static void
+drv_fast(void)
+{
+    // Idle state of the lines once the drive code is running
+    switch (drvRunMode) {
+    case DRIVE_S2:
+        drv_pull(IEC_CLOCK);
+        break;
+    case DRIVE_NIB:
+        sim_drv_atn_ack = true;
+        /* FALLTHROUGH */
+    case DRIVE_P2:
+        drv_pull(IEC_DATA);
+        break;
+    }
+
+    for (;;) {
+        while (!jobPending)
+            drv_delay(drive_cfg.react);
+        drv_run_job();
+        jobPending = false;
+    }
+}
+
+static void
+drive_task(void)
+{
+    volatile int why;
+
+    why = setjmp(drvAbort);
+    for (;;) {
+        drvAtnAbort = false;
+        if (why == DRV_RESET)
+            drv_reset();
+        drvRunMode = drvMode;
+        sim_drv_pp_out = false;
+        sim_drv_atn_ack = sim_drv_atna = false;
+
+        if (drvRunMode != DRIVE_IEC) {
+            drv_release(IEC_DATA | IEC_CLOCK);
+            drv_fast();
+        } else if (why == DRV_ATN) {
+            drv_atn();
+        }
+
+        // Idle until ATN or something else happens.
+        why = 0;
+        drvAtnAbort = (drvRunMode == DRIVE_IEC);
+        for (;;)
+            drv_delay(drive_cfg.react);
+    }
+}
+
+void
+drive_init(void)
+{
+    sim_task_start(drive_task);
+}
+
+void
+drive_set_mode(uint8_t mode)
+{
+    drvMode = mode;
+    jobPending = false;
+}
+
+void
+drive_start_job(uint8_t type, uint16_t len)
+{
+    jobType = type;
+    drive_len = len;
+    jobPending = true;
+}
+
+bool
+drive_job_busy(void)
+{
+    return jobPending;
+}
@@ -0,0 +1,78 @@
+/*
+ * Host simulation of the xum1541: virtual drive on the IEC bus
+ *
+ * The drive answers the standard IEC protocol as device 8 (or whatever
+ * is configured) and runs the drive side of the fast protocols as jobs
+ * given to it by the script. It polls the bus every "react" ns like
+ * the wait loops of the 6502 code do.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_DRIVE_H
+#define _SIM_DRIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Protocol the drive is running
+enum {
+    DRIVE_IEC = 0,
+    DRIVE_S1,
+    DRIVE_S2,
+    DRIVE_PP,
+    DRIVE_P2,
+    DRIVE_NIB,
+};
+
+// Drive timing and address. All times are in ns.
+struct drive_config {
+    uint8_t device;     // IEC device number
+    uint8_t jiffy;      // answer the JiffyDOS probe
+    uint8_t burst;      // 1571/1581 ROM, knows the burst fastload
+    uint8_t dos;        // run "U1" and "B-P", answer the error channel
+    uint32_t react;     // time between polls of the bus
+    uint32_t ts;        // talker bit setup time
+    uint32_t tv;        // talker bit valid time
+    uint32_t nibByte;   // time per byte of a nibbler track stream
+    uint32_t nibStart;  // time until a track write starts (sync, alignment)
+    uint32_t boot;      // time from the end of reset until ready
+    uint32_t srqBit;    // time per bit of fast serial output
+    uint32_t burstBlock; // time to read the next sector of a burst load
+    uint32_t listenBit; // time to store a bit as listener, 0 for no limit
+};
+
+extern struct drive_config drive_cfg;
+
+// Buffer for IEC and job data
+#define DRIVE_BUF_SIZE  0x10000
+extern uint8_t drive_buf[DRIVE_BUF_SIZE];
+extern uint16_t drive_len;
+
+// The file the drive sends for a burst fastload, whatever its name
+extern uint8_t drive_file[DRIVE_BUF_SIZE];
+extern uint16_t drive_file_len;
+
+/*
+ * The disk the DOS emulation reads "U1" blocks from. Tracks have the
+ * 1541 sector counts and each block holds a pattern made from its
+ * track and sector. Returns the DOS error number, 66 for a bad block.
+ */
+uint8_t drive_dos_block(uint8_t track, uint8_t sector, uint8_t *buf);
+
+// Job types, the drive sends or receives drive_len bytes of drive_buf
+enum {
+    DRIVE_JOB_SEND = 0,     // protocol transfer to the host
+    DRIVE_JOB_RECV,         // protocol transfer from the host
+    DRIVE_JOB_NIB_SEND,     // ATN handshaked nibbler command bytes
+    DRIVE_JOB_NIB_RECV,
+};
+
+void drive_init(void);
+void drive_set_mode(uint8_t mode);
+void drive_start_job(uint8_t type, uint16_t len);
+bool drive_job_busy(void);
+
+#endif // _SIM_DRIVE_H
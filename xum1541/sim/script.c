@@ -0,0 +1,739 @@
+/*
+ * Host simulation of the xum1541: simulated USB host running a script
+ *
+ * Each line of the script is one command, the same ones the opencbm
+ * xum1541 plugin sends. Data transfers are checked against what the
+ * virtual drive sent or received and timed in simulated microseconds:
+ *
+ *   init | reset | shutdown        control requests
+ *   set NAME VALUE                 timing (see setVars below), in us
+ *   set device N | set jiffy 0|1   drive address, JiffyDOS drive
+ *   set burst 0|1                  1571/1581 drive with burst fastload
+ *   set dos 0|1                    drive runs "U1" and "B-P" commands
+ *   drive iec|s1|s2|pp|p2|nib      start drive code for a protocol
+ *   setrelease SET RELEASE         IEC lines (bits as in opencbm.h)
+ *   poll                           print the IEC lines
+ *   listen|talk|open|close DEV SA  IEC commands under ATN
+ *   unlisten | untalk
+ *   write N | read N               IEC data transfers
+ *   PROTO write N | PROTO read N   s1, s2, pp, p2, nib and nibcmd
+ *   burst N                        burst fastload of an N byte file; with
+ *                                  "set burst 0" the adapter must give up
+ *   dos N [TRACK] | dosstep ...    read N blocks via the adapter's DOS
+ *                                  block reader or one step at a time
+ *   timing PROFILE                 IEC timing of the drive, a profile
+ *                                  (1541, 1571, 1581, fast) or calibrate
+ *   echo TEXT                      print a line
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xum1541.h"
+#include "sim/drive.h"
+
+int firmware_main(void);
+
+struct protocol {
+    const char *name;
+    uint8_t proto;
+    uint8_t mode;
+};
+
+static const struct protocol protocols[] = {
+    { "s1",     XUM1541_S1,             DRIVE_S1 },
+    { "s2",     XUM1541_S2,             DRIVE_S2 },
+    { "pp",     XUM1541_PP,             DRIVE_PP },
+    { "p2",     XUM1541_P2,             DRIVE_P2 },
+    { "nib",    XUM1541_NIB,            DRIVE_NIB },
+    { "nibcmd", XUM1541_NIB_COMMAND,    DRIVE_NIB },
+    { NULL,     0,                      0 },
+};
+
+struct setVar {
+    const char *name;
+    uint32_t *ns;
+};
+
+// nibtools track commands, the firmware knows them by these codes
+#define NIB_READ_TRACK  0x03
+#define NIB_WRITE_TRACK 0x0b
+
+static uint32_t timeoutNs = 3000000000U;
+
+static const struct setVar setVars[] = {
+    { "react",          &drive_cfg.react },
+    { "ts",             &drive_cfg.ts },
+    { "tv",             &drive_cfg.tv },
+    { "nib_byte",       &drive_cfg.nibByte },
+    { "nib_start",      &drive_cfg.nibStart },
+    { "boot",           &drive_cfg.boot },
+    { "srq_bit",        &drive_cfg.srqBit },
+    { "burst_block",    &drive_cfg.burstBlock },
+    { "listen_bit",     &drive_cfg.listenBit },
+    { "usb_latency",    &sim_usb_latency },
+    { "usb_byte",       &sim_usb_byte },
+    { "timeout",        &timeoutNs },
+    { NULL,             NULL },
+};
+
+static FILE *scriptFile;
+static const char *scriptName;
+static int lineNum, numChecks, numFailed;
+static bool verbose;
+
+static uint8_t hostBuf[XUM_MAX_XFER_SIZE];
+static uint8_t pattern[XUM_MAX_XFER_SIZE];
+static uint8_t patternSeed;
+
+// Abort the run with the script position if a command never finishes.
+void
+sim_timeout(void)
+{
+    sim_fatal("%s:%d: timeout", scriptName, lineNum);
+}
+
+static void
+host_wait(uint64_t ns)
+{
+    sim_sleep(ns);
+    if (sim_now > sim_deadline)
+        sim_timeout();
+}
+
+/*
+ * Test data, different for each command. Consecutive bytes never match
+ * the 00,55,aa,ff nibtools command prefix.
+ */
+static void
+make_pattern(uint16_t len)
+{
+    uint16_t i;
+
+    patternSeed += 0x35;
+    for (i = 0; i < len; i++)
+        pattern[i] = patternSeed + i * 13 + (i >> 8);
+}
+
+static void
+host_cmd(uint8_t cmd, uint8_t arg1, uint16_t arg2)
+{
+    uint8_t buf[XUM_CMDBUF_SIZE];
+
+    buf[0] = cmd;
+    buf[1] = arg1;
+    buf[2] = arg2 & 0xff;
+    buf[3] = arg2 >> 8;
+    sim_usb_out(buf, sizeof(buf));
+}
+
+// Get the status of a command that returns one, -1 if none came back.
+static int
+host_status(uint16_t *val)
+{
+    uint8_t status[XUM_STATUSBUF_SIZE];
+
+    if (sim_usb_in(status, sizeof(status)) != sizeof(status))
+        return -1;
+    if (val != NULL)
+        *val = XUM_GET_STATUS_VAL(status);
+    return XUM_GET_STATUS(status);
+}
+
+static uint16_t
+host_cbm_write(const uint8_t *buf, uint16_t len, uint8_t flags)
+{
+    uint16_t written = 0;
+
+    host_cmd(XUM1541_WRITE, XUM1541_CBM | flags, len);
+    sim_usb_out(buf, len);
+    if (host_status(&written) != XUM1541_IO_READY)
+        return 0;
+    return written;
+}
+
+static void
+host_wait_drive(void)
+{
+    while (drive_job_busy())
+        host_wait(SIM_US(1));
+}
+
+static void
+report(const char *cmd, uint16_t len, uint64_t start, bool ok)
+{
+    double us = (sim_now - start) / 1000.0;
+
+    numChecks++;
+    if (!ok)
+        numFailed++;
+    printf("%4d  %-20s %6u %12.1f us %9.2f us/byte  %s\n", lineNum, cmd,
+        len, us, len != 0 ? us / len : 0.0, ok ? "ok" : "FAIL");
+}
+
+static void
+report_mismatch(const uint8_t *got, const uint8_t *expected, uint16_t len)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        if (got[i] != expected[i]) {
+            printf("      first mismatch at %u: got %02x, expected %02x\n",
+                i, got[i], expected[i]);
+            return;
+        }
+    }
+}
+
+static bool
+check_data(const uint8_t *got, uint16_t gotLen, uint16_t len)
+{
+    if (gotLen != len) {
+        printf("      got %u of %u bytes\n", gotLen, len);
+        return false;
+    }
+    if (memcmp(got, pattern, len) != 0) {
+        report_mismatch(got, pattern, len);
+        return false;
+    }
+    return true;
+}
+
+// IEC commands under ATN
+static void
+do_atn(const char *cmd, uint8_t dev, uint8_t sa)
+{
+    uint8_t buf[2];
+    uint8_t len = 1, flags = XUM_WRITE_ATN;
+    uint64_t start = sim_now;
+
+    if (strcmp(cmd, "listen") == 0) {
+        buf[0] = 0x20 | dev;
+        buf[1] = 0x60 | sa;
+        len = 2;
+        flags |= XUM_WRITE_JIFFY;
+    } else if (strcmp(cmd, "talk") == 0) {
+        buf[0] = 0x40 | dev;
+        buf[1] = 0x60 | sa;
+        len = 2;
+        flags |= XUM_WRITE_TALK | XUM_WRITE_JIFFY;
+    } else if (strcmp(cmd, "open") == 0) {
+        buf[0] = 0x20 | dev;
+        buf[1] = 0xf0 | sa;
+        len = 2;
+        flags |= XUM_WRITE_JIFFY;
+    } else if (strcmp(cmd, "close") == 0) {
+        buf[0] = 0x20 | dev;
+        buf[1] = 0xe0 | sa;
+        len = 2;
+    } else if (strcmp(cmd, "unlisten") == 0)
+        buf[0] = 0x3f;
+    else
+        buf[0] = 0x5f;
+
+    report(cmd, len, start, host_cbm_write(buf, len, flags) == len);
+}
+
+static void
+do_iec_write(uint16_t len)
+{
+    uint64_t start = sim_now;
+    uint16_t first = drive_len, written;
+    bool ok;
+
+    make_pattern(len);
+    written = host_cbm_write(pattern, len, 0);
+    ok = (written == len) && check_data(drive_buf + first, drive_len - first,
+        len);
+    report("write", len, start, ok);
+}
+
+static void
+do_iec_read(uint16_t len)
+{
+    uint64_t start = sim_now;
+    uint16_t got;
+
+    // The drive looks at its buffer only once we ask for the first byte.
+    make_pattern(len);
+    memcpy(drive_buf, pattern, len);
+    drive_len = len;
+
+    host_cmd(XUM1541_READ, XUM1541_CBM, len);
+    got = sim_usb_in(hostBuf, len);
+    report("read", len, start, check_data(hostBuf, got, len));
+}
+
+/*
+ * Burst fastload like cbm_burst_load(): the "U0" 0x1f command goes to
+ * channel 15 with a fast host announced, then the blocks are read one
+ * at a time. An empty file must end in the "file not found" status.
+ * A drive without burst fastload never answers, so the adapter has to
+ * time out and return nothing.
+ */
+static void
+do_burst_load(uint16_t len)
+{
+    static const uint8_t cmd[] = { 'U', '0', 0x1f, 'F' };
+    uint8_t buf[2], block[256];
+    uint16_t got, total = 0;
+    uint64_t start = sim_now;
+    bool ok = true;
+
+    make_pattern(len);
+    memcpy(drive_file, pattern, len);
+    drive_file_len = len;
+
+    buf[0] = 0x20 | drive_cfg.device;
+    buf[1] = 0x6f;
+    ok = host_cbm_write(buf, 2, XUM_WRITE_ATN | XUM_WRITE_FAST) == 2 &&
+        host_cbm_write(cmd, sizeof(cmd), 0) == sizeof(cmd);
+    buf[0] = 0x3f;
+    ok = host_cbm_write(buf, 1, XUM_WRITE_ATN | XUM_WRITE_FAST) == 1 && ok;
+
+    while (ok) {
+        host_cmd(XUM1541_READ, XUM1541_BURST_LOAD, sizeof(block));
+        got = sim_usb_in(block, sizeof(block));
+        if (got == 1 + 254 && block[0] < 2) {
+            memcpy(hostBuf + total, block + 1, 254);
+            total += 254;
+        } else if (got >= 2 && block[0] == 0x1f && got == 2 + block[1]) {
+            memcpy(hostBuf + total, block + 2, block[1]);
+            total += block[1];
+            break;
+        } else if (drive_cfg.burst) {
+            ok = (len == 0 && got == 1 && block[0] == 0x02);
+            break;
+        } else {
+            ok = (got == 0);
+            break;
+        }
+    }
+    report("burst", len, start, ok && (drive_cfg.burst ?
+        check_data(hostBuf, total, len) : total == 0));
+}
+
+// Block i of a "dos" command, all of them on track if it is not 0
+static void
+dos_block_ts(uint16_t i, uint8_t track, uint8_t *ts)
+{
+    ts[0] = track != 0 ? track : 1 + (i / 17) % 35;
+    ts[1] = track != 0 ? i : i % 17;
+}
+
+// Read one block as the "original" transfer mode does, step by step.
+static void
+host_dos_step(uint8_t *ts, uint8_t *block)
+{
+    uint8_t buf[32], status[40];
+    int len;
+
+    buf[0] = 0x20 | drive_cfg.device;
+    buf[1] = 0x6f;
+    host_cbm_write(buf, 2, XUM_WRITE_ATN);
+    len = sprintf((char *)buf, "U1:2 0 %u %u", ts[0], ts[1]);
+    host_cbm_write(buf, len, 0);
+    buf[0] = 0x3f;
+    host_cbm_write(buf, 1, XUM_WRITE_ATN);
+
+    buf[0] = 0x40 | drive_cfg.device;
+    buf[1] = 0x6f;
+    host_cbm_write(buf, 2, XUM_WRITE_ATN | XUM_WRITE_TALK);
+    host_cmd(XUM1541_READ, XUM1541_CBM, sizeof(status));
+    len = sim_usb_in(status, sizeof(status));
+    buf[0] = 0x5f;
+    host_cbm_write(buf, 1, XUM_WRITE_ATN);
+
+    memset(block, 0, 256);
+    block[256] = 0xff;
+    if (len < 2)
+        return;
+    block[256] = (status[0] - '0') * 10 + status[1] - '0';
+    if (block[256] != 0)
+        return;
+
+    buf[0] = 0x20 | drive_cfg.device;
+    buf[1] = 0x6f;
+    host_cbm_write(buf, 2, XUM_WRITE_ATN);
+    len = sprintf((char *)buf, "B-P:2 0");
+    host_cbm_write(buf, len, 0);
+    buf[0] = 0x3f;
+    host_cbm_write(buf, 1, XUM_WRITE_ATN);
+
+    buf[0] = 0x40 | drive_cfg.device;
+    buf[1] = 0x62;
+    host_cbm_write(buf, 2, XUM_WRITE_ATN | XUM_WRITE_TALK);
+    host_cmd(XUM1541_READ, XUM1541_CBM, 256);
+    if (sim_usb_in(block, 256) != 256)
+        block[256] = 0xff;
+    buf[0] = 0x5f;
+    host_cbm_write(buf, 1, XUM_WRITE_ATN);
+}
+
+/*
+ * Read blocks on channel 2 like the "original" transfer mode, with the
+ * DOS block reader up to XUM_DOS_MAX_BLOCKS at a time or step by step.
+ * Each block is checked for its data and the DOS error number.
+ */
+static void
+do_dos_read(uint16_t n, uint8_t track, bool step)
+{
+    uint8_t buf[2 + 2 * XUM_DOS_MAX_BLOCKS], expected[XUM_DOS_BLOCK_SIZE];
+    uint16_t i, j, k, got;
+    uint64_t start = sim_now;
+    bool ok = true;
+
+    for (i = 0; i < n && ok; i += k) {
+        k = n - i;
+        if (k > XUM_DOS_MAX_BLOCKS)
+            k = XUM_DOS_MAX_BLOCKS;
+        for (j = 0; j < k; j++)
+            dos_block_ts(i + j, track, buf + 2 + 2 * j);
+
+        if (step) {
+            for (j = 0; j < k; j++)
+                host_dos_step(buf + 2 + 2 * j,
+                    hostBuf + j * XUM_DOS_BLOCK_SIZE);
+            got = k * XUM_DOS_BLOCK_SIZE;
+        } else {
+            buf[0] = drive_cfg.device;
+            buf[1] = 2;
+            host_cmd(XUM1541_WRITE, XUM1541_DOS_READ, 2 + 2 * k);
+            sim_usb_out(buf, 2 + 2 * k);
+            host_cmd(XUM1541_READ, XUM1541_DOS_READ,
+                k * XUM_DOS_BLOCK_SIZE);
+            got = sim_usb_in(hostBuf, k * XUM_DOS_BLOCK_SIZE);
+        }
+        if (got != k * XUM_DOS_BLOCK_SIZE) {
+            printf("      got %u of %u bytes\n", got,
+                k * XUM_DOS_BLOCK_SIZE);
+            ok = false;
+            break;
+        }
+
+        for (j = 0; j < k && ok; j++) {
+            expected[256] = drive_dos_block(buf[2 + 2 * j], buf[3 + 2 * j],
+                expected);
+            if (memcmp(hostBuf + j * XUM_DOS_BLOCK_SIZE, expected,
+                XUM_DOS_BLOCK_SIZE) != 0) {
+                printf("      block %u:", i + j);
+                report_mismatch(hostBuf + j * XUM_DOS_BLOCK_SIZE, expected,
+                    XUM_DOS_BLOCK_SIZE);
+                ok = false;
+            }
+        }
+    }
+    report(step ? "dosstep" : "dos", n, start, ok);
+}
+
+static void
+host_nib_command(uint8_t cmd)
+{
+    uint8_t buf[5] = { 0x00, 0x55, 0xaa, 0xff, cmd };
+
+    host_cmd(XUM1541_WRITE, XUM1541_NIB_COMMAND, sizeof(buf));
+    sim_usb_out(buf, sizeof(buf));
+}
+
+static void
+do_proto(const struct protocol *p, const char *dir, uint16_t len)
+{
+    uint64_t start = sim_now;
+    uint16_t got;
+    uint8_t ack;
+    char name[32];
+    bool ok = true;
+
+    snprintf(name, sizeof(name), "%s %s", p->name, dir);
+    make_pattern(len);
+    if (strcmp(dir, "read") == 0) {
+        memcpy(drive_buf, pattern, len);
+        drive_start_job(p->proto == XUM1541_NIB_COMMAND ?
+            DRIVE_JOB_NIB_SEND : DRIVE_JOB_SEND, len);
+
+        /*
+         * Read track like nibtools. The firmware answers the handshake
+         * itself and does it with the drive once the read is started.
+         */
+        if (p->proto == XUM1541_NIB) {
+            host_nib_command(NIB_READ_TRACK);
+            host_cmd(XUM1541_READ, XUM1541_NIB_COMMAND, 1);
+            ok = sim_usb_in(&ack, 1) == 1 && ack == 0x88;
+        }
+        host_cmd(XUM1541_READ, p->proto, len);
+        got = sim_usb_in(hostBuf, len);
+        ok = check_data(hostBuf, got, len) && ok;
+        host_wait_drive();
+    } else {
+        drive_start_job(p->proto == XUM1541_NIB_COMMAND ?
+            DRIVE_JOB_NIB_RECV : DRIVE_JOB_RECV, len);
+
+        // Write track like nibtools, the alignment byte is held back.
+        if (p->proto == XUM1541_NIB) {
+            host_nib_command(NIB_WRITE_TRACK);
+            hostBuf[0] = 0;
+            host_cmd(XUM1541_WRITE, XUM1541_NIB_COMMAND, 1);
+            sim_usb_out(hostBuf, 1);
+        }
+        host_cmd(XUM1541_WRITE, p->proto, len);
+        sim_usb_out(pattern, len);
+        host_wait_drive();
+        ok = check_data(drive_buf, len, len);
+    }
+    report(name, len, start, ok);
+}
+
+static void
+do_control(const char *cmd)
+{
+    uint8_t reply[XUM_DEVINFO_SIZE];
+    int8_t len;
+
+    if (strcmp(cmd, "init") == 0) {
+        len = sim_usb_control(REQTYPE_CLASS | REQDIR_DEVICETOHOST,
+            XUM1541_INIT, reply);
+        if (len == XUM_DEVINFO_SIZE) {
+            printf("      version %d, capabilities %02x, status %02x\n",
+                reply[0], reply[1], reply[2]);
+        }
+    } else if (strcmp(cmd, "reset") == 0) {
+        len = sim_usb_control(REQTYPE_CLASS | REQDIR_HOSTTODEVICE,
+            XUM1541_RESET, NULL);
+    } else {
+        len = sim_usb_control(REQTYPE_CLASS | REQDIR_HOSTTODEVICE,
+            XUM1541_SHUTDOWN, NULL);
+    }
+    if (len < 0)
+        printf("      %s was stalled\n", cmd);
+}
+
+/*
+ * Set the IEC timing of the drive. Calibration fails if it doesn't come
+ * up with a timing or takes longer than the 1541 profile.
+ */
+static void
+do_timing(const char *name)
+{
+    static const char *profiles[] = { "1541", "1571", "1581", "fast" };
+    uint8_t profile;
+    uint16_t timing = 0;
+    uint64_t start = sim_now;
+
+    for (profile = 0; profile < 4; profile++) {
+        if (strcmp(name, profiles[profile]) == 0)
+            break;
+    }
+    if (profile == 4)
+        profile = XUM_IEC_PROFILE_CALIBRATE;
+
+    host_cmd(XUM1541_IEC_TIMING, drive_cfg.device, profile);
+    host_status(&timing);
+    printf("      ts %u us, ack %u us\n", timing & 0xff, timing >> 8);
+    report("timing", 0, start, (timing & 0xff) != 0 &&
+        (timing & 0xff) <= 75 && (timing >> 8) <= 50);
+}
+
+static void
+do_setrelease(uint8_t set, uint8_t release)
+{
+    host_cmd(XUM1541_IEC_SETRELEASE, set, release);
+    host_status(NULL);
+}
+
+static void
+do_poll(void)
+{
+    uint16_t lines = 0;
+
+    host_cmd(XUM1541_IEC_POLL, 0, 0);
+    host_status(&lines);
+    printf("      lines %02x (data %d, clk %d, atn %d)\n", lines,
+        (lines & IEC_DATA) != 0, (lines & IEC_CLOCK) != 0,
+        (lines & IEC_ATN) != 0);
+}
+
+static bool
+run_line(char *line)
+{
+    char *argv[4], *p;
+    int argc;
+    const struct protocol *proto;
+    const struct setVar *var;
+    unsigned long n;
+
+    for (argc = 0, p = strtok(line, " \t\r\n"); p != NULL && argc < 4;
+        p = strtok(NULL, " \t\r\n"))
+        argv[argc++] = p;
+    if (argc == 0 || argv[0][0] == '#')
+        return true;
+    if (verbose)
+        fprintf(stderr, "%.1f us: %s:%d\n", sim_now / 1000.0, scriptName,
+            lineNum);
+
+    sim_deadline = sim_now + timeoutNs;
+    n = (argc > 1) ? strtoul(argv[argc - 1], NULL, 0) : 0;
+
+    if (strcmp(argv[0], "init") == 0 || strcmp(argv[0], "reset") == 0 ||
+        strcmp(argv[0], "shutdown") == 0) {
+        do_control(argv[0]);
+        return true;
+    }
+    if (strcmp(argv[0], "echo") == 0) {
+        printf("      %s\n", argc > 1 ? argv[1] : "");
+        return true;
+    }
+    if (strcmp(argv[0], "poll") == 0) {
+        do_poll();
+        return true;
+    }
+    if (strcmp(argv[0], "set") == 0 && argc == 3) {
+        for (var = setVars; var->name != NULL; var++) {
+            if (strcmp(var->name, argv[1]) == 0) {
+                *var->ns = (uint32_t)(strtod(argv[2], NULL) * 1000);
+                return true;
+            }
+        }
+        if (strcmp(argv[1], "device") == 0) {
+            drive_cfg.device = n;
+            return true;
+        }
+        if (strcmp(argv[1], "jiffy") == 0) {
+            drive_cfg.jiffy = n;
+            return true;
+        }
+        if (strcmp(argv[1], "burst") == 0) {
+            drive_cfg.burst = n;
+            return true;
+        }
+        if (strcmp(argv[1], "dos") == 0) {
+            drive_cfg.dos = n;
+            return true;
+        }
+        return false;
+    }
+    if (strcmp(argv[0], "drive") == 0 && argc == 2) {
+        if (strcmp(argv[1], "iec") == 0) {
+            drive_set_mode(DRIVE_IEC);
+            return true;
+        }
+        for (proto = protocols; proto->name != NULL; proto++) {
+            if (strcmp(proto->name, argv[1]) == 0) {
+                drive_set_mode(proto->mode);
+                return true;
+            }
+        }
+        return false;
+    }
+    if (strcmp(argv[0], "setrelease") == 0 && argc == 3) {
+        do_setrelease(strtoul(argv[1], NULL, 0), n);
+        return true;
+    }
+    if ((strcmp(argv[0], "listen") == 0 || strcmp(argv[0], "talk") == 0 ||
+        strcmp(argv[0], "open") == 0 || strcmp(argv[0], "close") == 0) &&
+        argc == 3) {
+        do_atn(argv[0], strtoul(argv[1], NULL, 0), n);
+        return true;
+    }
+    if (strcmp(argv[0], "unlisten") == 0 || strcmp(argv[0], "untalk") == 0) {
+        do_atn(argv[0], 0, 0);
+        return true;
+    }
+    if (strcmp(argv[0], "burst") == 0 && argc == 2 &&
+        n <= XUM_MAX_XFER_SIZE) {
+        do_burst_load(n);
+        return true;
+    }
+    if ((strcmp(argv[0], "dos") == 0 || strcmp(argv[0], "dosstep") == 0) &&
+        (argc == 2 || argc == 3)) {
+        // All 683 blocks of a 1541 disk at most
+        n = strtoul(argv[1], NULL, 0);
+        if (n == 0 || n > 683)
+            return false;
+        do_dos_read(n, argc == 3 ? strtoul(argv[2], NULL, 0) : 0,
+            argv[0][3] != '\0');
+        return true;
+    }
+    if (strcmp(argv[0], "timing") == 0 && argc == 2 &&
+        (strcmp(argv[1], "calibrate") == 0 || strcmp(argv[1], "fast") == 0 ||
+        n == 1541 || n == 1571 || n == 1581)) {
+        do_timing(argv[1]);
+        return true;
+    }
+    if (argc == 2 && n != 0 && n <= XUM_MAX_XFER_SIZE) {
+        if (strcmp(argv[0], "write") == 0) {
+            do_iec_write(n);
+            return true;
+        }
+        if (strcmp(argv[0], "read") == 0) {
+            do_iec_read(n);
+            return true;
+        }
+    }
+    if (argc == 3 && n != 0 && n <= XUM_MAX_XFER_SIZE &&
+        (strcmp(argv[1], "read") == 0 || strcmp(argv[1], "write") == 0)) {
+        for (proto = protocols; proto->name != NULL; proto++) {
+            if (strcmp(proto->name, argv[0]) == 0) {
+                // pp moves two bytes at a time.
+                if (proto->proto == XUM1541_PP && (n & 1) != 0)
+                    return false;
+                do_proto(proto, argv[1], n);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void
+host_task(void)
+{
+    char line[256];
+
+    // Let the firmware come up before sending anything.
+    sim_sleep(SIM_MS(10));
+
+    while (fgets(line, sizeof(line), scriptFile) != NULL) {
+        lineNum++;
+        if (!run_line(line))
+            sim_fatal("%s:%d: bad command", scriptName, lineNum);
+    }
+
+    printf("%d checks, %d failed, %.1f ms simulated\n", numChecks,
+        numFailed, sim_now / 1000000.0);
+    exit(numFailed != 0 ? 1 : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        verbose = true;
+        argc--;
+        argv++;
+    }
+    if (argc > 2) {
+        fprintf(stderr, "usage: xum1541-sim [-v] [script]\n");
+        return 2;
+    }
+
+    if (argc == 2) {
+        scriptName = argv[1];
+        scriptFile = fopen(scriptName, "r");
+        if (scriptFile == NULL) {
+            perror(scriptName);
+            return 2;
+        }
+    } else {
+        scriptName = "stdin";
+        scriptFile = stdin;
+    }
+
+    drive_init();
+    sim_task_start(host_task);
+    return firmware_main();
+}
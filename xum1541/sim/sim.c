@@ -0,0 +1,631 @@
+/*
+ * Host simulation of the xum1541: clock, tasks, IEC bus and USB endpoints
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "xum1541.h"
+
+#define SIM_MAX_TASKS       4
+#define SIM_STACK_SIZE      (256 * 1024)
+
+// USB endpoints are double banked, like on the AT90USB.
+#define SIM_EP_SIZE         XUM_ENDPOINT_BULK_SIZE
+#define SIM_EP_BANKS        2
+
+// Fixed per packet overhead on the wire (ns): token, handshake, CRC
+#define SIM_USB_PACKET      3000
+
+uint64_t sim_now;
+
+struct sim_task {
+    ucontext_t ctx;
+    uint64_t wake;
+    void (*fn)(void);
+};
+
+static struct sim_task tasks[SIM_MAX_TASKS];
+static int numTasks;
+static struct sim_task *curTask;        // NULL while the firmware runs
+static ucontext_t fwCtx;
+
+uint8_t sim_fw_lines, sim_drv_lines;
+bool sim_drv_atn_ack, sim_drv_atna;
+uint8_t sim_drv_sr, sim_drv_sr_bits;
+uint8_t sim_fw_pp, sim_drv_pp;
+bool sim_fw_pp_out, sim_drv_pp_out;
+
+uint64_t sim_deadline = UINT64_MAX;
+uint32_t sim_usb_latency = 1000000;     // one frame until a transfer starts
+uint32_t sim_usb_byte = 800;            // 12 Mbit/s plus bit stuffing
+
+struct sim_packet {
+    uint8_t len;
+    uint8_t data[SIM_EP_SIZE];
+};
+
+struct sim_endpoint {
+    struct sim_packet bank[SIM_EP_BANKS];   // queued packets, oldest first
+    uint8_t count;
+    uint8_t pos;                // OUT: next byte to read from bank[0]
+    struct sim_packet fill;     // IN: packet the firmware is writing
+    bool stalled;
+};
+
+static struct sim_endpoint epIn, epOut;
+static uint8_t curEndpoint;
+
+volatile uint8_t USB_DeviceState;
+USB_Request_Header_t USB_ControlRequest;
+
+// Control requests are delivered like the USB interrupt on the AVR.
+static bool irqEnabled = true, inIrq;
+static volatile bool ctrlPending, ctrlDone, ctrlAcked;
+static uint8_t ctrlReply[XUM_DEVINFO_SIZE];
+static uint8_t ctrlReplyLen;
+
+void
+sim_fatal(const char *fmt, ...)
+{
+    va_list ap;
+
+    fflush(stdout);
+    fprintf(stderr, "sim: %.1f us: ", sim_now / 1000.0);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+static void
+sim_task_entry(void)
+{
+    curTask->fn();
+
+    // A finished task never runs again.
+    curTask->wake = UINT64_MAX;
+    swapcontext(&curTask->ctx, &fwCtx);
+}
+
+void
+sim_task_start(void (*fn)(void))
+{
+    struct sim_task *t;
+
+    if (numTasks == SIM_MAX_TASKS)
+        sim_fatal("too many tasks");
+
+    t = &tasks[numTasks++];
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = malloc(SIM_STACK_SIZE);
+    t->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+    t->ctx.uc_link = NULL;
+    if (t->ctx.uc_stack.ss_sp == NULL)
+        sim_fatal("out of memory");
+    makecontext(&t->ctx, sim_task_entry, 0);
+    t->fn = fn;
+    t->wake = sim_now;
+}
+
+void
+sim_sleep(uint64_t ns)
+{
+    struct sim_task *t = curTask;
+
+    if (t == NULL)
+        sim_fatal("sim_sleep() called by the firmware");
+
+    t->wake = sim_now + (ns != 0 ? ns : 1);
+    swapcontext(&t->ctx, &fwCtx);
+}
+
+// Run all tasks which are due until the given time, earliest first.
+static void
+sim_run_tasks(uint64_t end)
+{
+    struct sim_task *t, *next;
+    int i;
+
+    for (;;) {
+        next = NULL;
+        for (i = 0; i < numTasks; i++) {
+            t = &tasks[i];
+            if (t->wake <= end && (next == NULL || t->wake < next->wake))
+                next = t;
+        }
+        if (next == NULL)
+            break;
+
+        if (next->wake > sim_now)
+            sim_now = next->wake;
+        curTask = next;
+        swapcontext(&fwCtx, &next->ctx);
+        curTask = NULL;
+    }
+}
+
+static void
+sim_usb_irq(void)
+{
+    uint8_t origEndpoint = curEndpoint;
+
+    inIrq = true;
+    ctrlPending = false;
+    ctrlAcked = false;
+    ctrlReplyLen = 0;
+
+    curEndpoint = 0;
+    EVENT_USB_Device_UnhandledControlRequest();
+    curEndpoint = origEndpoint;
+
+    inIrq = false;
+    ctrlDone = true;
+}
+
+void
+sim_advance(uint64_t ns)
+{
+    uint64_t end = sim_now + ns;
+
+    if (curTask != NULL)
+        sim_fatal("firmware code called from a task");
+
+    sim_run_tasks(end);
+    sim_now = end;
+
+    if (ctrlPending && irqEnabled && !inIrq)
+        sim_usb_irq();
+}
+
+void
+sim_cycles(uint16_t cycles)
+{
+    sim_advance((uint64_t)(cycles * SIM_CYCLE_NS + 0.5));
+}
+
+void
+sim_delay_us(double us)
+{
+    // IEC_T_TK is -1, which the AVR delay routines treat as no delay.
+    if (us > 0)
+        sim_advance((uint64_t)(us * 1000.0 + 0.5));
+}
+
+void
+sim_irq_enable(bool enable)
+{
+    irqEnabled = enable;
+    sim_cycles(1);
+}
+
+uint8_t
+sim_bus_lines(void)
+{
+    uint8_t lines = sim_fw_lines | sim_drv_lines;
+
+    if (sim_drv_atn_ack && ((lines & IEC_ATN) != 0) != sim_drv_atna)
+        lines |= IEC_DATA;
+    return lines;
+}
+
+void
+sim_srq_clock(void)
+{
+    sim_drv_sr = (sim_drv_sr << 1) | ((sim_bus_lines() & IEC_DATA) ? 0 : 1);
+    sim_drv_sr_bits++;
+}
+
+uint8_t
+sim_pp_value(void)
+{
+    uint8_t val = 0xff;         // pull-ups
+
+    if (sim_fw_pp_out)
+        val &= sim_fw_pp;
+    if (sim_drv_pp_out)
+        val &= sim_drv_pp;
+    return val;
+}
+
+/*
+ * LUFA device side, called by the firmware. Every call costs a few
+ * cycles so the firmware's polling loops advance the clock.
+ */
+void
+USB_Init(void)
+{
+    USB_DeviceState = DEVICE_STATE_Configured;
+    EVENT_USB_Device_Connect();
+    EVENT_USB_Device_ConfigurationChanged();
+}
+
+void
+USB_ShutDown(void)
+{
+    USB_DeviceState = DEVICE_STATE_Unattached;
+}
+
+static struct sim_endpoint *
+sim_endpoint(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+
+    if (curEndpoint == XUM_BULK_IN_ENDPOINT)
+        return &epIn;
+    if (curEndpoint == XUM_BULK_OUT_ENDPOINT)
+        return &epOut;
+    return NULL;
+}
+
+bool
+Endpoint_ConfigureEndpoint(uint8_t Number, uint8_t Type, uint8_t Direction,
+    uint16_t Size, uint8_t Banks)
+{
+    if (Size != SIM_EP_SIZE)
+        sim_fatal("endpoint %d has size %d", Number, Size);
+    return true;
+}
+
+void
+Endpoint_SelectEndpoint(uint8_t EndpointNumber)
+{
+    sim_cycles(SIM_USB_CYCLES);
+    curEndpoint = EndpointNumber;
+}
+
+uint8_t
+Endpoint_GetCurrentEndpoint(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+    return curEndpoint;
+}
+
+void
+Endpoint_ResetFIFO(uint8_t EndpointNumber)
+{
+    struct sim_endpoint *ep;
+
+    sim_cycles(SIM_USB_CYCLES);
+    if (EndpointNumber == XUM_BULK_IN_ENDPOINT)
+        ep = &epIn;
+    else if (EndpointNumber == XUM_BULK_OUT_ENDPOINT)
+        ep = &epOut;
+    else
+        return;
+
+    ep->count = 0;
+    ep->pos = 0;
+    ep->fill.len = 0;
+}
+
+void
+Endpoint_ResetDataToggle(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+}
+
+bool
+Endpoint_IsEnabled(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+    return true;
+}
+
+bool
+Endpoint_IsConfigured(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+    return true;
+}
+
+bool
+Endpoint_IsReadWriteAllowed(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep == &epIn)
+        return ep->count < SIM_EP_BANKS && ep->fill.len < SIM_EP_SIZE;
+    if (ep == &epOut)
+        return ep->count != 0 && ep->pos < ep->bank[0].len;
+    return false;
+}
+
+bool
+Endpoint_IsINReady(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    return ep == NULL || ep->count < SIM_EP_BANKS;
+}
+
+bool
+Endpoint_IsOUTReceived(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    return ep == &epOut && ep->count != 0;
+}
+
+uint16_t
+Endpoint_BytesInEndpoint(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep == &epIn)
+        return ep->fill.len;
+    if (ep == &epOut && ep->count != 0)
+        return ep->bank[0].len - ep->pos;
+    return 0;
+}
+
+void
+Endpoint_ClearSETUP(void)
+{
+    sim_cycles(SIM_USB_CYCLES);
+    if (curEndpoint == 0)
+        ctrlAcked = true;
+}
+
+void
+Endpoint_ClearIN(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep != &epIn)
+        return;
+    if (ep->count == SIM_EP_BANKS)
+        sim_fatal("ClearIN without a free bank");
+
+    ep->bank[ep->count++] = ep->fill;
+    ep->fill.len = 0;
+}
+
+void
+Endpoint_ClearOUT(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+    int i;
+
+    if (ep != &epOut || ep->count == 0)
+        return;
+
+    for (i = 1; i < ep->count; i++)
+        ep->bank[i - 1] = ep->bank[i];
+    ep->count--;
+    ep->pos = 0;
+}
+
+void
+Endpoint_StallTransaction(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep != NULL)
+        ep->stalled = true;
+}
+
+void
+Endpoint_ClearStall(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep != NULL)
+        ep->stalled = false;
+}
+
+bool
+Endpoint_IsStalled(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    return ep != NULL && ep->stalled;
+}
+
+uint8_t
+Endpoint_Read_Byte(void)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep != &epOut || ep->count == 0 || ep->pos >= ep->bank[0].len)
+        sim_fatal("Endpoint_Read_Byte() without data");
+    return ep->bank[0].data[ep->pos++];
+}
+
+void
+Endpoint_Write_Byte(uint8_t Byte)
+{
+    struct sim_endpoint *ep = sim_endpoint();
+
+    if (ep != &epIn || ep->count == SIM_EP_BANKS ||
+        ep->fill.len == SIM_EP_SIZE)
+        sim_fatal("Endpoint_Write_Byte() without a free bank");
+    ep->fill.data[ep->fill.len++] = Byte;
+}
+
+// Wait for OUT data, switching to the next bank once one is used up.
+static bool
+sim_wait_out(StreamCallbackPtr_t Callback)
+{
+    while (!Endpoint_IsReadWriteAllowed()) {
+        if (Endpoint_BytesInEndpoint() == 0)
+            Endpoint_ClearOUT();
+        if (Callback != NULL && Callback() == STREAMCALLBACK_Abort)
+            return false;
+    }
+    return true;
+}
+
+uint8_t
+Endpoint_Read_Stream_LE(void *Buffer, uint16_t Length,
+    StreamCallbackPtr_t Callback)
+{
+    uint8_t *buf = Buffer;
+
+    while (Length-- != 0) {
+        if (!sim_wait_out(Callback))
+            return ENDPOINT_RWSTREAM_CallbackAborted;
+        *buf++ = Endpoint_Read_Byte();
+    }
+    return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t
+Endpoint_Discard_Stream(uint16_t Length, StreamCallbackPtr_t Callback)
+{
+    while (Length-- != 0) {
+        if (!sim_wait_out(Callback))
+            return ENDPOINT_RWSTREAM_CallbackAborted;
+        Endpoint_Read_Byte();
+    }
+    return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t
+Endpoint_Write_Stream_LE(const void *Buffer, uint16_t Length,
+    StreamCallbackPtr_t Callback)
+{
+    const uint8_t *buf = Buffer;
+
+    while (Length-- != 0) {
+        while (!Endpoint_IsReadWriteAllowed()) {
+            if (Endpoint_BytesInEndpoint() == SIM_EP_SIZE &&
+                epIn.count < SIM_EP_BANKS)
+                Endpoint_ClearIN();
+            if (Callback != NULL && Callback() == STREAMCALLBACK_Abort)
+                return ENDPOINT_RWSTREAM_CallbackAborted;
+        }
+        Endpoint_Write_Byte(*buf++);
+    }
+    return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t
+Endpoint_Write_Control_Stream_LE(const void *Buffer, uint16_t Length)
+{
+    sim_cycles(SIM_USB_CYCLES * Length);
+    if (Length > sizeof(ctrlReply))
+        Length = sizeof(ctrlReply);
+    memcpy(ctrlReply, Buffer, Length);
+    ctrlReplyLen = Length;
+    return ENDPOINT_RWSTREAM_NoError;
+}
+
+/*
+ * Host side, called from the host task. Transfers start after the
+ * per transfer latency, then each packet takes its time on the wire.
+ */
+static void
+sim_host_wait(void)
+{
+    sim_sleep(SIM_US(1));
+    if (sim_now > sim_deadline)
+        sim_timeout();
+}
+
+static uint64_t
+sim_packet_time(uint8_t len)
+{
+    return SIM_USB_PACKET + (uint64_t)len * sim_usb_byte;
+}
+
+void
+sim_usb_out(const uint8_t *buf, uint16_t len)
+{
+    struct sim_packet *pkt;
+    uint8_t n;
+
+    sim_sleep(sim_usb_latency);
+    while (len != 0) {
+        n = (len < SIM_EP_SIZE) ? len : SIM_EP_SIZE;
+        while (epOut.count == SIM_EP_BANKS && !epOut.stalled)
+            sim_host_wait();
+        if (epOut.stalled)
+            return;
+
+        sim_sleep(sim_packet_time(n));
+        pkt = &epOut.bank[epOut.count];
+        memcpy(pkt->data, buf, n);
+        pkt->len = n;
+        epOut.count++;
+
+        buf += n;
+        len -= n;
+    }
+}
+
+uint16_t
+sim_usb_in(uint8_t *buf, uint16_t len)
+{
+    struct sim_packet pkt;
+    uint16_t got = 0, n;
+    int i;
+
+    sim_sleep(sim_usb_latency);
+    for (;;) {
+        while (epIn.count == 0 && !epIn.stalled)
+            sim_host_wait();
+        if (epIn.count == 0)
+            break;
+
+        pkt = epIn.bank[0];
+        sim_sleep(sim_packet_time(pkt.len));
+        for (i = 1; i < epIn.count; i++)
+            epIn.bank[i - 1] = epIn.bank[i];
+        epIn.count--;
+
+        n = (pkt.len < len - got) ? pkt.len : len - got;
+        memcpy(buf + got, pkt.data, n);
+        got += n;
+
+        // A short packet ends the transfer.
+        if (pkt.len < SIM_EP_SIZE || got == len)
+            break;
+    }
+    return got;
+}
+
+int8_t
+sim_usb_control(uint8_t bmRequestType, uint8_t request, uint8_t *reply)
+{
+    sim_sleep(sim_usb_latency);
+
+    USB_ControlRequest.bmRequestType = bmRequestType;
+    USB_ControlRequest.bRequest = request;
+    USB_ControlRequest.wValue = 0;
+    USB_ControlRequest.wIndex = 0;
+    USB_ControlRequest.wLength =
+        (bmRequestType & REQDIR_DEVICETOHOST) ? XUM_DEVINFO_SIZE : 0;
+    ctrlDone = false;
+    ctrlPending = true;
+    while (!ctrlDone)
+        sim_host_wait();
+
+    // Not acknowledged means the request was stalled.
+    if (!ctrlAcked)
+        return -1;
+
+    if (reply != NULL)
+        memcpy(reply, ctrlReply, ctrlReplyLen);
+    return ctrlReplyLen;
+}
+
+bool
+sim_usb_stalled(void)
+{
+    return epIn.stalled || epOut.stalled;
+}
+
+void
+sim_usb_clear_stall(void)
+{
+    epIn.stalled = epOut.stalled = false;
+}
@@ -0,0 +1,90 @@
+/*
+ * Host simulation of the xum1541: clock, tasks, IEC bus and USB endpoints
+ *
+ * The firmware runs unmodified on the host. Every port access, delay and
+ * USB endpoint access advances a simulated clock, and while the clock
+ * advances, the virtual drive and the simulated USB host run as
+ * cooperative tasks on their own stacks. Everything is deterministic, so
+ * a protocol loop always takes the same simulated time.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Simulated time since start, in ns
+extern uint64_t sim_now;
+
+#define SIM_US(x)           ((uint64_t)((x) * 1000))
+#define SIM_MS(x)           ((uint64_t)((x) * 1000000))
+
+/*
+ * Cost of firmware operations. Only IO port and USB endpoint accesses
+ * and the delays are counted, plain computation is free. This is close
+ * enough for the protocol loops, which are dominated by their waits.
+ */
+#define SIM_CYCLE_NS        (1000000000.0 / F_CPU)
+#define SIM_IO_CYCLES       2
+#define SIM_USB_CYCLES      4
+
+// Firmware side: advance the clock, running the drive and host meanwhile.
+void sim_advance(uint64_t ns);
+void sim_cycles(uint16_t cycles);
+void sim_delay_us(double us);
+void sim_irq_enable(bool enable);
+void sim_fatal(const char *fmt, ...)
+    __attribute__((noreturn, format(printf, 1, 2)));
+
+// Tasks (drive, host): start one, and sleep from within one.
+void sim_task_start(void (*fn)(void));
+void sim_sleep(uint64_t ns);
+
+/*
+ * The IEC bus. Each side pulls lines by setting their IEC_DATA, IEC_CLOCK,
+ * IEC_ATN and IEC_RESET bits; a line is active if either side pulls it.
+ *
+ * The 1541 also pulls DATA in hardware while ATN does not match its ATNA
+ * output. The drive turns this on with sim_drv_atn_ack.
+ */
+extern uint8_t sim_fw_lines, sim_drv_lines;
+extern bool sim_drv_atn_ack, sim_drv_atna;
+uint8_t sim_bus_lines(void);
+
+/*
+ * The serial port of a 1571/1581 drive. It shifts in DATA, MSB first,
+ * each time the firmware releases SRQ.
+ */
+extern uint8_t sim_drv_sr, sim_drv_sr_bits;
+void sim_srq_clock(void);
+
+// The parallel port. A side only drives it while its *_pp_out is set.
+extern uint8_t sim_fw_pp, sim_drv_pp;
+extern bool sim_fw_pp_out, sim_drv_pp_out;
+uint8_t sim_pp_value(void);
+
+/*
+ * The host side of the USB device. The transfers block the calling task
+ * for the simulated USB time. sim_usb_in() returns early on a short
+ * packet or a stall.
+ */
+void sim_usb_out(const uint8_t *buf, uint16_t len);
+uint16_t sim_usb_in(uint8_t *buf, uint16_t len);
+int8_t sim_usb_control(uint8_t bmRequestType, uint8_t request,
+    uint8_t *reply);
+bool sim_usb_stalled(void);
+void sim_usb_clear_stall(void);
+
+// USB timing: per transfer latency and per byte on the wire (ns)
+extern uint32_t sim_usb_latency, sim_usb_byte;
+
+// Host waits past the deadline call sim_timeout(), provided by the host.
+extern uint64_t sim_deadline;
+void sim_timeout(void) __attribute__((noreturn));
+
+#endif // _SIM_H
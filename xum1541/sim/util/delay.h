@@ -0,0 +1,17 @@
+/*
+ * Host simulation of the xum1541: stand-in for <util/delay.h>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _SIM_UTIL_DELAY_H
+#define _SIM_UTIL_DELAY_H
+
+#include "sim/sim.h"
+
+#define _delay_us(x)            sim_delay_us(x)
+#define _delay_ms(x)            sim_delay_us((x) * 1000.0)
+
+#endif // _SIM_UTIL_DELAY_H
@@ -8,7 +8,7 @@
 #ifdef TAPE_SUPPORT
 
 // Tape firmware version (check tape.h)
-#define TapeFirmwareVersion 0x0001
+#define TapeFirmwareVersion 0x0002
 
 // Tape State Register: Current state of tape operations.
 volatile uint8_t TSR = 0;
@@ -21,10 +21,36 @@ static volatile uint32_t Tape_Timer1Ovf   = 0; // Timer1 overflow counter.
 static volatile uint16_t Tape_Timer1Stamp = 0; // Timer1-ICR1 timestamp.
 static volatile uint16_t Tape_Timer1Stamp_last = 0; // Last Timer1-ICR1 timestamp.
 
+// Packed capture format (XUM_TAP_PACKED): a delta is sent as the difference
+// to one of the last four different deltas of the same signal level (pilot
+// tone, short/medium/long pulses of the loaders). There is a table for each
+// level, kept in most recently used order.
+//   0iixxxxx                    : 5 bit signed difference to table entry ii
+//   10xxxxxx xxxxxxxx           : 14 bit signed difference to table entry 0
+//   110xxxxx xxxxxxxx xxxxxxxx  : 21 bit delta
+//   11100000 + 5-byte timestamp : long delta in unpacked format, table unchanged
+#define TAPE_PACKED_TABLE_SIZE 4
+static bool              Tape_Packed = false;
+static uint32_t          Tape_PackedTable[2][TAPE_PACKED_TABLE_SIZE];
+static uint8_t           Tape_PackedLevel; // Signal level of the next delta (0/1).
+
 // Global variables (write)
 static volatile uint32_t HiDelta;
 static volatile uint16_t LoDelta;
-static volatile uint32_t DeltaCount;
+static volatile uint32_t DeltaCount; // Delta bytes still to be received from host.
+
+// Write delta ring: Tape_Write() receives the deltas from host while the
+// TIMER1_COMPA ISR writes the previous ones, so the ISR never waits for USB.
+// Together with the double banked OUT endpoint, the host can send the
+// next packet while the current one is written to tape.
+#define TAPE_DELTA_RING_SIZE 32 // Must be a power of 2.
+#define TAPE_UNDERRUN_RETRY  0x0200 // =32us (16MHz timer), wait for data on underrun.
+static volatile uint32_t Tape_RingHiDelta[TAPE_DELTA_RING_SIZE];
+static volatile uint16_t Tape_RingLoDelta[TAPE_DELTA_RING_SIZE];
+static volatile uint8_t  Tape_RingHead = 0, Tape_RingTail = 0;
+static volatile bool     Tape_AllDeltasReceived = false;
+static volatile bool     Tape_WaitingForDelta = false; // Ring ran empty while writing.
+static volatile uint16_t Tape_Underruns = 0;
 
 // Global variables (misc)
 volatile bool            StopWaitForSense = false;
@@ -77,9 +103,13 @@ uint16_t    Tape_StartWrite(void);                      // WRITE
 void        Tape_StopCapture(void);                     // READ
 uint16_t    Tape_StartWrite(void);                      // WRITE
 void        Tape_StopWrite(void);                       // WRITE
+int8_t      Tape_usbSendRawTimeStamp(void);             // READ
+int8_t      Tape_usbSendPackedTimeStamp(void);          // READ
 void        Tape_usbSendTimeStamp(void);                // READ
-void        Tape_usbReceiveDelta(void);                 // WRITE
-uint16_t    Tape_Capture(void);                         // READ
+int8_t      Tape_usbReceiveDelta(uint32_t *pHiDelta, uint16_t *pLoDelta); // WRITE
+void        Tape_FillDeltaRing(void);                   // WRITE
+bool        Tape_NextDelta(void);                       // WRITE
+uint16_t    Tape_Capture(bool Packed);                  // READ
 uint16_t    Tape_Write(void);                           // WRITE
 
 
@@ -878,8 +908,14 @@ uint16_t Tape_StartWrite(void)
 	// Pin Change Mask Register 0. Enable pin change interrupt on PB0: SENSE
 	PCMSK0 = (uint8_t)(1 << PCINT0);
 
-	// Receive first delta (+ avoid SENSE signal noise).
-	Tape_usbReceiveDelta();
+	// Receive first deltas (+ avoid SENSE signal noise).
+	Tape_FillDeltaRing();
+	if (!Tape_NextDelta())
+	{
+		// Nothing to write (or USB transfer failed).
+		Tape_StopWrite();
+		return TapeStatus;
+	}
 
 	// Reset Timer1.
 	TCNT1 = 0;
@@ -916,7 +952,7 @@ uint16_t Tape_StartWrite(void)
 	}
 
 	// TapeStatus initialized to Tape_Status_OK by Tape_PrepareWrite().
-	// Tape_usbReceiveDelta() above ("Receive first delta") may have flagged USB transfer failure.
+	// Tape_FillDeltaRing() above ("Receive first deltas") may have flagged USB transfer failure.
 	return TapeStatus;
 }
 
@@ -970,128 +1006,233 @@ void Tape_StopWrite(void)
 }
 
 
-// Send timestamp to host. Stop tape capture on error.
+// Send delta in unpacked format: 2 bytes (<2ms) or 5 bytes.
 // Executed from ISR while interrupts disabled.
-// Flags "Tape_Status_ERROR_usbSendByte" on USB transfer error.
-void Tape_usbSendTimeStamp(void)
+//   Return values:
+//    0: timestamp sent
+//   -1: USB transfer error
+int8_t Tape_usbSendRawTimeStamp(void)
 {
-	// Calculate delta
-	HiDelta = Tape_Timer1Ovf;
-	LoDelta = Tape_Timer1Stamp - Tape_Timer1Stamp_last;
-	if (Tape_Timer1Stamp < Tape_Timer1Stamp_last)
-		HiDelta--;
-	Tape_Timer1Ovf = 0;
-	Tape_Timer1Stamp_last = Tape_Timer1Stamp;
-
 	if ((HiDelta != 0) || (LoDelta >= 0x8000))
 	{
 		// Long signal (>=2ms)
 		// MSB of 5-byte timestamp must be 1 (restricts deltas to max 9.5 hours).
 		if (usbSendByte(((HiDelta >> 16) & 0xff) | 0x80) != 0)
-		{
-			Tape_StopCapture();
-			TapeStatus = Tape_Status_ERROR_usbSendByte;
-			return;
-		}
-
+			return -1;
 		if (usbSendByte((HiDelta >> 8) & 0xff) != 0)
-		{
-			Tape_StopCapture();
-			TapeStatus = Tape_Status_ERROR_usbSendByte;
-			return;
-		}
-
+			return -1;
 		if (usbSendByte(HiDelta & 0xff) != 0)
-		{
-			Tape_StopCapture();
-			TapeStatus = Tape_Status_ERROR_usbSendByte;
-			return;
-		}
+			return -1;
 	}
 
 	if (usbSendByte(LoDelta >> 8) != 0)
+		return -1;
+	if (usbSendByte(LoDelta & 0xff) != 0)
+		return -1;
+
+	return 0;
+}
+
+
+// Send delta in packed format (see top of file).
+// Executed from ISR while interrupts disabled.
+//   Return values:
+//    0: timestamp sent
+//   -1: USB transfer error
+int8_t Tape_usbSendPackedTimeStamp(void)
+{
+	uint32_t Delta, *pTable = Tape_PackedTable[Tape_PackedLevel];
+	int32_t  Diff;
+	uint8_t  i;
+
+	Tape_PackedLevel ^= 1;
+
+	if (HiDelta >= 0x20)
 	{
-		Tape_StopCapture();
-		TapeStatus = Tape_Status_ERROR_usbSendByte;
-		return;
+		// Very long signal (>=131ms): escape to unpacked format.
+		if (usbSendByte(0xe0) != 0)
+			return -1;
+		return Tape_usbSendRawTimeStamp();
 	}
 
-	if (usbSendByte(LoDelta & 0xff) != 0)
+	Delta = (HiDelta << 16) | LoDelta;
+
+	// Look for a table entry close enough for the 1 byte code.
+	for (i = 0; i < TAPE_PACKED_TABLE_SIZE; i++)
+	{
+		Diff = (int32_t)(Delta - pTable[i]);
+		if ((Diff >= -16) && (Diff < 16))
+			break;
+	}
+
+	if (i < TAPE_PACKED_TABLE_SIZE)
+	{
+		if (usbSendByte((i << 5) | (Diff & 0x1f)) != 0)
+			return -1;
+	}
+	else
+	{
+		i = TAPE_PACKED_TABLE_SIZE - 1; // New entry, drop the oldest one.
+		Diff = (int32_t)(Delta - pTable[0]);
+
+		if ((Diff >= -8192) && (Diff < 8192))
+		{
+			if (usbSendByte(0x80 | ((Diff >> 8) & 0x3f)) != 0)
+				return -1;
+			if (usbSendByte(Diff & 0xff) != 0)
+				return -1;
+		}
+		else
+		{
+			if (usbSendByte(0xc0 | (Delta >> 16)) != 0)
+				return -1;
+			if (usbSendByte((Delta >> 8) & 0xff) != 0)
+				return -1;
+			if (usbSendByte(Delta & 0xff) != 0)
+				return -1;
+		}
+	}
+
+	// Move entry to front.
+	for (; i > 0; i--)
+		pTable[i] = pTable[i - 1];
+	pTable[0] = Delta;
+
+	return 0;
+}
+
+
+// Send timestamp to host. Stop tape capture on error.
+// Executed from ISR while interrupts disabled.
+// Flags "Tape_Status_ERROR_usbSendByte" on USB transfer error.
+void Tape_usbSendTimeStamp(void)
+{
+	int8_t res;
+
+	// Calculate delta
+	HiDelta = Tape_Timer1Ovf;
+	LoDelta = Tape_Timer1Stamp - Tape_Timer1Stamp_last;
+	if (Tape_Timer1Stamp < Tape_Timer1Stamp_last)
+		HiDelta--;
+	Tape_Timer1Ovf = 0;
+	Tape_Timer1Stamp_last = Tape_Timer1Stamp;
+
+	if (Tape_Packed)
+		res = Tape_usbSendPackedTimeStamp();
+	else
+		res = Tape_usbSendRawTimeStamp();
+
+	if (res != 0)
 	{
 		Tape_StopCapture();
 		TapeStatus = Tape_Status_ERROR_usbSendByte;
-		return;
 	}
 }
 
 
-// Receive delta from host. Stop tape write on error.
-// Executed from ISR while interrupts disabled.
-// Flags "Tape_Status_ERROR_usbRecvByte" on USB transfer error.
-void Tape_usbReceiveDelta(void)
+// Receive delta from host.
+//   Return values:
+//    0: delta received
+//   -1: USB transfer error
+int8_t Tape_usbReceiveDelta(uint32_t *pHiDelta, uint16_t *pLoDelta)
 {
 	uint8_t data, data2;
 
 	if (usbRecvByte(&data) != 0)
-	{
-		Tape_StopWrite();
-		TapeStatus = Tape_Status_ERROR_usbRecvByte;
-		return;
-	}
+		return -1;
 
 	if (usbRecvByte(&data2) != 0)
-	{
-		Tape_StopWrite();
-		TapeStatus = Tape_Status_ERROR_usbRecvByte;
-		return;
-	}
+		return -1;
 
 	if ((data & 0x80) == 0)
 	{
 		// Short signal (<2ms)
-		HiDelta = 0;
-		LoDelta = data;
-		LoDelta = (LoDelta << 8) + data2;
+		*pHiDelta = 0;
+		*pLoDelta = ((uint16_t)data << 8) + data2;
 
 		// Update delta counter.
-		DeltaCount -= 2;
+		DeltaCount = (DeltaCount > 2) ? (DeltaCount - 2) : 0;
 	}
 	else
 	{
 		// Long signal (>=2ms)
-		HiDelta = data & 0x7F;
-		HiDelta = (HiDelta << 8) + data2;
+		*pHiDelta = data & 0x7F;
+		*pHiDelta = (*pHiDelta << 8) + data2;
 
 		if (usbRecvByte(&data) != 0)
-		{
-			Tape_StopWrite();
-			TapeStatus = Tape_Status_ERROR_usbRecvByte;
-			return;
-		}
-		HiDelta = (HiDelta << 8) + data;
+			return -1;
+		*pHiDelta = (*pHiDelta << 8) + data;
 
 		if (usbRecvByte(&data) != 0)
-		{
-			Tape_StopWrite();
-			TapeStatus = Tape_Status_ERROR_usbRecvByte;
-			return;
-		}
-		LoDelta = data;
+			return -1;
 
-		if (usbRecvByte(&data) != 0)
+		if (usbRecvByte(&data2) != 0)
+			return -1;
+		*pLoDelta = ((uint16_t)data << 8) + data2;
+
+		// Update delta counter.
+		DeltaCount = (DeltaCount > 5) ? (DeltaCount - 5) : 0;
+	}
+
+	return 0;
+}
+
+
+// Receive deltas from host into the ring until it is full or all deltas are received.
+// Executed from Tape_Write() while the ISR writes the deltas already in the ring.
+// Stops tape write and flags "Tape_Status_ERROR_usbRecvByte" on USB transfer error.
+void Tape_FillDeltaRing(void)
+{
+	uint32_t NewHiDelta;
+	uint16_t NewLoDelta;
+	uint8_t  NextHead, oldSREG;
+
+	while (!Tape_AllDeltasReceived && (TSR & XUM1541_TAP_WRITING))
+	{
+		NextHead = (Tape_RingHead + 1) & (TAPE_DELTA_RING_SIZE - 1);
+		if (NextHead == Tape_RingTail)
+			return; // Ring full.
+
+		if (Tape_usbReceiveDelta(&NewHiDelta, &NewLoDelta) != 0)
 		{
-			Tape_StopWrite();
+			oldSREG = SREG;
+			cli();
+			if (TSR & XUM1541_TAP_WRITING)
+				Tape_StopWrite();
 			TapeStatus = Tape_Status_ERROR_usbRecvByte;
+			SREG = oldSREG;
 			return;
 		}
-		LoDelta = (LoDelta << 8) + data;
 
-		// Update delta counter.
-		DeltaCount -= 5;
+		// Fill the entry before publishing it to the ISR.
+		Tape_RingHiDelta[Tape_RingHead] = NewHiDelta;
+		Tape_RingLoDelta[Tape_RingHead] = NewLoDelta;
+		Tape_RingHead = NextHead;
+
+		if (DeltaCount == 0)
+			Tape_AllDeltasReceived = true;
 	}
 }
 
 
+// Take next delta from the ring into HiDelta/LoDelta.
+// Executed from ISR while interrupts disabled.
+//   Return values:
+//   - true:  next delta available
+//   - false: ring empty
+bool Tape_NextDelta(void)
+{
+	if (Tape_RingTail == Tape_RingHead)
+		return false;
+
+	HiDelta = Tape_RingHiDelta[Tape_RingTail];
+	LoDelta = Tape_RingLoDelta[Tape_RingTail];
+	Tape_RingTail = (Tape_RingTail + 1) & (TAPE_DELTA_RING_SIZE - 1);
+
+	return true;
+}
+
+
 // Pin change interrupt: SENSE
 // Stop tape capture/write if user presses <STOP>.
 // Only active while actually reading or writing.
@@ -1143,7 +1284,7 @@ ISR(TIMER1_CAPT_vect)
 		TIFR1 |= (uint8_t)(1 << TOV1);
 	}
 
-	Tape_usbSendTimeStamp(); // Send 5-byte timestamp to host.
+	Tape_usbSendTimeStamp(); // Send timestamp to host.
 }
 
 
@@ -1168,7 +1309,7 @@ ISR(TIMER1_COMPA_vect)
 	}
 	else // (TSR & XUM1541_TAP_WRITING)
 	{
-		if (myOC1AMode == OC1A_KEEP)
+		if ((myOC1AMode == OC1A_KEEP) && !Tape_WaitingForDelta)
 		{
 			// No toggle on OC1A pin occurred.
 
@@ -1183,17 +1324,32 @@ ISR(TIMER1_COMPA_vect)
 			else
 				OCR1A = 0xffff;
 		}
-		else // (myOC1AMode == OC1A_CHANGE)
+		else // (myOC1AMode == OC1A_CHANGE) or waiting for delta
 		{
 			// A toggle on OC1A pin occurred.
 
-			if (DeltaCount < 1)
+			if (!Tape_NextDelta()) // Get next delta. LoDelta < 10 is endless CTC.
 			{
-				Tape_StopWrite();
+				if (Tape_AllDeltasReceived)
+				{
+					Tape_StopWrite();
+				}
+				else
+				{
+					// Underrun: host did not deliver the next delta in time.
+					// Keep WRITE signal (stretches this signal) and look again soon.
+					if (!Tape_WaitingForDelta)
+					{
+						Tape_Underruns++;
+						Tape_WaitingForDelta = true;
+					}
+					Tape_KeepOC1AonCompareMatch();
+					OCR1A = TAPE_UNDERRUN_RETRY;
+				}
 			}
 			else
 			{
-				Tape_usbReceiveDelta(); // Get next delta. LoDelta < 10 is endless CTC.
+				Tape_WaitingForDelta = false;
 
 				if (HiDelta == 0)
 				{
@@ -1213,7 +1369,7 @@ ISR(TIMER1_COMPA_vect)
 					else
 						OCR1A = 0xffff;
 				}
-			} // else (DeltaCount >= 1)
+			} // else (next delta available)
 		}
 	} // else (TSR & XUM1541_TAP_WRITING)
 }
@@ -1227,11 +1383,16 @@ ISR(TIMER1_COMPA_vect)
 //   - Tape_Status_ERROR_Sense_Not_On_Play
 //   - Tape_Status_ERROR_Device_Not_Configured
 //   - Tape_Status_ERROR_Device_Disconnected
-uint16_t Tape_Capture(void)
+uint16_t Tape_Capture(bool Packed)
 {
 	uint8_t oldSREG = SREG; // Unknown Global Interrupt Enable state.
 	cli(); // Disable interrupts.
 
+	// Reset packed format state.
+	Tape_Packed = Packed;
+	memset(Tape_PackedTable, 0, sizeof(Tape_PackedTable));
+	Tape_PackedLevel = 0;
+
 	wdt_reset(); // Feed the watchdog.
 	usbInitIo(-1, ENDPOINT_DIR_IN);
 	DELAY_MS(10);
@@ -1268,11 +1429,14 @@ uint16_t Tape_Capture(void)
 //   - Tape_Status_ERROR_External_Break
 //   - Tape_Status_ERROR_usbRecvByte
 //   - Tape_Status_ERROR_Write_Interrupted_By_Stop
+//   - Tape_Status_ERROR_Write_Underrun
 //   - Tape_Status_ERROR_Sense_Not_On_Record
 //   - Tape_Status_ERROR_Device_Not_Configured
 //   - Tape_Status_ERROR_Device_Disconnected
 uint16_t Tape_Write(void)
 {
+	uint32_t CountHi;
+	uint16_t CountLo;
 	uint8_t oldSREG = SREG; // Unknown Global Interrupt Enable state.
 	cli(); // Disable interrupts.
 
@@ -1280,30 +1444,48 @@ uint16_t Tape_Write(void)
 	usbInitIo(-1, ENDPOINT_DIR_OUT);
 	DELAY_MS(10);
 
+	// Empty delta ring.
+	Tape_RingHead = 0;
+	Tape_RingTail = 0;
+	Tape_AllDeltasReceived = false;
+	Tape_WaitingForDelta = false;
+	Tape_Underruns = 0;
+
 	// Get number of delta bytes.
-	// Sets TapeStatus to "Tape_Status_ERROR_usbRecvByte" if USB transfer fails.
 	// TapeStatus was initialized to Tape_Status_OK by initial Tape_PrepareWrite().
-	Tape_usbReceiveDelta();
-	DeltaCount = HiDelta;
-	DeltaCount = (DeltaCount << 16) | LoDelta; // Only lower 2 bytes of HiDelta used here.
-
-	//   Return values:
-	//   - Tape_Status_OK
-	//   - Tape_Status_ERROR_usbRecvByte
-	//   - Tape_Status_ERROR_Sense_Not_On_Record
-	//   - Tape_Status_ERROR_Device_Not_Configured
-	//   - Tape_Status_ERROR_Device_Disconnected
-	TapeStatus = Tape_StartWrite(); // Start actual tape write.
+	if (Tape_usbReceiveDelta(&CountHi, &CountLo) != 0)
+	{
+		TapeStatus = Tape_Status_ERROR_usbRecvByte;
+	}
+	else
+	{
+		DeltaCount = CountHi;
+		DeltaCount = (DeltaCount << 16) | CountLo; // Only lower 2 bytes of CountHi used here.
+		if (DeltaCount == 0)
+			Tape_AllDeltasReceived = true;
+
+		//   Return values:
+		//   - Tape_Status_OK
+		//   - Tape_Status_ERROR_usbRecvByte
+		//   - Tape_Status_ERROR_Sense_Not_On_Record
+		//   - Tape_Status_ERROR_Device_Not_Configured
+		//   - Tape_Status_ERROR_Device_Disconnected
+		TapeStatus = Tape_StartWrite(); // Start actual tape write.
+	}
 
 	sei(); // Enable interrupts for tape write.
 
+	// Keep the delta ring filled while the ISR writes.
 	while (TSR & XUM1541_TAP_WRITING)
+	{
 		wdt_reset(); // Feed the watchdog while writing.
+		Tape_FillDeltaRing();
+	}
 
 	Set_usbDataLen(0);
 
 	// Stall endpoint if tape write stopped early. Feeds watchdog.
-	if (DeltaCount > 0)
+	if (!Tape_AllDeltasReceived)
 		Endpoint_StallTransaction();
 	else
 		usbIoDone();
@@ -1312,6 +1494,10 @@ uint16_t Tape_Write(void)
 
 	SREG = oldSREG; // Restore Global Interrupt Enable state.
 
+	// Signals were stretched if the host did not deliver the deltas in time.
+	if ((TapeStatus == Tape_Status_OK) && (Tape_Underruns != 0))
+		TapeStatus = Tape_Status_ERROR_Write_Underrun;
+
 	// Everything ok if Tape_Status_OK, return Tape_Status_OK_Write_Finished.
 	// If error occurred return specific error reason.
 	return ((TapeStatus == Tape_Status_OK) ? Tape_Status_OK_Write_Finished : TapeStatus);
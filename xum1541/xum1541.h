@@ -27,6 +27,7 @@
 #define BUMBLEB                 1
 #define ZOOMFLOPPY              2
 #define OLIMEX                  3
+#define SIM                     4
 
 #if MODEL == USBKEY
 #include "cpu-usbkey.h"
@@ -40,6 +41,9 @@
 #elif MODEL == ZOOMFLOPPY
 #include "cpu-zoomfloppy.h"
 #include "board-zoomfloppy.h"
+#elif MODEL == SIM
+#include "cpu-sim.h"
+#include "board-sim.h"
 #endif
 
 #include "xum1541_types.h"      // Version and protocol definitions
@@ -119,6 +123,7 @@ extern volatile uint8_t TSR;
 #define Tape_Status_ERROR_usbRecvByte               (Tape_Status_ERROR - 7)
 #define Tape_Status_ERROR_External_Break            (Tape_Status_ERROR - 8)
 //#define Tape_Status_ERROR_Wrong_Tape_Firmware       (Tape_Status_ERROR - 9) // Only for user mode applications.
+#define Tape_Status_ERROR_Write_Underrun             (Tape_Status_ERROR - 10)
 
 #endif // TAPE_SUPPORT
 
@@ -164,6 +169,38 @@ int8_t usbSendByte(uint8_t data);
 int8_t usbRecvByte(uint8_t *data);
 void Set_usbDataLen(uint16_t Len);
 
+// Transfer modes for usbSetIoMode()
+#define USB_IO_HOST             0 // to and from the host (default)
+#define USB_IO_LOCAL            1 // to and from a firmware buffer
+#define USB_IO_NESTED           2 // within a running transfer to the host
+void usbSetIoMode(uint8_t mode, uint8_t *buf);
+
+// Block transfers for the protocol loops, see commands.c
+extern uint8_t usbBankLeft;
+bool usbInitBlockIo(uint16_t len, uint8_t dir);
+void usbBlockIoDone(void);
+int8_t usbNextInBank(void);
+int8_t usbNextOutBank(void);
+
+INLINE int8_t
+usbSendBlockByte(uint8_t data)
+{
+    Endpoint_Write_Byte(data);
+    if (--usbBankLeft == 0)
+        return usbNextInBank();
+    return 0;
+}
+
+INLINE int8_t
+usbRecvBlockByte(uint8_t *data)
+{
+    if (usbBankLeft == 0 && usbNextOutBank() != 0)
+        return -1;
+    usbBankLeft--;
+    *data = Endpoint_Read_Byte();
+    return 0;
+}
+
 // IEC functions
 #define XUM_WRITE_TALK          (1 << 0)
 #define XUM_WRITE_ATN           (1 << 1)
@@ -189,6 +226,9 @@ struct ProtocolFunctions *iec_init(void);
 struct ProtocolFunctions *ieee_init(void);
 #endif
 
+// Per device IEC timing (setup and ack delays), see XUM1541_IEC_TIMING
+uint16_t iec_set_timing(uint8_t dev, uint8_t profile, uint8_t ts, uint8_t ack);
+
 /*
  * Special protocol handlers:
  * cbm - default CBM serial or IEEE-488
@@ -197,6 +237,7 @@ struct ProtocolFunctions *ieee_init(void);
  * p2 - parallel
  * pp - parallel
  * nib - nibbler parallel
+ * dos - DOS block reader, using the cbm handlers
  * Tape - 153x tape
  */
 uint8_t s1_read_byte(void);
@@ -216,6 +257,9 @@ uint8_t nib_srqburst_read(void);
 void nib_srqburst_write(uint8_t data);
 uint8_t nib_srq_write_handshaked(uint8_t data, uint8_t toggle);
 #endif // SRQ_NIB_SUPPORT
+void dos_set_blocks(uint16_t len);
+void dos_read_blocks(uint16_t len);
+uint16_t dos_calibrate(uint8_t dev);
 #ifdef TAPE_SUPPORT
 uint16_t Tape_GetTapeFirmwareVersion(void); // Return tape firmware version for compatibility check.
 uint16_t Tape_UploadConfig(void);           // Upload tape read/write configuration.
@@ -227,7 +271,7 @@ uint16_t Tape_WaitForStopSense(void);       // Wait for tape <STOP> if running.
 uint16_t Tape_WaitForPlaySense(void);       // Wait for tape <PLAY/RECORD> if stopped. Feed watchdog while waiting.
 uint16_t Tape_MotorOn(void);                // Turns the tape drive motor on.
 uint16_t Tape_MotorOff(void);               // Turns the tape drive motor off.
-uint16_t Tape_Capture(void);                // Tape capture loop. Starts the actual tape capturing.
+uint16_t Tape_Capture(bool Packed);         // Tape capture loop. Starts the actual tape capturing.
 uint16_t Tape_Write(void);                  // Tape write loop. Starts the actual tape writing.
 uint16_t Probe4TapeDevice(void);            // Probe for tape device presence.
 void     Tape_Reset(bool whatever);         // External configuration reset. Dummy argument.
@@ -33,7 +33,12 @@
 // Adapter capabilities, but device may not support them
 #define XUM1541_CAP_CBM             0x01 // supports CBM commands
 #define XUM1541_CAP_NIB             0x02 // parallel nibbler
-#define XUM1541_CAP_NIB_SRQ         0x04 // 1571 serial nibbler
+#define XUM1541_CAP_NIB_SRQ         0x04 // 1571 serial nibbler, burst load
+#ifdef SRQ_NIB_SUPPORT
+#define XUM1541_CAP_SRQ             XUM1541_CAP_NIB_SRQ
+#else
+#define XUM1541_CAP_SRQ             0
+#endif
 #ifdef IEEE_SUPPORT
 #define XUM1541_CAP_IEEE488         0x08 // GPIB (PET) parallel bus
 #else
@@ -44,10 +49,17 @@
 #else
 #define XUM1541_CAP_TAP             0
 #endif
+#define XUM1541_CAP_JIFFY           0x20 // JiffyDOS for XUM1541_CBM
+#define XUM1541_CAP_DOS             0x40 // DOS block reader
+#define XUM1541_CAP_TIMING          0x80 // XUM1541_IEC_TIMING profiles
 
 #define XUM1541_CAPABILITIES        (XUM1541_CAP_CBM |      \
                                      XUM1541_CAP_NIB |      \
+                                     XUM1541_CAP_SRQ |      \
                                      XUM1541_CAP_TAP |      \
+                                     XUM1541_CAP_JIFFY |    \
+                                     XUM1541_CAP_DOS |      \
+                                     XUM1541_CAP_TIMING |   \
                                      XUM1541_CAP_IEEE488)
 
 // Actual auto-detected status
@@ -98,6 +110,7 @@
 #define XUM1541_PARBURST_WRITE      (XUM1541_IOCTL + 15)
 #define XUM1541_SRQBURST_READ       (XUM1541_IOCTL + 16)
 #define XUM1541_SRQBURST_WRITE      (XUM1541_IOCTL + 17)
+#define XUM1541_IEC_TIMING          (XUM1541_IOCTL + 18)
 #define XUM1541_TAP_MOTOR_ON            (XUM1541_IOCTL + 50)
 #define XUM1541_TAP_GET_VER             (XUM1541_IOCTL + 51)
 #define XUM1541_TAP_PREPARE_CAPTURE     (XUM1541_IOCTL + 52)
@@ -147,11 +160,53 @@
 #define XUM1541_NIB_SRQ_COMMAND     (9 << 4) // Serial commands
 #define XUM1541_TAP                (10 << 4) // tape read/write
 #define XUM1541_TAP_CONFIG         (11 << 4) // tape send/receive configuration
+#define XUM1541_BURST_LOAD         (12 << 4) // 1571/1581 burst fastload block
+#define XUM1541_DOS_READ           (13 << 4) // read disk blocks via the DOS
+
+/*
+ * DOS block reader: write the device, channel and up to this many
+ * track/sector pairs, then read 256 data bytes and the DOS error
+ * number (0xff if the drive did not answer) for each block.
+ */
+#define XUM_DOS_MAX_BLOCKS          16
+#define XUM_DOS_BLOCK_SIZE          (256 + 1)
 
 // Flags for use with write and XUM1541_CBM protocol
 #define XUM_WRITE_TALK              (1 << 0)
 #define XUM_WRITE_ATN               (1 << 1)
 
+/*
+ * With XUM_WRITE_ATN: probe for JiffyDOS on the last byte. If the device
+ * answers, the following XUM1541_CBM reads and writes use JiffyDOS
+ * until the next command under ATN. Older firmware ignores this flag.
+ */
+#define XUM_WRITE_JIFFY             (1 << 2)
+
+/*
+ * With XUM_WRITE_ATN: tell 1571/1581 drives that we can do fast serial,
+ * as the C128 does. Needed before a burst command ("U0"). Only adapters
+ * with XUM1541_CAP_NIB_SRQ have the SRQ line to do this.
+ */
+#define XUM_WRITE_FAST              (1 << 3)
+
+/*
+ * Flags for use with read and XUM1541_TAP protocol: send the capture
+ * timestamps in the packed format (tape firmware version 2 and up).
+ */
+#define XUM_TAP_PACKED              (1 << 0)
+
+/*
+ * Timing profiles of the standard protocol for XUM1541_IEC_TIMING, one
+ * per device address. The status value is the timing now in use, the
+ * bit setup time in the low byte and the byte acknowledge hold time in
+ * the high byte (us). Only firmware with XUM1541_CAP_TIMING knows it.
+ */
+#define XUM_IEC_PROFILE_1541        0 // stock 1541, safe for all drives
+#define XUM_IEC_PROFILE_1571        1
+#define XUM_IEC_PROFILE_1581        2
+#define XUM_IEC_PROFILE_FAST        3 // SD2IEC and other modern drives
+#define XUM_IEC_PROFILE_CALIBRATE   0xff // find the fastest that works
+
 // Request an early exit from nib read via burst_read_track_var()
 #define XUM1541_NIB_READ_VAR        0x8000
 